@@ -19,6 +19,7 @@
 #include <linux/genhd.h>
 #include <linux/delay.h>
 #include <linux/atomic.h>
+#include <linux/backing-dev.h>
 #include "blk-cgroup.h"
 #include "blk.h"
 
@@ -600,6 +601,7 @@ static void blkcg_destroy(struct cgroup *cgroup)
 {
 	struct blkcg *blkcg = cgroup_to_blkcg(cgroup);
 
+	cgwb_blkcg_offline(&blkcg->css);
 	if (blkcg != &blkcg_root)
 		kfree(blkcg);
 }
@@ -1810,6 +1810,10 @@ void submit_bio(int rw, struct bio *bio)
 	if (bio_has_data(bio) && !(rw & REQ_DISCARD)) {
 		if (rw & WRITE) {
 			count_vm_events(PGPGOUT, count);
+#ifdef CONFIG_CGROUP_WRITEBACK
+			if (current->wb_blkcg_css)
+				bio_associate_blkcg(bio, current->wb_blkcg_css);
+#endif
 		} else {
 			task_io_account_read(bio->bi_size);
 			count_vm_events(PGPGIN, count);
@@ -1650,6 +1650,30 @@ bad:
 EXPORT_SYMBOL(bioset_create);
 
 #ifdef CONFIG_BLK_CGROUP
+/**
+ * bio_associate_blkcg - associate a bio with a blkcg
+ * @bio: target bio
+ * @blkcg_css: css of the blkcg to associate
+ *
+ * Associate @bio with the blkcg of @blkcg_css if it hasn't been associated
+ * with a blkcg yet, so that it is charged to that blkcg whichever task
+ * issues it.  Writeback uses this to charge the IO of the flusher to the
+ * cgroup the written inode belongs to.
+ *
+ * This function takes an extra reference of @blkcg_css which will be put
+ * when @bio is released.  The caller must own @bio and hold a reference
+ * of @blkcg_css.
+ */
+int bio_associate_blkcg(struct bio *bio, struct cgroup_subsys_state *blkcg_css)
+{
+	if (bio->bi_css)
+		return -EBUSY;
+
+	css_get(blkcg_css);
+	bio->bi_css = blkcg_css;
+	return 0;
+}
+
 /**
  * bio_associate_current - associate a bio with %current
  * @bio: target bio
@@ -1679,7 +1703,10 @@ int bio_associate_current(struct bio *bio)
 	get_io_context_active(ioc);
 	bio->bi_ioc = ioc;
 
-	/* associate blkcg if exists */
+	/* associate blkcg if exists, unless bio_associate_blkcg() did */
+	if (bio->bi_css)
+		return 0;
+
 	rcu_read_lock();
 	css = task_subsys_state(current, blkio_subsys_id);
 	if (css && css_tryget(css))
@@ -51,22 +51,27 @@ EXPORT_SYMBOL(I_BDEV);
 /*
  * Move the inode from its current bdi to a new bdi. If the inode is dirty we
  * need to move it onto the dirty list of @dst so that the inode is always on
- * the right list.
+ * the right list.  A dirty inode goes to the bdi's own writeback lists even
+ * if it was on a cgroup's, a clean one is attributed anew when redirtied.
  */
 static void bdev_inode_switch_bdi(struct inode *inode,
 			struct backing_dev_info *dst)
 {
 	struct backing_dev_info *old = inode->i_data.backing_dev_info;
+	struct bdi_writeback *old_wb = bdi_inode_wb(old, inode);
 
 	if (unlikely(dst == old))		/* deadlock avoidance */
 		return;
-	bdi_lock_two(&old->wb, &dst->wb);
+	bdi_lock_two(old_wb, &dst->wb);
 	spin_lock(&inode->i_lock);
 	inode->i_data.backing_dev_info = dst;
-	if (inode->i_state & I_DIRTY)
+	if (inode->i_state & I_DIRTY) {
+		inode_switch_wb(inode, &dst->wb);
 		list_move(&inode->i_wb_list, &dst->wb.b_dirty);
+	} else
+		inode_switch_wb(inode, NULL);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&old->wb.list_lock);
+	spin_unlock(&old_wb->list_lock);
 	spin_unlock(&dst->wb.list_lock);
 }
 
@@ -2345,6 +2345,98 @@ done:
 	return ret;
 }
 
+/*
+ * optimistic version of btrfs_search_slot for read only searches.
+ *
+ * No locks are taken on the way down.  Each block is sampled with
+ * btrfs_tree_seq_begin() instead, and we only follow a pointer once the
+ * block we read it from is known not to have changed.  cow, splits and
+ * merges all write lock the blocks they touch, so an unchanged lock_seq
+ * also means the block is still part of the tree.  Only the leaf gets a
+ * real read lock, and only if nobody is writing to it.
+ *
+ * Anything unexpected (blocks that aren't cached and uptodate, writers
+ * in the way, a changed lock_seq) returns -EAGAIN and the caller falls
+ * back to the locked search.
+ */
+static int search_slot_lockless(struct btrfs_root *root,
+				struct btrfs_key *key, struct btrfs_path *p)
+{
+	struct extent_buffer *b;
+	struct extent_buffer *child;
+	unsigned seq;
+	unsigned child_seq;
+	u64 blocknr;
+	u64 gen;
+	u32 nritems;
+	int level;
+	int slot;
+	int ret;
+
+	b = btrfs_root_node(root);
+	seq = btrfs_tree_seq_begin(b);
+	level = btrfs_header_level(b);
+	if (level >= BTRFS_MAX_LEVEL) {
+		free_extent_buffer(b);
+		return -EAGAIN;
+	}
+	p->nodes[level] = b;
+	if (rcu_access_pointer(root->node) != b ||
+	    btrfs_tree_seq_retry(b, seq))
+		return -EAGAIN;
+
+	while (level > 0) {
+		nritems = btrfs_header_nritems(b);
+		if (nritems == 0 || nritems > BTRFS_NODEPTRS_PER_BLOCK(root))
+			return -EAGAIN;
+
+		ret = bin_search(b, key, level, &slot);
+		if (ret < 0)
+			return -EAGAIN;
+		if (ret && slot > 0)
+			slot--;
+		p->slots[level] = slot;
+		blocknr = btrfs_node_blockptr(b, slot);
+		gen = btrfs_node_ptr_generation(b, slot);
+		if (btrfs_tree_seq_retry(b, seq))
+			return -EAGAIN;
+
+		child = btrfs_find_tree_block(root, blocknr,
+					      btrfs_level_size(root, level - 1));
+		if (!child)
+			return -EAGAIN;
+		p->nodes[level - 1] = child;
+		if (btrfs_buffer_uptodate(child, gen, 1) <= 0)
+			return -EAGAIN;
+
+		/*
+		 * b still pointing to child after we sampled child's
+		 * lock_seq means child was live at that point
+		 */
+		child_seq = btrfs_tree_seq_begin(child);
+		if (btrfs_header_level(child) != level - 1 ||
+		    btrfs_tree_seq_retry(b, seq) ||
+		    btrfs_tree_seq_retry(child, child_seq))
+			return -EAGAIN;
+
+		b = child;
+		seq = child_seq;
+		level--;
+	}
+
+	if (!btrfs_try_tree_read_lock(b))
+		return -EAGAIN;
+	p->locks[0] = BTRFS_READ_LOCK;
+	if (btrfs_tree_seq_retry(b, seq))
+		return -EAGAIN;
+
+	ret = bin_search(b, key, 0, &slot);
+	p->slots[0] = slot;
+	if (!p->leave_spinning)
+		btrfs_set_path_blocking(p);
+	return ret;
+}
+
 /*
  * look for key in the tree.  path is filled in with nodes along the way
  * if key is found, we return zero and you can find the item in the leaf
@@ -2402,6 +2494,19 @@ int btrfs_search_slot(struct btrfs_trans_handle *trans, struct btrfs_root
 
 	min_write_lock_level = write_lock_level;
 
+	/*
+	 * plain lookups try to get down the tree without taking any
+	 * locks first
+	 */
+	if (!cow && !ins_len && !lowest_level && !p->keep_locks &&
+	    !p->skip_locking && !p->search_commit_root &&
+	    !p->search_for_split) {
+		ret = search_slot_lockless(root, key, p);
+		if (ret != -EAGAIN)
+			return ret;
+		btrfs_release_path(p);
+	}
+
 again:
 	/*
 	 * we try very hard to do read locks on the root
@@ -5229,3 +5334,263 @@ int btrfs_previous_item(struct btrfs_root *root,
 	}
 	return 1;
 }
+
+/*
+ * move a compare cursor to the next key in the tree.  With @descend set
+ * and the cursor on a node pointer, we step into the child block,
+ * otherwise the whole subtree under the current pointer is skipped.
+ *
+ * returns 1 once we walk off the end of the tree
+ */
+static int tree_compare_advance(struct btrfs_root *root,
+				struct btrfs_path *path, int *level,
+				int root_level, int descend,
+				struct btrfs_key *key)
+{
+	struct extent_buffer *eb;
+	int slot;
+
+	if (descend && *level > 0) {
+		eb = path->nodes[*level];
+		slot = path->slots[*level];
+		eb = read_tree_block(root, btrfs_node_blockptr(eb, slot),
+				     btrfs_level_size(root, *level - 1),
+				     btrfs_node_ptr_generation(eb, slot));
+		if (!eb)
+			return -ENOMEM;
+		if (!extent_buffer_uptodate(eb)) {
+			free_extent_buffer(eb);
+			return -EIO;
+		}
+		(*level)--;
+		free_extent_buffer(path->nodes[*level]);
+		path->nodes[*level] = eb;
+		path->slots[*level] = 0;
+	} else {
+		path->slots[*level]++;
+		while (path->slots[*level] >=
+		       btrfs_header_nritems(path->nodes[*level])) {
+			if (*level == root_level)
+				return 1;
+			free_extent_buffer(path->nodes[*level]);
+			path->nodes[*level] = NULL;
+			(*level)++;
+			path->slots[*level]++;
+		}
+	}
+
+	if (*level == 0)
+		btrfs_item_key_to_cpu(path->nodes[0], key, path->slots[0]);
+	else
+		btrfs_node_key_to_cpu(path->nodes[*level], key,
+				      path->slots[*level]);
+	return 0;
+}
+
+static int tree_compare_item(struct btrfs_path *left_path,
+			     struct btrfs_path *right_path, char *tmp_buf)
+{
+	struct extent_buffer *left = left_path->nodes[0];
+	struct extent_buffer *right = right_path->nodes[0];
+	int left_slot = left_path->slots[0];
+	int right_slot = right_path->slots[0];
+	u32 len;
+
+	len = btrfs_item_size_nr(left, left_slot);
+	if (len != btrfs_item_size_nr(right, right_slot))
+		return 1;
+
+	read_extent_buffer(left, tmp_buf,
+			   btrfs_item_ptr_offset(left, left_slot), len);
+	return memcmp_extent_buffer(right, tmp_buf,
+				    btrfs_item_ptr_offset(right, right_slot),
+				    len) != 0;
+}
+
+/*
+ * compare the commit roots of two trees and call @changed_cb for every
+ * item that is only in the left tree (NEW), only in the right tree
+ * (DELETED) or in both with different contents (CHANGED), in key order.
+ *
+ * Snapshots share everything that wasn't modified since they were taken,
+ * so whenever both trees point to the same block at the same key the
+ * whole subtree is skipped without being read.  The cost is proportional
+ * to the changes, not to the size of the trees.
+ *
+ * @right_root may be NULL, in which case every item of the left tree is
+ * reported as new.  No locks are taken, callers are expected to only
+ * use this on read only roots.
+ */
+int btrfs_compare_trees(struct btrfs_root *left_root,
+			struct btrfs_root *right_root,
+			btrfs_changed_cb_t changed_cb, void *ctx)
+{
+	struct btrfs_path *left_path = NULL;
+	struct btrfs_path *right_path = NULL;
+	struct btrfs_key left_key;
+	struct btrfs_key right_key;
+	struct extent_buffer *eb;
+	char *tmp_buf = NULL;
+	int left_root_level;
+	int right_root_level = 0;
+	int left_level;
+	int right_level = 0;
+	int left_end;
+	int right_end = 1;
+	int advance_left;
+	int advance_right;
+	int cmp;
+	int ret;
+
+	left_path = btrfs_alloc_path();
+	right_path = btrfs_alloc_path();
+	tmp_buf = kmalloc(left_root->leafsize, GFP_NOFS);
+	if (!left_path || !right_path || !tmp_buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	down_read(&left_root->fs_info->extent_commit_sem);
+	eb = left_root->commit_root;
+	extent_buffer_get(eb);
+	left_level = left_root_level = btrfs_header_level(eb);
+	left_path->nodes[left_level] = eb;
+	left_end = btrfs_header_nritems(eb) == 0;
+	if (right_root) {
+		eb = right_root->commit_root;
+		extent_buffer_get(eb);
+		right_level = right_root_level = btrfs_header_level(eb);
+		right_path->nodes[right_level] = eb;
+		right_end = btrfs_header_nritems(eb) == 0;
+	}
+	up_read(&left_root->fs_info->extent_commit_sem);
+
+	if (!left_end) {
+		if (left_level == 0)
+			btrfs_item_key_to_cpu(left_path->nodes[0],
+					      &left_key, 0);
+		else
+			btrfs_node_key_to_cpu(left_path->nodes[left_level],
+					      &left_key, 0);
+	}
+	if (!right_end) {
+		if (right_level == 0)
+			btrfs_item_key_to_cpu(right_path->nodes[0],
+					      &right_key, 0);
+		else
+			btrfs_node_key_to_cpu(right_path->nodes[right_level],
+					      &right_key, 0);
+	}
+
+	while (!left_end || !right_end) {
+		/* 0: stay, 1: next slot, 2: step into the child */
+		advance_left = 0;
+		advance_right = 0;
+
+		if (right_end || (!left_end && left_level > right_level)) {
+			if (left_level > 0 || !right_end) {
+				advance_left = 2;
+			} else {
+				ret = changed_cb(left_root, right_root,
+						 left_path, right_path,
+						 &left_key,
+						 BTRFS_COMPARE_TREE_NEW, ctx);
+				if (ret)
+					goto out;
+				advance_left = 1;
+			}
+		} else if (left_end || right_level > left_level) {
+			if (right_level > 0 || !left_end) {
+				advance_right = 2;
+			} else {
+				ret = changed_cb(left_root, right_root,
+						 left_path, right_path,
+						 &right_key,
+						 BTRFS_COMPARE_TREE_DELETED, ctx);
+				if (ret)
+					goto out;
+				advance_right = 1;
+			}
+		} else if (left_level == 0) {
+			cmp = btrfs_comp_cpu_keys(&left_key, &right_key);
+			if (cmp < 0) {
+				ret = changed_cb(left_root, right_root,
+						 left_path, right_path,
+						 &left_key,
+						 BTRFS_COMPARE_TREE_NEW, ctx);
+				advance_left = 1;
+			} else if (cmp > 0) {
+				ret = changed_cb(left_root, right_root,
+						 left_path, right_path,
+						 &right_key,
+						 BTRFS_COMPARE_TREE_DELETED, ctx);
+				advance_right = 1;
+			} else {
+				ret = 0;
+				if (tree_compare_item(left_path, right_path,
+						      tmp_buf))
+					ret = changed_cb(left_root, right_root,
+						left_path, right_path,
+						&left_key,
+						BTRFS_COMPARE_TREE_CHANGED,
+						ctx);
+				advance_left = 1;
+				advance_right = 1;
+			}
+			if (ret)
+				goto out;
+		} else {
+			cmp = btrfs_comp_cpu_keys(&left_key, &right_key);
+			if (cmp < 0) {
+				advance_left = 2;
+			} else if (cmp > 0) {
+				advance_right = 2;
+			} else if (btrfs_node_blockptr(
+					left_path->nodes[left_level],
+					left_path->slots[left_level]) ==
+				   btrfs_node_blockptr(
+					right_path->nodes[right_level],
+					right_path->slots[right_level]) &&
+				   btrfs_node_ptr_generation(
+					left_path->nodes[left_level],
+					left_path->slots[left_level]) ==
+				   btrfs_node_ptr_generation(
+					right_path->nodes[right_level],
+					right_path->slots[right_level])) {
+				/* shared subtree, nothing changed below */
+				advance_left = 1;
+				advance_right = 1;
+			} else {
+				advance_left = 2;
+				advance_right = 2;
+			}
+		}
+
+		if (advance_left) {
+			ret = tree_compare_advance(left_root, left_path,
+						   &left_level,
+						   left_root_level,
+						   advance_left == 2,
+						   &left_key);
+			if (ret < 0)
+				goto out;
+			left_end = ret;
+		}
+		if (advance_right) {
+			ret = tree_compare_advance(right_root, right_path,
+						   &right_level,
+						   right_root_level,
+						   advance_right == 2,
+						   &right_key);
+			if (ret < 0)
+				goto out;
+			right_end = ret;
+		}
+	}
+	ret = 0;
+out:
+	btrfs_free_path(left_path);
+	btrfs_free_path(right_path);
+	kfree(tmp_buf);
+	return ret;
+}
@@ -3941,6 +3941,7 @@ static struct extent_buffer *__alloc_extent_buffer(struct extent_io_tree *tree,
 	eb->tree = tree;
 	eb->bflags = 0;
 	rwlock_init(&eb->lock);
+	seqcount_init(&eb->lock_seq);
 	atomic_set(&eb->write_locks, 0);
 	atomic_set(&eb->read_locks, 0);
 	atomic_set(&eb->blocking_readers, 0);
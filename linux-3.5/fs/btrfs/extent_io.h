@@ -150,6 +150,12 @@ struct extent_buffer {
 	/* protects write locks */
 	rwlock_t lock;
 
+	/*
+	 * bumped by write lock holders on lock and unlock, lets
+	 * lockless readers in btrfs_search_slot validate what they read
+	 */
+	seqcount_t lock_seq;
+
 	/* readers use lock_wq while they wait for the write
 	 * lock holders to unlock
 	 */
@@ -53,6 +53,7 @@
 #include "inode-map.h"
 #include "backref.h"
 #include "rcu-string.h"
+#include "send.h"
 
 /* Mask out flags that are inappropriate for the given type of inode. */
 static inline __u32 btrfs_mask_flags(umode_t mode, __u32 flags)
@@ -1547,6 +1548,12 @@ static noinline int btrfs_ioctl_subvol_setflags(struct file *file,
 	if (!!(flags & BTRFS_SUBVOL_RDONLY) == btrfs_root_readonly(root))
 		goto out;
 
+	/* a running send relies on the snapshot not changing */
+	if (root->send_in_progress) {
+		ret = -EPERM;
+		goto out;
+	}
+
 	root_flags = btrfs_root_flags(&root->root_item);
 	if (flags & BTRFS_SUBVOL_RDONLY)
 		btrfs_set_root_flags(&root->root_item,
@@ -2018,6 +2025,14 @@ static noinline int btrfs_ioctl_snap_destroy(struct file *file,
 
 	down_write(&root->fs_info->subvol_sem);
 
+	if (dest->send_in_progress) {
+		printk(KERN_WARNING "btrfs: attempt to delete subvolume %llu "
+		       "during send\n",
+		       (unsigned long long)dest->root_key.objectid);
+		err = -EPERM;
+		goto out_up_write;
+	}
+
 	err = may_destroy_subvol(dest);
 	if (err)
 		goto out_up_write;
@@ -3476,6 +3491,8 @@ long btrfs_ioctl(struct file *file, unsigned int
 		return btrfs_ioctl_get_dev_stats(root, argp, 0);
 	case BTRFS_IOC_GET_AND_RESET_DEV_STATS:
 		return btrfs_ioctl_get_dev_stats(root, argp, 1);
+	case BTRFS_IOC_SEND:
+		return btrfs_ioctl_send(file, argp);
 	}
 
 	return -ENOTTY;
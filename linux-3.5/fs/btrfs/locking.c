@@ -159,6 +159,7 @@ int btrfs_try_tree_write_lock(struct extent_buffer *eb)
 	atomic_inc(&eb->write_locks);
 	atomic_inc(&eb->spinning_writers);
 	eb->lock_owner = current->pid;
+	write_seqcount_begin(&eb->lock_seq);
 	return 1;
 }
 
@@ -207,6 +208,9 @@ void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb)
 /*
  * take a spinning write lock.  This will wait for both
  * blocking readers or writers
+ *
+ * lock_seq stays odd for as long as the write lock is held, blocking
+ * or not, so lockless readers can tell the buffer may be changing.
  */
 void btrfs_tree_lock(struct extent_buffer *eb)
 {
@@ -230,6 +234,7 @@ again:
 	atomic_inc(&eb->spinning_writers);
 	atomic_inc(&eb->write_locks);
 	eb->lock_owner = current->pid;
+	write_seqcount_begin(&eb->lock_seq);
 }
 
 /*
@@ -242,6 +247,7 @@ void btrfs_tree_unlock(struct extent_buffer *eb)
 	BUG_ON(blockers > 1);
 
 	btrfs_assert_tree_locked(eb);
+	write_seqcount_end(&eb->lock_seq);
 	atomic_dec(&eb->write_locks);
 
 	if (blockers) {
@@ -49,6 +49,21 @@ static inline void btrfs_tree_unlock_rw(struct extent_buffer *eb, int rw)
 		BUG();
 }
 
+/*
+ * lockless readers sample lock_seq before looking at the buffer and
+ * recheck it afterwards.  An odd value means a writer holds the lock.
+ */
+static inline unsigned btrfs_tree_seq_begin(struct extent_buffer *eb)
+{
+	return raw_seqcount_begin(&eb->lock_seq);
+}
+
+static inline int btrfs_tree_seq_retry(struct extent_buffer *eb,
+				       unsigned seq)
+{
+	return (seq & 1) || read_seqcount_retry(&eb->lock_seq, seq);
+}
+
 static inline void btrfs_set_lock_blocking(struct extent_buffer *eb)
 {
 	btrfs_set_lock_blocking_rw(eb, BTRFS_WRITE_LOCK);
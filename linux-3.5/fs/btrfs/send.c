@@ -0,0 +1,2391 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License v2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/xattr.h>
+#include <linux/crc32c.h>
+#include <linux/vmalloc.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/kdev_t.h>
+#include <asm/uaccess.h>
+
+#include "send.h"
+#include "backref.h"
+#include "disk-io.h"
+#include "btrfs_inode.h"
+#include "transaction.h"
+#include "ioctl.h"
+
+/*
+ * Send walks the commit roots of the snapshot being sent (the send root)
+ * and of the parent snapshot side by side with btrfs_compare_trees and
+ * turns every difference into commands that redo it on the receiving
+ * side, where a copy of the parent snapshot is expected.  Without a
+ * parent everything is reported as new.
+ *
+ * Differences arrive in key order, so inodes are processed one after the
+ * other by increasing inode number.  Inodes below send_progress already
+ * have their final names on the receiving side, the others still have
+ * the ones they had in the parent snapshot.  Whenever an inode has to be
+ * put somewhere that isn't there yet, or has to get out of the way of
+ * one that is being put into place, it gets an orphan name in the top
+ * directory of the subvolume until it is processed itself.
+ */
+
+/*
+ * paths are built from the last component backwards, so the buffer is
+ * filled from its end
+ */
+struct fs_path {
+	char *start;
+	char *end;
+	char buf[PATH_MAX];
+};
+
+struct recorded_ref {
+	struct list_head list;
+	u64 dir;
+	u64 dir_gen;
+	/* the entry was moved out of the way or took the place of another */
+	int overwrote;
+	int name_len;
+	char name[];
+};
+
+struct send_dir {
+	struct list_head list;
+	u64 ino;
+	u64 gen;
+};
+
+struct send_inode_info {
+	u64 gen;
+	u64 size;
+	u64 mode;
+	u64 uid;
+	u64 gid;
+	u64 rdev;
+	u64 nlink;
+	struct timespec atime;
+	struct timespec mtime;
+	struct timespec ctime;
+};
+
+struct send_ctx {
+	struct file *send_filp;
+	loff_t send_off;
+	char *send_buf;
+	u32 send_size;
+	u32 send_max_size;
+	u64 total_send_size;
+
+	struct btrfs_root *send_root;
+	struct btrfs_root *parent_root;
+
+	/* the inode btrfs_compare_trees reports differences for */
+	u64 cur_ino;
+	u64 cur_inode_gen;
+	u64 cur_inode_mode;
+	u64 cur_inode_size;
+	u64 cur_inode_old_size;
+	int cur_inode_new;
+	int cur_inode_new_gen;
+	int cur_inode_deleted;
+	int cur_inode_skip;
+	/* the current dir has already been renamed to its new place */
+	int cur_inode_moved;
+	int cur_refs_done;
+	struct inode *cur_inode;
+
+	/* inodes below this have their final names on the receiving side */
+	u64 send_progress;
+
+	struct list_head new_refs;
+	struct list_head deleted_refs;
+
+	/* new dirs created early because new entries go into them */
+	struct list_head created_dirs;
+	/* unprocessed dirs moved to their orphan name to break a cycle */
+	struct list_head orphan_dirs;
+	/* deleted dirs that were not empty yet */
+	struct list_head pending_rmdirs;
+
+	/* something was created in or moved through the top dir */
+	int top_dir_dirty;
+
+	char *read_buf;
+};
+
+static struct fs_path *fs_path_alloc(void)
+{
+	struct fs_path *p;
+
+	p = kmalloc(sizeof(*p), GFP_NOFS);
+	if (!p)
+		return NULL;
+	p->end = p->buf + PATH_MAX;
+	p->start = p->end;
+	return p;
+}
+
+static void fs_path_free(struct fs_path *p)
+{
+	kfree(p);
+}
+
+static void fs_path_reset(struct fs_path *p)
+{
+	p->start = p->end;
+}
+
+static int fs_path_len(struct fs_path *p)
+{
+	return p->end - p->start;
+}
+
+static void fs_path_copy(struct fs_path *p, struct fs_path *from)
+{
+	int len = fs_path_len(from);
+
+	p->start = p->end - len;
+	memcpy(p->start, from->start, len);
+}
+
+/* add a component in front of the path */
+static int fs_path_prepend(struct fs_path *p, const char *name, int name_len)
+{
+	int sep = p->start != p->end;
+
+	if (name_len + sep > p->start - p->buf)
+		return -ENAMETOOLONG;
+	if (sep)
+		*--p->start = '/';
+	p->start -= name_len;
+	memcpy(p->start, name, name_len);
+	return 0;
+}
+
+static struct btrfs_path *alloc_path_for_send(void)
+{
+	struct btrfs_path *path;
+
+	path = btrfs_alloc_path();
+	if (!path)
+		return NULL;
+	path->search_commit_root = 1;
+	path->skip_locking = 1;
+	return path;
+}
+
+static int write_buf(struct send_ctx *sctx, const void *buf, u32 len)
+{
+	mm_segment_t old_fs;
+	u32 pos = 0;
+	int ret = 0;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+
+	while (pos < len) {
+		ret = vfs_write(sctx->send_filp, (char __user *)buf + pos,
+				len - pos, &sctx->send_off);
+		if (ret < 0)
+			goto out;
+		if (ret == 0) {
+			ret = -EIO;
+			goto out;
+		}
+		pos += ret;
+	}
+	ret = 0;
+out:
+	set_fs(old_fs);
+	return ret;
+}
+
+static void begin_cmd(struct send_ctx *sctx, int cmd)
+{
+	struct btrfs_cmd_header *hdr;
+
+	BUG_ON(sctx->send_size);
+
+	hdr = (struct btrfs_cmd_header *)sctx->send_buf;
+	hdr->cmd = cpu_to_le16(cmd);
+	sctx->send_size = sizeof(*hdr);
+}
+
+static int tlv_put(struct send_ctx *sctx, u16 attr, const void *data, int len)
+{
+	struct btrfs_tlv_header *hdr;
+	int total_len = sizeof(*hdr) + len;
+
+	if (unlikely(sctx->send_size + total_len > sctx->send_max_size))
+		return -EOVERFLOW;
+
+	hdr = (struct btrfs_tlv_header *)(sctx->send_buf + sctx->send_size);
+	hdr->tlv_type = cpu_to_le16(attr);
+	hdr->tlv_len = cpu_to_le16(len);
+	memcpy(hdr + 1, data, len);
+	sctx->send_size += total_len;
+	return 0;
+}
+
+static int tlv_put_u64(struct send_ctx *sctx, u16 attr, u64 value)
+{
+	__le64 tmp = cpu_to_le64(value);
+
+	return tlv_put(sctx, attr, &tmp, sizeof(tmp));
+}
+
+static int tlv_put_path(struct send_ctx *sctx, u16 attr, struct fs_path *p)
+{
+	return tlv_put(sctx, attr, p->start, fs_path_len(p));
+}
+
+static int tlv_put_timespec(struct send_ctx *sctx, u16 attr,
+			    struct timespec *ts)
+{
+	struct btrfs_timespec bts;
+
+	bts.sec = cpu_to_le64(ts->tv_sec);
+	bts.nsec = cpu_to_le32(ts->tv_nsec);
+	return tlv_put(sctx, attr, &bts, sizeof(bts));
+}
+
+#define TLV_PUT(sctx, attr, data, len) \
+	do { \
+		ret = tlv_put(sctx, attr, data, len); \
+		if (ret < 0) \
+			goto tlv_put_failure; \
+	} while (0)
+
+#define TLV_PUT_U64(sctx, attr, value) \
+	do { \
+		ret = tlv_put_u64(sctx, attr, value); \
+		if (ret < 0) \
+			goto tlv_put_failure; \
+	} while (0)
+
+#define TLV_PUT_PATH(sctx, attr, p) \
+	do { \
+		ret = tlv_put_path(sctx, attr, p); \
+		if (ret < 0) \
+			goto tlv_put_failure; \
+	} while (0)
+
+#define TLV_PUT_TIMESPEC(sctx, attr, ts) \
+	do { \
+		ret = tlv_put_timespec(sctx, attr, ts); \
+		if (ret < 0) \
+			goto tlv_put_failure; \
+	} while (0)
+
+static int send_cmd(struct send_ctx *sctx)
+{
+	struct btrfs_cmd_header *hdr;
+	u32 crc;
+	int ret;
+
+	hdr = (struct btrfs_cmd_header *)sctx->send_buf;
+	hdr->len = cpu_to_le32(sctx->send_size - sizeof(*hdr));
+	hdr->crc = 0;
+
+	crc = crc32c(0, (unsigned char *)sctx->send_buf, sctx->send_size);
+	hdr->crc = cpu_to_le32(crc);
+
+	ret = write_buf(sctx, sctx->send_buf, sctx->send_size);
+
+	sctx->total_send_size += sctx->send_size;
+	sctx->send_size = 0;
+	return ret;
+}
+
+static int send_header(struct send_ctx *sctx)
+{
+	struct btrfs_stream_header hdr;
+
+	strcpy(hdr.magic, BTRFS_SEND_STREAM_MAGIC);
+	hdr.version = cpu_to_le32(BTRFS_SEND_STREAM_VERSION);
+	return write_buf(sctx, &hdr, sizeof(hdr));
+}
+
+static void fill_timespec(struct extent_buffer *eb, struct btrfs_timespec *bts,
+			  struct timespec *ts)
+{
+	ts->tv_sec = btrfs_timespec_sec(eb, bts);
+	ts->tv_nsec = btrfs_timespec_nsec(eb, bts);
+}
+
+static int get_inode_info(struct btrfs_root *root, u64 ino,
+			  struct send_inode_info *info)
+{
+	struct btrfs_path *path;
+	struct btrfs_inode_item *ii;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	int ret;
+
+	if (!root)
+		return -ENOENT;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = ino;
+	key.type = BTRFS_INODE_ITEM_KEY;
+	key.offset = 0;
+	ret = btrfs_search_slot(NULL, root, &key, path, 0, 0);
+	if (ret < 0)
+		goto out;
+	if (ret) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	eb = path->nodes[0];
+	ii = btrfs_item_ptr(eb, path->slots[0], struct btrfs_inode_item);
+	info->gen = btrfs_inode_generation(eb, ii);
+	info->size = btrfs_inode_size(eb, ii);
+	info->mode = btrfs_inode_mode(eb, ii);
+	info->uid = btrfs_inode_uid(eb, ii);
+	info->gid = btrfs_inode_gid(eb, ii);
+	info->rdev = btrfs_inode_rdev(eb, ii);
+	info->nlink = btrfs_inode_nlink(eb, ii);
+	fill_timespec(eb, btrfs_inode_atime(ii), &info->atime);
+	fill_timespec(eb, btrfs_inode_mtime(ii), &info->mtime);
+	fill_timespec(eb, btrfs_inode_ctime(ii), &info->ctime);
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int get_inode_gen(struct btrfs_root *root, u64 ino, u64 *gen)
+{
+	struct send_inode_info info;
+	int ret;
+
+	ret = get_inode_info(root, ino, &info);
+	*gen = ret ? 0 : info.gen;
+	return ret;
+}
+
+/*
+ * position the path at the first item with a key >= key, returns 1 if
+ * there is none
+ */
+static int search_first(struct btrfs_root *root, struct btrfs_path *path,
+			struct btrfs_key *key)
+{
+	int ret;
+
+	ret = btrfs_search_slot(NULL, root, key, path, 0, 0);
+	if (ret < 0)
+		return ret;
+	if (path->slots[0] >= btrfs_header_nritems(path->nodes[0]))
+		return btrfs_next_leaf(root, path);
+	return 0;
+}
+
+/* advance to the next item, returns 1 at the end of the tree */
+static int next_item(struct btrfs_root *root, struct btrfs_path *path)
+{
+	path->slots[0]++;
+	if (path->slots[0] >= btrfs_header_nritems(path->nodes[0]))
+		return btrfs_next_leaf(root, path);
+	return 0;
+}
+
+/* the parent dir and name of the first ref of ino */
+static int get_first_ref(struct btrfs_root *root, u64 ino, u64 *dir,
+			 char *name, int *name_len)
+{
+	struct btrfs_path *path;
+	struct btrfs_inode_ref *iref;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = ino;
+	key.type = BTRFS_INODE_REF_KEY;
+	key.offset = 0;
+	ret = search_first(root, path, &key);
+	if (ret < 0)
+		goto out;
+	if (ret)
+		goto not_found;
+
+	eb = path->nodes[0];
+	btrfs_item_key_to_cpu(eb, &key, path->slots[0]);
+	if (key.objectid != ino || key.type != BTRFS_INODE_REF_KEY)
+		goto not_found;
+
+	iref = btrfs_item_ptr(eb, path->slots[0], struct btrfs_inode_ref);
+	*name_len = btrfs_inode_ref_name_len(eb, iref);
+	read_extent_buffer(eb, name, (unsigned long)(iref + 1), *name_len);
+	*dir = key.offset;
+	ret = 0;
+	goto out;
+not_found:
+	ret = -ENOENT;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int lookup_dir_item_inode(struct btrfs_root *root, u64 dir,
+				 const char *name, int name_len, u64 *ino)
+{
+	struct btrfs_path *path;
+	struct btrfs_dir_item *di;
+	struct btrfs_key key;
+	int ret = 0;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	di = btrfs_lookup_dir_item(NULL, root, path, dir, name, name_len, 0);
+	if (IS_ERR(di)) {
+		ret = PTR_ERR(di);
+		goto out;
+	}
+	if (!di) {
+		ret = -ENOENT;
+		goto out;
+	}
+	btrfs_dir_item_key_to_cpu(path->nodes[0], di, &key);
+	/* subvolumes below this one are not part of the stream */
+	if (key.type != BTRFS_INODE_ITEM_KEY) {
+		ret = -ENOENT;
+		goto out;
+	}
+	*ino = key.objectid;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int read_symlink(struct btrfs_root *root, u64 ino, struct fs_path *dest)
+{
+	struct btrfs_path *path;
+	struct btrfs_file_extent_item *ei;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	u32 len;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = ino;
+	key.type = BTRFS_EXTENT_DATA_KEY;
+	key.offset = 0;
+	ret = btrfs_search_slot(NULL, root, &key, path, 0, 0);
+	if (ret < 0)
+		goto out;
+	if (ret) {
+		ret = -EIO;
+		goto out;
+	}
+
+	eb = path->nodes[0];
+	ei = btrfs_item_ptr(eb, path->slots[0], struct btrfs_file_extent_item);
+	if (btrfs_file_extent_type(eb, ei) != BTRFS_FILE_EXTENT_INLINE ||
+	    btrfs_file_extent_compression(eb, ei) != BTRFS_COMPRESS_NONE) {
+		ret = -EIO;
+		goto out;
+	}
+	len = btrfs_file_extent_inline_len(eb, ei);
+	if (len >= PATH_MAX) {
+		ret = -ENAMETOOLONG;
+		goto out;
+	}
+
+	fs_path_reset(dest);
+	dest->start = dest->end - len;
+	read_extent_buffer(eb, dest->start,
+			   btrfs_file_extent_inline_start(ei), len);
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static struct send_dir *find_send_dir(struct list_head *head, u64 ino, u64 gen)
+{
+	struct send_dir *sd;
+
+	list_for_each_entry(sd, head, list) {
+		if (sd->ino == ino && sd->gen == gen)
+			return sd;
+	}
+	return NULL;
+}
+
+static int add_send_dir(struct list_head *head, u64 ino, u64 gen)
+{
+	struct send_dir *sd;
+
+	sd = kmalloc(sizeof(*sd), GFP_NOFS);
+	if (!sd)
+		return -ENOMEM;
+	sd->ino = ino;
+	sd->gen = gen;
+	list_add_tail(&sd->list, head);
+	return 0;
+}
+
+static void del_send_dir(struct send_dir *sd)
+{
+	list_del(&sd->list);
+	kfree(sd);
+}
+
+static void free_send_dirs(struct list_head *head)
+{
+	struct send_dir *sd;
+
+	while (!list_empty(head)) {
+		sd = list_first_entry(head, struct send_dir, list);
+		del_send_dir(sd);
+	}
+}
+
+static int record_ref(struct list_head *head, u64 dir, u64 dir_gen,
+		      const char *name, int name_len)
+{
+	struct recorded_ref *ref;
+
+	ref = kmalloc(sizeof(*ref) + name_len, GFP_NOFS);
+	if (!ref)
+		return -ENOMEM;
+	ref->dir = dir;
+	ref->dir_gen = dir_gen;
+	ref->overwrote = 0;
+	ref->name_len = name_len;
+	memcpy(ref->name, name, name_len);
+	list_add_tail(&ref->list, head);
+	return 0;
+}
+
+static void free_recorded_refs(struct list_head *head)
+{
+	struct recorded_ref *ref;
+
+	while (!list_empty(head)) {
+		ref = list_first_entry(head, struct recorded_ref, list);
+		list_del(&ref->list);
+		kfree(ref);
+	}
+}
+
+static int gen_orphan_name(u64 ino, u64 gen, char *name)
+{
+	return sprintf(name, "o%llu-%llu-0", (unsigned long long)ino,
+		       (unsigned long long)gen);
+}
+
+/*
+ * An entry (dir, name) of ino in the parent snapshot is gone on the
+ * receiving side once an already processed inode took that name in the
+ * send snapshot, or the current one did and moved ino out of its way.
+ */
+static int did_overwrite_ref(struct send_ctx *sctx, u64 dir, u64 dir_gen,
+			     u64 ino, u64 ino_gen, const char *name,
+			     int name_len)
+{
+	struct recorded_ref *ref;
+	u64 ow_ino;
+	u64 gen;
+	int ret;
+
+	if (!sctx->parent_root)
+		return 0;
+
+	ret = get_inode_gen(sctx->send_root, dir, &gen);
+	if (ret == -ENOENT)
+		return 0;
+	if (ret < 0)
+		return ret;
+	if (gen != dir_gen)
+		return 0;
+
+	ret = lookup_dir_item_inode(sctx->send_root, dir, name, name_len,
+				    &ow_ino);
+	if (ret == -ENOENT)
+		return 0;
+	if (ret < 0)
+		return ret;
+
+	if (ow_ino == ino) {
+		ret = get_inode_gen(sctx->send_root, ino, &gen);
+		if (ret < 0)
+			return ret;
+		if (gen == ino_gen)
+			return 0;
+	}
+
+	if (ow_ino < sctx->send_progress)
+		return 1;
+	if (ow_ino != sctx->cur_ino)
+		return 0;
+
+	list_for_each_entry(ref, &sctx->new_refs, list) {
+		if (ref->overwrote && ref->dir == dir &&
+		    ref->name_len == name_len &&
+		    !memcmp(ref->name, name, name_len))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * The name and parent dir ino currently has on the receiving side.
+ * Returns 1 if that is its orphan name in the top dir.
+ */
+static int cur_name_and_parent(struct send_ctx *sctx, u64 ino, u64 gen,
+			       u64 *parent, u64 *parent_gen,
+			       char *name, int *name_len)
+{
+	struct btrfs_root *root;
+	u64 cur_gen;
+	int processed;
+	int ret;
+
+	processed = ino < sctx->send_progress ||
+		    (ino == sctx->cur_ino && sctx->cur_inode_moved);
+	root = processed ? sctx->send_root : sctx->parent_root;
+
+	if (!processed && (find_send_dir(&sctx->orphan_dirs, ino, gen) ||
+			   find_send_dir(&sctx->pending_rmdirs, ino, gen)))
+		goto orphan;
+
+	ret = get_inode_gen(root, ino, &cur_gen);
+	if (ret == -ENOENT)
+		goto orphan;
+	if (ret < 0)
+		return ret;
+	if (cur_gen != gen)
+		goto orphan;
+
+	ret = get_first_ref(root, ino, parent, name, name_len);
+	if (ret < 0)
+		return ret;
+	ret = get_inode_gen(root, *parent, parent_gen);
+	if (ret < 0)
+		return ret;
+
+	if (!processed) {
+		ret = did_overwrite_ref(sctx, *parent, *parent_gen, ino, gen,
+					name, *name_len);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			goto orphan;
+	}
+	return 0;
+
+orphan:
+	sctx->top_dir_dirty = 1;
+	*parent = BTRFS_FIRST_FREE_OBJECTID;
+	*parent_gen = 0;
+	*name_len = gen_orphan_name(ino, gen, name);
+	return 1;
+}
+
+/*
+ * put the current path of ino in front of dest, returns 1 if ino has
+ * its orphan name
+ */
+static int __get_cur_path(struct send_ctx *sctx, u64 ino, u64 gen,
+			  struct fs_path *dest)
+{
+	char name[BTRFS_NAME_LEN];
+	u64 parent;
+	u64 parent_gen;
+	int name_len;
+	int is_orphan = 0;
+	int first = 1;
+	int ret;
+
+	while (ino != BTRFS_FIRST_FREE_OBJECTID) {
+		ret = cur_name_and_parent(sctx, ino, gen, &parent, &parent_gen,
+					  name, &name_len);
+		if (ret < 0)
+			return ret;
+		if (first)
+			is_orphan = ret;
+		first = 0;
+
+		ret = fs_path_prepend(dest, name, name_len);
+		if (ret < 0)
+			return ret;
+		ino = parent;
+		gen = parent_gen;
+	}
+	return is_orphan;
+}
+
+static int get_cur_path(struct send_ctx *sctx, u64 ino, u64 gen,
+			struct fs_path *dest)
+{
+	fs_path_reset(dest);
+	return __get_cur_path(sctx, ino, gen, dest);
+}
+
+static int get_cur_ref_path(struct send_ctx *sctx, u64 dir, u64 dir_gen,
+			    const char *name, int name_len,
+			    struct fs_path *dest)
+{
+	int ret;
+
+	fs_path_reset(dest);
+	ret = fs_path_prepend(dest, name, name_len);
+	if (ret < 0)
+		return ret;
+	ret = __get_cur_path(sctx, dir, dir_gen, dest);
+	return ret < 0 ? ret : 0;
+}
+
+static int get_orphan_path(u64 ino, u64 gen, struct fs_path *dest)
+{
+	char name[BTRFS_NAME_LEN];
+	int name_len;
+
+	name_len = gen_orphan_name(ino, gen, name);
+	fs_path_reset(dest);
+	return fs_path_prepend(dest, name, name_len);
+}
+
+static int send_rename(struct send_ctx *sctx, struct fs_path *from,
+		       struct fs_path *to)
+{
+	int ret;
+
+	begin_cmd(sctx, BTRFS_SEND_C_RENAME);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, from);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH_TO, to);
+	return send_cmd(sctx);
+
+tlv_put_failure:
+	sctx->send_size = 0;
+	return ret;
+}
+
+static int send_link(struct send_ctx *sctx, struct fs_path *path,
+		     struct fs_path *lnk)
+{
+	int ret;
+
+	begin_cmd(sctx, BTRFS_SEND_C_LINK);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, path);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH_LINK, lnk);
+	return send_cmd(sctx);
+
+tlv_put_failure:
+	sctx->send_size = 0;
+	return ret;
+}
+
+static int send_path_cmd(struct send_ctx *sctx, int cmd, struct fs_path *path)
+{
+	int ret;
+
+	begin_cmd(sctx, cmd);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, path);
+	return send_cmd(sctx);
+
+tlv_put_failure:
+	sctx->send_size = 0;
+	return ret;
+}
+
+static int send_utimes(struct send_ctx *sctx, u64 ino, u64 gen)
+{
+	struct send_inode_info info;
+	struct fs_path *p;
+	int ret;
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+
+	ret = get_inode_info(sctx->send_root, ino, &info);
+	if (ret < 0)
+		goto out;
+	ret = get_cur_path(sctx, ino, gen, p);
+	if (ret < 0)
+		goto out;
+
+	begin_cmd(sctx, BTRFS_SEND_C_UTIMES);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+	TLV_PUT_TIMESPEC(sctx, BTRFS_SEND_A_ATIME, &info.atime);
+	TLV_PUT_TIMESPEC(sctx, BTRFS_SEND_A_MTIME, &info.mtime);
+	TLV_PUT_TIMESPEC(sctx, BTRFS_SEND_A_CTIME, &info.ctime);
+	ret = send_cmd(sctx);
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(p);
+	return ret;
+}
+
+/* create ino under its orphan name */
+static int send_create_inode(struct send_ctx *sctx, u64 ino, u64 gen)
+{
+	struct send_inode_info info;
+	struct fs_path *p;
+	struct fs_path *target = NULL;
+	int cmd;
+	int ret;
+
+	ret = get_inode_info(sctx->send_root, ino, &info);
+	if (ret < 0)
+		return ret;
+
+	if (S_ISREG(info.mode))
+		cmd = BTRFS_SEND_C_MKFILE;
+	else if (S_ISDIR(info.mode))
+		cmd = BTRFS_SEND_C_MKDIR;
+	else if (S_ISLNK(info.mode))
+		cmd = BTRFS_SEND_C_SYMLINK;
+	else if (S_ISCHR(info.mode) || S_ISBLK(info.mode))
+		cmd = BTRFS_SEND_C_MKNOD;
+	else if (S_ISFIFO(info.mode))
+		cmd = BTRFS_SEND_C_MKFIFO;
+	else if (S_ISSOCK(info.mode))
+		cmd = BTRFS_SEND_C_MKSOCK;
+	else
+		return -EOPNOTSUPP;
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+
+	ret = get_orphan_path(ino, gen, p);
+	if (ret < 0)
+		goto out;
+	sctx->top_dir_dirty = 1;
+
+	if (cmd == BTRFS_SEND_C_SYMLINK) {
+		target = fs_path_alloc();
+		if (!target) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		ret = read_symlink(sctx->send_root, ino, target);
+		if (ret < 0)
+			goto out;
+	}
+
+	begin_cmd(sctx, cmd);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+	TLV_PUT_U64(sctx, BTRFS_SEND_A_INO, ino);
+	if (cmd == BTRFS_SEND_C_SYMLINK) {
+		TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH_LINK, target);
+	} else if (cmd == BTRFS_SEND_C_MKNOD || cmd == BTRFS_SEND_C_MKFIFO ||
+		   cmd == BTRFS_SEND_C_MKSOCK) {
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_RDEV,
+			    new_encode_dev((dev_t)info.rdev));
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_MODE, info.mode);
+	}
+	ret = send_cmd(sctx);
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(target);
+	fs_path_free(p);
+	return ret;
+}
+
+/*
+ * new dirs the current inode gets linked into are created early when
+ * they come after it
+ */
+static int create_dir_if_needed(struct send_ctx *sctx, u64 dir, u64 dir_gen)
+{
+	u64 gen;
+	int ret;
+
+	if (dir < sctx->send_progress)
+		return 0;
+	if (find_send_dir(&sctx->created_dirs, dir, dir_gen))
+		return 0;
+
+	ret = get_inode_gen(sctx->parent_root, dir, &gen);
+	if (ret < 0 && ret != -ENOENT)
+		return ret;
+	if (!ret && gen == dir_gen)
+		return 0;
+
+	ret = send_create_inode(sctx, dir, dir_gen);
+	if (ret < 0)
+		return ret;
+	return add_send_dir(&sctx->created_dirs, dir, dir_gen);
+}
+
+/*
+ * An unprocessed inode that has the name the current one gets is moved
+ * to its orphan name.  It finds its own place once it is processed.
+ */
+static int orphanize_conflict(struct send_ctx *sctx, struct recorded_ref *ref,
+			      struct fs_path *p, struct fs_path *orphan)
+{
+	u64 dir_gen;
+	u64 ow_ino;
+	u64 ow_gen;
+	int ret;
+
+	if (!sctx->parent_root)
+		return 0;
+
+	ret = get_inode_gen(sctx->parent_root, ref->dir, &dir_gen);
+	if (ret == -ENOENT)
+		return 0;
+	if (ret < 0)
+		return ret;
+	if (dir_gen != ref->dir_gen)
+		return 0;
+
+	ret = lookup_dir_item_inode(sctx->parent_root, ref->dir, ref->name,
+				    ref->name_len, &ow_ino);
+	if (ret == -ENOENT)
+		return 0;
+	if (ret < 0)
+		return ret;
+	if (ow_ino <= sctx->cur_ino)
+		return 0;
+
+	ret = get_inode_gen(sctx->parent_root, ow_ino, &ow_gen);
+	if (ret < 0)
+		return ret;
+	if (find_send_dir(&sctx->orphan_dirs, ow_ino, ow_gen))
+		return 0;
+
+	ret = get_cur_ref_path(sctx, ref->dir, ref->dir_gen, ref->name,
+			       ref->name_len, p);
+	if (ret < 0)
+		return ret;
+	ret = get_orphan_path(ow_ino, ow_gen, orphan);
+	if (ret < 0)
+		return ret;
+	ret = send_rename(sctx, p, orphan);
+	if (ret < 0)
+		return ret;
+	ref->overwrote = 1;
+	return 0;
+}
+
+/*
+ * A dir can't be moved below itself.  If its new parent currently sits
+ * below it, the unprocessed dir closest to it on that path is moved to
+ * its orphan name first.
+ */
+static int resolve_dir_cycle(struct send_ctx *sctx, u64 dir, u64 dir_gen,
+			     struct fs_path *p, struct fs_path *orphan)
+{
+	char name[BTRFS_NAME_LEN];
+	u64 ino = dir;
+	u64 gen = dir_gen;
+	u64 parent;
+	u64 parent_gen;
+	u64 victim = 0;
+	u64 victim_gen = 0;
+	int name_len;
+	int depth = 0;
+	int ret;
+
+	while (ino != BTRFS_FIRST_FREE_OBJECTID && ino != sctx->cur_ino) {
+		if (++depth > PATH_MAX / 2)
+			return -ELOOP;
+		ret = cur_name_and_parent(sctx, ino, gen, &parent, &parent_gen,
+					  name, &name_len);
+		if (ret < 0)
+			return ret;
+		if (ino > sctx->cur_ino && !ret) {
+			victim = ino;
+			victim_gen = gen;
+		}
+		ino = parent;
+		gen = parent_gen;
+	}
+	if (ino != sctx->cur_ino)
+		return 0;
+	if (WARN_ON(!victim))
+		return -EIO;
+
+	ret = get_cur_path(sctx, victim, victim_gen, p);
+	if (ret < 0)
+		return ret;
+	ret = get_orphan_path(victim, victim_gen, orphan);
+	if (ret < 0)
+		return ret;
+	ret = send_rename(sctx, p, orphan);
+	if (ret < 0)
+		return ret;
+	return add_send_dir(&sctx->orphan_dirs, victim, victim_gen);
+}
+
+/*
+ * A deleted dir can go once every entry it had in the parent snapshot
+ * has been moved away or removed.
+ */
+static int can_rmdir(struct send_ctx *sctx, u64 dir)
+{
+	struct btrfs_root *root = sctx->parent_root;
+	struct btrfs_path *path;
+	struct btrfs_dir_item *di;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	struct btrfs_key loc;
+	u64 gen;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = dir;
+	key.type = BTRFS_DIR_INDEX_KEY;
+	key.offset = 0;
+	ret = search_first(root, path, &key);
+	while (!ret) {
+		eb = path->nodes[0];
+		btrfs_item_key_to_cpu(eb, &key, path->slots[0]);
+		if (key.objectid != dir || key.type != BTRFS_DIR_INDEX_KEY)
+			break;
+
+		di = btrfs_item_ptr(eb, path->slots[0], struct btrfs_dir_item);
+		btrfs_dir_item_key_to_cpu(eb, di, &loc);
+		if (loc.type == BTRFS_INODE_ITEM_KEY &&
+		    loc.objectid >= sctx->send_progress) {
+			ret = get_inode_gen(root, loc.objectid, &gen);
+			if (ret < 0)
+				goto out;
+			if (!find_send_dir(&sctx->orphan_dirs, loc.objectid,
+					   gen)) {
+				ret = 0;
+				goto out;
+			}
+		}
+		ret = next_item(root, path);
+	}
+	if (ret >= 0)
+		ret = 1;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+/* parent dirs that were changed on the receiving side get their times */
+static int send_dir_utimes(struct send_ctx *sctx, struct list_head *head,
+			   u64 *last_dir)
+{
+	struct recorded_ref *ref;
+	u64 gen;
+	int ret;
+
+	list_for_each_entry(ref, head, list) {
+		if (ref->dir == *last_dir || ref->dir >= sctx->send_progress)
+			continue;
+		ret = get_inode_gen(sctx->send_root, ref->dir, &gen);
+		if (ret == -ENOENT)
+			continue;
+		if (ret < 0)
+			return ret;
+		if (gen != ref->dir_gen)
+			continue;
+		ret = send_utimes(sctx, ref->dir, gen);
+		if (ret < 0)
+			return ret;
+		*last_dir = ref->dir;
+	}
+	return 0;
+}
+
+/*
+ * Puts the current inode in place: creates it if it is new, renames,
+ * links and unlinks it according to the refs recorded for it and
+ * removes it if it is a deleted dir.
+ */
+static int process_recorded_refs(struct send_ctx *sctx)
+{
+	struct recorded_ref *ref;
+	struct send_dir *sd;
+	struct fs_path *valid_path = NULL;
+	struct fs_path *p = NULL;
+	u64 ino = sctx->cur_ino;
+	u64 gen = sctx->cur_inode_gen;
+	u64 last_dir = 0;
+	int is_orphan;
+	int orphan_exists;
+	int ret = 0;
+
+	if (ino == BTRFS_FIRST_FREE_OBJECTID)
+		goto done;
+
+	valid_path = fs_path_alloc();
+	p = fs_path_alloc();
+	if (!valid_path || !p) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (sctx->cur_inode_new) {
+		sd = NULL;
+		if (S_ISDIR(sctx->cur_inode_mode))
+			sd = find_send_dir(&sctx->created_dirs, ino, gen);
+		if (sd) {
+			del_send_dir(sd);
+		} else {
+			ret = send_create_inode(sctx, ino, gen);
+			if (ret < 0)
+				goto out;
+		}
+	}
+
+	list_for_each_entry(ref, &sctx->new_refs, list) {
+		ret = create_dir_if_needed(sctx, ref->dir, ref->dir_gen);
+		if (ret < 0)
+			goto out;
+		ret = orphanize_conflict(sctx, ref, p, valid_path);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (S_ISDIR(sctx->cur_inode_mode)) {
+		if (!list_empty(&sctx->new_refs)) {
+			ref = list_first_entry(&sctx->new_refs,
+					       struct recorded_ref, list);
+			ret = resolve_dir_cycle(sctx, ref->dir, ref->dir_gen,
+						p, valid_path);
+			if (ret < 0)
+				goto out;
+			ret = get_cur_path(sctx, ino, gen, valid_path);
+			if (ret < 0)
+				goto out;
+			ret = get_cur_ref_path(sctx, ref->dir, ref->dir_gen,
+					       ref->name, ref->name_len, p);
+			if (ret < 0)
+				goto out;
+			ret = send_rename(sctx, valid_path, p);
+			if (ret < 0)
+				goto out;
+			sctx->cur_inode_moved = 1;
+		} else if (sctx->cur_inode_deleted) {
+			ret = get_cur_path(sctx, ino, gen, valid_path);
+			if (ret < 0)
+				goto out;
+			is_orphan = ret;
+			ret = can_rmdir(sctx, ino);
+			if (ret < 0)
+				goto out;
+			if (ret) {
+				ret = send_path_cmd(sctx, BTRFS_SEND_C_RMDIR,
+						    valid_path);
+			} else {
+				if (!is_orphan) {
+					ret = get_orphan_path(ino, gen, p);
+					if (ret < 0)
+						goto out;
+					ret = send_rename(sctx, valid_path, p);
+					if (ret < 0)
+						goto out;
+				}
+				ret = add_send_dir(&sctx->pending_rmdirs, ino,
+						   gen);
+			}
+			if (ret < 0)
+				goto out;
+		}
+	} else {
+		ret = get_cur_path(sctx, ino, gen, valid_path);
+		if (ret < 0)
+			goto out;
+		is_orphan = ret;
+		orphan_exists = is_orphan;
+
+		list_for_each_entry(ref, &sctx->deleted_refs, list) {
+			ret = did_overwrite_ref(sctx, ref->dir, ref->dir_gen,
+						ino, gen, ref->name,
+						ref->name_len);
+			if (ret < 0)
+				goto out;
+			if (ret) {
+				ref->overwrote = 1;
+				orphan_exists = 1;
+			}
+		}
+
+		list_for_each_entry(ref, &sctx->new_refs, list) {
+			ret = get_cur_ref_path(sctx, ref->dir, ref->dir_gen,
+					       ref->name, ref->name_len, p);
+			if (ret < 0)
+				goto out;
+			if (is_orphan) {
+				ret = send_rename(sctx, valid_path, p);
+				if (ret < 0)
+					goto out;
+				fs_path_copy(valid_path, p);
+				is_orphan = 0;
+				orphan_exists = 0;
+			} else {
+				ret = send_link(sctx, p, valid_path);
+				if (ret < 0)
+					goto out;
+			}
+		}
+
+		list_for_each_entry(ref, &sctx->deleted_refs, list) {
+			if (ref->overwrote)
+				continue;
+			ret = get_cur_ref_path(sctx, ref->dir, ref->dir_gen,
+					       ref->name, ref->name_len, p);
+			if (ret < 0)
+				goto out;
+			ret = send_path_cmd(sctx, BTRFS_SEND_C_UNLINK, p);
+			if (ret < 0)
+				goto out;
+		}
+
+		if (orphan_exists) {
+			ret = get_orphan_path(ino, gen, p);
+			if (ret < 0)
+				goto out;
+			ret = send_path_cmd(sctx, BTRFS_SEND_C_UNLINK, p);
+			if (ret < 0)
+				goto out;
+		}
+	}
+
+done:
+	sctx->send_progress = ino + 1;
+
+	sd = find_send_dir(&sctx->orphan_dirs, ino, gen);
+	if (sd)
+		del_send_dir(sd);
+
+	/* old parent dirs waiting to be removed may be empty now */
+	list_for_each_entry(ref, &sctx->deleted_refs, list) {
+		sd = find_send_dir(&sctx->pending_rmdirs, ref->dir,
+				   ref->dir_gen);
+		if (!sd)
+			continue;
+		ret = can_rmdir(sctx, ref->dir);
+		if (ret < 0)
+			goto out;
+		if (!ret)
+			continue;
+		ret = get_orphan_path(ref->dir, ref->dir_gen, p);
+		if (ret < 0)
+			goto out;
+		ret = send_path_cmd(sctx, BTRFS_SEND_C_RMDIR, p);
+		if (ret < 0)
+			goto out;
+		del_send_dir(sd);
+	}
+
+	ret = send_dir_utimes(sctx, &sctx->new_refs, &last_dir);
+	if (ret < 0)
+		goto out;
+	ret = send_dir_utimes(sctx, &sctx->deleted_refs, &last_dir);
+out:
+	fs_path_free(p);
+	fs_path_free(valid_path);
+	return ret;
+}
+
+static int process_refs_if_needed(struct send_ctx *sctx)
+{
+	int ret;
+
+	if (sctx->cur_refs_done)
+		return 0;
+	sctx->cur_refs_done = 1;
+
+	ret = process_recorded_refs(sctx);
+	free_recorded_refs(&sctx->new_refs);
+	free_recorded_refs(&sctx->deleted_refs);
+	return ret;
+}
+
+typedef int (*iterate_ref_cb_t)(struct send_ctx *sctx, u64 dir,
+				const char *name, int name_len, void *ctx);
+
+static int iterate_inode_ref(struct send_ctx *sctx, struct extent_buffer *eb,
+			     int slot, u64 dir, iterate_ref_cb_t cb, void *ctx)
+{
+	struct btrfs_inode_ref *iref;
+	char name[BTRFS_NAME_LEN];
+	unsigned long ptr;
+	u32 total;
+	u32 cur = 0;
+	int name_len;
+	int ret;
+
+	ptr = btrfs_item_ptr_offset(eb, slot);
+	total = btrfs_item_size_nr(eb, slot);
+	while (cur < total) {
+		iref = (struct btrfs_inode_ref *)(ptr + cur);
+		name_len = btrfs_inode_ref_name_len(eb, iref);
+		if (name_len > BTRFS_NAME_LEN)
+			return -EIO;
+		read_extent_buffer(eb, name, (unsigned long)(iref + 1),
+				   name_len);
+		ret = cb(sctx, dir, name, name_len, ctx);
+		if (ret)
+			return ret;
+		cur += sizeof(*iref) + name_len;
+	}
+	return 0;
+}
+
+struct ref_ctx {
+	struct btrfs_root *root;
+	struct list_head *head;
+	/* names also present in this item are not recorded */
+	struct extent_buffer *other_eb;
+	int other_slot;
+	/* set by find_ref_cb */
+	const char *name;
+	int name_len;
+};
+
+static int find_ref_cb(struct send_ctx *sctx, u64 dir, const char *name,
+		       int name_len, void *ctx)
+{
+	struct ref_ctx *rctx = ctx;
+
+	return name_len == rctx->name_len &&
+	       !memcmp(name, rctx->name, name_len);
+}
+
+static int record_ref_cb(struct send_ctx *sctx, u64 dir, const char *name,
+			 int name_len, void *ctx)
+{
+	struct ref_ctx *rctx = ctx;
+	struct ref_ctx find;
+	u64 dir_gen;
+	int ret;
+
+	if (rctx->other_eb) {
+		find.name = name;
+		find.name_len = name_len;
+		ret = iterate_inode_ref(sctx, rctx->other_eb, rctx->other_slot,
+					dir, find_ref_cb, &find);
+		if (ret < 0)
+			return ret;
+		if (ret)
+			return 0;
+	}
+
+	ret = get_inode_gen(rctx->root, dir, &dir_gen);
+	if (ret < 0)
+		return ret;
+	return record_ref(rctx->head, dir, dir_gen, name, name_len);
+}
+
+static int changed_ref(struct send_ctx *sctx, struct btrfs_path *left_path,
+		       struct btrfs_path *right_path, struct btrfs_key *key,
+		       enum btrfs_compare_tree_result result)
+{
+	struct ref_ctx rctx;
+	int ret;
+
+	BUG_ON(sctx->cur_refs_done);
+
+	if (result != BTRFS_COMPARE_TREE_DELETED) {
+		rctx.root = sctx->send_root;
+		rctx.head = &sctx->new_refs;
+		rctx.other_eb = NULL;
+		if (result == BTRFS_COMPARE_TREE_CHANGED) {
+			rctx.other_eb = right_path->nodes[0];
+			rctx.other_slot = right_path->slots[0];
+		}
+		ret = iterate_inode_ref(sctx, left_path->nodes[0],
+					left_path->slots[0], key->offset,
+					record_ref_cb, &rctx);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (result != BTRFS_COMPARE_TREE_NEW) {
+		rctx.root = sctx->parent_root;
+		rctx.head = &sctx->deleted_refs;
+		rctx.other_eb = NULL;
+		if (result == BTRFS_COMPARE_TREE_CHANGED) {
+			rctx.other_eb = left_path->nodes[0];
+			rctx.other_slot = left_path->slots[0];
+		}
+		ret = iterate_inode_ref(sctx, right_path->nodes[0],
+					right_path->slots[0], key->offset,
+					record_ref_cb, &rctx);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/* record every ref ino has in root */
+static int record_all_refs(struct send_ctx *sctx, struct btrfs_root *root,
+			   u64 ino, struct list_head *head)
+{
+	struct btrfs_path *path;
+	struct btrfs_key key;
+	struct ref_ctx rctx;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	rctx.root = root;
+	rctx.head = head;
+	rctx.other_eb = NULL;
+
+	key.objectid = ino;
+	key.type = BTRFS_INODE_REF_KEY;
+	key.offset = 0;
+	ret = search_first(root, path, &key);
+	while (!ret) {
+		btrfs_item_key_to_cpu(path->nodes[0], &key, path->slots[0]);
+		if (key.objectid != ino || key.type != BTRFS_INODE_REF_KEY)
+			break;
+		ret = iterate_inode_ref(sctx, path->nodes[0], path->slots[0],
+					key.offset, record_ref_cb, &rctx);
+		if (ret < 0)
+			goto out;
+		ret = next_item(root, path);
+	}
+	if (ret > 0)
+		ret = 0;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+/* a copy of a xattr item, which may hold several colliding names */
+static struct btrfs_dir_item *copy_xattr_item(struct extent_buffer *eb,
+					      int slot, u32 *len)
+{
+	struct btrfs_dir_item *di;
+
+	*len = btrfs_item_size_nr(eb, slot);
+	di = kmalloc(*len, GFP_NOFS);
+	if (!di)
+		return NULL;
+	read_extent_buffer(eb, di, btrfs_item_ptr_offset(eb, slot), *len);
+	return di;
+}
+
+#define xattr_name(di) ((char *)((di) + 1))
+#define xattr_data(di) (xattr_name(di) + le16_to_cpu((di)->name_len))
+#define xattr_next(di) \
+	((struct btrfs_dir_item *)(xattr_data(di) + le16_to_cpu((di)->data_len)))
+
+/*
+ * find name in a copied xattr item, with data also matching if it is
+ * given
+ */
+static int find_xattr(struct btrfs_dir_item *item, u32 len,
+		      struct btrfs_dir_item *di, int match_data)
+{
+	struct btrfs_dir_item *cur = item;
+	u16 name_len = le16_to_cpu(di->name_len);
+	u16 data_len = le16_to_cpu(di->data_len);
+
+	while ((char *)cur < (char *)item + len) {
+		if (le16_to_cpu(cur->name_len) == name_len &&
+		    !memcmp(xattr_name(cur), xattr_name(di), name_len) &&
+		    (!match_data ||
+		     (le16_to_cpu(cur->data_len) == data_len &&
+		      !memcmp(xattr_data(cur), xattr_data(di), data_len))))
+			return 1;
+		cur = xattr_next(cur);
+	}
+	return 0;
+}
+
+static int send_xattr(struct send_ctx *sctx, int cmd, struct btrfs_dir_item *di)
+{
+	struct fs_path *p;
+	int ret;
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+
+	ret = get_cur_path(sctx, sctx->cur_ino, sctx->cur_inode_gen, p);
+	if (ret < 0)
+		goto out;
+
+	begin_cmd(sctx, cmd);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+	TLV_PUT(sctx, BTRFS_SEND_A_XATTR_NAME, xattr_name(di),
+		le16_to_cpu(di->name_len));
+	if (cmd == BTRFS_SEND_C_SET_XATTR)
+		TLV_PUT(sctx, BTRFS_SEND_A_XATTR_DATA, xattr_data(di),
+			le16_to_cpu(di->data_len));
+	ret = send_cmd(sctx);
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(p);
+	return ret;
+}
+
+static int changed_xattr(struct send_ctx *sctx, struct btrfs_path *left_path,
+			 struct btrfs_path *right_path,
+			 enum btrfs_compare_tree_result result)
+{
+	struct btrfs_dir_item *left = NULL;
+	struct btrfs_dir_item *right = NULL;
+	struct btrfs_dir_item *di;
+	u32 left_len = 0;
+	u32 right_len = 0;
+	int ret = 0;
+
+	if (result != BTRFS_COMPARE_TREE_DELETED) {
+		left = copy_xattr_item(left_path->nodes[0],
+				       left_path->slots[0], &left_len);
+		if (!left)
+			return -ENOMEM;
+	}
+	if (result != BTRFS_COMPARE_TREE_NEW) {
+		right = copy_xattr_item(right_path->nodes[0],
+					right_path->slots[0], &right_len);
+		if (!right) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (di = left; di && (char *)di < (char *)left + left_len;
+	     di = xattr_next(di)) {
+		if (right && find_xattr(right, right_len, di, 1))
+			continue;
+		ret = send_xattr(sctx, BTRFS_SEND_C_SET_XATTR, di);
+		if (ret < 0)
+			goto out;
+	}
+	for (di = right; di && (char *)di < (char *)right + right_len;
+	     di = xattr_next(di)) {
+		if (left && find_xattr(left, left_len, di, 0))
+			continue;
+		ret = send_xattr(sctx, BTRFS_SEND_C_REMOVE_XATTR, di);
+		if (ret < 0)
+			goto out;
+	}
+out:
+	kfree(left);
+	kfree(right);
+	return ret;
+}
+
+/* copy file data through the page cache of the send root inode */
+static ssize_t fill_read_buf(struct send_ctx *sctx, u64 offset, u32 len)
+{
+	struct inode *inode;
+	struct page *page;
+	struct btrfs_key key;
+	pgoff_t index;
+	unsigned pg_offset;
+	unsigned cur_len;
+	loff_t i_size;
+	ssize_t ret = 0;
+	char *addr;
+
+	if (!sctx->cur_inode) {
+		key.objectid = sctx->cur_ino;
+		key.type = BTRFS_INODE_ITEM_KEY;
+		key.offset = 0;
+		inode = btrfs_iget(sctx->send_root->fs_info->sb, &key,
+				   sctx->send_root, NULL);
+		if (IS_ERR(inode))
+			return PTR_ERR(inode);
+		sctx->cur_inode = inode;
+	}
+	inode = sctx->cur_inode;
+
+	i_size = i_size_read(inode);
+	if (offset >= i_size)
+		return 0;
+	if (offset + len > i_size)
+		len = i_size - offset;
+
+	while (ret < len) {
+		index = offset >> PAGE_CACHE_SHIFT;
+		pg_offset = offset & ~PAGE_CACHE_MASK;
+		cur_len = min_t(unsigned, PAGE_CACHE_SIZE - pg_offset,
+				len - ret);
+
+		page = find_or_create_page(inode->i_mapping, index, GFP_NOFS);
+		if (!page)
+			return -ENOMEM;
+
+		if (!PageUptodate(page)) {
+			inode->i_mapping->a_ops->readpage(NULL, page);
+			lock_page(page);
+			if (!PageUptodate(page)) {
+				unlock_page(page);
+				page_cache_release(page);
+				return -EIO;
+			}
+		}
+
+		addr = kmap(page);
+		memcpy(sctx->read_buf + ret, addr + pg_offset, cur_len);
+		kunmap(page);
+		unlock_page(page);
+		page_cache_release(page);
+
+		offset += cur_len;
+		ret += cur_len;
+	}
+	return ret;
+}
+
+/* write len bytes at offset, from the file or zeroes */
+static int send_write(struct send_ctx *sctx, u64 offset, u64 len, int zero)
+{
+	struct fs_path *p;
+	ssize_t num_read;
+	u32 chunk;
+	int ret;
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+
+	ret = get_cur_path(sctx, sctx->cur_ino, sctx->cur_inode_gen, p);
+	if (ret < 0)
+		goto out;
+
+	while (len) {
+		chunk = min_t(u64, len, BTRFS_SEND_READ_SIZE);
+		if (zero) {
+			memset(sctx->read_buf, 0, chunk);
+			num_read = chunk;
+		} else {
+			num_read = fill_read_buf(sctx, offset, chunk);
+			if (num_read < 0) {
+				ret = num_read;
+				goto out;
+			}
+			if (!num_read)
+				break;
+		}
+
+		begin_cmd(sctx, BTRFS_SEND_C_WRITE);
+		TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_FILE_OFFSET, offset);
+		TLV_PUT(sctx, BTRFS_SEND_A_DATA, sctx->read_buf, num_read);
+		ret = send_cmd(sctx);
+		if (ret < 0)
+			goto out;
+
+		offset += num_read;
+		len -= num_read;
+	}
+	ret = 0;
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(p);
+	return ret;
+}
+
+struct clone_ctx {
+	struct send_ctx *sctx;
+	u64 disk_bytenr;
+	u64 offset;
+	u64 len;
+	u64 src_ino;
+	u64 src_offset;
+	int found;
+};
+
+/*
+ * a clone source must already be complete on the receiving side and
+ * still reference the whole range of the extent
+ */
+static int verify_clone_source(struct send_ctx *sctx, u64 ino, u64 offset,
+			       u64 len, u64 disk_bytenr)
+{
+	struct btrfs_root *root = sctx->send_root;
+	struct btrfs_file_extent_item *ei;
+	struct send_inode_info info;
+	struct btrfs_path *path;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	int ret;
+
+	ret = get_inode_info(root, ino, &info);
+	if (ret < 0)
+		return ret == -ENOENT ? 0 : ret;
+	if (!S_ISREG(info.mode) || !info.nlink || offset + len > info.size)
+		return 0;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = ino;
+	key.type = BTRFS_EXTENT_DATA_KEY;
+	key.offset = offset;
+	ret = btrfs_search_slot(NULL, root, &key, path, 0, 0);
+	if (ret < 0)
+		goto out;
+	if (ret) {
+		if (path->slots[0] == 0)
+			goto no_clone;
+		path->slots[0]--;
+	}
+
+	eb = path->nodes[0];
+	btrfs_item_key_to_cpu(eb, &key, path->slots[0]);
+	if (key.objectid != ino || key.type != BTRFS_EXTENT_DATA_KEY)
+		goto no_clone;
+	ei = btrfs_item_ptr(eb, path->slots[0], struct btrfs_file_extent_item);
+	if (btrfs_file_extent_type(eb, ei) != BTRFS_FILE_EXTENT_REG ||
+	    btrfs_file_extent_disk_bytenr(eb, ei) != disk_bytenr ||
+	    key.offset + btrfs_file_extent_num_bytes(eb, ei) < offset + len)
+		goto no_clone;
+	ret = 1;
+	goto out;
+no_clone:
+	ret = 0;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int clone_source_cb(u64 ino, u64 offset, u64 root, void *ctx)
+{
+	struct clone_ctx *cctx = ctx;
+	struct send_ctx *sctx = cctx->sctx;
+	int ret;
+
+	if (root != sctx->send_root->objectid)
+		return 0;
+	if (ino > sctx->cur_ino)
+		return 0;
+	if (ino == sctx->cur_ino && offset + cctx->len > cctx->offset)
+		return 0;
+
+	ret = verify_clone_source(sctx, ino, offset, cctx->len,
+				  cctx->disk_bytenr);
+	if (ret <= 0)
+		return ret;
+
+	cctx->src_ino = ino;
+	cctx->src_offset = offset;
+	cctx->found = 1;
+	return 1;
+}
+
+static int send_clone(struct send_ctx *sctx, struct clone_ctx *cctx)
+{
+	struct fs_path *p;
+	struct fs_path *src = NULL;
+	u64 src_gen;
+	int ret;
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+	src = fs_path_alloc();
+	if (!src) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = get_cur_path(sctx, sctx->cur_ino, sctx->cur_inode_gen, p);
+	if (ret < 0)
+		goto out;
+	ret = get_inode_gen(sctx->send_root, cctx->src_ino, &src_gen);
+	if (ret < 0)
+		goto out;
+	ret = get_cur_path(sctx, cctx->src_ino, src_gen, src);
+	if (ret < 0)
+		goto out;
+
+	begin_cmd(sctx, BTRFS_SEND_C_CLONE);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+	TLV_PUT_U64(sctx, BTRFS_SEND_A_FILE_OFFSET, cctx->offset);
+	TLV_PUT_U64(sctx, BTRFS_SEND_A_CLONE_LEN, cctx->len);
+	TLV_PUT_PATH(sctx, BTRFS_SEND_A_CLONE_PATH, src);
+	TLV_PUT_U64(sctx, BTRFS_SEND_A_CLONE_OFFSET, cctx->src_offset);
+	ret = send_cmd(sctx);
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(src);
+	fs_path_free(p);
+	return ret;
+}
+
+static int process_extent(struct send_ctx *sctx, struct extent_buffer *eb,
+			  int slot, struct btrfs_key *key)
+{
+	struct btrfs_file_extent_item *ei;
+	struct clone_ctx cctx;
+	u64 offset = key->offset;
+	u64 sectorsize = sctx->send_root->sectorsize;
+	u64 disk_bytenr = 0;
+	u64 len;
+	u64 end;
+	int type;
+	int ret;
+
+	if (!S_ISREG(sctx->cur_inode_mode))
+		return 0;
+
+	ei = btrfs_item_ptr(eb, slot, struct btrfs_file_extent_item);
+	type = btrfs_file_extent_type(eb, ei);
+	if (type == BTRFS_FILE_EXTENT_INLINE) {
+		len = btrfs_file_extent_inline_len(eb, ei);
+	} else {
+		len = btrfs_file_extent_num_bytes(eb, ei);
+		disk_bytenr = btrfs_file_extent_disk_bytenr(eb, ei);
+	}
+
+	if (offset >= sctx->cur_inode_size)
+		return 0;
+	if (offset + len > sctx->cur_inode_size)
+		len = sctx->cur_inode_size - offset;
+
+	if (type != BTRFS_FILE_EXTENT_INLINE &&
+	    (!disk_bytenr || type == BTRFS_FILE_EXTENT_PREALLOC)) {
+		/* holes only need filling where the old file had data */
+		if (offset >= sctx->cur_inode_old_size)
+			return 0;
+		end = min(offset + len, sctx->cur_inode_old_size);
+		return send_write(sctx, offset, end - offset, 1);
+	}
+
+	if (type == BTRFS_FILE_EXTENT_REG && IS_ALIGNED(offset, sectorsize) &&
+	    IS_ALIGNED(len, sectorsize)) {
+		memset(&cctx, 0, sizeof(cctx));
+		cctx.sctx = sctx;
+		cctx.disk_bytenr = disk_bytenr;
+		cctx.offset = offset;
+		cctx.len = len;
+		ret = iterate_extent_inodes(sctx->send_root->fs_info,
+					    disk_bytenr,
+					    btrfs_file_extent_offset(eb, ei),
+					    1, clone_source_cb, &cctx);
+		if (ret < 0 && ret != -ENOENT)
+			return ret;
+		if (cctx.found)
+			return send_clone(sctx, &cctx);
+	}
+
+	return send_write(sctx, offset, len, 0);
+}
+
+/*
+ * an inode that was replaced by a new one with the same number is sent
+ * as a deletion and a creation, with all items of the new one
+ */
+static int process_all_items(struct send_ctx *sctx)
+{
+	struct btrfs_root *root = sctx->send_root;
+	struct btrfs_path *path;
+	struct btrfs_key key;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = sctx->cur_ino;
+	key.type = BTRFS_XATTR_ITEM_KEY;
+	key.offset = 0;
+	ret = search_first(root, path, &key);
+	while (!ret) {
+		btrfs_item_key_to_cpu(path->nodes[0], &key, path->slots[0]);
+		if (key.objectid != sctx->cur_ino)
+			break;
+
+		if (key.type == BTRFS_XATTR_ITEM_KEY)
+			ret = changed_xattr(sctx, path, NULL,
+					    BTRFS_COMPARE_TREE_NEW);
+		else if (key.type == BTRFS_EXTENT_DATA_KEY)
+			ret = process_extent(sctx, path->nodes[0],
+					     path->slots[0], &key);
+		if (ret < 0)
+			goto out;
+		ret = next_item(root, path);
+	}
+	if (ret > 0)
+		ret = 0;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int send_inode_attrs(struct send_ctx *sctx)
+{
+	struct send_inode_info left;
+	struct send_inode_info right;
+	struct fs_path *p;
+	int new = sctx->cur_inode_new;
+	int ret;
+
+	ret = get_inode_info(sctx->send_root, sctx->cur_ino, &left);
+	if (ret < 0)
+		return ret;
+	if (!new) {
+		ret = get_inode_info(sctx->parent_root, sctx->cur_ino, &right);
+		if (ret < 0)
+			return ret;
+	}
+
+	p = fs_path_alloc();
+	if (!p)
+		return -ENOMEM;
+	ret = get_cur_path(sctx, sctx->cur_ino, sctx->cur_inode_gen, p);
+	if (ret < 0)
+		goto out;
+
+	if (S_ISREG(left.mode) && (new || left.size != right.size)) {
+		begin_cmd(sctx, BTRFS_SEND_C_TRUNCATE);
+		TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_SIZE, left.size);
+		ret = send_cmd(sctx);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (!S_ISLNK(left.mode) && (new || left.mode != right.mode)) {
+		begin_cmd(sctx, BTRFS_SEND_C_CHMOD);
+		TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_MODE, left.mode & 07777);
+		ret = send_cmd(sctx);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (new || left.uid != right.uid || left.gid != right.gid) {
+		begin_cmd(sctx, BTRFS_SEND_C_CHOWN);
+		TLV_PUT_PATH(sctx, BTRFS_SEND_A_PATH, p);
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_UID, left.uid);
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_GID, left.gid);
+		ret = send_cmd(sctx);
+		if (ret < 0)
+			goto out;
+	}
+
+	/* last, everything above changes the ctime on the receiving side */
+	ret = send_utimes(sctx, sctx->cur_ino, sctx->cur_inode_gen);
+	goto out;
+
+tlv_put_failure:
+	sctx->send_size = 0;
+out:
+	fs_path_free(p);
+	return ret;
+}
+
+static int finish_inode(struct send_ctx *sctx)
+{
+	int ret = 0;
+
+	if (!sctx->cur_ino)
+		return 0;
+
+	if (sctx->cur_inode_skip) {
+		sctx->send_progress = sctx->cur_ino + 1;
+		goto out;
+	}
+
+	ret = process_refs_if_needed(sctx);
+	if (ret < 0)
+		goto out;
+
+	if (sctx->cur_inode_new_gen) {
+		ret = process_all_items(sctx);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (!sctx->cur_inode_deleted)
+		ret = send_inode_attrs(sctx);
+out:
+	if (sctx->cur_inode) {
+		iput(sctx->cur_inode);
+		sctx->cur_inode = NULL;
+	}
+	return ret;
+}
+
+static int start_inode(struct send_ctx *sctx, u64 ino)
+{
+	struct send_inode_info left;
+	struct send_inode_info right;
+	int left_ret;
+	int right_ret;
+	int ret;
+
+	sctx->cur_ino = ino;
+	sctx->send_progress = ino;
+	sctx->cur_inode_new = 0;
+	sctx->cur_inode_new_gen = 0;
+	sctx->cur_inode_deleted = 0;
+	sctx->cur_inode_skip = 0;
+	sctx->cur_inode_moved = 0;
+	sctx->cur_refs_done = 0;
+	sctx->cur_inode_size = 0;
+	sctx->cur_inode_old_size = 0;
+
+	left_ret = get_inode_info(sctx->send_root, ino, &left);
+	if (left_ret < 0 && left_ret != -ENOENT)
+		return left_ret;
+	right_ret = get_inode_info(sctx->parent_root, ino, &right);
+	if (right_ret < 0 && right_ret != -ENOENT)
+		return right_ret;
+
+	/* unlinked inodes still waiting for their orphan cleanup */
+	if (!left_ret && !left.nlink)
+		left_ret = -ENOENT;
+	if (!right_ret && !right.nlink)
+		right_ret = -ENOENT;
+
+	if (left_ret && right_ret) {
+		sctx->cur_inode_skip = 1;
+		return 0;
+	}
+
+	if (left_ret || (!right_ret && left.gen != right.gen)) {
+		sctx->cur_inode_deleted = 1;
+		sctx->cur_inode_gen = right.gen;
+		sctx->cur_inode_mode = right.mode;
+		if (left_ret)
+			return 0;
+
+		/* remove the old inode right away, then create the new one */
+		ret = record_all_refs(sctx, sctx->parent_root, ino,
+				      &sctx->deleted_refs);
+		if (ret < 0)
+			return ret;
+		ret = process_refs_if_needed(sctx);
+		if (ret < 0)
+			return ret;
+
+		sctx->send_progress = ino;
+		sctx->cur_refs_done = 0;
+		sctx->cur_inode_deleted = 0;
+		sctx->cur_inode_new_gen = 1;
+		right_ret = -ENOENT;
+	}
+
+	sctx->cur_inode_gen = left.gen;
+	sctx->cur_inode_mode = left.mode;
+	sctx->cur_inode_size = left.size;
+	if (right_ret) {
+		sctx->cur_inode_new = 1;
+	} else {
+		sctx->cur_inode_old_size = right.size;
+	}
+
+	if (sctx->cur_inode_new_gen)
+		return record_all_refs(sctx, sctx->send_root, ino,
+				       &sctx->new_refs);
+	return 0;
+}
+
+static int changed_cb(struct btrfs_root *left_root,
+		      struct btrfs_root *right_root,
+		      struct btrfs_path *left_path,
+		      struct btrfs_path *right_path,
+		      struct btrfs_key *key,
+		      enum btrfs_compare_tree_result result,
+		      void *ctx)
+{
+	struct send_ctx *sctx = ctx;
+	int ret;
+
+	if (key->objectid < BTRFS_FIRST_FREE_OBJECTID ||
+	    key->objectid > BTRFS_LAST_FREE_OBJECTID)
+		return 0;
+	if (key->type != BTRFS_INODE_ITEM_KEY &&
+	    key->type != BTRFS_INODE_REF_KEY &&
+	    key->type != BTRFS_XATTR_ITEM_KEY &&
+	    key->type != BTRFS_EXTENT_DATA_KEY)
+		return 0;
+
+	if (fatal_signal_pending(current))
+		return -EINTR;
+
+	if (key->objectid != sctx->cur_ino) {
+		ret = finish_inode(sctx);
+		if (ret < 0)
+			return ret;
+		ret = start_inode(sctx, key->objectid);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (sctx->cur_inode_skip || sctx->cur_inode_new_gen)
+		return 0;
+
+	switch (key->type) {
+	case BTRFS_INODE_REF_KEY:
+		return changed_ref(sctx, left_path, right_path, key, result);
+	case BTRFS_XATTR_ITEM_KEY:
+		ret = process_refs_if_needed(sctx);
+		if (ret < 0 || sctx->cur_inode_deleted)
+			return ret;
+		return changed_xattr(sctx, left_path, right_path, result);
+	case BTRFS_EXTENT_DATA_KEY:
+		ret = process_refs_if_needed(sctx);
+		if (ret < 0 || sctx->cur_inode_deleted ||
+		    result == BTRFS_COMPARE_TREE_DELETED)
+			return ret;
+		return process_extent(sctx, left_path->nodes[0],
+				      left_path->slots[0], key);
+	}
+	return 0;
+}
+
+static int get_subvol_name(struct btrfs_root *root, char *name, int *name_len)
+{
+	struct btrfs_root *tree_root = root->fs_info->tree_root;
+	struct btrfs_path *path;
+	struct btrfs_root_ref *rref;
+	struct extent_buffer *eb;
+	struct btrfs_key key;
+	int ret;
+
+	path = alloc_path_for_send();
+	if (!path)
+		return -ENOMEM;
+
+	key.objectid = root->objectid;
+	key.type = BTRFS_ROOT_BACKREF_KEY;
+	key.offset = 0;
+	ret = search_first(tree_root, path, &key);
+	if (ret < 0)
+		goto out;
+	if (ret)
+		goto not_found;
+
+	eb = path->nodes[0];
+	btrfs_item_key_to_cpu(eb, &key, path->slots[0]);
+	if (key.objectid != root->objectid ||
+	    key.type != BTRFS_ROOT_BACKREF_KEY)
+		goto not_found;
+
+	rref = btrfs_item_ptr(eb, path->slots[0], struct btrfs_root_ref);
+	*name_len = btrfs_root_ref_name_len(eb, rref);
+	if (*name_len > BTRFS_NAME_LEN) {
+		ret = -EIO;
+		goto out;
+	}
+	read_extent_buffer(eb, name, (unsigned long)(rref + 1), *name_len);
+	ret = 0;
+	goto out;
+not_found:
+	ret = -ENOENT;
+out:
+	btrfs_free_path(path);
+	return ret;
+}
+
+static int send_subvol_begin(struct send_ctx *sctx)
+{
+	char name[BTRFS_NAME_LEN];
+	int name_len;
+	int ret;
+
+	ret = get_subvol_name(sctx->send_root, name, &name_len);
+	if (ret < 0)
+		return ret;
+
+	if (sctx->parent_root)
+		begin_cmd(sctx, BTRFS_SEND_C_SNAPSHOT);
+	else
+		begin_cmd(sctx, BTRFS_SEND_C_SUBVOL);
+	TLV_PUT(sctx, BTRFS_SEND_A_PATH, name, name_len);
+	TLV_PUT_U64(sctx, BTRFS_SEND_A_CTRANSID,
+		    btrfs_root_generation(&sctx->send_root->root_item));
+	if (sctx->parent_root)
+		TLV_PUT_U64(sctx, BTRFS_SEND_A_CLONE_CTRANSID,
+			    btrfs_root_generation(&sctx->parent_root->root_item));
+	return send_cmd(sctx);
+
+tlv_put_failure:
+	sctx->send_size = 0;
+	return ret;
+}
+
+static int send_subvol(struct send_ctx *sctx)
+{
+	int ret;
+
+	ret = send_header(sctx);
+	if (ret < 0)
+		return ret;
+	ret = send_subvol_begin(sctx);
+	if (ret < 0)
+		return ret;
+
+	ret = btrfs_compare_trees(sctx->send_root, sctx->parent_root,
+				  changed_cb, sctx);
+	if (ret < 0)
+		return ret;
+	ret = finish_inode(sctx);
+	if (ret < 0)
+		return ret;
+
+	/* orphan names came and went in the top dir */
+	if (sctx->top_dir_dirty) {
+		ret = send_utimes(sctx, BTRFS_FIRST_FREE_OBJECTID, 0);
+		if (ret < 0)
+			return ret;
+	}
+
+	begin_cmd(sctx, BTRFS_SEND_C_END);
+	return send_cmd(sctx);
+}
+
+long btrfs_ioctl_send(struct file *mnt_file, void __user *arg_)
+{
+	struct btrfs_root *send_root = BTRFS_I(mnt_file->f_path.dentry->d_inode)->root;
+	struct btrfs_fs_info *fs_info = send_root->fs_info;
+	struct btrfs_root *parent_root = NULL;
+	struct btrfs_ioctl_send_args *arg;
+	struct send_ctx *sctx = NULL;
+	struct btrfs_key key;
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	arg = memdup_user(arg_, sizeof(*arg));
+	if (IS_ERR(arg))
+		return PTR_ERR(arg);
+
+	/* only the sent subvolume itself is used as clone source */
+	if (arg->flags || arg->clone_sources_count) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (arg->parent_root) {
+		key.objectid = arg->parent_root;
+		key.type = BTRFS_ROOT_ITEM_KEY;
+		key.offset = (u64)-1;
+		parent_root = btrfs_read_fs_root_no_name(fs_info, &key);
+		if (IS_ERR(parent_root)) {
+			ret = PTR_ERR(parent_root);
+			goto out;
+		}
+	}
+
+	/* the snapshots can't be deleted or made writable while sending */
+	down_write(&fs_info->subvol_sem);
+	if (!btrfs_root_readonly(send_root) ||
+	    (parent_root && !btrfs_root_readonly(parent_root))) {
+		up_write(&fs_info->subvol_sem);
+		ret = -EPERM;
+		goto out;
+	}
+	send_root->send_in_progress++;
+	if (parent_root)
+		parent_root->send_in_progress++;
+	up_write(&fs_info->subvol_sem);
+
+	sctx = kzalloc(sizeof(*sctx), GFP_NOFS);
+	if (!sctx) {
+		ret = -ENOMEM;
+		goto out_unpin;
+	}
+	INIT_LIST_HEAD(&sctx->new_refs);
+	INIT_LIST_HEAD(&sctx->deleted_refs);
+	INIT_LIST_HEAD(&sctx->created_dirs);
+	INIT_LIST_HEAD(&sctx->orphan_dirs);
+	INIT_LIST_HEAD(&sctx->pending_rmdirs);
+	sctx->send_root = send_root;
+	sctx->parent_root = parent_root;
+	sctx->send_max_size = BTRFS_SEND_BUF_SIZE;
+
+	sctx->send_filp = fget(arg->send_fd);
+	if (!sctx->send_filp) {
+		ret = -EBADF;
+		goto out_unpin;
+	}
+	if (!(sctx->send_filp->f_mode & FMODE_WRITE)) {
+		ret = -EBADF;
+		goto out_unpin;
+	}
+	sctx->send_off = sctx->send_filp->f_pos;
+
+	sctx->send_buf = vmalloc(BTRFS_SEND_BUF_SIZE);
+	sctx->read_buf = vmalloc(BTRFS_SEND_READ_SIZE);
+	if (!sctx->send_buf || !sctx->read_buf) {
+		ret = -ENOMEM;
+		goto out_unpin;
+	}
+
+	ret = send_subvol(sctx);
+	sctx->send_filp->f_pos = sctx->send_off;
+
+out_unpin:
+	down_write(&fs_info->subvol_sem);
+	send_root->send_in_progress--;
+	if (parent_root)
+		parent_root->send_in_progress--;
+	up_write(&fs_info->subvol_sem);
+
+	if (sctx) {
+		if (sctx->cur_inode)
+			iput(sctx->cur_inode);
+		if (sctx->send_filp)
+			fput(sctx->send_filp);
+		vfree(sctx->send_buf);
+		vfree(sctx->read_buf);
+		free_recorded_refs(&sctx->new_refs);
+		free_recorded_refs(&sctx->deleted_refs);
+		free_send_dirs(&sctx->created_dirs);
+		free_send_dirs(&sctx->orphan_dirs);
+		free_send_dirs(&sctx->pending_rmdirs);
+		kfree(sctx);
+	}
+out:
+	kfree(arg);
+	return ret;
+}
@@ -0,0 +1,634 @@
+/*
+ *  fs/ext4/extent_status.c
+ *
+ * Extent status tree
+ *
+ * Every inode keeps an rbtree of non-overlapping extents that caches what
+ * is known about its logical to physical block mapping. An extent is one
+ * of:
+ *
+ *   written	- mapped to initialized blocks on disk
+ *   unwritten	- mapped to uninitialized (preallocated) blocks
+ *   delayed	- dirty in the page cache, waiting for delayed allocation
+ *   hole	- known not to be mapped
+ *
+ * ext4_map_blocks() consults the tree before walking the on-disk extent
+ * tree or indirect blocks, and records whatever it looked up or allocated.
+ * Lookups that hit the tree neither take i_data_sem nor touch any
+ * buffer.
+ *
+ * Delayed extents are not a cache: they are the only record of which
+ * blocks are under delayed allocation, and replace scanning the page cache
+ * for delayed buffers. They are inserted when a block is reserved in
+ * ext4_da_map_blocks() and only go away when the blocks get allocated,
+ * invalidated or truncated. Everything else may be dropped at any time and
+ * is reclaimed by a per-filesystem shrinker when memory gets tight.
+ *
+ * The tree is protected by i_es_lock. Updates are made with i_data_sem
+ * held for writing, except for delayed extents and looked up mappings,
+ * which are recorded under i_data_sem held for reading. The latter never
+ * override what is already in the tree, so they cannot undo a concurrent
+ * update.
+ */
+#include <linux/rbtree.h>
+#include <linux/backing-dev.h>
+#include "ext4.h"
+#include "extent_status.h"
+
+#include <trace/events/ext4.h>
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init ext4_init_es(void)
+{
+	ext4_es_cachep = kmem_cache_create("ext4_extent_status",
+					   sizeof(struct extent_status),
+					   0, SLAB_RECLAIM_ACCOUNT, NULL);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void ext4_exit_es(void)
+{
+	if (ext4_es_cachep)
+		kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->cache_es = NULL;
+}
+
+/*
+ * Delayed extents must never be dropped; everything else is a cache that
+ * the shrinker may reclaim.
+ */
+static inline int ext4_es_is_reclaimable(struct extent_status *es)
+{
+	return !ext4_es_is_delayed(es);
+}
+
+static inline int ext4_es_has_pblock(unsigned long long status)
+{
+	return status & (EXTENT_STATUS_WRITTEN | EXTENT_STATUS_UNWRITTEN);
+}
+
+/*
+ * Search the tree for the extent containing @lblk. If there is none,
+ * return the first extent after it, or NULL.
+ */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					       ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	if (es && lblk < es->es_lblk)
+		return es;
+
+	if (es && lblk > ext4_es_end(es)) {
+		node = rb_next(&es->rb_node);
+		return node ? rb_entry(node, struct extent_status, rb_node) :
+			      NULL;
+	}
+
+	return NULL;
+}
+
+static inline struct extent_status *ext4_es_next(struct extent_status *es)
+{
+	struct rb_node *node = rb_next(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+static struct extent_status *
+ext4_es_alloc_extent(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len,
+		     ext4_fsblk_t pblk)
+{
+	struct extent_status *es;
+
+	es = kmem_cache_alloc(ext4_es_cachep, GFP_ATOMIC);
+	if (es == NULL)
+		return NULL;
+	es->es_lblk = lblk;
+	es->es_len = len;
+	es->es_pblk = pblk;
+
+	if (ext4_es_is_reclaimable(es)) {
+		EXT4_I(inode)->i_es_lru_nr++;
+		percpu_counter_inc(&EXT4_SB(inode->i_sb)->s_extent_cache_cnt);
+	}
+
+	return es;
+}
+
+static void ext4_es_free_extent(struct inode *inode, struct extent_status *es)
+{
+	if (ext4_es_is_reclaimable(es)) {
+		BUG_ON(EXT4_I(inode)->i_es_lru_nr == 0);
+		EXT4_I(inode)->i_es_lru_nr--;
+		percpu_counter_dec(&EXT4_SB(inode->i_sb)->s_extent_cache_cnt);
+	}
+
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+/*
+ * Two extents can be merged if they have the same status, are logically
+ * adjacent and, if mapped, physically contiguous.
+ */
+static int ext4_es_can_be_merged(struct extent_status *es1,
+				 struct extent_status *es2)
+{
+	if (ext4_es_status(es1) != ext4_es_status(es2))
+		return 0;
+
+	if ((u64)es1->es_len + es2->es_len > EXT_MAX_BLOCKS)
+		return 0;
+
+	if ((u64)es1->es_lblk + es1->es_len != es2->es_lblk)
+		return 0;
+
+	if (ext4_es_has_pblock(ext4_es_status(es1)) &&
+	    ext4_es_pblock(es1) + es1->es_len != ext4_es_pblock(es2))
+		return 0;
+
+	return 1;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_left(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+
+	node = rb_prev(&es->rb_node);
+	if (!node)
+		return es;
+
+	es1 = rb_entry(node, struct extent_status, rb_node);
+	if (ext4_es_can_be_merged(es1, es)) {
+		es1->es_len += es->es_len;
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		es = es1;
+	}
+
+	return es;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_right(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+
+	es1 = ext4_es_next(es);
+	if (es1 && ext4_es_can_be_merged(es, es1)) {
+		es->es_len += es1->es_len;
+		rb_erase(&es1->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es1);
+	}
+
+	return es;
+}
+
+/*
+ * Insert @newes into the tree, which must not hold anything overlapping
+ * it. Failing to allocate only matters for delayed extents: anything else
+ * is simply not cached.
+ */
+static int __es_insert_extent(struct inode *inode, struct extent_status *newes)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+
+		if (newes->es_lblk < es->es_lblk) {
+			if (ext4_es_can_be_merged(newes, es)) {
+				/* @es is @newes' right neighbour */
+				es->es_lblk = newes->es_lblk;
+				es->es_len += newes->es_len;
+				es->es_pblk = newes->es_pblk;
+				es = ext4_es_try_to_merge_left(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_left;
+		} else if (newes->es_lblk > ext4_es_end(es)) {
+			if (ext4_es_can_be_merged(es, newes)) {
+				es->es_len += newes->es_len;
+				es = ext4_es_try_to_merge_right(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_right;
+		} else {
+			BUG();
+		}
+	}
+
+	es = ext4_es_alloc_extent(inode, newes->es_lblk, newes->es_len,
+				  newes->es_pblk);
+	if (!es)
+		return ext4_es_is_delayed(newes) ? -ENOMEM : 0;
+	rb_link_node(&es->rb_node, parent, p);
+	rb_insert_color(&es->rb_node, &tree->root);
+
+out:
+	tree->cache_es = es;
+	return 0;
+}
+
+/*
+ * Remove [lblk, end] from the tree, trimming and splitting extents that
+ * straddle its boundaries. Splitting needs a new extent; if that cannot
+ * be allocated the tail of a cached extent is dropped, while a delayed
+ * one is left untouched and -ENOMEM returned.
+ */
+static int __es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t end)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, orig_es;
+	ext4_lblk_t len1, len2;
+	int err;
+
+	es = __es_tree_search(&tree->root, lblk);
+	if (!es || es->es_lblk > end)
+		return 0;
+
+	/* the extents cover the removed range partly, forget the hint */
+	tree->cache_es = NULL;
+
+	orig_es = *es;
+	len1 = lblk > es->es_lblk ? lblk - es->es_lblk : 0;
+	len2 = ext4_es_end(es) > end ? ext4_es_end(es) - end : 0;
+	if (len1 > 0)
+		es->es_len = len1;
+	if (len2 > 0) {
+		struct extent_status newes;
+
+		newes.es_lblk = end + 1;
+		newes.es_len = len2;
+		newes.es_pblk = orig_es.es_pblk;
+		if (ext4_es_has_pblock(ext4_es_status(&orig_es)))
+			newes.es_pblk += end + 1 - orig_es.es_lblk;
+
+		if (len1 > 0) {
+			/* the range is in the middle of @es, split it */
+			err = __es_insert_extent(inode, &newes);
+			if (err) {
+				es->es_len = orig_es.es_len;
+				return err;
+			}
+		} else {
+			es->es_lblk = newes.es_lblk;
+			es->es_len = newes.es_len;
+			es->es_pblk = newes.es_pblk;
+		}
+		return 0;
+	}
+
+	if (len1 > 0)
+		es = ext4_es_next(es);
+
+	while (es && ext4_es_end(es) <= end) {
+		struct extent_status *next = ext4_es_next(es);
+
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		es = next;
+	}
+
+	if (es && es->es_lblk <= end) {
+		ext4_lblk_t skip = end + 1 - es->es_lblk;
+
+		es->es_lblk += skip;
+		es->es_len -= skip;
+		if (ext4_es_has_pblock(ext4_es_status(es)))
+			es->es_pblk += skip;
+	}
+
+	return 0;
+}
+
+/*
+ * Record [lblk, end] as @status, leaving alone any part of it that the
+ * tree holds as one of the statuses in @keep.
+ */
+static int __es_insert_range(struct inode *inode, ext4_lblk_t lblk,
+			     ext4_lblk_t end, ext4_fsblk_t pblk,
+			     unsigned long long status, unsigned long long keep)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, newes;
+	ext4_lblk_t cur = lblk, gap_end;
+	int err;
+
+	while (1) {
+		/* find the next extent to keep within [cur, end] */
+		es = keep ? __es_tree_search(&tree->root, cur) : NULL;
+		while (es && es->es_lblk <= end && !(ext4_es_status(es) & keep))
+			es = ext4_es_next(es);
+		if (es && es->es_lblk > end)
+			es = NULL;
+
+		if (!es || es->es_lblk > cur) {
+			gap_end = es ? es->es_lblk - 1 : end;
+
+			err = __es_remove_extent(inode, cur, gap_end);
+			if (err)
+				return err;
+
+			newes.es_lblk = cur;
+			newes.es_len = gap_end - cur + 1;
+			newes.es_pblk = status | (pblk & ~EXTENT_STATUS_FLAGS);
+			if (ext4_es_has_pblock(status))
+				newes.es_pblk += cur - lblk;
+			err = __es_insert_extent(inode, &newes);
+			if (err)
+				return err;
+		}
+
+		if (!es || ext4_es_end(es) >= end)
+			return 0;
+		cur = ext4_es_end(es) + 1;
+	}
+}
+
+static void ext4_es_lru_add(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!list_empty(&ei->i_es_lru))
+		return;
+
+	spin_lock(&sbi->s_es_lru_lock);
+	if (list_empty(&ei->i_es_lru))
+		list_add_tail(&ei->i_es_lru, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+void ext4_es_lru_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_del_init(&ei->i_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+/*
+ * ext4_es_insert_extent() records [lblk, lblk + len) as @status, mapped
+ * from @pblk on if it is written or unwritten.
+ *
+ * Parts of the range that the tree holds with one of the statuses in
+ * @keep are left as they are: callers that allocate blocks for anything
+ * but delayed allocation writeback pass EXTENT_STATUS_DELAYED, so that
+ * dirty delayed buffers stay accounted as such until written back.
+ */
+void ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len, ext4_fsblk_t pblk,
+			   unsigned long long status, unsigned long long keep)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int err;
+
+	if (len == 0)
+		return;
+
+	trace_ext4_es_insert_extent(inode, lblk, len, pblk, status);
+
+	BUG_ON(lblk + len - 1 < lblk);
+retry:
+	write_lock(&ei->i_es_lock);
+	err = __es_insert_range(inode, lblk, lblk + len - 1, pblk, status,
+				keep);
+	write_unlock(&ei->i_es_lock);
+	if (err == -ENOMEM) {
+		congestion_wait(BLK_RW_ASYNC, HZ/50);
+		goto retry;
+	}
+
+	if (ei->i_es_lru_nr)
+		ext4_es_lru_add(inode);
+}
+
+/*
+ * ext4_es_remove_extent() forgets everything known about
+ * [lblk, lblk + len), delayed extents included.
+ */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int err;
+
+	if (len == 0)
+		return;
+
+	trace_ext4_es_remove_extent(inode, lblk, len);
+
+	BUG_ON(lblk + len - 1 < lblk);
+retry:
+	write_lock(&ei->i_es_lock);
+	err = __es_remove_extent(inode, lblk, lblk + len - 1);
+	write_unlock(&ei->i_es_lock);
+	if (err == -ENOMEM) {
+		congestion_wait(BLK_RW_ASYNC, HZ/50);
+		goto retry;
+	}
+}
+
+/*
+ * ext4_es_lookup_extent() copies the extent containing @lblk to @es.
+ * Returns 1 if there is one, 0 if the tree knows nothing about @lblk.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+	int found = 0;
+
+	read_lock(&ei->i_es_lock);
+
+	es1 = tree->cache_es;
+	if (es1 && in_range(lblk, es1->es_lblk, es1->es_len)) {
+		found = 1;
+		goto out;
+	}
+
+	node = tree->root.rb_node;
+	while (node) {
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es1->es_lblk) {
+			node = node->rb_left;
+		} else if (lblk > ext4_es_end(es1)) {
+			node = node->rb_right;
+		} else {
+			found = 1;
+			break;
+		}
+	}
+
+out:
+	if (found) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+		/* give the inode a second chance against the shrinker */
+		if (!ei->i_es_referenced)
+			ei->i_es_referenced = 1;
+	}
+
+	read_unlock(&ei->i_es_lock);
+
+	trace_ext4_es_lookup_extent(inode, lblk, found ? es : NULL);
+	return found;
+}
+
+/*
+ * ext4_es_find_delayed_extent() copies the first delayed extent that ends
+ * at or after @lblk to @es. Returns 1 if there is one, else 0.
+ */
+int ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *es1;
+
+	read_lock(&ei->i_es_lock);
+	es1 = __es_tree_search(&ei->i_es_tree.root, lblk);
+	while (es1 && !ext4_es_is_delayed(es1))
+		es1 = ext4_es_next(es1);
+	if (es1) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+	}
+	read_unlock(&ei->i_es_lock);
+
+	return es1 != NULL;
+}
+
+/*
+ * Free up to @nr_to_scan reclaimable extents of @ei. Called with i_es_lock
+ * held for writing.
+ */
+static int __es_try_to_reclaim_extents(struct ext4_inode_info *ei,
+				       int nr_to_scan)
+{
+	struct inode *inode = &ei->vfs_inode;
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es, *next;
+	int nr_shrunk = 0;
+
+	tree->cache_es = NULL;
+
+	for (es = __es_tree_search(&tree->root, 0); es; es = next) {
+		next = ext4_es_next(es);
+		if (!ext4_es_is_reclaimable(es))
+			continue;
+
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		if (++nr_shrunk >= nr_to_scan)
+			break;
+	}
+
+	return nr_shrunk;
+}
+
+/*
+ * Inodes with reclaimable extents sit on a per-filesystem list in the order
+ * they got their first one. The shrinker walks it from the head, skipping
+ * once the inodes that had a lookup hit since its last visit.
+ */
+static int ext4_es_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct ext4_sb_info *sbi = container_of(shrink,
+					struct ext4_sb_info, s_es_shrinker);
+	struct ext4_inode_info *ei;
+	struct list_head *cur, *tmp;
+	LIST_HEAD(skipped);
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_shrunk = 0;
+	int ret;
+
+	ret = percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+	if (!nr_to_scan)
+		return ret;
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_for_each_safe(cur, tmp, &sbi->s_es_lru) {
+		int shrunk;
+
+		if (nr_shrunk >= nr_to_scan)
+			break;
+
+		ei = list_entry(cur, struct ext4_inode_info, i_es_lru);
+		if (ei->i_es_referenced) {
+			ei->i_es_referenced = 0;
+			list_move_tail(cur, &skipped);
+			continue;
+		}
+
+		if (!write_trylock(&ei->i_es_lock))
+			continue;
+
+		shrunk = __es_try_to_reclaim_extents(ei,
+						nr_to_scan - nr_shrunk);
+		if (ei->i_es_lru_nr == 0)
+			list_del_init(&ei->i_es_lru);
+		else
+			list_move_tail(cur, &skipped);
+		write_unlock(&ei->i_es_lock);
+
+		nr_shrunk += shrunk;
+	}
+	list_splice_tail(&skipped, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+
+	ret = percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+	trace_ext4_es_shrink(sbi->s_sb, nr_to_scan, nr_shrunk, ret);
+	return ret;
+}
+
+void ext4_es_register_shrinker(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	INIT_LIST_HEAD(&sbi->s_es_lru);
+	spin_lock_init(&sbi->s_es_lru_lock);
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->s_es_shrinker);
+}
+
+void ext4_es_unregister_shrinker(struct super_block *sb)
+{
+	unregister_shrinker(&EXT4_SB(sb)->s_es_shrinker);
+}
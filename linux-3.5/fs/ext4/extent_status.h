@@ -0,0 +1,104 @@
+/*
+ *  fs/ext4/extent_status.h
+ *
+ * Per-inode cache of the logical to physical block mapping, holding
+ * written, unwritten, delayed and hole ranges.
+ */
+
+#ifndef _EXT4_EXTENT_STATUS_H
+#define _EXT4_EXTENT_STATUS_H
+
+/*
+ * The status of an extent is kept in the top bits of es_pblk, physical
+ * block numbers never get that large.
+ */
+#define EXTENT_STATUS_WRITTEN	(1ULL << 63)
+#define EXTENT_STATUS_UNWRITTEN	(1ULL << 62)
+#define EXTENT_STATUS_DELAYED	(1ULL << 61)
+#define EXTENT_STATUS_HOLE	(1ULL << 60)
+
+#define EXTENT_STATUS_FLAGS	(EXTENT_STATUS_WRITTEN | \
+				 EXTENT_STATUS_UNWRITTEN | \
+				 EXTENT_STATUS_DELAYED | \
+				 EXTENT_STATUS_HOLE)
+
+struct extent_status {
+	struct rb_node rb_node;
+	ext4_lblk_t es_lblk;	/* first logical block extent covers */
+	ext4_lblk_t es_len;	/* length of extent in block */
+	ext4_fsblk_t es_pblk;	/* first physical block and status */
+};
+
+struct ext4_es_tree {
+	struct rb_root root;
+	struct extent_status *cache_es;	/* recently accessed extent */
+};
+
+extern int __init ext4_init_es(void);
+extern void ext4_exit_es(void);
+extern void ext4_es_init_tree(struct ext4_es_tree *tree);
+
+extern void ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+				  ext4_lblk_t len, ext4_fsblk_t pblk,
+				  unsigned long long status,
+				  unsigned long long keep);
+extern void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+				  ext4_lblk_t len);
+extern int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+				 struct extent_status *es);
+extern int ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				       struct extent_status *es);
+
+extern void ext4_es_register_shrinker(struct super_block *sb);
+extern void ext4_es_unregister_shrinker(struct super_block *sb);
+extern void ext4_es_lru_del(struct inode *inode);
+
+/*
+ * Record a mapping that was looked up rather than changed: ranges the tree
+ * already knows about are left alone, so this cannot override the result
+ * of a concurrent update.
+ */
+static inline void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
+					ext4_lblk_t len, ext4_fsblk_t pblk,
+					unsigned long long status)
+{
+	ext4_es_insert_extent(inode, lblk, len, pblk, status,
+			      EXTENT_STATUS_FLAGS);
+}
+
+static inline unsigned long long ext4_es_status(struct extent_status *es)
+{
+	return es->es_pblk & EXTENT_STATUS_FLAGS;
+}
+
+static inline ext4_fsblk_t ext4_es_pblock(struct extent_status *es)
+{
+	return es->es_pblk & ~EXTENT_STATUS_FLAGS;
+}
+
+static inline int ext4_es_is_written(struct extent_status *es)
+{
+	return (es->es_pblk & EXTENT_STATUS_WRITTEN) != 0;
+}
+
+static inline int ext4_es_is_unwritten(struct extent_status *es)
+{
+	return (es->es_pblk & EXTENT_STATUS_UNWRITTEN) != 0;
+}
+
+static inline int ext4_es_is_delayed(struct extent_status *es)
+{
+	return (es->es_pblk & EXTENT_STATUS_DELAYED) != 0;
+}
+
+static inline int ext4_es_is_hole(struct extent_status *es)
+{
+	return (es->es_pblk & EXTENT_STATUS_HOLE) != 0;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	return es->es_lblk + es->es_len - 1;
+}
+
+#endif /* _EXT4_EXTENT_STATUS_H */
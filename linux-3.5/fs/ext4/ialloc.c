@@ -920,6 +920,11 @@ got:
 		}
 	}
 
+	/* Small files and directories start out with their data inline */
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_INLINEDATA) &&
+	    (S_ISDIR(mode) || S_ISREG(mode)))
+		ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+
 	if (ext4_handle_valid(handle)) {
 		ei->i_sync_tid = handle->h_transaction->t_tid;
 		ei->i_datasync_tid = handle->h_transaction->t_tid;
@@ -0,0 +1,1594 @@
+/*
+ *  fs/ext4/inline.c
+ *
+ * Inline data: small files and directories kept inside the inode.
+ *
+ * When the inline_data feature is enabled, a regular file or directory
+ * starts out with its data in i_block (EXT4_MIN_INLINE_DATA_SIZE bytes)
+ * followed by the value of the in-inode xattr "system.data".  The xattr
+ * exists, possibly empty, for as long as the inode carries
+ * EXT4_INODE_INLINE_DATA, and ei->i_inline_off points at its entry.
+ * Once the data no longer fits, it is moved to a freshly allocated block
+ * and the inode goes back to an extent tree (or block map) for good.
+ *
+ * An inline directory stores the inode number of its parent in the first
+ * EXT4_INLINE_DOTDOT_SIZE bytes of i_block, "." is implicit.  The rest of
+ * i_block and the xattr value each hold a chain of ordinary directory
+ * entries, whose rec_len adds up to the size of that area.
+ *
+ * xattr_sem protects the inline data against concurrent conversion and
+ * xattr updates, which may move the value around.  Whenever it is held
+ * for writing, EXT4_STATE_NO_EXPAND is set so that marking the inode dirty
+ * does not try to expand i_extra_isize, which needs xattr_sem as well.
+ */
+
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/fiemap.h>
+#include <linux/slab.h>
+
+#include "ext4_jbd2.h"
+#include "ext4.h"
+#include "xattr.h"
+#include "truncate.h"
+
+static void ext4_write_lock_xattr(struct inode *inode, int *save)
+{
+	down_write(&EXT4_I(inode)->xattr_sem);
+	*save = ext4_test_inode_state(inode, EXT4_STATE_NO_EXPAND);
+	ext4_set_inode_state(inode, EXT4_STATE_NO_EXPAND);
+}
+
+static void ext4_write_unlock_xattr(struct inode *inode, int *save)
+{
+	if (!*save)
+		ext4_clear_inode_state(inode, EXT4_STATE_NO_EXPAND);
+	up_write(&EXT4_I(inode)->xattr_sem);
+}
+
+/*
+ * Return the largest value system.data could have if it used up all the
+ * free space of the in-inode xattr area.
+ */
+static int get_max_inline_xattr_value_size(struct inode *inode,
+					   struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_ibody_header *header;
+	struct ext4_xattr_entry *entry;
+	struct ext4_inode *raw_inode;
+	int free, min_offs;
+
+	min_offs = EXT4_SB(inode->i_sb)->s_inode_size -
+			EXT4_GOOD_OLD_INODE_SIZE -
+			EXT4_I(inode)->i_extra_isize -
+			sizeof(struct ext4_xattr_ibody_header);
+
+	/*
+	 * Without any xattr the whole area is free, minus the entry for
+	 * system.data and the 4 bytes terminating the entry table.
+	 */
+	if (!ext4_test_inode_state(inode, EXT4_STATE_XATTR))
+		return EXT4_XATTR_SIZE(min_offs -
+			EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA)) -
+			EXT4_XATTR_ROUND - sizeof(__u32));
+
+	raw_inode = ext4_raw_inode(iloc);
+	header = IHDR(inode, raw_inode);
+	entry = IFIRST(header);
+
+	for (; !IS_LAST_ENTRY(entry); entry = EXT4_XATTR_NEXT(entry)) {
+		if (!entry->e_value_block && entry->e_value_size) {
+			size_t offs = le16_to_cpu(entry->e_value_offs);
+			if (offs < min_offs)
+				min_offs = offs;
+		}
+	}
+	free = min_offs -
+		((void *)entry - (void *)IFIRST(header)) - sizeof(__u32);
+
+	if (EXT4_I(inode)->i_inline_off) {
+		entry = (struct ext4_xattr_entry *)
+			((void *)raw_inode + EXT4_I(inode)->i_inline_off);
+		return free + EXT4_XATTR_SIZE(le32_to_cpu(entry->e_value_size));
+	}
+
+	free -= EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA));
+	if (free > EXT4_XATTR_ROUND)
+		return EXT4_XATTR_SIZE(free - EXT4_XATTR_ROUND);
+	return 0;
+}
+
+/*
+ * Get the maximum size we could store inline, i_block included.
+ */
+static int ext4_get_max_inline_size(struct inode *inode)
+{
+	struct ext4_iloc iloc;
+	int max_inline_size;
+
+	if (EXT4_I(inode)->i_extra_isize == 0)
+		return 0;
+
+	if (ext4_get_inode_loc(inode, &iloc))
+		return 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	max_inline_size = get_max_inline_xattr_value_size(inode, &iloc);
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	brelse(iloc.bh);
+
+	if (!max_inline_size)
+		return 0;
+
+	return max_inline_size + EXT4_MIN_INLINE_DATA_SIZE;
+}
+
+static int ext4_get_inline_size(struct inode *inode)
+{
+	if (EXT4_I(inode)->i_inline_off)
+		return EXT4_I(inode)->i_inline_size;
+
+	return 0;
+}
+
+/*
+ * Look up system.data and cache where it is.  The caller either holds
+ * xattr_sem or has the inode to itself, as ext4_iget() does.
+ */
+int ext4_find_inline_data_nolock(struct inode *inode, struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	int error;
+
+	if (EXT4_I(inode)->i_extra_isize == 0)
+		return 0;
+
+	is.iloc = *iloc;
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		return error;
+
+	if (!is.s.not_found) {
+		EXT4_I(inode)->i_inline_off = (u16)((void *)is.s.here -
+					(void *)ext4_raw_inode(iloc));
+		EXT4_I(inode)->i_inline_size = EXT4_MIN_INLINE_DATA_SIZE +
+				le32_to_cpu(is.s.here->e_value_size);
+		ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	}
+	return 0;
+}
+
+/* Where the value of system.data starts, the inline data past i_block. */
+static void *ext4_get_inline_xattr_pos(struct inode *inode,
+				       struct ext4_iloc *iloc)
+{
+	struct ext4_inode *raw_inode = ext4_raw_inode(iloc);
+	struct ext4_xattr_entry *entry;
+
+	BUG_ON(!EXT4_I(inode)->i_inline_off);
+
+	entry = (struct ext4_xattr_entry *)
+		((void *)raw_inode + EXT4_I(inode)->i_inline_off);
+
+	return (void *)IFIRST(IHDR(inode, raw_inode)) +
+		le16_to_cpu(entry->e_value_offs);
+}
+
+static int ext4_read_inline_data(struct inode *inode, void *buffer,
+				 unsigned int len, struct ext4_iloc *iloc)
+{
+	struct ext4_inode *raw_inode = ext4_raw_inode(iloc);
+	int cp_len, total;
+
+	BUG_ON(len > EXT4_I(inode)->i_inline_size);
+
+	cp_len = min_t(unsigned int, len, EXT4_MIN_INLINE_DATA_SIZE);
+	memcpy(buffer, (void *)raw_inode->i_block, cp_len);
+
+	total = cp_len;
+	len -= cp_len;
+	if (!len)
+		return total;
+
+	memcpy(buffer + cp_len, ext4_get_inline_xattr_pos(inode, iloc), len);
+	return total + len;
+}
+
+/*
+ * Copy len bytes at offset pos of buffer into the inline data.  The
+ * caller has write access to iloc->bh and made sure the inline data is
+ * large enough.
+ */
+static void ext4_write_inline_data(struct inode *inode, struct ext4_iloc *iloc,
+				   void *buffer, loff_t pos, unsigned int len)
+{
+	struct ext4_inode *raw_inode = ext4_raw_inode(iloc);
+	int cp_len;
+
+	BUG_ON(!EXT4_I(inode)->i_inline_off);
+	BUG_ON(pos + len > EXT4_I(inode)->i_inline_size);
+
+	buffer += pos;
+
+	if (pos < EXT4_MIN_INLINE_DATA_SIZE) {
+		cp_len = min_t(unsigned int, len,
+			       EXT4_MIN_INLINE_DATA_SIZE - pos);
+		memcpy((void *)raw_inode->i_block + pos, buffer, cp_len);
+
+		len -= cp_len;
+		buffer += cp_len;
+		pos += cp_len;
+	}
+
+	if (!len)
+		return;
+
+	pos -= EXT4_MIN_INLINE_DATA_SIZE;
+	memcpy(ext4_get_inline_xattr_pos(inode, iloc) + pos, buffer, len);
+}
+
+static int ext4_create_inline_data(handle_t *handle, struct inode *inode,
+				   struct ext4_iloc *iloc, unsigned int len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	void *value = NULL;
+	int error;
+
+	BUFFER_TRACE(iloc->bh, "get_write_access");
+	error = ext4_journal_get_write_access(handle, iloc->bh);
+	if (error)
+		return error;
+
+	if (len > EXT4_MIN_INLINE_DATA_SIZE) {
+		len -= EXT4_MIN_INLINE_DATA_SIZE;
+		value = kzalloc(len, GFP_NOFS);
+		if (!value)
+			return -ENOMEM;
+		i.value = value;
+	} else {
+		len = 0;
+		i.value = "";
+	}
+	i.value_len = len;
+
+	is.iloc = *iloc;
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+
+	BUG_ON(!is.s.not_found);
+
+	error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+	if (error) {
+		if (error == -ENOSPC)
+			ext4_clear_inode_state(inode,
+					       EXT4_STATE_MAY_INLINE_DATA);
+		goto out;
+	}
+
+	memset((void *)ext4_raw_inode(iloc)->i_block, 0,
+	       EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, EXT4_MIN_INLINE_DATA_SIZE);
+
+	ei->i_inline_off = (u16)((void *)is.s.here -
+				 (void *)ext4_raw_inode(iloc));
+	ei->i_inline_size = EXT4_MIN_INLINE_DATA_SIZE + len;
+	ext4_clear_inode_flag(inode, EXT4_INODE_EXTENTS);
+	ext4_set_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+
+	get_bh(iloc->bh);
+	error = ext4_mark_iloc_dirty(handle, inode, iloc);
+out:
+	kfree(value);
+	return error;
+}
+
+/* Grow system.data so that the inline data is len bytes long. */
+static int ext4_update_inline_data(handle_t *handle, struct inode *inode,
+				   struct ext4_iloc *iloc, unsigned int len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	void *value;
+	int error;
+
+	if (len <= ei->i_inline_size)
+		return 0;
+
+	is.iloc = *iloc;
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		return error;
+
+	BUG_ON(is.s.not_found);
+
+	len -= EXT4_MIN_INLINE_DATA_SIZE;
+	value = kzalloc(len, GFP_NOFS);
+	if (!value)
+		return -ENOMEM;
+
+	memcpy(value, ext4_get_inline_xattr_pos(inode, iloc),
+	       le32_to_cpu(is.s.here->e_value_size));
+
+	BUFFER_TRACE(iloc->bh, "get_write_access");
+	error = ext4_journal_get_write_access(handle, iloc->bh);
+	if (error)
+		goto out;
+
+	i.value = value;
+	i.value_len = len;
+	error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+	if (error)
+		goto out;
+
+	ei->i_inline_off = (u16)((void *)is.s.here -
+				 (void *)ext4_raw_inode(iloc));
+	ei->i_inline_size = EXT4_MIN_INLINE_DATA_SIZE +
+			    le32_to_cpu(is.s.here->e_value_size);
+	ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+
+	get_bh(iloc->bh);
+	error = ext4_mark_iloc_dirty(handle, inode, iloc);
+out:
+	kfree(value);
+	return error;
+}
+
+/*
+ * Make room for len bytes of inline data, creating system.data if the
+ * inode has none yet.  Returns -ENOSPC if the data has to go to a block.
+ */
+static int ext4_prepare_inline_data(handle_t *handle, struct inode *inode,
+				    struct ext4_iloc *iloc, unsigned int len)
+{
+	int ret, no_expand;
+
+	if (!ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA))
+		return -ENOSPC;
+
+	if (len > ext4_get_max_inline_size(inode))
+		return -ENOSPC;
+
+	ext4_write_lock_xattr(inode, &no_expand);
+	if (EXT4_I(inode)->i_inline_off)
+		ret = ext4_update_inline_data(handle, inode, iloc, len);
+	else
+		ret = ext4_create_inline_data(handle, inode, iloc, len);
+	ext4_write_unlock_xattr(inode, &no_expand);
+
+	return ret;
+}
+
+/*
+ * Remove the inline data and give the inode an empty extent tree or
+ * block map.  Called with xattr_sem held for writing.
+ */
+static int ext4_destroy_inline_data_nolock(handle_t *handle,
+					   struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+		.value = NULL,
+		.value_len = 0,
+	};
+	int error;
+
+	if (!ei->i_inline_off)
+		return 0;
+
+	error = ext4_get_inode_loc(inode, &is.iloc);
+	if (error)
+		return error;
+
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+
+	BUFFER_TRACE(is.iloc.bh, "get_write_access");
+	error = ext4_journal_get_write_access(handle, is.iloc.bh);
+	if (error)
+		goto out;
+
+	if (!is.s.not_found) {
+		error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+		if (error)
+			goto out;
+	}
+
+	memset((void *)ext4_raw_inode(&is.iloc)->i_block, 0,
+	       EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, EXT4_MIN_INLINE_DATA_SIZE);
+
+	ext4_clear_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	ei->i_inline_off = 0;
+	ei->i_inline_size = 0;
+
+	if (EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
+				      EXT4_FEATURE_INCOMPAT_EXTENTS)) {
+		ext4_set_inode_flag(inode, EXT4_INODE_EXTENTS);
+		ext4_ext_tree_init(handle, inode);
+	}
+
+	get_bh(is.iloc.bh);
+	error = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+out:
+	brelse(is.iloc.bh);
+	return error;
+}
+
+/*
+ * Fill the locked first page of the file from the inline data.  Called
+ * with xattr_sem held.
+ */
+static int ext4_read_inline_page(struct inode *inode, struct page *page)
+{
+	struct ext4_iloc iloc;
+	void *kaddr;
+	size_t len;
+	int ret;
+
+	BUG_ON(!PageLocked(page));
+	BUG_ON(!ext4_has_inline_data(inode));
+	BUG_ON(page->index);
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	len = min_t(size_t, ext4_get_inline_size(inode), i_size_read(inode));
+	kaddr = kmap_atomic(page);
+	ret = ext4_read_inline_data(inode, kaddr, len, &iloc);
+	flush_dcache_page(page);
+	kunmap_atomic(kaddr);
+	zero_user_segment(page, len, PAGE_CACHE_SIZE);
+	SetPageUptodate(page);
+	brelse(iloc.bh);
+
+	return ret;
+}
+
+/*
+ * ->readpage() for an inode with inline data.  Returns -EAGAIN if the
+ * data has been moved to a block in the meantime.
+ */
+int ext4_readpage_inline(struct inode *inode, struct page *page)
+{
+	int ret = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		return -EAGAIN;
+	}
+
+	/* Inline data only ever covers the first page. */
+	if (!page->index)
+		ret = ext4_read_inline_page(inode, page);
+	else if (!PageUptodate(page)) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	unlock_page(page);
+	return ret >= 0 ? 0 : ret;
+}
+
+/*
+ * Put back the inline data of a regular file whose conversion failed
+ * before its block was allocated, from the page it was read into.
+ * Called with xattr_sem held for writing.
+ */
+static int ext4_restore_inline_page(handle_t *handle, struct inode *inode,
+				    struct page *page, unsigned int len)
+{
+	struct ext4_iloc iloc;
+	void *kaddr;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	ret = ext4_create_inline_data(handle, inode, &iloc, len);
+	if (ret) {
+		brelse(iloc.bh);
+		return ret;
+	}
+
+	kaddr = kmap_atomic(page);
+	ext4_write_inline_data(inode, &iloc, kaddr, 0, len);
+	kunmap_atomic(kaddr);
+
+	return ext4_mark_iloc_dirty(handle, inode, &iloc);
+}
+
+/*
+ * Move the inline data of a regular file to a newly allocated block,
+ * going through the page cache like an ordinary write.
+ */
+static int ext4_convert_inline_data_to_extent(struct address_space *mapping,
+					      struct inode *inode,
+					      unsigned flags)
+{
+	handle_t *handle = NULL;
+	struct page *page = NULL;
+	int ret, err, needed_blocks, no_expand;
+	int retries = 0, sem_held = 0;
+	unsigned from, to;
+
+	if (!ext4_has_inline_data(inode)) {
+		/* Nothing to convert, don't try inline data again. */
+		ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+		return 0;
+	}
+
+	needed_blocks = ext4_writepage_trans_blocks(inode);
+retry:
+	handle = ext4_journal_start(inode, needed_blocks);
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		handle = NULL;
+		goto out;
+	}
+
+	/* We cannot recurse into the filesystem as the transaction is already
+	 * started */
+	flags |= AOP_FLAG_NOFS;
+
+	page = grab_cache_page_write_begin(mapping, 0, flags);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ext4_write_lock_xattr(inode, &no_expand);
+	sem_held = 1;
+	/* Somebody else converted it already. */
+	if (!ext4_has_inline_data(inode)) {
+		ret = 0;
+		goto out;
+	}
+
+	from = 0;
+	to = ext4_get_inline_size(inode);
+	if (!PageUptodate(page)) {
+		ret = ext4_read_inline_page(inode, page);
+		if (ret < 0)
+			goto out;
+	}
+
+	ret = ext4_destroy_inline_data_nolock(handle, inode);
+	if (ret)
+		goto out;
+
+	ret = __block_write_begin(page, from, to, ext4_get_block);
+	if (ret && !(page_has_buffers(page) &&
+		     buffer_mapped(page_buffers(page)))) {
+		/*
+		 * No block got allocated, so the page is the only copy of
+		 * the data left: put it back inline before letting go.
+		 */
+		err = ext4_restore_inline_page(handle, inode, page, to);
+		if (err)
+			EXT4_ERROR_INODE(inode, "error %d restoring inline data",
+					 err);
+		unlock_page(page);
+		page_cache_release(page);
+		page = NULL;
+		ext4_write_unlock_xattr(inode, &no_expand);
+		sem_held = 0;
+		ext4_journal_stop(handle);
+		handle = NULL;
+		if (ret == -ENOSPC &&
+		    ext4_should_retry_alloc(inode->i_sb, &retries))
+			goto retry;
+		goto out;
+	}
+	if (!ret && ext4_should_journal_data(inode))
+		ret = ext4_walk_page_buffers(handle, page_buffers(page),
+					     from, to, NULL,
+					     do_journal_get_write_access);
+	if (ret) {
+		unlock_page(page);
+		page_cache_release(page);
+		page = NULL;
+		ext4_orphan_add(handle, inode);
+		ext4_write_unlock_xattr(inode, &no_expand);
+		sem_held = 0;
+		ext4_journal_stop(handle);
+		handle = NULL;
+		ext4_truncate_failed_write(inode);
+		/*
+		 * If truncate failed early the inode might
+		 * still be on the orphan list; we need to
+		 * make sure the inode is removed from the
+		 * orphan list in that case.
+		 */
+		if (inode->i_nlink)
+			ext4_orphan_del(NULL, inode);
+		if (ret == -ENOSPC &&
+		    ext4_should_retry_alloc(inode->i_sb, &retries))
+			goto retry;
+		goto out;
+	}
+
+	if (ext4_should_journal_data(inode)) {
+		ret = ext4_walk_page_buffers(handle, page_buffers(page),
+					     from, to, NULL, write_end_fn);
+		ext4_set_inode_state(inode, EXT4_STATE_JDATA);
+	} else {
+		if (ext4_should_order_data(inode))
+			ret = ext4_jbd2_file_inode(handle, inode);
+		block_commit_write(page, from, to);
+	}
+out:
+	if (page) {
+		unlock_page(page);
+		page_cache_release(page);
+	}
+	if (sem_held)
+		ext4_write_unlock_xattr(inode, &no_expand);
+	if (handle)
+		ext4_journal_stop(handle);
+	return ret;
+}
+
+/*
+ * ->write_begin() for an inode that may have inline data.  Returns 1 with
+ * the first page locked and the handle running if the write goes to the
+ * inline data, and 0 once the data is in a block and the caller should
+ * carry on as usual.
+ */
+int ext4_try_to_write_inline_data(struct address_space *mapping,
+				  struct inode *inode,
+				  loff_t pos, unsigned len,
+				  unsigned flags,
+				  struct page **pagep)
+{
+	handle_t *handle;
+	struct page *page;
+	struct ext4_iloc iloc;
+	int ret;
+
+	if (pos + len > ext4_get_max_inline_size(inode))
+		goto convert;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	/* The write only touches the inode itself. */
+	handle = ext4_journal_start(inode, 1);
+	if (IS_ERR(handle)) {
+		brelse(iloc.bh);
+		return PTR_ERR(handle);
+	}
+
+	ret = ext4_prepare_inline_data(handle, inode, &iloc, pos + len);
+	if (ret == -ENOSPC) {
+		ext4_journal_stop(handle);
+		brelse(iloc.bh);
+		goto convert;
+	}
+	if (ret)
+		goto out;
+
+	flags |= AOP_FLAG_NOFS;
+
+	page = grab_cache_page_write_begin(mapping, 0, flags);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		ret = 0;
+		goto out_release_page;
+	}
+
+	if (!PageUptodate(page)) {
+		ret = ext4_read_inline_page(inode, page);
+		if (ret < 0)
+			goto out_release_page;
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	*pagep = page;
+	brelse(iloc.bh);
+	return 1;
+
+out_release_page:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	unlock_page(page);
+	page_cache_release(page);
+out:
+	ext4_journal_stop(handle);
+	brelse(iloc.bh);
+	return ret;
+convert:
+	return ext4_convert_inline_data_to_extent(mapping, inode, flags);
+}
+
+/*
+ * Copy what ->write_begin() prepared into the inline data.  The page
+ * stays clean, there is nothing left for writeback to do.
+ */
+int ext4_write_inline_data_end(struct inode *inode, loff_t pos, unsigned len,
+			       unsigned copied, struct page *page)
+{
+	handle_t *handle = ext4_journal_current_handle();
+	struct ext4_iloc iloc;
+	void *kaddr;
+	int ret, no_expand;
+
+	if (unlikely(copied < len) && !PageUptodate(page))
+		return 0;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret) {
+		ext4_std_error(inode->i_sb, ret);
+		return 0;
+	}
+
+	BUFFER_TRACE(iloc.bh, "get_write_access");
+	ret = ext4_journal_get_write_access(handle, iloc.bh);
+	if (ret) {
+		ext4_std_error(inode->i_sb, ret);
+		brelse(iloc.bh);
+		return 0;
+	}
+
+	ext4_write_lock_xattr(inode, &no_expand);
+	BUG_ON(!ext4_has_inline_data(inode));
+
+	kaddr = kmap_atomic(page);
+	ext4_write_inline_data(inode, &iloc, kaddr, pos, copied);
+	kunmap_atomic(kaddr);
+	SetPageUptodate(page);
+	/* The data is in the inode, keep writeback away from the page. */
+	ClearPageDirty(page);
+	ext4_write_unlock_xattr(inode, &no_expand);
+
+	ret = ext4_mark_iloc_dirty(handle, inode, &iloc);
+	if (ret)
+		ext4_std_error(inode->i_sb, ret);
+
+	return copied;
+}
+
+/*
+ * Move the inline data out of the inode before something that needs
+ * blocks, like fallocate or a write fault, touches the file.
+ */
+int ext4_convert_inline_data(struct inode *inode)
+{
+	return ext4_convert_inline_data_to_extent(inode->i_mapping, inode, 0);
+}
+
+/*
+ * Shrink the inline data to i_size.  Clears *has_inline if the inode
+ * has no inline data (any more) and ext4_truncate() has to do the work.
+ */
+void ext4_inline_data_truncate(struct inode *inode, int *has_inline)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	handle_t *handle;
+	void *value = NULL;
+	int no_expand, err;
+	loff_t i_size;
+
+	handle = ext4_journal_start(inode, 1);
+	if (IS_ERR(handle)) {
+		ext4_std_error(inode->i_sb, PTR_ERR(handle));
+		return;
+	}
+
+	ext4_write_lock_xattr(inode, &no_expand);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline = 0;
+		ext4_write_unlock_xattr(inode, &no_expand);
+		ext4_journal_stop(handle);
+		return;
+	}
+
+	err = ext4_get_inode_loc(inode, &is.iloc);
+	if (err)
+		goto out;
+
+	BUFFER_TRACE(is.iloc.bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, is.iloc.bh);
+	if (err)
+		goto out;
+
+	i_size = inode->i_size;
+	ei->i_disksize = i_size;
+
+	if (i_size < ei->i_inline_size) {
+		/* Shrink the part kept in the xattr. */
+		if (ei->i_inline_size > EXT4_MIN_INLINE_DATA_SIZE) {
+			err = ext4_xattr_ibody_find(inode, &i, &is);
+			if (err)
+				goto out;
+			BUG_ON(is.s.not_found);
+
+			if (i_size > EXT4_MIN_INLINE_DATA_SIZE) {
+				i.value_len = i_size -
+					      EXT4_MIN_INLINE_DATA_SIZE;
+				value = kmalloc(i.value_len, GFP_NOFS);
+				if (!value) {
+					err = -ENOMEM;
+					goto out;
+				}
+				memcpy(value,
+				       ext4_get_inline_xattr_pos(inode,
+								 &is.iloc),
+				       i.value_len);
+				i.value = value;
+			} else
+				i.value = "";
+
+			err = ext4_xattr_ibody_set(handle, inode, &i, &is);
+			if (err)
+				goto out;
+		}
+
+		/* And clear what is beyond i_size in i_block. */
+		if (i_size < EXT4_MIN_INLINE_DATA_SIZE)
+			memset((void *)ext4_raw_inode(&is.iloc)->i_block +
+			       i_size, 0, EXT4_MIN_INLINE_DATA_SIZE - i_size);
+
+		ei->i_inline_size = max_t(loff_t, i_size,
+					  EXT4_MIN_INLINE_DATA_SIZE);
+	}
+
+	get_bh(is.iloc.bh);
+	err = ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+out:
+	ext4_write_unlock_xattr(inode, &no_expand);
+	brelse(is.iloc.bh);
+	kfree(value);
+	if (err)
+		ext4_std_error(inode->i_sb, err);
+
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	ext4_journal_stop(handle);
+}
+
+int ext4_inline_data_fiemap(struct inode *inode,
+			    struct fiemap_extent_info *fieinfo,
+			    int *has_inline)
+{
+	__u32 flags = FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_LAST;
+	struct ext4_iloc iloc;
+	__u64 physical;
+	int error = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline = 0;
+		goto out;
+	}
+
+	error = ext4_get_inode_loc(inode, &iloc);
+	if (error)
+		goto out;
+
+	physical = (__u64)iloc.bh->b_blocknr << inode->i_sb->s_blocksize_bits;
+	physical += (char *)ext4_raw_inode(&iloc) - iloc.bh->b_data;
+	physical += offsetof(struct ext4_inode, i_block);
+	brelse(iloc.bh);
+
+	error = fiemap_fill_next_extent(fieinfo, 0, physical,
+					i_size_read(inode), flags);
+out:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	return error < 0 ? error : 0;
+}
+
+/*
+ * Directories
+ */
+
+/*
+ * Set up an empty inline directory: the parent in front of a single
+ * unused entry that covers the rest of i_block.  Returns -ENOSPC if the
+ * directory needs a block.
+ */
+int ext4_try_create_inline_dir(handle_t *handle, struct inode *parent,
+			       struct inode *inode)
+{
+	unsigned int blocksize = inode->i_sb->s_blocksize;
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	ret = ext4_prepare_inline_data(handle, inode, &iloc,
+				       EXT4_MIN_INLINE_DATA_SIZE);
+	if (ret)
+		goto out;
+
+	de = (struct ext4_dir_entry_2 *)ext4_raw_inode(&iloc)->i_block;
+	de->inode = cpu_to_le32(parent->i_ino);
+	de = (struct ext4_dir_entry_2 *)((void *)de + EXT4_INLINE_DOTDOT_SIZE);
+	de->inode = 0;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_MIN_INLINE_DATA_SIZE -
+					   EXT4_INLINE_DOTDOT_SIZE, blocksize);
+	set_nlink(inode, 2);
+	inode->i_size = EXT4_I(inode)->i_disksize = EXT4_MIN_INLINE_DATA_SIZE;
+out:
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * Return the entry at offset (counted from the start of i_block) and
+ * the area, i_block or the xattr value, it lives in.
+ */
+static struct ext4_dir_entry_2 *
+ext4_get_inline_entry(struct inode *inode, struct ext4_iloc *iloc,
+		      unsigned int offset, void **inline_start,
+		      int *inline_size)
+{
+	void *inline_pos;
+
+	BUG_ON(offset > ext4_get_inline_size(inode));
+
+	if (offset < EXT4_MIN_INLINE_DATA_SIZE) {
+		inline_pos = (void *)ext4_raw_inode(iloc)->i_block;
+		*inline_size = EXT4_MIN_INLINE_DATA_SIZE;
+	} else {
+		inline_pos = ext4_get_inline_xattr_pos(inode, iloc);
+		offset -= EXT4_MIN_INLINE_DATA_SIZE;
+		*inline_size = ext4_get_inline_size(inode) -
+				EXT4_MIN_INLINE_DATA_SIZE;
+	}
+
+	*inline_start = inline_pos;
+	return (struct ext4_dir_entry_2 *)(inline_pos + offset);
+}
+
+/* Returns 1 if the entry was added. */
+static int ext4_add_dirent_to_inline(handle_t *handle,
+				     struct dentry *dentry,
+				     struct inode *inode,
+				     struct ext4_iloc *iloc,
+				     void *inline_start, int inline_size)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	const char *name = (const char *)dentry->d_name.name;
+	int namelen = dentry->d_name.len;
+	struct ext4_dir_entry_2 *de;
+	int err;
+
+	err = ext4_find_dest_de(dir, inode, iloc->bh, inline_start,
+				inline_size, name, namelen, &de);
+	if (err)
+		return err;
+
+	BUFFER_TRACE(iloc->bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, iloc->bh);
+	if (err)
+		return err;
+	ext4_insert_dentry(inode, de, dir->i_sb->s_blocksize, name, namelen);
+
+	/*
+	 * XXX shouldn't update any times until successful
+	 * completion of syscall, but too many callers depend
+	 * on this.
+	 */
+	dir->i_mtime = dir->i_ctime = ext4_current_time(dir);
+	dir->i_version++;
+	return 1;
+}
+
+/*
+ * Grow system.data of a directory as far as the inode allows, and cover
+ * the new space with an unused entry.
+ */
+static int ext4_update_inline_dir(handle_t *handle, struct inode *dir,
+				  struct ext4_iloc *iloc)
+{
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	struct ext4_dir_entry_2 *de;
+	int old_size, new_size, ret;
+
+	old_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	new_size = get_max_inline_xattr_value_size(dir, iloc);
+	if (new_size - old_size < EXT4_DIR_REC_LEN(1))
+		return -ENOSPC;
+
+	ret = ext4_update_inline_data(handle, dir, iloc,
+				      new_size + EXT4_MIN_INLINE_DATA_SIZE);
+	if (ret)
+		return ret;
+
+	de = ext4_get_inline_xattr_pos(dir, iloc) + old_size;
+	de->inode = 0;
+	de->name_len = 0;
+	de->rec_len = ext4_rec_len_to_disk(ext4_get_inline_size(dir) -
+					   EXT4_MIN_INLINE_DATA_SIZE -
+					   old_size, blocksize);
+
+	dir->i_size = EXT4_I(dir)->i_disksize = ext4_get_inline_size(dir);
+	return 0;
+}
+
+/*
+ * Put back the inline data of a directory whose conversion to a block
+ * failed.
+ */
+static void ext4_restore_inline_data(handle_t *handle, struct inode *inode,
+				     struct ext4_iloc *iloc,
+				     void *buf, int inline_size)
+{
+	ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	if (ext4_create_inline_data(handle, inode, iloc, inline_size))
+		return;
+	ext4_write_inline_data(inode, iloc, buf, 0, inline_size);
+	inode->i_size = EXT4_I(inode)->i_disksize = inline_size;
+}
+
+/*
+ * Move an inline directory into its first block: "." and "..", then the
+ * entries from i_block and the xattr, the last one stretched to the end
+ * of the block.  Called with xattr_sem held for writing.
+ */
+static int ext4_convert_inline_dir(handle_t *handle, struct inode *dir,
+				   struct ext4_iloc *iloc)
+{
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	int inline_size = ext4_get_inline_size(dir);
+	struct buffer_head *bh = NULL;
+	struct ext4_dir_entry_2 *de, *top;
+	unsigned int offset, rlen;
+	int csum_size = 0;
+	int err;
+	void *buf;
+
+	if (EXT4_HAS_RO_COMPAT_FEATURE(dir->i_sb,
+				       EXT4_FEATURE_RO_COMPAT_METADATA_CSUM))
+		csum_size = sizeof(struct ext4_dir_entry_tail);
+
+	buf = kmalloc(inline_size, GFP_NOFS);
+	if (!buf)
+		return -ENOMEM;
+
+	err = ext4_read_inline_data(dir, buf, inline_size, iloc);
+	if (err < 0)
+		goto out;
+
+	err = ext4_destroy_inline_data_nolock(handle, dir);
+	if (err)
+		goto out;
+
+	dir->i_size = EXT4_I(dir)->i_disksize = 0;
+	bh = ext4_bread(handle, dir, 0, 1, &err);
+	if (!bh)
+		goto out_restore;
+
+	BUFFER_TRACE(bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, bh);
+	if (err)
+		goto out_restore;
+
+	memset(bh->b_data, 0, blocksize);
+	top = ext4_init_dot_dotdot(dir, (struct ext4_dir_entry_2 *)bh->b_data,
+				   blocksize, csum_size,
+				   le32_to_cpu(((struct ext4_dir_entry_2 *)
+						buf)->inode), 1);
+	memcpy(top, buf + EXT4_INLINE_DOTDOT_SIZE,
+	       inline_size - EXT4_INLINE_DOTDOT_SIZE);
+
+	/* Find the last entry and stretch it to the end of the block. */
+	de = top;
+	offset = (char *)top - bh->b_data;
+	for (;;) {
+		if (ext4_check_dir_entry(dir, NULL, de, bh, bh->b_data,
+					 blocksize - csum_size, offset)) {
+			err = -EIO;
+			goto out_restore;
+		}
+		rlen = ext4_rec_len_from_disk(de->rec_len, blocksize);
+		if (offset + rlen >= (char *)top - bh->b_data + inline_size -
+				     EXT4_INLINE_DOTDOT_SIZE)
+			break;
+		offset += rlen;
+		de = (struct ext4_dir_entry_2 *)(bh->b_data + offset);
+	}
+	de->rec_len = ext4_rec_len_to_disk(blocksize - csum_size - offset,
+					   blocksize);
+
+	if (csum_size)
+		initialize_dirent_tail(EXT4_DIRENT_TAIL(bh->b_data, blocksize),
+				       blocksize);
+
+	set_buffer_uptodate(bh);
+	BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
+	err = ext4_handle_dirty_dirent_node(handle, dir, bh);
+	if (err)
+		goto out_restore;
+	set_buffer_verified(bh);
+
+	dir->i_size = EXT4_I(dir)->i_disksize = blocksize;
+	err = ext4_mark_inode_dirty(handle, dir);
+	goto out;
+
+out_restore:
+	ext4_restore_inline_data(handle, dir, iloc, buf, inline_size);
+out:
+	brelse(bh);
+	kfree(buf);
+	return err;
+}
+
+/*
+ * Add an entry to an inline directory.  Returns 1 if it was added, 0 if
+ * the directory is (now) block based and the caller has to add it there,
+ * or a negative error.
+ */
+int ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+			      struct inode *inode)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int ret, no_expand;
+
+	ret = ext4_get_inode_loc(dir, &iloc);
+	if (ret)
+		return ret;
+
+	ext4_write_lock_xattr(dir, &no_expand);
+	if (!ext4_has_inline_data(dir))
+		goto out;
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block +
+			EXT4_INLINE_DOTDOT_SIZE;
+	inline_size = EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE;
+
+	ret = ext4_add_dirent_to_inline(handle, dentry, inode, &iloc,
+					inline_start, inline_size);
+	if (ret != -ENOSPC)
+		goto out;
+
+	/* Try the xattr, growing it first if it is still empty. */
+	inline_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	if (!inline_size) {
+		ret = ext4_update_inline_dir(handle, dir, &iloc);
+		if (ret && ret != -ENOSPC)
+			goto out;
+		inline_size = ext4_get_inline_size(dir) -
+				EXT4_MIN_INLINE_DATA_SIZE;
+	}
+
+	if (inline_size) {
+		inline_start = ext4_get_inline_xattr_pos(dir, &iloc);
+		ret = ext4_add_dirent_to_inline(handle, dentry, inode, &iloc,
+						inline_start, inline_size);
+		if (ret != -ENOSPC)
+			goto out;
+	}
+
+	/* The inode is full, the directory needs a block. */
+	ret = ext4_convert_inline_dir(handle, dir, &iloc);
+out:
+	ext4_write_unlock_xattr(dir, &no_expand);
+	if (ret > 0)
+		ret = ext4_mark_inode_dirty(handle, dir) ? : 1;
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * Look up name in an inline directory.  ".." is answered with i_block
+ * itself, whose first word is the inode number of the parent.  The
+ * returned buffer is the inode table block.
+ */
+struct buffer_head *ext4_find_inline_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir,
+					   int *has_inline_data)
+{
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int ret;
+
+	if (ext4_get_inode_loc(dir, &iloc))
+		return NULL;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	if (d_name->len == 2 && !memcmp(d_name->name, "..", 2)) {
+		*res_dir = (struct ext4_dir_entry_2 *)
+				ext4_raw_inode(&iloc)->i_block;
+		goto out_find;
+	}
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block +
+			EXT4_INLINE_DOTDOT_SIZE;
+	inline_size = EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE;
+	ret = search_dir(iloc.bh, inline_start, inline_size, dir, d_name,
+			 0, res_dir);
+	if (ret == 1)
+		goto out_find;
+	if (ret < 0)
+		goto out;
+
+	inline_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	if (!inline_size)
+		goto out;
+
+	inline_start = ext4_get_inline_xattr_pos(dir, &iloc);
+	ret = search_dir(iloc.bh, inline_start, inline_size, dir, d_name,
+			 0, res_dir);
+	if (ret == 1)
+		goto out_find;
+out:
+	brelse(iloc.bh);
+	iloc.bh = NULL;
+out_find:
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return iloc.bh;
+}
+
+int ext4_delete_inline_entry(handle_t *handle, struct inode *dir,
+			     struct ext4_dir_entry_2 *de_del,
+			     struct buffer_head *bh, int *has_inline_data)
+{
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int err, no_expand;
+
+	err = ext4_get_inode_loc(dir, &iloc);
+	if (err)
+		return err;
+
+	ext4_write_lock_xattr(dir, &no_expand);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	if ((void *)de_del - (void *)ext4_raw_inode(&iloc)->i_block <
+	    EXT4_MIN_INLINE_DATA_SIZE) {
+		inline_start = (void *)ext4_raw_inode(&iloc)->i_block +
+				EXT4_INLINE_DOTDOT_SIZE;
+		inline_size = EXT4_MIN_INLINE_DATA_SIZE -
+				EXT4_INLINE_DOTDOT_SIZE;
+	} else {
+		inline_start = ext4_get_inline_xattr_pos(dir, &iloc);
+		inline_size = ext4_get_inline_size(dir) -
+				EXT4_MIN_INLINE_DATA_SIZE;
+	}
+
+	BUFFER_TRACE(bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, bh);
+	if (err)
+		goto out;
+
+	err = ext4_generic_delete_entry(handle, dir, de_del, bh,
+					inline_start, inline_size, 0);
+	if (err)
+		goto out;
+
+	err = ext4_mark_inode_dirty(handle, dir);
+out:
+	ext4_write_unlock_xattr(dir, &no_expand);
+	brelse(iloc.bh);
+	if (err && err != -ENOENT)
+		ext4_std_error(dir->i_sb, err);
+	return err;
+}
+
+/* Returns 1 if the inline directory is empty, as empty_dir() does. */
+int empty_inline_dir(struct inode *dir, int *has_inline_data)
+{
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	unsigned int offset;
+	void *inline_pos;
+	int inline_size;
+	int err, ret = 1;
+
+	err = ext4_get_inode_loc(dir, &iloc);
+	if (err) {
+		EXT4_ERROR_INODE(dir, "error %d getting inode block", err);
+		return 1;
+	}
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	de = (struct ext4_dir_entry_2 *)ext4_raw_inode(&iloc)->i_block;
+	if (!le32_to_cpu(de->inode)) {
+		ext4_warning(dir->i_sb,
+			     "bad inline directory (dir #%lu) - no `..'",
+			     dir->i_ino);
+		goto out;
+	}
+
+	offset = EXT4_INLINE_DOTDOT_SIZE;
+	while (offset < ext4_get_inline_size(dir)) {
+		de = ext4_get_inline_entry(dir, &iloc, offset,
+					   &inline_pos, &inline_size);
+		if (ext4_check_dir_entry(dir, NULL, de, iloc.bh, inline_pos,
+					 inline_size, offset)) {
+			ext4_warning(dir->i_sb,
+				     "bad inline directory (dir #%lu) - "
+				     "inode %u, rec_len %u, name_len %d, "
+				     "inline size %d",
+				     dir->i_ino, le32_to_cpu(de->inode),
+				     le16_to_cpu(de->rec_len), de->name_len,
+				     inline_size);
+			goto out;
+		}
+		if (le32_to_cpu(de->inode)) {
+			ret = 0;
+			goto out;
+		}
+		offset += ext4_rec_len_from_disk(de->rec_len,
+						 dir->i_sb->s_blocksize);
+	}
+out:
+	up_read(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * For ext4_rename(): the buffer holding the parent of an inline
+ * directory, and a fake ".." entry whose inode field is that parent.
+ */
+struct buffer_head *ext4_get_first_inline_block(struct inode *inode,
+					struct ext4_dir_entry_2 **parent_de,
+					int *retval)
+{
+	struct ext4_iloc iloc;
+
+	*retval = ext4_get_inode_loc(inode, &iloc);
+	if (*retval)
+		return NULL;
+
+	*parent_de = (struct ext4_dir_entry_2 *)ext4_raw_inode(&iloc)->i_block;
+	return iloc.bh;
+}
+
+/* Copy the whole inline directory, taken under xattr_sem. */
+static void *ext4_get_inline_dir_copy(struct inode *inode, int *inline_size,
+				      int *has_inline_data, int *err)
+{
+	struct ext4_iloc iloc;
+	void *buf = NULL;
+
+	*err = ext4_get_inode_loc(inode, &iloc);
+	if (*err)
+		return NULL;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	*inline_size = ext4_get_inline_size(inode);
+	buf = kmalloc(*inline_size, GFP_NOFS);
+	if (!buf) {
+		*err = -ENOMEM;
+		goto out;
+	}
+	ext4_read_inline_data(inode, buf, *inline_size, &iloc);
+out:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	brelse(iloc.bh);
+	return buf;
+}
+
+/*
+ * readdir() positions of an inline directory are those it would have
+ * once converted to a block: "." at 0, ".." right after it, and the
+ * entries from EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2) on.  Thus a
+ * conversion between two calls does not disturb a readdir in progress.
+ */
+#define INLINE_DOTDOT_POS	EXT4_DIR_REC_LEN(1)
+#define INLINE_ENTRIES_POS	(EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2))
+#define INLINE_POS_SHIFT	(INLINE_ENTRIES_POS - EXT4_INLINE_DOTDOT_SIZE)
+
+int ext4_read_inline_dir(struct file *filp, void *dirent, filldir_t filldir,
+			 int *has_inline_data)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct super_block *sb = inode->i_sb;
+	unsigned int blocksize = sb->s_blocksize;
+	struct ext4_dir_entry_2 *de;
+	unsigned int parent_ino, offset, rlen;
+	int inline_size, end, err = 0;
+	void *buf;
+
+	buf = ext4_get_inline_dir_copy(inode, &inline_size, has_inline_data,
+				       &err);
+	if (!buf)
+		return err;
+
+	parent_ino = le32_to_cpu(((struct ext4_dir_entry_2 *)buf)->inode);
+	end = inline_size + INLINE_POS_SHIFT;
+
+	/*
+	 * If the directory changed since the last call, f_pos may point
+	 * into the middle of an entry.  Move it to the next entry boundary.
+	 */
+	if (filp->f_version != inode->i_version) {
+		if (filp->f_pos > INLINE_DOTDOT_POS &&
+		    filp->f_pos < INLINE_ENTRIES_POS)
+			filp->f_pos = INLINE_ENTRIES_POS;
+		else if (filp->f_pos > INLINE_ENTRIES_POS) {
+			offset = EXT4_INLINE_DOTDOT_SIZE;
+			while (offset + INLINE_POS_SHIFT < filp->f_pos &&
+			       offset < inline_size) {
+				de = (struct ext4_dir_entry_2 *)(buf + offset);
+				rlen = ext4_rec_len_from_disk(de->rec_len,
+							      blocksize);
+				/* Caught by ext4_check_dir_entry() below. */
+				if (rlen < EXT4_DIR_REC_LEN(1))
+					break;
+				offset += rlen;
+			}
+			filp->f_pos = offset + INLINE_POS_SHIFT;
+		}
+		filp->f_version = inode->i_version;
+	}
+
+	while (filp->f_pos < end) {
+		if (filp->f_pos == 0) {
+			if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR))
+				break;
+			filp->f_pos = INLINE_DOTDOT_POS;
+			continue;
+		}
+		if (filp->f_pos == INLINE_DOTDOT_POS) {
+			if (filldir(dirent, "..", 2, INLINE_DOTDOT_POS,
+				    parent_ino, DT_DIR))
+				break;
+			filp->f_pos = INLINE_ENTRIES_POS;
+			continue;
+		}
+
+		offset = filp->f_pos - INLINE_POS_SHIFT;
+		de = (struct ext4_dir_entry_2 *)(buf + offset);
+		if (ext4_check_dir_entry(inode, filp, de, NULL, buf,
+					 inline_size, offset)) {
+			/* Skip the rest of the directory. */
+			filp->f_pos = end;
+			break;
+		}
+		if (le32_to_cpu(de->inode)) {
+			if (filldir(dirent, de->name, de->name_len,
+				    filp->f_pos, le32_to_cpu(de->inode),
+				    get_dtype(sb, de->file_type)))
+				break;
+		}
+		filp->f_pos += ext4_rec_len_from_disk(de->rec_len, blocksize);
+	}
+
+	kfree(buf);
+	return 0;
+}
+
+/*
+ * The htree readdir path for an inline directory: feed all its entries,
+ * including "." and "..", into the rbtree of the open file.
+ */
+int htree_inlinedir_to_tree(struct file *dir_file, struct inode *dir,
+			    struct dx_hash_info *hinfo,
+			    __u32 start_hash, __u32 start_minor_hash,
+			    int *has_inline_data)
+{
+	struct ext4_dir_entry_2 fake, *de;
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	unsigned int offset = 0;
+	int inline_size, count = 0, err = 0;
+	void *buf;
+
+	buf = ext4_get_inline_dir_copy(dir, &inline_size, has_inline_data,
+				       &err);
+	if (!buf)
+		return err;
+
+	memset(&fake, 0, sizeof(fake));
+	fake.file_type = EXT4_FT_DIR;
+
+	while (offset < inline_size) {
+		if (offset == 0) {
+			/* "." and ".." both come from the first word */
+			fake.inode = cpu_to_le32(dir->i_ino);
+			fake.name_len = 1;
+			strcpy(fake.name, ".");
+			de = &fake;
+			offset = 1;
+		} else if (offset == 1) {
+			fake.inode = ((struct ext4_dir_entry_2 *)buf)->inode;
+			fake.name_len = 2;
+			strcpy(fake.name, "..");
+			de = &fake;
+			offset = EXT4_INLINE_DOTDOT_SIZE;
+		} else {
+			de = (struct ext4_dir_entry_2 *)(buf + offset);
+			if (ext4_check_dir_entry(dir, dir_file, de, NULL, buf,
+						 inline_size, offset))
+				break;
+			offset += ext4_rec_len_from_disk(de->rec_len,
+							 blocksize);
+		}
+
+		ext4fs_dirhash(de->name, de->name_len, hinfo);
+		if ((hinfo->hash < start_hash) ||
+		    ((hinfo->hash == start_hash) &&
+		     (hinfo->minor_hash < start_minor_hash)))
+			continue;
+		if (de->inode == 0)
+			continue;
+		err = ext4_htree_store_dirent(dir_file, hinfo->hash,
+					      hinfo->minor_hash, de);
+		if (err) {
+			count = err;
+			break;
+		}
+		count++;
+	}
+
+	kfree(buf);
+	return count;
+}
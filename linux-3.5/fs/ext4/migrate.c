@@ -455,6 +455,10 @@ int ext4_ext_migrate(struct inode *inode)
 		 */
 		return retval;
 
+	/* i_block holds inline data, there is no block map to convert */
+	if (ext4_has_inline_data(inode))
+		return -EOPNOTSUPP;
+
 	handle = ext4_journal_start(inode,
 					EXT4_DATA_TRANS_BLOCKS(inode->i_sb) +
 					EXT4_INDEX_EXTRA_TRANS_BLOCKS + 3 +
@@ -21,6 +21,10 @@
 #define EXT4_XATTR_INDEX_TRUSTED		4
 #define	EXT4_XATTR_INDEX_LUSTRE			5
 #define EXT4_XATTR_INDEX_SECURITY	        6
+#define EXT4_XATTR_INDEX_SYSTEM			7
+
+/* Name of the system.data attribute holding inline file data */
+#define EXT4_XATTR_SYSTEM_DATA		"data"
 
 struct ext4_xattr_header {
 	__le32	h_magic;	/* magic number for identification */
@@ -64,6 +68,27 @@ struct ext4_xattr_entry {
 		EXT4_GOOD_OLD_INODE_SIZE + \
 		EXT4_I(inode)->i_extra_isize))
 #define IFIRST(hdr) ((struct ext4_xattr_entry *)((hdr)+1))
+#define IS_LAST_ENTRY(entry) (*(__u32 *)(entry) == 0)
+
+struct ext4_xattr_info {
+	int name_index;
+	const char *name;
+	const void *value;
+	size_t value_len;
+};
+
+struct ext4_xattr_search {
+	struct ext4_xattr_entry *first;
+	void *base;
+	void *end;
+	struct ext4_xattr_entry *here;
+	int not_found;
+};
+
+struct ext4_xattr_ibody_find {
+	struct ext4_xattr_search s;
+	struct ext4_iloc iloc;
+};
 
 # ifdef CONFIG_EXT4_FS_XATTR
 
@@ -90,6 +115,61 @@ extern void ext4_exit_xattr(void);
 
 extern const struct xattr_handler *ext4_xattr_handlers[];
 
+extern int ext4_xattr_ibody_find(struct inode *inode, struct ext4_xattr_info *i,
+				 struct ext4_xattr_ibody_find *is);
+extern int ext4_xattr_ibody_get(struct inode *inode, int name_index,
+				const char *name,
+				void *buffer, size_t buffer_size);
+extern int ext4_xattr_ibody_set(handle_t *handle, struct inode *inode,
+				struct ext4_xattr_info *i,
+				struct ext4_xattr_ibody_find *is);
+
+/* inline.c */
+extern int ext4_find_inline_data_nolock(struct inode *inode,
+					struct ext4_iloc *iloc);
+extern int ext4_readpage_inline(struct inode *inode, struct page *page);
+extern int ext4_try_to_write_inline_data(struct address_space *mapping,
+					 struct inode *inode,
+					 loff_t pos, unsigned len,
+					 unsigned flags,
+					 struct page **pagep);
+extern int ext4_write_inline_data_end(struct inode *inode,
+				      loff_t pos, unsigned len,
+				      unsigned copied,
+				      struct page *page);
+extern int ext4_convert_inline_data(struct inode *inode);
+extern void ext4_inline_data_truncate(struct inode *inode, int *has_inline);
+extern int ext4_inline_data_fiemap(struct inode *inode,
+				   struct fiemap_extent_info *fieinfo,
+				   int *has_inline);
+
+extern int ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+				     struct inode *inode);
+extern int ext4_try_create_inline_dir(handle_t *handle,
+				      struct inode *parent,
+				      struct inode *inode);
+extern int ext4_read_inline_dir(struct file *filp,
+				void *dirent, filldir_t filldir,
+				int *has_inline_data);
+extern int htree_inlinedir_to_tree(struct file *dir_file,
+				   struct inode *dir,
+				   struct dx_hash_info *hinfo,
+				   __u32 start_hash, __u32 start_minor_hash,
+				   int *has_inline_data);
+extern struct buffer_head *ext4_find_inline_entry(struct inode *dir,
+					const struct qstr *d_name,
+					struct ext4_dir_entry_2 **res_dir,
+					int *has_inline_data);
+extern int ext4_delete_inline_entry(handle_t *handle,
+				    struct inode *dir,
+				    struct ext4_dir_entry_2 *de_del,
+				    struct buffer_head *bh,
+				    int *has_inline_data);
+extern int empty_inline_dir(struct inode *dir, int *has_inline_data);
+extern struct buffer_head *ext4_get_first_inline_block(struct inode *inode,
+					struct ext4_dir_entry_2 **parent_de,
+					int *retval);
+
 # else  /* CONFIG_EXT4_FS_XATTR */
 
 static inline int
@@ -143,6 +223,116 @@ ext4_expand_extra_isize_ea(struct inode *inode, int new_extra_isize,
 
 #define ext4_xattr_handlers	NULL
 
+static inline int
+ext4_find_inline_data_nolock(struct inode *inode, struct ext4_iloc *iloc)
+{
+	return 0;
+}
+
+static inline int
+ext4_readpage_inline(struct inode *inode, struct page *page)
+{
+	return -EAGAIN;
+}
+
+static inline int
+ext4_try_to_write_inline_data(struct address_space *mapping,
+			      struct inode *inode, loff_t pos, unsigned len,
+			      unsigned flags, struct page **pagep)
+{
+	return 0;
+}
+
+static inline int
+ext4_write_inline_data_end(struct inode *inode, loff_t pos, unsigned len,
+			   unsigned copied, struct page *page)
+{
+	return -EIO;
+}
+
+static inline int ext4_convert_inline_data(struct inode *inode)
+{
+	return 0;
+}
+
+static inline void
+ext4_inline_data_truncate(struct inode *inode, int *has_inline)
+{
+	*has_inline = 0;
+}
+
+static inline int
+ext4_inline_data_fiemap(struct inode *inode,
+			struct fiemap_extent_info *fieinfo, int *has_inline)
+{
+	*has_inline = 0;
+	return 0;
+}
+
+static inline int
+ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+			  struct inode *inode)
+{
+	return 0;
+}
+
+static inline int
+ext4_try_create_inline_dir(handle_t *handle, struct inode *parent,
+			   struct inode *inode)
+{
+	return 0;
+}
+
+static inline int
+ext4_read_inline_dir(struct file *filp, void *dirent, filldir_t filldir,
+		     int *has_inline_data)
+{
+	*has_inline_data = 0;
+	return 0;
+}
+
+static inline int
+htree_inlinedir_to_tree(struct file *dir_file, struct inode *dir,
+			struct dx_hash_info *hinfo,
+			__u32 start_hash, __u32 start_minor_hash,
+			int *has_inline_data)
+{
+	*has_inline_data = 0;
+	return 0;
+}
+
+static inline struct buffer_head *
+ext4_find_inline_entry(struct inode *dir, const struct qstr *d_name,
+		       struct ext4_dir_entry_2 **res_dir,
+		       int *has_inline_data)
+{
+	*has_inline_data = 0;
+	return NULL;
+}
+
+static inline int
+ext4_delete_inline_entry(handle_t *handle, struct inode *dir,
+			 struct ext4_dir_entry_2 *de_del,
+			 struct buffer_head *bh, int *has_inline_data)
+{
+	*has_inline_data = 0;
+	return 0;
+}
+
+static inline int empty_inline_dir(struct inode *dir, int *has_inline_data)
+{
+	*has_inline_data = 0;
+	return 0;
+}
+
+static inline struct buffer_head *
+ext4_get_first_inline_block(struct inode *inode,
+			    struct ext4_dir_entry_2 **parent_de, int *retval)
+{
+	*retval = -EIO;
+	return NULL;
+}
+
 # endif  /* CONFIG_EXT4_FS_XATTR */
 
 #ifdef CONFIG_EXT4_FS_SECURITY
@@ -27,6 +27,8 @@
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/tracepoint.h>
+#include <linux/hash.h>
+#include <linux/workqueue.h>
 #include "internal.h"
 
 /*
@@ -52,6 +54,45 @@ struct wb_writeback_work {
 	struct completion *done;	/* set if the caller waits */
 };
 
+/*
+ * Number of inodes a writeback worker is handed per batch
+ */
+#define WB_WORKER_BATCH		16
+
+/*
+ * A writeback worker writes the inodes the flusher hands to it, one
+ * after the other.  Different workers run in parallel.
+ */
+struct wb_worker {
+	struct wb_worker_pool *pool;
+	struct work_struct work;
+	unsigned int nr_inodes;
+	struct inode *inodes[WB_WORKER_BATCH];
+};
+
+/*
+ * Pool of writeback workers of a bdi_writeback.  It is only used by
+ * the thread doing writeback for the bdi_writeback, which also
+ * creates and frees it.
+ *
+ * The flusher hands a batch of inodes from b_io to the workers, moving
+ * them to b_busy, and waits for the batch to finish.  The workers
+ * requeue the inodes themselves.  @work, @chunk and @wrote are
+ * protected by wb->list_lock while a batch runs.
+ */
+struct wb_worker_pool {
+	struct bdi_writeback *wb;
+	struct wb_writeback_work *work;	/* work the batch is done for */
+	long chunk;			/* pages per inode */
+	long wrote;			/* pages and inodes written */
+	atomic_t busy;			/* workers still running */
+	wait_queue_head_t wait;		/* flusher waits for !busy */
+	unsigned int nr_workers;
+	struct wb_worker workers[0];
+};
+
+static struct workqueue_struct *wb_worker_wq;
+
 /*
  * We don't actually have pdflush, but this one is exported though /proc...
  */
@@ -79,6 +120,11 @@ static inline struct backing_dev_info *inode_to_bdi(struct inode *inode)
 	return sb->s_bdi;
 }
 
+static inline struct bdi_writeback *inode_to_wb(struct inode *inode)
+{
+	return bdi_inode_wb(inode_to_bdi(inode), inode);
+}
+
 static inline struct inode *wb_inode(struct list_head *head)
 {
 	return list_entry(head, struct inode, i_wb_list);
@@ -191,11 +237,11 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
  */
 void inode_wb_list_del(struct inode *inode)
 {
-	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct bdi_writeback *wb = inode_to_wb(inode);
 
-	spin_lock(&bdi->wb.list_lock);
+	spin_lock(&wb->list_lock);
 	list_del_init(&inode->i_wb_list);
-	spin_unlock(&bdi->wb.list_lock);
+	spin_unlock(&wb->list_lock);
 }
 
 /*
@@ -378,9 +424,10 @@ static void inode_sleep_on_writeback(struct inode *inode)
  * Find proper writeback list for the inode depending on its current state and
  * possibly also change of its state while we were doing writeback.  Here we
  * handle things such as livelock prevention or fairness of writeback among
- * inodes. This function can be called only by flusher thread - noone else
- * processes all inodes in writeback lists and requeueing inodes behind flusher
- * thread's back can have unexpected consequences.
+ * inodes. This function can be called only by flusher thread, or by the
+ * writeback workers it waits for - noone else processes all inodes in
+ * writeback lists and requeueing inodes behind flusher thread's back can
+ * have unexpected consequences.
  */
 static void requeue_inode(struct inode *inode, struct bdi_writeback *wb,
 			  struct writeback_control *wbc)
@@ -548,9 +595,11 @@ out:
 	return ret;
 }
 
-static long writeback_chunk_size(struct backing_dev_info *bdi,
+static long writeback_chunk_size(struct bdi_writeback *wb,
 				 struct wb_writeback_work *work)
 {
+	struct backing_dev_info *bdi = wb->bdi;
+	unsigned int nr_workers = wb->pool ? wb->pool->nr_workers : 1;
 	long pages;
 
 	/*
@@ -565,11 +614,14 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
 	 *              write_cache_pages()     <== called once for each inode
 	 *                   (quickly) tag currently dirty pages
 	 *                   (maybe slowly) sync all tagged pages
+	 *
+	 * With several workers, each one gets its share of the device
+	 * bandwidth, so that a slice still takes about half a second.
 	 */
 	if (work->sync_mode == WB_SYNC_ALL || work->tagged_writepages)
 		pages = LONG_MAX;
 	else {
-		pages = min(bdi->avg_write_bandwidth / 2,
+		pages = min(bdi->avg_write_bandwidth / 2 / nr_workers,
 			    global_dirty_limit / DIRTY_SCOPE);
 		pages = min(pages, work->nr_pages);
 		pages = round_down(pages + MIN_WRITEBACK_PAGES,
@@ -579,6 +631,148 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
 	return pages;
 }
 
+static void wb_init_wbc(struct writeback_control *wbc,
+			struct wb_writeback_work *work)
+{
+	memset(wbc, 0, sizeof(*wbc));
+	wbc->sync_mode		= work->sync_mode;
+	wbc->tagged_writepages	= work->tagged_writepages;
+	wbc->for_kupdate	= work->for_kupdate;
+	wbc->for_background	= work->for_background;
+	wbc->range_cyclic	= work->range_cyclic;
+	wbc->range_start	= 0;
+	wbc->range_end		= LLONG_MAX;
+}
+
+/*
+ * Write back the inodes handed to a worker, and requeue them the way
+ * writeback_sb_inodes() does.
+ */
+static void wb_worker_fn(struct work_struct *w)
+{
+	struct wb_worker *worker = container_of(w, struct wb_worker, work);
+	struct wb_worker_pool *pool = worker->pool;
+	struct bdi_writeback *wb = pool->wb;
+	struct writeback_control wbc;
+	unsigned int i;
+
+	current->flags |= PF_SWAPWRITE;
+
+	for (i = 0; i < worker->nr_inodes; i++) {
+		struct inode *inode = worker->inodes[i];
+		long written;
+
+		wb_init_wbc(&wbc, pool->work);
+		wbc.nr_to_write = pool->chunk;
+
+		__writeback_single_inode(inode, wb, &wbc);
+
+		written = pool->chunk - wbc.nr_to_write;
+		spin_lock(&wb->list_lock);
+		pool->work->nr_pages -= written;
+		pool->wrote += written;
+		spin_lock(&inode->i_lock);
+		if (!(inode->i_state & I_DIRTY))
+			pool->wrote++;
+		requeue_inode(inode, wb, &wbc);
+		inode_sync_complete(inode);
+		spin_unlock(&inode->i_lock);
+		spin_unlock(&wb->list_lock);
+		cond_resched();
+	}
+	worker->nr_inodes = 0;
+
+	current->flags &= ~PF_SWAPWRITE;
+
+	if (atomic_dec_and_test(&pool->busy))
+		wake_up(&pool->wait);
+}
+
+/*
+ * Dirty inodes are partitioned among the workers by inode number, so
+ * a given inode is always written by the same worker.
+ */
+static struct wb_worker *wb_pick_worker(struct wb_worker_pool *pool,
+					struct inode *inode)
+{
+	unsigned long hash = hash_long(inode->i_ino, BITS_PER_LONG);
+
+	return &pool->workers[hash % pool->nr_workers];
+}
+
+/*
+ * Start the workers that have been handed inodes, and wait for all of
+ * them to finish.  Returns the number of pages and inodes written.
+ *
+ * Called with wb->list_lock held, releases and reacquires it.
+ */
+static long wb_run_workers(struct wb_worker_pool *pool)
+	__releases(pool->wb->list_lock)
+	__acquires(pool->wb->list_lock)
+{
+	struct bdi_writeback *wb = pool->wb;
+	unsigned int i;
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		struct wb_worker *worker = &pool->workers[i];
+
+		if (worker->nr_inodes) {
+			atomic_inc(&pool->busy);
+			queue_work(wb_worker_wq, &worker->work);
+		}
+	}
+
+	if (atomic_read(&pool->busy)) {
+		spin_unlock(&wb->list_lock);
+		wait_event(pool->wait, !atomic_read(&pool->busy));
+		spin_lock(&wb->list_lock);
+	}
+
+	return pool->wrote;
+}
+
+static void wb_free_pool(struct bdi_writeback *wb)
+{
+	kfree(wb->pool);
+	wb->pool = NULL;
+}
+
+/*
+ * Bring the worker pool in line with bdi->wb_workers.  A single worker
+ * means the flusher writes inodes itself, and if the pool can't be
+ * allocated it does the same.
+ */
+static void wb_update_pool(struct bdi_writeback *wb)
+{
+	unsigned int nr = ACCESS_ONCE(wb->bdi->wb_workers);
+	struct wb_worker_pool *pool;
+	unsigned int i;
+
+	if (!wb_worker_wq)
+		nr = 1;
+	if (nr == (wb->pool ? wb->pool->nr_workers : 1))
+		return;
+
+	wb_free_pool(wb);
+	if (nr <= 1)
+		return;
+
+	pool = kzalloc(sizeof(*pool) + nr * sizeof(struct wb_worker),
+		       GFP_KERNEL);
+	if (!pool)
+		return;
+
+	pool->wb = wb;
+	atomic_set(&pool->busy, 0);
+	init_waitqueue_head(&pool->wait);
+	pool->nr_workers = nr;
+	for (i = 0; i < nr; i++) {
+		pool->workers[i].pool = pool;
+		INIT_WORK(&pool->workers[i].work, wb_worker_fn);
+	}
+	wb->pool = pool;
+}
+
 /*
  * Write a portion of b_io inodes which belong to @sb.
  *
@@ -586,24 +780,29 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
  * inodes. Otherwise write only ones which go sequentially
  * in reverse order.
  *
+ * With a worker pool, the inodes are handed to the workers instead, up
+ * to a batch per worker or, unless every inode is written in full, the
+ * pages left to write, and written in parallel.
+ *
  * Return the number of pages and/or inodes written.
  */
 static long writeback_sb_inodes(struct super_block *sb,
 				struct bdi_writeback *wb,
 				struct wb_writeback_work *work)
 {
-	struct writeback_control wbc = {
-		.sync_mode		= work->sync_mode,
-		.tagged_writepages	= work->tagged_writepages,
-		.for_kupdate		= work->for_kupdate,
-		.for_background		= work->for_background,
-		.range_cyclic		= work->range_cyclic,
-		.range_start		= 0,
-		.range_end		= LLONG_MAX,
-	};
+	struct writeback_control wbc;
+	struct wb_worker_pool *pool = wb->pool;
 	unsigned long start_time = jiffies;
 	long write_chunk;
 	long wrote = 0;  /* count both pages and inodes */
+	long handed = 0; /* pages handed to workers */
+
+	wb_init_wbc(&wbc, work);
+	if (pool) {
+		pool->work = work;
+		pool->chunk = writeback_chunk_size(wb, work);
+		pool->wrote = 0;
+	}
 
 	while (!list_empty(&wb->b_io)) {
 		struct inode *inode = wb_inode(wb->b_io.prev);
@@ -653,6 +852,32 @@ static long writeback_sb_inodes(struct super_block *sb,
 			trace_writeback_sb_inodes_requeue(inode);
 			continue;
 		}
+		if (pool && !(inode->i_state & I_SYNC)) {
+			struct wb_worker *worker = wb_pick_worker(pool, inode);
+
+			if (worker->nr_inodes == WB_WORKER_BATCH) {
+				spin_unlock(&inode->i_lock);
+				break;
+			}
+			/* I_SYNC pins the inode, as below */
+			inode->i_state |= I_SYNC;
+			spin_unlock(&inode->i_lock);
+			list_move(&inode->i_wb_list, &wb->b_busy);
+			worker->inodes[worker->nr_inodes++] = inode;
+
+			/*
+			 * Integrity and tagged writeback write each inode
+			 * in full, so only the worker batches bound them.
+			 */
+			if (work->sync_mode == WB_SYNC_ALL ||
+			    work->tagged_writepages)
+				continue;
+			handed = min(handed, LONG_MAX - pool->chunk);
+			handed += pool->chunk;
+			if (handed >= work->nr_pages)
+				break;
+			continue;
+		}
 		spin_unlock(&wb->list_lock);
 
 		/*
@@ -670,7 +895,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 		inode->i_state |= I_SYNC;
 		spin_unlock(&inode->i_lock);
 
-		write_chunk = writeback_chunk_size(wb->bdi, work);
+		write_chunk = writeback_chunk_size(wb, work);
 		wbc.nr_to_write = write_chunk;
 		wbc.pages_skipped = 0;
 
@@ -701,6 +926,8 @@ static long writeback_sb_inodes(struct super_block *sb,
 				break;
 		}
 	}
+	if (pool)
+		wrote += wb_run_workers(pool);
 	return wrote;
 }
 
@@ -781,6 +1008,12 @@ static bool over_bground_thresh(struct backing_dev_info *bdi)
 static void wb_update_bandwidth(struct bdi_writeback *wb,
 				unsigned long start_time)
 {
+	/*
+	 * The bdi bandwidth is serialized by the bdi's own list_lock.  The
+	 * pages written for cgroups are caught up on by the next update.
+	 */
+	if (wb_is_cgwb(wb))
+		return;
 	__bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, start_time);
 }
 
@@ -894,6 +1127,72 @@ static long wb_writeback(struct bdi_writeback *wb,
 	return nr_pages - work->nr_pages;
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * Write back the inodes of the cgroup bdi_writebacks of @bdi, charging the
+ * IO to the cgroup owning them.  Inodes of cgroups already gone are
+ * written on behalf of the root cgroup.
+ */
+static long cgwb_writeback(struct backing_dev_info *bdi,
+			   struct wb_writeback_work *work)
+{
+	struct bdi_writeback *wb;
+	struct cgroup_subsys_state *blkcg_css;
+	struct list_head *pos;
+	long wrote = 0;
+
+	/*
+	 * Only the flusher removes entries from cgwb_list, so the one we
+	 * are at stays put while we drop the lock to write it.
+	 */
+	spin_lock_irq(&bdi->cgwb_lock);
+	for (pos = bdi->cgwb_list.next; pos != &bdi->cgwb_list;
+	     pos = pos->next) {
+		wb = list_entry(pos, struct bdi_writeback, bdi_node);
+		if (!wb_has_dirty_io(wb))
+			continue;
+		blkcg_css = wb->blkcg_css;
+		if (blkcg_css && !css_tryget(blkcg_css))
+			blkcg_css = NULL;
+		spin_unlock_irq(&bdi->cgwb_lock);
+
+		current->wb_blkcg_css = blkcg_css;
+		wrote += wb_writeback(wb, work);
+		current->wb_blkcg_css = NULL;
+		if (blkcg_css)
+			css_put(blkcg_css);
+
+		spin_lock_irq(&bdi->cgwb_lock);
+		if (work->nr_pages <= 0)
+			break;
+	}
+	spin_unlock_irq(&bdi->cgwb_lock);
+
+	return wrote;
+}
+#else
+static inline long cgwb_writeback(struct backing_dev_info *bdi,
+				  struct wb_writeback_work *work)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Do @work on @wb, and on the bdi_writebacks of the cgroups that dirtied
+ * inodes on the same bdi.
+ */
+static long wb_writeback_all(struct bdi_writeback *wb,
+			     struct wb_writeback_work *work)
+{
+	long wrote;
+
+	wrote = wb_writeback(wb, work);
+	if (work->nr_pages > 0)
+		wrote += cgwb_writeback(wb->bdi, work);
+	return wrote;
+}
+
 /*
  * Return the next wb_writeback_work struct that hasn't been processed yet.
  */
@@ -935,7 +1234,7 @@ static long wb_check_background_flush(struct bdi_writeback *wb)
 			.reason		= WB_REASON_BACKGROUND,
 		};
 
-		return wb_writeback(wb, &work);
+		return wb_writeback_all(wb, &work);
 	}
 
 	return 0;
@@ -969,7 +1268,7 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 			.reason		= WB_REASON_PERIODIC,
 		};
 
-		return wb_writeback(wb, &work);
+		return wb_writeback_all(wb, &work);
 	}
 
 	return 0;
@@ -985,6 +1284,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 	long wrote = 0;
 
 	set_bit(BDI_writeback_running, &wb->bdi->state);
+	wb_update_pool(wb);
 	while ((work = get_next_work_item(bdi)) != NULL) {
 		/*
 		 * Override sync mode, in case we must wait for completion
@@ -995,7 +1295,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 
 		trace_writeback_exec(bdi, work);
 
-		wrote += wb_writeback(wb, work);
+		wrote += wb_writeback_all(wb, work);
 
 		/*
 		 * Notify the caller of completion if this is a synchronous
@@ -1012,6 +1312,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 	 */
 	wrote += wb_check_old_data_flush(wb);
 	wrote += wb_check_background_flush(wb);
+	bdi_reap_cgwbs(bdi);
 	clear_bit(BDI_writeback_running, &wb->bdi->state);
 
 	return wrote;
@@ -1058,7 +1359,7 @@ int bdi_writeback_thread(void *data)
 			continue;
 		}
 
-		if (wb_has_dirty_io(wb) && dirty_writeback_interval)
+		if (bdi_has_dirty_io(bdi) && dirty_writeback_interval)
 			schedule_timeout(msecs_to_jiffies(dirty_writeback_interval * 10));
 		else {
 			/*
@@ -1074,10 +1375,25 @@ int bdi_writeback_thread(void *data)
 	if (!list_empty(&bdi->work_list))
 		wb_do_writeback(wb, 1);
 
+	wb_free_pool(wb);
+
 	trace_writeback_thread_stop(bdi);
 	return 0;
 }
 
+static int __init wb_worker_init(void)
+{
+	/*
+	 * Writeback workers clean pages for reclaim, so they need a
+	 * rescuer.  Without the workqueue the flusher threads write all
+	 * inodes themselves.
+	 */
+	wb_worker_wq = alloc_workqueue("writeback", WQ_MEM_RECLAIM | WQ_UNBOUND,
+				       0);
+	return 0;
+}
+fs_initcall(wb_worker_init);
+
 
 /*
  * Start writeback of `nr_pages' pages.  If `nr_pages' is zero, write back
@@ -1204,6 +1520,7 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
+			struct bdi_writeback *wb;
 			bool wakeup_bdi = false;
 			bdi = inode_to_bdi(inode);
 
@@ -1217,15 +1534,16 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 				 * bdi thread to make sure background
 				 * write-back happens later.
 				 */
-				if (!wb_has_dirty_io(&bdi->wb))
+				if (!bdi_has_dirty_io(bdi))
 					wakeup_bdi = true;
 			}
 
 			spin_unlock(&inode->i_lock);
-			spin_lock(&bdi->wb.list_lock);
+			wb = inode_attach_wb(inode, bdi);
+			spin_lock(&wb->list_lock);
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_wb_list, &bdi->wb.b_dirty);
-			spin_unlock(&bdi->wb.list_lock);
+			list_move(&inode->i_wb_list, &wb->b_dirty);
+			spin_unlock(&wb->list_lock);
 
 			if (wakeup_bdi)
 				bdi_wakeup_thread_delayed(bdi);
@@ -1419,7 +1737,7 @@ EXPORT_SYMBOL(sync_inodes_sb);
  */
 int write_inode_now(struct inode *inode, int sync)
 {
-	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
+	struct bdi_writeback *wb = inode_to_wb(inode);
 	struct writeback_control wbc = {
 		.nr_to_write = LONG_MAX,
 		.sync_mode = sync ? WB_SYNC_ALL : WB_SYNC_NONE,
@@ -1448,7 +1766,7 @@ EXPORT_SYMBOL(write_inode_now);
  */
 int sync_inode(struct inode *inode, struct writeback_control *wbc)
 {
-	return writeback_single_inode(inode, &inode_to_bdi(inode)->wb, wbc);
+	return writeback_single_inode(inode, inode_to_wb(inode), wbc);
 }
 EXPORT_SYMBOL(sync_inode);
 
@@ -478,6 +478,7 @@ static void cuse_fc_release(struct fuse_conn *fc)
  */
 static int cuse_channel_open(struct inode *inode, struct file *file)
 {
+	struct fuse_dev *fud;
 	struct cuse_conn *cc;
 	int rc;
 
@@ -491,14 +492,20 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&cc->list);
 	cc->fc.release = cuse_fc_release;
 
+	fud = fuse_dev_alloc(&cc->fc);
+	/* the channel's device now owns the reference to cc */
+	fuse_conn_put(&cc->fc);
+	if (!fud)
+		return -ENOMEM;
+
 	cc->fc.connected = 1;
 	cc->fc.blocked = 0;
 	rc = cuse_send_init(cc);
 	if (rc) {
-		fuse_conn_put(&cc->fc);
+		fuse_dev_free(fud);
 		return rc;
 	}
-	file->private_data = &cc->fc;	/* channel owns base reference to cc */
+	file->private_data = fud;
 
 	return 0;
 }
@@ -516,7 +523,8 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
  */
 static int cuse_channel_release(struct inode *inode, struct file *file)
 {
-	struct cuse_conn *cc = fc_to_cc(file->private_data);
+	struct fuse_dev *fud = file->private_data;
+	struct cuse_conn *cc = fc_to_cc(fud->fc);
 	int rc;
 
 	/* remove from the conntbl, no more access from this point on */
@@ -534,7 +542,7 @@ static int cuse_channel_release(struct inode *inode, struct file *file)
 
 	/* kill connection and shutdown channel */
 	fuse_conn_kill(&cc->fc);
-	rc = fuse_dev_release(inode, file);	/* puts the base reference */
+	rc = fuse_dev_release(inode, file);	/* puts the device's reference */
 
 	return rc;
 }
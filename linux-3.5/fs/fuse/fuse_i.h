@@ -35,6 +35,10 @@
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
+/** Number of hash buckets for the requests being processed on a device */
+#define FUSE_PQ_HASH_BITS 8
+#define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
+
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
     permission checking is done in the kernel */
@@ -214,8 +218,8 @@ enum fuse_req_state {
  * A request to the client
  */
 struct fuse_req {
-	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	/** This can be on either the pending list of fuse_iqueue or
+	    the processing or io lists of a fuse_dev */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -224,9 +228,6 @@ struct fuse_req {
 	/** refcount */
 	atomic_t count;
 
-	/** Unique ID for the interrupt request */
-	u64 intr_unique;
-
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
@@ -315,6 +316,68 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * Input queue of a connection: requests, interrupts and forgets
+ * waiting to be read by the userspace filesystem.
+ *
+ * This has its own lock, so that daemon threads waiting for and picking
+ * up requests don't contend with the rest of the connection.  Lock
+ * ordering is fuse_conn->lock, then fuse_iqueue->lock.
+ */
+struct fuse_iqueue {
+	/** Lock protecting the members of this structure and the
+	    PENDING -> READING transition of requests */
+	spinlock_t lock;
+
+	/** Cleared on umount, connection abort and device release */
+	unsigned connected;
+
+	/** Readers of the connection are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+};
+
+/**
+ * An opened /dev/fuse file attached to a connection.
+ *
+ * Every connection has at least one, further ones are created by
+ * cloning with the FUSE_DEV_IOC_CLONE ioctl, so that each thread of a
+ * multithreaded daemon can have its own channel.  Replies must be
+ * written to the device the request was read from.
+ */
+struct fuse_dev {
+	/** The connection this device belongs to */
+	struct fuse_conn *fc;
+
+	/** Entry on fc->devices */
+	struct list_head entry;
+
+	/** The list of requests under I/O, protected by fc->lock */
+	struct list_head io;
+
+	/** The requests being processed, hashed by unique ID and
+	    protected by fc->lock */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
+};
+
 /**
  * A Fuse connection.
  *
@@ -347,17 +410,11 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Input queue */
+	struct fuse_iqueue iq;
 
-	/** The list of pending requests */
-	struct list_head pending;
-
-	/** The list of requests being processed */
-	struct list_head processing;
-
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** The devices attached to this connection */
+	struct list_head devices;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -380,16 +437,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -401,9 +448,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -475,6 +519,9 @@ struct fuse_conn {
 	/** Do multi-page cached writes */
 	unsigned big_writes:1;
 
+	/** Cache buffered writes in the page cache, flush via writepages */
+	unsigned writeback_cache:1;
+
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
@@ -505,9 +552,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -720,6 +764,17 @@ void fuse_conn_init(struct fuse_conn *fc);
  */
 void fuse_conn_put(struct fuse_conn *fc);
 
+/**
+ * Allocate a device and attach it to the connection.  The device holds
+ * a reference to fc.
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Detach the device from its connection and free it
+ */
+void fuse_dev_free(struct fuse_dev *fud);
+
 /**
  * Add connection to control filesystem
  */
@@ -747,6 +802,9 @@ int fuse_update_attributes(struct inode *inode, struct kstat *stat,
 
 void fuse_flush_writepages(struct inode *inode);
 
+int fuse_flush_times(struct inode *inode, struct fuse_file *ff);
+int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
+
 void fuse_set_nowrite(struct inode *inode);
 void fuse_release_nowrite(struct inode *inode);
 
@@ -150,6 +150,9 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	inode->i_cdev = NULL;
 	inode->i_rdev = 0;
 	inode->dirtied_when = 0;
+#ifdef CONFIG_CGROUP_WRITEBACK
+	inode->i_wb = NULL;
+#endif
 
 	if (security_inode_alloc(inode))
 		goto out;
@@ -233,6 +236,7 @@ void __destroy_inode(struct inode *inode)
 	BUG_ON(inode_has_buffers(inode));
 	security_inode_free(inode);
 	fsnotify_inode_delete(inode);
+	inode_switch_wb(inode, NULL);
 	if (!inode->i_nlink) {
 		WARN_ON(atomic_long_read(&inode->i_sb->s_remove_count) == 0);
 		atomic_long_dec(&inode->i_sb->s_remove_count);
@@ -489,6 +493,12 @@ EXPORT_SYMBOL(__remove_inode_hash);
 void clear_inode(struct inode *inode)
 {
 	might_sleep();
+	/*
+	 * ->evict_inode() usually only truncates when there are pages
+	 * left, but the shadow entries of evicted pages must go as well.
+	 */
+	if (inode->i_data.nrshadows)
+		truncate_inode_pages(&inode->i_data, 0);
 	/*
 	 * We have to cycle tree_lock here because reclaim can be still in the
 	 * process of removing the last page (in __delete_from_page_cache())
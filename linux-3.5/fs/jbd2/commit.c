@@ -103,6 +103,23 @@ static void jbd2_commit_block_csum_set(journal_t *j,
 	h->h_chksum[0] = cpu_to_be32(csum);
 }
 
+/*
+ * An asynchronous commit record is submitted without waiting for the
+ * blocks it covers, so it may reach the platter before them.  Recovery
+ * can only notice that when the commit block carries a checksum; without
+ * one we keep ordering the commit record behind a cache flush.
+ */
+static inline int jbd2_async_commit(journal_t *journal)
+{
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT))
+		return 0;
+	return JBD2_HAS_COMPAT_FEATURE(journal,
+				       JBD2_FEATURE_COMPAT_CHECKSUM) ||
+	       JBD2_HAS_INCOMPAT_FEATURE(journal,
+					 JBD2_FEATURE_INCOMPAT_CSUM_V2);
+}
+
 /*
  * Done it all: now submit the commit record.  We should have
  * cleaned up our previous buffers by now, so if we are in abort
@@ -154,9 +171,7 @@ static int journal_submit_commit_record(journal_t *journal,
 	set_buffer_uptodate(bh);
 	bh->b_end_io = journal_end_buffer_io_sync;
 
-	if (journal->j_flags & JBD2_BARRIER &&
-	    !JBD2_HAS_INCOMPAT_FEATURE(journal,
-				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT))
+	if (journal->j_flags & JBD2_BARRIER && !jbd2_async_commit(journal))
 		ret = submit_bh(WRITE_SYNC | WRITE_FLUSH_FUA, bh);
 	else
 		ret = submit_bh(WRITE_SYNC, bh);
@@ -191,11 +206,12 @@ static int journal_wait_on_commit_record(journal_t *journal,
  * use writepages() because with dealyed allocation we may be doing
  * block allocation in writepages().
  */
-static int journal_submit_inode_data_buffers(struct address_space *mapping)
+static int journal_submit_inode_data_buffers(struct address_space *mapping,
+					     enum writeback_sync_modes mode)
 {
 	int ret;
 	struct writeback_control wbc = {
-		.sync_mode =  WB_SYNC_ALL,
+		.sync_mode =  mode,
 		.nr_to_write = mapping->nrpages * 2,
 		.range_start = 0,
 		.range_end = i_size_read(mapping->host),
@@ -232,7 +248,7 @@ static int journal_submit_data_buffers(journal_t *journal,
 		 * only allocated blocks here.
 		 */
 		trace_jbd2_submit_inode_data(jinode->i_vfs_inode);
-		err = journal_submit_inode_data_buffers(mapping);
+		err = journal_submit_inode_data_buffers(mapping, WB_SYNC_ALL);
 		if (!ret)
 			ret = err;
 		spin_lock(&journal->j_list_lock);
@@ -245,6 +261,48 @@ static int journal_submit_data_buffers(journal_t *journal,
 	return ret;
 }
 
+/*
+ * Start writing the ordered data of the running transaction while the
+ * committing one waits for its commit record and the cache flush.  We only
+ * do this when somebody already asked for the running transaction to be
+ * committed, so its own commit mostly finds the data in flight.  That
+ * commit still submits and waits for everything itself (this is merely a
+ * head start), so ordering guarantees are unchanged.
+ *
+ * The running transaction cannot go away under us because only this
+ * thread commits it.  New inodes are added to the head of its inode list,
+ * so the walk below simply does not see them.
+ */
+static int journal_start_next_data(journal_t *journal)
+{
+	transaction_t *next;
+	struct jbd2_inode *jinode;
+	int started = 0;
+
+	read_lock(&journal->j_state_lock);
+	next = journal->j_running_transaction;
+	if (!next || !tid_geq(journal->j_commit_request, next->t_tid)) {
+		read_unlock(&journal->j_state_lock);
+		return 0;
+	}
+	read_unlock(&journal->j_state_lock);
+
+	spin_lock(&journal->j_list_lock);
+	list_for_each_entry(jinode, &next->t_inode_list, i_list) {
+		set_bit(__JI_COMMIT_RUNNING, &jinode->i_flags);
+		spin_unlock(&journal->j_list_lock);
+		journal_submit_inode_data_buffers(jinode->i_vfs_inode->i_mapping,
+						  WB_SYNC_NONE);
+		spin_lock(&journal->j_list_lock);
+		clear_bit(__JI_COMMIT_RUNNING, &jinode->i_flags);
+		smp_mb__after_clear_bit();
+		wake_up_bit(&jinode->i_flags, __JI_COMMIT_RUNNING);
+		started = 1;
+	}
+	spin_unlock(&journal->j_list_lock);
+	return started;
+}
+
 /*
  * Wait for data submitted for writeout, refile inodes to proper
  * transaction if needed.
@@ -392,6 +450,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	tid_t first_tid;
 	int update_tail;
 	int csum_size = 0;
+	unsigned long phase;
 
 	if (JBD2_HAS_INCOMPAT_FEATURE(journal, JBD2_FEATURE_INCOMPAT_CSUM_V2))
 		csum_size = sizeof(struct jbd2_journal_block_tail);
@@ -745,7 +804,9 @@ start_journal_io:
 		}
 	}
 
+	phase = jiffies;
 	err = journal_finish_inode_data_buffers(journal, commit_transaction);
+	stats.run.rs_data = jbd2_time_diff(phase, jiffies);
 	if (err) {
 		printk(KERN_WARNING
 			"JBD2: Detected IO errors while flushing file data "
@@ -784,14 +845,19 @@ start_journal_io:
 	 * then we must flush the file system device before we issue
 	 * the commit record
 	 */
+	stats.run.rs_flush = 0;
+	stats.run.rs_flushes = 0;
 	if (commit_transaction->t_need_data_flush &&
 	    (journal->j_fs_dev != journal->j_dev) &&
-	    (journal->j_flags & JBD2_BARRIER))
+	    (journal->j_flags & JBD2_BARRIER)) {
+		phase = jiffies;
 		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		stats.run.rs_flush += jbd2_time_diff(phase, jiffies);
+		stats.run.rs_flushes++;
+	}
 
 	/* Done it all: now write the commit record asynchronously. */
-	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
-				      JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+	if (jbd2_async_commit(journal)) {
 		err = journal_submit_commit_record(journal, commit_transaction,
 						 &cbh, crc32_sum);
 		if (err)
@@ -799,6 +865,7 @@ start_journal_io:
 	}
 
 	blk_finish_plug(&plug);
+	phase = jiffies;
 
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
@@ -910,20 +977,32 @@ wait_for_iobuf:
 	J_ASSERT(commit_transaction->t_state == T_COMMIT_DFLUSH);
 	commit_transaction->t_state = T_COMMIT_JFLUSH;
 	write_unlock(&journal->j_state_lock);
+	stats.run.rs_log = jbd2_time_diff(phase, jiffies);
+	phase = jiffies;
 
-	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
-				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+	if (!jbd2_async_commit(journal)) {
 		err = journal_submit_commit_record(journal, commit_transaction,
 						&cbh, crc32_sum);
 		if (err)
 			__jbd2_journal_abort_hard(journal);
+		if (cbh && journal->j_flags & JBD2_BARRIER)
+			stats.run.rs_flushes++;
 	}
+
+	/*
+	 * From here on we only wait for the commit record and the cache
+	 * flush.  Let the next transaction's data use the disk meanwhile.
+	 */
+	stats.run.rs_overlapped = journal_start_next_data(journal);
+
 	if (cbh)
 		err = journal_wait_on_commit_record(journal, cbh);
-	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
-				      JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
-	    journal->j_flags & JBD2_BARRIER) {
+	stats.run.rs_commit = jbd2_time_diff(phase, jiffies);
+	if (jbd2_async_commit(journal) && journal->j_flags & JBD2_BARRIER) {
+		phase = jiffies;
 		blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
+		stats.run.rs_flush += jbd2_time_diff(phase, jiffies);
+		stats.run.rs_flushes++;
 	}
 
 	if (err)
@@ -943,6 +1022,7 @@ wait_for_iobuf:
            before. */
 
 	jbd_debug(3, "JBD2: commit phase 6\n");
+	phase = jiffies;
 
 	J_ASSERT(list_empty(&commit_transaction->t_inode_list));
 	J_ASSERT(commit_transaction->t_buffers == NULL);
@@ -1081,6 +1161,8 @@ restart_loop:
 	J_ASSERT(commit_transaction->t_state == T_COMMIT_JFLUSH);
 
 	commit_transaction->t_start = jiffies;
+	stats.run.rs_checkpoint = jbd2_time_diff(phase,
+						 commit_transaction->t_start);
 	stats.run.rs_logging = jbd2_time_diff(stats.run.rs_logging,
 					      commit_transaction->t_start);
 
@@ -1103,6 +1185,13 @@ restart_loop:
 	journal->j_stats.run.rs_locked += stats.run.rs_locked;
 	journal->j_stats.run.rs_flushing += stats.run.rs_flushing;
 	journal->j_stats.run.rs_logging += stats.run.rs_logging;
+	journal->j_stats.run.rs_data += stats.run.rs_data;
+	journal->j_stats.run.rs_log += stats.run.rs_log;
+	journal->j_stats.run.rs_commit += stats.run.rs_commit;
+	journal->j_stats.run.rs_flush += stats.run.rs_flush;
+	journal->j_stats.run.rs_checkpoint += stats.run.rs_checkpoint;
+	journal->j_stats.run.rs_flushes += stats.run.rs_flushes;
+	journal->j_stats.run.rs_overlapped += stats.run.rs_overlapped;
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
@@ -910,6 +910,16 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    jiffies_to_msecs(s->stats->run.rs_flushing / s->stats->ts_tid));
 	seq_printf(seq, "  %ums logging transaction\n",
 	    jiffies_to_msecs(s->stats->run.rs_logging / s->stats->ts_tid));
+	seq_printf(seq, "    %ums waiting for ordered data\n",
+	    jiffies_to_msecs(s->stats->run.rs_data / s->stats->ts_tid));
+	seq_printf(seq, "    %ums waiting for log writes\n",
+	    jiffies_to_msecs(s->stats->run.rs_log / s->stats->ts_tid));
+	seq_printf(seq, "    %ums writing commit record\n",
+	    jiffies_to_msecs(s->stats->run.rs_commit / s->stats->ts_tid));
+	seq_printf(seq, "    %ums flushing disk caches\n",
+	    jiffies_to_msecs(s->stats->run.rs_flush / s->stats->ts_tid));
+	seq_printf(seq, "    %ums checkpoint processing\n",
+	    jiffies_to_msecs(s->stats->run.rs_checkpoint / s->stats->ts_tid));
 	seq_printf(seq, "  %lluus average transaction commit time\n",
 		   div_u64(s->journal->j_average_commit_time, 1000));
 	seq_printf(seq, "  %lu handles per transaction\n",
@@ -918,6 +928,9 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "%u cache flushes, %u commits overlapped with "
+		   "the next transaction\n", s->stats->run.rs_flushes,
+		   s->stats->run.rs_overlapped);
 	return 0;
 }
 
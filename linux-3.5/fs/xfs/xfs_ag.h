@@ -159,7 +159,8 @@ typedef struct xfs_agi {
 #define	XFS_BUF_TO_AGI(bp)	((xfs_agi_t *)((bp)->b_addr))
 
 extern int xfs_read_agi(struct xfs_mount *mp, struct xfs_trans *tp,
-				xfs_agnumber_t agno, struct xfs_buf **bpp);
+				xfs_agnumber_t agno, int flags,
+				struct xfs_buf **bpp);
 
 /*
  * The third a.g. block contains the a.g. freelist, an array
@@ -438,9 +438,28 @@ xfs_ialloc_next_ag(
 	return agno;
 }
 
+/*
+ * Allocation group this cpu moves to when the AGI it would normally use is
+ * locked by another allocation.  Each cpu starts out in a different AG and
+ * then sticks to the last one it found uncontended, so parallel creates in
+ * the same directory end up allocating from different AGI buffers and inode
+ * chunks instead of queueing up on the parent's AG.
+ */
+STATIC xfs_agnumber_t
+xfs_ialloc_cursor_ag(
+	xfs_mount_t	*mp)
+{
+	return this_cpu_read(*mp->m_agicursor) % mp->m_maxagi;
+}
+
 /*
  * Select an allocation group to look for a free inode in, based on the parent
  * inode and then mode.  Return the allocation group buffer.
+ *
+ * The first pass over the AGs only trylocks the AGI buffers, skipping the
+ * ones in use by other allocations.  If the starting AG can't be used right
+ * away we continue at this cpu's cursor AG.  Only the second pass waits for
+ * AGI buffers.
  */
 STATIC xfs_buf_t *			/* allocation group buffer */
 xfs_ialloc_ag_select(
@@ -452,13 +471,16 @@ xfs_ialloc_ag_select(
 	xfs_buf_t	*agbp;		/* allocation group header buffer */
 	xfs_agnumber_t	agcount;	/* number of ag's in the filesystem */
 	xfs_agnumber_t	agno;		/* current ag number */
+	xfs_agnumber_t	cagno;		/* this cpu's cursor ag */
 	int		flags;		/* alloc buffer locking flags */
+	int		bflags;		/* agi buffer locking flags */
 	xfs_extlen_t	ineed;		/* blocks needed for inode allocation */
 	xfs_extlen_t	longest = 0;	/* longest extent available */
 	xfs_mount_t	*mp;		/* mount point structure */
 	int		needspace;	/* file mode implies space allocated */
 	xfs_perag_t	*pag;		/* per allocation group data */
 	xfs_agnumber_t	pagno;		/* parent (starting) ag number */
+	xfs_agnumber_t	tried;		/* ags tried in the trylock pass */
 
 	/*
 	 * Files of these types need at least one block if length > 0
@@ -483,14 +505,17 @@ xfs_ialloc_ag_select(
 	 * if none are currently free.
 	 */
 	agno = pagno;
+	cagno = xfs_ialloc_cursor_ag(mp);
+	tried = 0;
 	flags = XFS_ALLOC_FLAG_TRYLOCK;
+	bflags = XBF_TRYLOCK;
 	for (;;) {
 		pag = xfs_perag_get(mp, agno);
 		if (!pag->pagi_init) {
-			if (xfs_ialloc_read_agi(mp, tp, agno, &agbp)) {
+			if (xfs_ialloc_read_agi(mp, tp, agno, bflags, &agbp))
 				agbp = NULL;
+			if (!agbp)
 				goto nextag;
-			}
 		} else
 			agbp = NULL;
 
@@ -506,10 +531,10 @@ xfs_ialloc_ag_select(
 		ineed = pag->pagi_freecount ? 0 : XFS_IALLOC_BLOCKS(mp);
 		if (ineed && !pag->pagf_init) {
 			if (agbp == NULL &&
-			    xfs_ialloc_read_agi(mp, tp, agno, &agbp)) {
+			    xfs_ialloc_read_agi(mp, tp, agno, bflags, &agbp))
 				agbp = NULL;
+			if (!agbp)
 				goto nextag;
-			}
 			(void)xfs_alloc_pagf_init(mp, tp, agno, flags);
 		}
 		if (!ineed || pag->pagf_init) {
@@ -520,11 +545,14 @@ xfs_ialloc_ag_select(
 			     longest >= ineed &&
 			     okalloc)) {
 				if (agbp == NULL &&
-				    xfs_ialloc_read_agi(mp, tp, agno, &agbp)) {
+				    xfs_ialloc_read_agi(mp, tp, agno, bflags,
+							&agbp))
 					agbp = NULL;
+				if (!agbp)
 					goto nextag;
-				}
 				xfs_perag_put(pag);
+				if (agno != pagno)
+					this_cpu_write(*mp->m_agicursor, agno);
 				return agbp;
 			}
 		}
@@ -539,14 +567,33 @@ nextag:
 		 */
 		if (XFS_FORCED_SHUTDOWN(mp))
 			return NULL;
+		if (flags) {
+			/*
+			 * The trylock pass tries pagno, then every other AG
+			 * once starting at this cpu's cursor.  After that,
+			 * go around again from pagno without trylocks.
+			 */
+			if (++tried < agcount) {
+				if (tried == 1 && cagno != pagno)
+					agno = cagno;
+				else {
+					do {
+						if (++agno >= agcount)
+							agno = 0;
+					} while (agno == pagno);
+				}
+				continue;
+			}
+			agno = pagno;
+			flags = 0;
+			bflags = 0;
+			continue;
+		}
 		agno++;
 		if (agno >= agcount)
 			agno = 0;
-		if (agno == pagno) {
-			if (flags == 0)
-				return NULL;
-			flags = 0;
-		}
+		if (agno == pagno)
+			return NULL;
 	}
 }
 
@@ -778,7 +825,7 @@ nextag:
 			xfs_perag_put(pag);
 			goto nextag;
 		}
-		error = xfs_ialloc_read_agi(mp, tp, tagno, &agbp);
+		error = xfs_ialloc_read_agi(mp, tp, tagno, 0, &agbp);
 		xfs_perag_put(pag);
 		if (error)
 			goto nextag;
@@ -1086,7 +1133,7 @@ xfs_difree(
 	/*
 	 * Get the allocation group header.
 	 */
-	error = xfs_ialloc_read_agi(mp, tp, agno, &agbp);
+	error = xfs_ialloc_read_agi(mp, tp, agno, 0, &agbp);
 	if (error) {
 		xfs_warn(mp, "%s: xfs_ialloc_read_agi() returned error %d.",
 			__func__, error);
@@ -1215,7 +1262,7 @@ xfs_imap_lookup(
 	int			error;
 	int			i;
 
-	error = xfs_ialloc_read_agi(mp, tp, agno, &agbp);
+	error = xfs_ialloc_read_agi(mp, tp, agno, 0, &agbp);
 	if (error) {
 		xfs_alert(mp,
 			"%s: xfs_ialloc_read_agi() returned error %d, agno %d",
@@ -1480,6 +1527,7 @@ xfs_read_agi(
 	struct xfs_mount	*mp,	/* file system mount structure */
 	struct xfs_trans	*tp,	/* transaction pointer */
 	xfs_agnumber_t		agno,	/* allocation group number */
+	int			flags,	/* XBF_ */
 	struct xfs_buf		**bpp)	/* allocation group hdr buf */
 {
 	struct xfs_agi		*agi;	/* allocation group header */
@@ -1490,9 +1538,13 @@ xfs_read_agi(
 
 	error = xfs_trans_read_buf(mp, tp, mp->m_ddev_targp,
 			XFS_AG_DADDR(mp, agno, XFS_AGI_DADDR(mp)),
-			XFS_FSS_TO_BB(mp, 1), 0, bpp);
+			XFS_FSS_TO_BB(mp, 1), flags, bpp);
 	if (error)
 		return error;
+	if (!*bpp) {
+		ASSERT(flags & XBF_TRYLOCK);
+		return 0;
+	}
 
 	ASSERT(!xfs_buf_geterror(*bpp));
 	agi = XFS_BUF_TO_AGI(*bpp);
@@ -1522,15 +1574,18 @@ xfs_ialloc_read_agi(
 	struct xfs_mount	*mp,	/* file system mount structure */
 	struct xfs_trans	*tp,	/* transaction pointer */
 	xfs_agnumber_t		agno,	/* allocation group number */
+	int			flags,	/* XBF_ */
 	struct xfs_buf		**bpp)	/* allocation group hdr buf */
 {
 	struct xfs_agi		*agi;	/* allocation group header */
 	struct xfs_perag	*pag;	/* per allocation group data */
 	int			error;
 
-	error = xfs_read_agi(mp, tp, agno, bpp);
+	error = xfs_read_agi(mp, tp, agno, flags, bpp);
 	if (error)
 		return error;
+	if (!*bpp)
+		return 0;
 
 	agi = XFS_BUF_TO_AGI(*bpp);
 	pag = xfs_perag_get(mp, agno);
@@ -1562,7 +1617,7 @@ xfs_ialloc_pagi_init(
 	xfs_buf_t	*bp = NULL;
 	int		error;
 
-	error = xfs_ialloc_read_agi(mp, tp, agno, &bp);
+	error = xfs_ialloc_read_agi(mp, tp, agno, 0, &bp);
 	if (error)
 		return error;
 	if (bp)
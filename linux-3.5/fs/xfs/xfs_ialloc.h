@@ -128,6 +128,7 @@ xfs_ialloc_read_agi(
 	struct xfs_mount *mp,		/* file system mount structure */
 	struct xfs_trans *tp,		/* transaction pointer */
 	xfs_agnumber_t	agno,		/* allocation group number */
+	int		flags,		/* XBF_ */
 	struct xfs_buf	**bpp);		/* allocation group hdr buf */
 
 /*
@@ -263,7 +263,7 @@ xfs_bulkstat(
 	while (XFS_BULKSTAT_UBLEFT(ubleft) && agno < mp->m_sb.sb_agcount) {
 		cond_resched();
 		bp = NULL;
-		error = xfs_ialloc_read_agi(mp, NULL, agno, &agbp);
+		error = xfs_ialloc_read_agi(mp, NULL, agno, 0, &agbp);
 		if (error) {
 			/*
 			 * Skip this allocation group and go to the next one.
@@ -634,7 +634,7 @@ xfs_inumbers(
 	agbp = NULL;
 	while (left > 0 && agno < mp->m_sb.sb_agcount) {
 		if (agbp == NULL) {
-			error = xfs_ialloc_read_agi(mp, NULL, agno, &agbp);
+			error = xfs_ialloc_read_agi(mp, NULL, agno, 0, &agbp);
 			if (error) {
 				/*
 				 * If we can't read the AGI of this ag,
@@ -3054,7 +3054,7 @@ xlog_recover_clear_agi_bucket(
 	if (error)
 		goto out_abort;
 
-	error = xfs_read_agi(mp, tp, agno, &agibp);
+	error = xfs_read_agi(mp, tp, agno, 0, &agibp);
 	if (error)
 		goto out_abort;
 
@@ -3170,7 +3170,7 @@ xlog_recover_process_iunlinks(
 		/*
 		 * Find the agi for this ag.
 		 */
-		error = xfs_read_agi(mp, NULL, agno, &agibp);
+		error = xfs_read_agi(mp, NULL, agno, 0, &agibp);
 		if (error) {
 			/*
 			 * AGI is b0rked. Don't process it.
@@ -3843,7 +3843,7 @@ xlog_recover_check_summary(
 			xfs_buf_relse(agfbp);
 		}
 
-		error = xfs_read_agi(mp, NULL, agno, &agibp);
+		error = xfs_read_agi(mp, NULL, agno, 0, &agibp);
 		if (error) {
 			xfs_alert(mp, "%s agi read failed agno %d error %d",
 						__func__, agno, error);
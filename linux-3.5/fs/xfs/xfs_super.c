@@ -991,6 +991,7 @@ xfs_fs_put_super(
 	xfs_unmountfs(mp);
 	xfs_syncd_stop(mp);
 	xfs_freesb(mp);
+	free_percpu(mp->m_agicursor);
 	xfs_icsb_destroy_counters(mp);
 	xfs_destroy_mount_workqueues(mp);
 	xfs_close_devices(mp);
@@ -1288,6 +1289,7 @@ xfs_fs_fill_super(
 	struct inode		*root;
 	struct xfs_mount	*mp = NULL;
 	int			flags = 0, error = ENOMEM;
+	int			cpu;
 
 	mp = kzalloc(sizeof(struct xfs_mount), GFP_KERNEL);
 	if (!mp)
@@ -1327,9 +1329,17 @@ xfs_fs_fill_super(
 	if (error)
 		goto out_destroy_workqueues;
 
+	mp->m_agicursor = alloc_percpu(xfs_agnumber_t);
+	if (!mp->m_agicursor) {
+		error = ENOMEM;
+		goto out_destroy_counters;
+	}
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(mp->m_agicursor, cpu) = cpu;
+
 	error = xfs_readsb(mp, flags);
 	if (error)
-		goto out_destroy_counters;
+		goto out_free_agicursor;
 
 	error = xfs_finish_flags(mp);
 	if (error)
@@ -1389,6 +1399,8 @@ xfs_fs_fill_super(
 	xfs_filestream_unmount(mp);
  out_free_sb:
 	xfs_freesb(mp);
+ out_free_agicursor:
+	free_percpu(mp->m_agicursor);
  out_destroy_counters:
 	xfs_icsb_destroy_counters(mp);
 out_destroy_workqueues:
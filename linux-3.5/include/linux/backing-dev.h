@@ -47,6 +47,21 @@ enum bdi_stat_item {
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/*
+ * Page counts of a cgroup bdi_writeback, which the bdi's counters include
+ */
+enum wb_stat_item {
+	WB_RECLAIMABLE,
+	WB_WRITEBACK,
+	WB_WRITTEN,
+	NR_WB_STAT_ITEMS
+};
+
+/* Upper limit for backing_dev_info.wb_workers */
+#define BDI_MAX_WB_WORKERS	32
+
+struct wb_worker_pool;
+
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
 	unsigned int nr;
@@ -59,7 +74,26 @@ struct bdi_writeback {
 	struct list_head b_dirty;	/* dirty inodes */
 	struct list_head b_io;		/* parked for writeback */
 	struct list_head b_more_io;	/* parked for more writeback */
+	struct list_head b_busy;	/* handed to writeback workers */
 	spinlock_t list_lock;		/* protects the b_* lists */
+
+	struct wb_worker_pool *pool;	/* owned by the flusher thread */
+
+#ifdef CONFIG_CGROUP_WRITEBACK
+	/*
+	 * Cgroup bdi_writebacks only: the owning blkcg, NULL once it is
+	 * gone, and the write bandwidth the cgroup gets from the device.
+	 */
+	struct cgroup_subsys_state *blkcg_css;
+	struct list_head bdi_node;	/* anchored at bdi->cgwb_list */
+	atomic_t refcnt;		/* attached inodes + bdi->cgwb_list */
+	struct percpu_counter stat[NR_WB_STAT_ITEMS];
+
+	unsigned long bw_time_stamp;	/* last time write bw is updated */
+	unsigned long written_stamp;	/* pages written at bw_time_stamp */
+	unsigned long write_bandwidth;	/* the estimated write bandwidth */
+	unsigned long avg_write_bandwidth; /* further smoothed write bw */
+#endif
 };
 
 struct backing_dev_info {
@@ -95,9 +129,17 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	unsigned int wb_workers;  /* inodes written back in parallel */
+
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list */
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct list_head cgwb_list;	/* writeback info of blkcgs */
+	struct bdi_writeback *cgwb_spare; /* next one to hand to a blkcg */
+	spinlock_t cgwb_lock;		/* protects cgwb_list, cgwb_spare */
+#endif
+
 	struct list_head work_list;
 
 	struct device *dev;
@@ -135,7 +177,8 @@ static inline int wb_has_dirty_io(struct bdi_writeback *wb)
 {
 	return !list_empty(&wb->b_dirty) ||
 	       !list_empty(&wb->b_io) ||
-	       !list_empty(&wb->b_more_io);
+	       !list_empty(&wb->b_more_io) ||
+	       !list_empty(&wb->b_busy);
 }
 
 static inline void __add_bdi_stat(struct backing_dev_info *bdi,
@@ -215,7 +258,136 @@ static inline unsigned long bdi_stat_error(struct backing_dev_info *bdi)
 #endif
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+
+struct bdi_writeback *inode_attach_wb(struct inode *inode,
+				      struct backing_dev_info *bdi);
+void inode_switch_wb(struct inode *inode, struct bdi_writeback *wb);
+void cgwb_blkcg_offline(struct cgroup_subsys_state *blkcg_css);
+void bdi_reap_cgwbs(struct backing_dev_info *bdi);
+
+static inline bool wb_is_cgwb(struct bdi_writeback *wb)
+{
+	return wb != &wb->bdi->wb;
+}
+
+/*
+ * The bdi_writeback whose lists hold @inode while it is dirty
+ */
+static inline struct bdi_writeback *bdi_inode_wb(struct backing_dev_info *bdi,
+						 struct inode *inode)
+{
+	return inode->i_wb ? inode->i_wb : &bdi->wb;
+}
+
+/*
+ * The cgroup bdi_writeback the pages of @mapping are accounted to, NULL
+ * if they are only accounted to the bdi.
+ */
+static inline struct bdi_writeback *mapping_cgwb(struct address_space *mapping)
+{
+	struct bdi_writeback *wb;
+
+	if (!mapping->host)
+		return NULL;
+	wb = ACCESS_ONCE(mapping->host->i_wb);
+	return wb && wb_is_cgwb(wb) ? wb : NULL;
+}
+
+static inline void add_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item, s64 amount)
+{
+	unsigned long flags;
+
+	if (!wb)
+		return;
+	local_irq_save(flags);
+	__percpu_counter_add(&wb->stat[item], amount, BDI_STAT_BATCH);
+	local_irq_restore(flags);
+}
+
+static inline void inc_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+	add_wb_stat(wb, item, 1);
+}
+
+static inline void dec_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+	add_wb_stat(wb, item, -1);
+}
+
+static inline s64 wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+	return percpu_counter_read_positive(&wb->stat[item]);
+}
+
+static inline s64 wb_stat_sum(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+	s64 sum;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	sum = percpu_counter_sum_positive(&wb->stat[item]);
+	local_irq_restore(flags);
+
+	return sum;
+}
+
+#else	/* CONFIG_CGROUP_WRITEBACK */
+
+static inline struct bdi_writeback *
+inode_attach_wb(struct inode *inode, struct backing_dev_info *bdi)
+{
+	return &bdi->wb;
+}
+
+static inline void inode_switch_wb(struct inode *inode,
+				   struct bdi_writeback *wb)
+{
+}
+
+static inline void cgwb_blkcg_offline(struct cgroup_subsys_state *blkcg_css)
+{
+}
+
+static inline void bdi_reap_cgwbs(struct backing_dev_info *bdi)
+{
+}
+
+static inline bool wb_is_cgwb(struct bdi_writeback *wb)
+{
+	return false;
+}
+
+static inline struct bdi_writeback *bdi_inode_wb(struct backing_dev_info *bdi,
+						 struct inode *inode)
+{
+	return &bdi->wb;
+}
+
+static inline struct bdi_writeback *mapping_cgwb(struct address_space *mapping)
+{
+	return NULL;
+}
+
+static inline void inc_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+}
+
+static inline void dec_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
+{
+}
+
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
 int bdi_set_min_ratio(struct backing_dev_info *bdi, unsigned int min_ratio);
+int bdi_set_wb_workers(struct backing_dev_info *bdi, unsigned int nr);
 int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
 
 /*
@@ -642,9 +642,18 @@ struct transaction_run_stats_s {
 	unsigned long		rs_flushing;
 	unsigned long		rs_logging;
 
+	/* Breakdown of the logging phase */
+	unsigned long		rs_data;
+	unsigned long		rs_log;
+	unsigned long		rs_commit;
+	unsigned long		rs_flush;
+	unsigned long		rs_checkpoint;
+
 	__u32			rs_handle_count;
 	__u32			rs_blocks;
 	__u32			rs_blocks_logged;
+	__u32			rs_flushes;
+	__u32			rs_overlapped;
 };
 
 struct transaction_stats_s {
@@ -387,6 +387,13 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Set when reclaim cleared a PTE of this mm but deferred the TLB
+	 * flush. See flush_tlb_batched_pending().
+	 */
+	bool tlb_flush_batched;
 #endif
 	struct uprobes_state uprobes_state;
 };
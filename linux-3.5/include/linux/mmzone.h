@@ -133,6 +133,9 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_SHADOWS,	/* shadow entries of pages evicted from here */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults close enough to be activated */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -140,6 +143,11 @@ enum zone_stat_item {
 	NUMA_INTERLEAVE_HIT,	/* interleaver preferred this zone */
 	NUMA_LOCAL,		/* allocation from local node */
 	NUMA_OTHER,		/* allocation from other node */
+#endif
+#ifdef CONFIG_COMPACTION
+	NR_COMPACT_STALL,	/* direct compaction runs against this zone */
+	NR_COMPACT_SUCCESS,	/* direct compaction satisfied an allocation */
+	NR_KCOMPACTD_SUCCESS,	/* kcompactd restored the requested order */
 #endif
 	NR_ANON_TRANSPARENT_HUGEPAGES,
 	NR_VM_ZONE_STAT_ITEMS };
@@ -233,13 +241,21 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * Blocks of order 0 up to PAGE_ALLOC_COSTLY_ORDER are cached on the
+ * per-cpu lists so that the common small high-order allocations (kernel
+ * stacks, slab pages, skb heads) do not need to take zone->lock.
+ */
+#define NR_PCP_ORDERS		(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS		(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per migrate type and order */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -407,6 +423,9 @@ struct zone {
 	spinlock_t		lru_lock;
 	struct lruvec		lruvec;
 
+	/* Evictions and activations, see mm/workingset.c */
+	atomic_long_t		inactive_age;
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
@@ -697,6 +716,22 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	/* Protected by lock_memory_hotplug() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;	/* Protected by lock_memory_hotplug() */
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+#endif
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	/*
+	 * Only the first static_init_size pages of the node's highest zone
+	 * get their struct pages initialised during early boot.  The rest,
+	 * from first_deferred_pfn on, is initialised by a per-node kthread
+	 * or on demand by the allocator.  Protected by node_size_lock.
+	 */
+	unsigned long static_init_size;
+	unsigned long first_deferred_pfn;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
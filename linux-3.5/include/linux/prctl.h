@@ -149,4 +149,16 @@
 
 #define PR_GET_TID_ADDRESS	40
 
+/*
+ * Core scheduling cookies, see Documentation/scheduler/sched-core.txt.
+ * arg2 is the command, arg3 the pid (0 for the caller), arg4 the scope.
+ */
+#define PR_SCHED_CORE			41
+# define PR_SCHED_CORE_GET		0	/* store cookie at u64 *arg5 */
+# define PR_SCHED_CORE_CREATE		1	/* give pid a new cookie */
+# define PR_SCHED_CORE_SHARE_TO		2	/* give pid the caller's cookie */
+# define PR_SCHED_CORE_SHARE_FROM	3	/* take pid's cookie */
+# define PR_SCHED_CORE_SCOPE_THREAD		0
+# define PR_SCHED_CORE_SCOPE_THREAD_GROUP	1
+
 #endif /* _LINUX_PRCTL_H */
@@ -222,6 +222,12 @@ extern unsigned int nr_free_pagecache_pages(void);
 #define nr_free_pages() global_page_state(NR_FREE_PAGES)
 
 
+/* linux/mm/workingset.c */
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+bool workingset_refault(void *shadow);
+void workingset_forget(void *shadow);
+void workingset_activation(struct page *page);
+
 /* linux/mm/swap.c */
 extern void __lru_cache_add(struct page *, enum lru_list lru);
 extern void lru_cache_add_lru(struct page *, enum lru_list lru);
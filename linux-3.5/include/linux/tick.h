@@ -46,6 +46,8 @@ enum tick_nohz_mode {
  * @iowait_sleeptime:	Sum of the time slept in idle with sched tick stopped, with IO outstanding
  * @sleep_length:	Duration of the current idle sleep
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
+ * @busy_jiffies:	jiffies up to which cputime was accounted while the
+ *			tick was stopped on a CPU running a single task
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -68,6 +70,9 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	unsigned long			busy_jiffies;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -142,4 +147,37 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+struct task_struct;
+
+#ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void __init tick_nohz_init(void);
+extern void tick_nohz_full_check(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern bool tick_nohz_full_kick_timer(int cpu, unsigned long expires);
+extern void tick_nohz_full_kick_all(void);
+extern void tick_nohz_task_switch(struct task_struct *prev);
+#else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_init(void) { }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline bool tick_nohz_full_kick_timer(int cpu, unsigned long expires)
+{
+	return false;
+}
+static inline void tick_nohz_full_kick_all(void) { }
+static inline void tick_nohz_task_switch(struct task_struct *prev) { }
+#endif /* !NO_HZ_FULL */
+
 #endif
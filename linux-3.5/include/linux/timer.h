@@ -22,6 +22,7 @@ struct timer_list {
 	unsigned long data;
 
 	int slack;
+	unsigned int idx;	/* wheel bucket, valid while pending */
 
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
@@ -211,6 +212,8 @@ extern int del_timer(struct timer_list * timer);
 extern int mod_timer(struct timer_list *timer, unsigned long expires);
 extern int mod_timer_pending(struct timer_list *timer, unsigned long expires);
 extern int mod_timer_pinned(struct timer_list *timer, unsigned long expires);
+extern int mod_timers(struct timer_list **timers, unsigned int nr,
+		      unsigned long expires);
 
 extern void set_timer_slack(struct timer_list *time, int slack_hz);
 
@@ -15,6 +15,7 @@ struct ext4_inode_info;
 struct mpage_da_data;
 struct ext4_map_blocks;
 struct ext4_extent;
+struct extent_status;
 
 #define EXT4_I(inode) (container_of(inode, struct ext4_inode_info, vfs_inode))
 
@@ -1746,75 +1747,17 @@ TRACE_EVENT(ext4_get_implied_cluster_alloc_exit,
 		  __entry->len, __entry->flags, __entry->ret)
 );
 
-TRACE_EVENT(ext4_ext_put_in_cache,
-	TP_PROTO(struct inode *inode, ext4_lblk_t lblk, unsigned int len,
-		 ext4_fsblk_t start),
-
-	TP_ARGS(inode, lblk, len, start),
-
-	TP_STRUCT__entry(
-		__field(	ino_t,		ino	)
-		__field(	dev_t,		dev	)
-		__field(	ext4_lblk_t,	lblk	)
-		__field(	unsigned int,	len	)
-		__field(	ext4_fsblk_t,	start	)
-	),
-
-	TP_fast_assign(
-		__entry->ino	= inode->i_ino;
-		__entry->dev	= inode->i_sb->s_dev;
-		__entry->lblk	= lblk;
-		__entry->len	= len;
-		__entry->start	= start;
-	),
-
-	TP_printk("dev %d,%d ino %lu lblk %u len %u start %llu",
-		  MAJOR(__entry->dev), MINOR(__entry->dev),
-		  (unsigned long) __entry->ino,
-		  (unsigned) __entry->lblk,
-		  __entry->len,
-		  (unsigned long long) __entry->start)
-);
-
-TRACE_EVENT(ext4_ext_in_cache,
-	TP_PROTO(struct inode *inode, ext4_lblk_t lblk, int ret),
-
-	TP_ARGS(inode, lblk, ret),
-
-	TP_STRUCT__entry(
-		__field(	ino_t,		ino	)
-		__field(	dev_t,		dev	)
-		__field(	ext4_lblk_t,	lblk	)
-		__field(	int,		ret	)
-	),
-
-	TP_fast_assign(
-		__entry->ino	= inode->i_ino;
-		__entry->dev	= inode->i_sb->s_dev;
-		__entry->lblk	= lblk;
-		__entry->ret	= ret;
-	),
-
-	TP_printk("dev %d,%d ino %lu lblk %u ret %d",
-		  MAJOR(__entry->dev), MINOR(__entry->dev),
-		  (unsigned long) __entry->ino,
-		  (unsigned) __entry->lblk,
-		  __entry->ret)
-
-);
-
 TRACE_EVENT(ext4_find_delalloc_range,
 	TP_PROTO(struct inode *inode, ext4_lblk_t from, ext4_lblk_t to,
-		int reverse, int found, ext4_lblk_t found_blk),
+		int found, ext4_lblk_t found_blk),
 
-	TP_ARGS(inode, from, to, reverse, found, found_blk),
+	TP_ARGS(inode, from, to, found, found_blk),
 
 	TP_STRUCT__entry(
 		__field(	ino_t,		ino		)
 		__field(	dev_t,		dev		)
 		__field(	ext4_lblk_t,	from		)
 		__field(	ext4_lblk_t,	to		)
-		__field(	int,		reverse		)
 		__field(	int,		found		)
 		__field(	ext4_lblk_t,	found_blk	)
 	),
@@ -1824,18 +1767,15 @@ TRACE_EVENT(ext4_find_delalloc_range,
 		__entry->dev		= inode->i_sb->s_dev;
 		__entry->from		= from;
 		__entry->to		= to;
-		__entry->reverse	= reverse;
 		__entry->found		= found;
 		__entry->found_blk	= found_blk;
 	),
 
-	TP_printk("dev %d,%d ino %lu from %u to %u reverse %d found %d "
-		  "(blk = %u)",
+	TP_printk("dev %d,%d ino %lu from %u to %u found %d (blk = %u)",
 		  MAJOR(__entry->dev), MINOR(__entry->dev),
 		  (unsigned long) __entry->ino,
 		  (unsigned) __entry->from, (unsigned) __entry->to,
-		  __entry->reverse, __entry->found,
-		  (unsigned) __entry->found_blk)
+		  __entry->found, (unsigned) __entry->found_blk)
 );
 
 TRACE_EVENT(ext4_get_reserved_cluster_alloc,
@@ -2055,6 +1995,124 @@ TRACE_EVENT(ext4_ext_remove_space_done,
 		  (unsigned short) __entry->eh_entries)
 );
 
+TRACE_EVENT(ext4_es_insert_extent,
+	TP_PROTO(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len,
+		 ext4_fsblk_t pblk, unsigned long long status),
+
+	TP_ARGS(inode, lblk, len, pblk, status),
+
+	TP_STRUCT__entry(
+		__field(	ino_t,		ino		)
+		__field(	dev_t,		dev		)
+		__field(	ext4_lblk_t,	lblk		)
+		__field(	ext4_lblk_t,	len		)
+		__field(	ext4_fsblk_t,	pblk		)
+		__field(	unsigned int,	status		)
+	),
+
+	TP_fast_assign(
+		__entry->ino		= inode->i_ino;
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->lblk		= lblk;
+		__entry->len		= len;
+		__entry->pblk		= pblk;
+		__entry->status		= status >> 60;
+	),
+
+	TP_printk("dev %d,%d ino %lu es [%u/%u) pblk %llu status %x",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long) __entry->ino,
+		  __entry->lblk, __entry->len,
+		  (unsigned long long) __entry->pblk, __entry->status)
+);
+
+TRACE_EVENT(ext4_es_remove_extent,
+	TP_PROTO(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len),
+
+	TP_ARGS(inode, lblk, len),
+
+	TP_STRUCT__entry(
+		__field(	ino_t,		ino		)
+		__field(	dev_t,		dev		)
+		__field(	ext4_lblk_t,	lblk		)
+		__field(	ext4_lblk_t,	len		)
+	),
+
+	TP_fast_assign(
+		__entry->ino		= inode->i_ino;
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->lblk		= lblk;
+		__entry->len		= len;
+	),
+
+	TP_printk("dev %d,%d ino %lu es [%u/%u)",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long) __entry->ino,
+		  __entry->lblk, __entry->len)
+);
+
+TRACE_EVENT(ext4_es_lookup_extent,
+	TP_PROTO(struct inode *inode, ext4_lblk_t lblk,
+		 struct extent_status *es),
+
+	TP_ARGS(inode, lblk, es),
+
+	TP_STRUCT__entry(
+		__field(	ino_t,		ino		)
+		__field(	dev_t,		dev		)
+		__field(	ext4_lblk_t,	lblk		)
+		__field(	ext4_lblk_t,	es_lblk		)
+		__field(	ext4_lblk_t,	es_len		)
+		__field(	ext4_fsblk_t,	es_pblk		)
+		__field(	unsigned int,	status		)
+		__field(	int,		found		)
+	),
+
+	TP_fast_assign(
+		__entry->ino		= inode->i_ino;
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->lblk		= lblk;
+		__entry->found		= es != NULL;
+		__entry->es_lblk	= es ? es->es_lblk : 0;
+		__entry->es_len		= es ? es->es_len : 0;
+		__entry->es_pblk	= es ? ext4_es_pblock(es) : 0;
+		__entry->status		= es ? ext4_es_status(es) >> 60 : 0;
+	),
+
+	TP_printk("dev %d,%d ino %lu lblk %u found %d [%u/%u) pblk %llu "
+		  "status %x",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long) __entry->ino, __entry->lblk,
+		  __entry->found, __entry->es_lblk, __entry->es_len,
+		  (unsigned long long) __entry->es_pblk, __entry->status)
+);
+
+TRACE_EVENT(ext4_es_shrink,
+	TP_PROTO(struct super_block *sb, int nr_to_scan, int nr_shrunk,
+		 int cache_cnt),
+
+	TP_ARGS(sb, nr_to_scan, nr_shrunk, cache_cnt),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,		dev		)
+		__field(	int,		nr_to_scan	)
+		__field(	int,		nr_shrunk	)
+		__field(	int,		cache_cnt	)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->nr_to_scan	= nr_to_scan;
+		__entry->nr_shrunk	= nr_shrunk;
+		__entry->cache_cnt	= cache_cnt;
+	),
+
+	TP_printk("dev %d,%d nr_to_scan %d nr_shrunk %d cache_cnt %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->nr_to_scan, __entry->nr_shrunk,
+		  __entry->cache_cnt)
+);
+
 #endif /* _TRACE_EXT4_H */
 
 /* This part must be outside protection */
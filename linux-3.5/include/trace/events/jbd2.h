@@ -146,6 +146,11 @@ TRACE_EVENT(jbd2_run_stats,
 		__field(	unsigned long,	locked		)
 		__field(	unsigned long,	flushing	)
 		__field(	unsigned long,	logging		)
+		__field(	unsigned long,	data		)
+		__field(	unsigned long,	log		)
+		__field(	unsigned long,	commit		)
+		__field(	unsigned long,	flush		)
+		__field(	unsigned long,	checkpoint	)
 		__field(		__u32,	handle_count	)
 		__field(		__u32,	blocks		)
 		__field(		__u32,	blocks_logged	)
@@ -159,19 +164,30 @@ TRACE_EVENT(jbd2_run_stats,
 		__entry->locked		= stats->rs_locked;
 		__entry->flushing	= stats->rs_flushing;
 		__entry->logging	= stats->rs_logging;
+		__entry->data		= stats->rs_data;
+		__entry->log		= stats->rs_log;
+		__entry->commit		= stats->rs_commit;
+		__entry->flush		= stats->rs_flush;
+		__entry->checkpoint	= stats->rs_checkpoint;
 		__entry->handle_count	= stats->rs_handle_count;
 		__entry->blocks		= stats->rs_blocks;
 		__entry->blocks_logged	= stats->rs_blocks_logged;
 	),
 
 	TP_printk("dev %d,%d tid %lu wait %u running %u locked %u flushing %u "
-		  "logging %u handle_count %u blocks %u blocks_logged %u",
+		  "logging %u data %u log %u commit %u flush %u checkpoint %u "
+		  "handle_count %u blocks %u blocks_logged %u",
 		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->tid,
 		  jiffies_to_msecs(__entry->wait),
 		  jiffies_to_msecs(__entry->running),
 		  jiffies_to_msecs(__entry->locked),
 		  jiffies_to_msecs(__entry->flushing),
 		  jiffies_to_msecs(__entry->logging),
+		  jiffies_to_msecs(__entry->data),
+		  jiffies_to_msecs(__entry->log),
+		  jiffies_to_msecs(__entry->commit),
+		  jiffies_to_msecs(__entry->flush),
+		  jiffies_to_msecs(__entry->checkpoint),
 		  __entry->handle_count, __entry->blocks,
 		  __entry->blocks_logged)
 );
@@ -243,7 +243,7 @@ DECLARE_EVENT_CLASS(mm_page,
 		page_to_pfn(__entry->page),
 		__entry->order,
 		__entry->migratetype,
-		__entry->order == 0)
+		__entry->order <= PAGE_ALLOC_COSTLY_ORDER)
 );
 
 DEFINE_EVENT(mm_page, mm_page_alloc_zone_locked,
@@ -264,6 +264,37 @@ DEFINE_EVENT_PRINT(mm_page, mm_page_pcpu_drain,
 		__entry->order, __entry->migratetype)
 );
 
+TRACE_EVENT(mm_page_zone_lock_hold,
+
+	TP_PROTO(struct zone *zone, unsigned int order, int nr_pages,
+		 u64 held_ns),
+
+	TP_ARGS(zone, order, nr_pages, held_ns),
+
+	TP_STRUCT__entry(
+		__field(	int,		nid		)
+		__field(	int,		zid		)
+		__field(	unsigned int,	order		)
+		__field(	int,		nr_pages	)
+		__field(	u64,		held_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->nid		= zone_to_nid(zone);
+		__entry->zid		= zone_idx(zone);
+		__entry->order		= order;
+		__entry->nr_pages	= nr_pages;
+		__entry->held_ns	= held_ns;
+	),
+
+	TP_printk("nid=%d zid=%d order=%u nr_pages=%d held_ns=%llu",
+		__entry->nid,
+		__entry->zid,
+		__entry->order,
+		__entry->nr_pages,
+		(unsigned long long)__entry->held_ns)
+);
+
 TRACE_EVENT(mm_page_alloc_extfrag,
 
 	TP_PROTO(struct page *page,
@@ -541,6 +541,8 @@ asmlinkage void __init start_kernel(void)
 	}
 	idr_init_cache();
 	perf_event_init();
+	/* Before rcu_init(), which offloads callbacks of nohz_full CPUs */
+	tick_nohz_init();
 	rcu_init();
 	radix_tree_init();
 	/* init some links before init_ISA_irqs() */
@@ -862,6 +864,8 @@ static int __init kernel_init(void * unused)
 	smp_init();
 	sched_init_smp();
 
+	page_alloc_init_late();
+
 	do_basic_setup();
 
 	/* Open the /dev/console on the rootfs, this should never fail */
@@ -2541,6 +2541,19 @@ done:
 		list_del_init(&cpuctx->rotation_list);
 }
 
+/*
+ * The tick drives rotation, frequency adjustment and unthrottling of all
+ * the contexts on the rotation list, so it can only be stopped while the
+ * list is empty. Called with IRQs disabled.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	if (!list_empty(&__get_cpu_var(rotation_list)))
+		return false;
+
+	return true;
+}
+
 void perf_event_task_tick(void)
 {
 	struct list_head *head = &__get_cpu_var(rotation_list);
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -580,6 +581,9 @@ static void arm_timer(struct k_itimer *timer)
 				cputime_expires->sched_exp = exp->sched;
 			break;
 		}
+
+		/* Timers are checked from the tick, make sure it runs */
+		tick_nohz_full_kick_all();
 	}
 }
 
@@ -1343,6 +1347,26 @@ void run_posix_cpu_timers(struct task_struct *tsk)
 	}
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - check whether @tsk has cpu timers armed
+ * @tsk:	The task running on the CPU that wants to stop its tick.
+ *
+ * Thread and process cpu timers are only checked from the tick, so a
+ * full dynticks CPU has to keep it while any of them are armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * Set one of the process-wide special case CPU timers or RLIMIT_CPU.
  * The tsk->sighand->siglock must be held by the caller.
@@ -1389,6 +1413,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -52,6 +52,7 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -304,7 +305,8 @@ cpu_has_callbacks_ready_to_invoke(struct rcu_data *rdp)
 static int
 cpu_needs_another_gp(struct rcu_state *rsp, struct rcu_data *rdp)
 {
-	return *rdp->nxttail[RCU_DONE_TAIL] && !rcu_gp_in_progress(rsp);
+	return (*rdp->nxttail[RCU_DONE_TAIL] || rcu_nocb_needs_gp(rsp)) &&
+	       !rcu_gp_in_progress(rsp);
 }
 
 /*
@@ -700,6 +702,13 @@ static int rcu_implicit_dynticks_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
+	/*
+	 * A full dynticks CPU running a single task may not take a tick
+	 * for a long time. Kick it so that it restarts the tick until it
+	 * has reported its quiescent state.
+	 */
+	tick_nohz_full_kick_cpu(rdp->cpu);
+
 	/* Go check for the CPU being offline. */
 	return rcu_implicit_offline_qs(rdp);
 }
@@ -1177,6 +1186,7 @@ static void rcu_report_qs_rsp(struct rcu_state *rsp, unsigned long flags)
 
 	rsp->completed = rsp->gpnum;  /* Declare the grace period complete. */
 	trace_rcu_grace_period(rsp->name, rsp->completed, "end");
+	rcu_nocb_gp_cleanup(rsp);
 	rsp->fqs_state = RCU_GP_IDLE;
 	rcu_start_gp(rsp, flags);  /* releases root node's rnp->lock. */
 }
@@ -1880,6 +1890,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* No-CBs CPUs hand their callbacks to their rcuo kthread. */
+	if (__call_rcu_nocb(rdp, head, lazy)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	rdp->qlen++;
 	if (lazy)
@@ -2246,6 +2262,19 @@ static int rcu_pending(int cpu)
 	       rcu_preempt_pending(cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Check to see if the current CPU has to keep taking scheduling-clock
+ * interrupts because RCU has work for it right now, most likely a
+ * quiescent state to report.  Only a full dynticks CPU running a task
+ * asks this; queued callbacks are covered by rcu_needs_cpu().
+ */
+int rcu_needs_tick(int cpu)
+{
+	return rcu_pending(cpu);
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 /*
  * Check to see if any future RCU-related work will need to be done
  * by the current CPU, even if none need be done immediately, returning
@@ -2337,7 +2366,18 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (cpu_is_offline(cpu)) {
+		if (is_nocb_cpu(cpu)) {
+			/*
+			 * The rcuo kthread invokes callbacks in order, so
+			 * a barrier callback queued behind them will do,
+			 * whether or not the CPU is online.
+			 */
+			preempt_enable();
+			atomic_inc(&rcu_barrier_cpu_count);
+			rcu_nocb_post_barrier(rdp,
+					      &per_cpu(rcu_barrier_head, cpu),
+					      rcu_barrier_callback);
+		} else if (cpu_is_offline(cpu)) {
 			preempt_enable();
 			while (cpu_is_offline(cpu) && ACCESS_ONCE(rdp->qlen))
 				schedule_timeout_interruptible(1);
@@ -2424,6 +2464,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -2649,6 +2690,7 @@ static void __init rcu_init_one(struct rcu_state *rsp,
 	}
 
 	rsp->rda = rda;
+	rcu_init_one_nocb(rsp);
 	rnp = rsp->level[NUM_RCU_LVLS - 1];
 	for_each_possible_cpu(i) {
 		while (i > rnp->grphi)
@@ -2663,6 +2705,7 @@ void __init rcu_init(void)
 	int cpu;
 
 	rcu_bootup_announce();
+	rcu_init_nocb();
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
 	__rcu_init_preempt();
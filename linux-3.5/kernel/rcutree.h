@@ -27,6 +27,8 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait.h>
+#include <linux/irq_work.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS, CONFIG_RCU_FANOUT, and
@@ -198,6 +200,11 @@ struct rcu_node {
 				/*  per-CPU kthreads as needed. */
 	unsigned int node_kthread_status;
 				/* State of node_kthread_task for tracing. */
+#ifdef CONFIG_RCU_NOCB_CPU
+	wait_queue_head_t nocb_gp_wq;
+				/* Place for the rcuo kthreads of this */
+				/*  group's CPUs to wait for grace periods. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 } ____cacheline_internodealigned_in_smp;
 
 /*
@@ -311,6 +318,18 @@ struct rcu_data {
 	unsigned long n_rp_need_fqs;
 	unsigned long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) Callback offloading. */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs waiting for kthread */
+	atomic_long_t nocb_q_count_lazy; /*  (approximate). */
+	int nocb_p_count;		/* # CBs being invoked by kthread */
+	int nocb_p_count_lazy;		/*  (approximate). */
+	wait_queue_head_t nocb_wq;	/* For nocb kthreads to sleep on. */
+	struct task_struct *nocb_kthread;
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -408,6 +427,13 @@ struct rcu_state {
 						/*  for CPU stalls. */
 	unsigned long gp_max;			/* Maximum GP duration in */
 						/*  jiffies. */
+#ifdef CONFIG_RCU_NOCB_CPU
+	unsigned long nocb_gp_req;		/* Last GP needed by an */
+						/*  rcuo kthread.  Guarded */
+						/*  by root rcu_node's lock. */
+	struct irq_work nocb_gp_work;		/* Wakes rcuo kthreads once */
+						/*  a GP has completed. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 	char *name;				/* Name of structure. */
 };
 
@@ -498,5 +524,15 @@ static void print_cpu_stall_info(struct rcu_state *rsp, int cpu);
 static void print_cpu_stall_info_end(void);
 static void zero_cpu_stall_ticks(struct rcu_data *rdp);
 static void increment_cpu_stall_ticks(void);
+static bool is_nocb_cpu(int cpu);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy);
+static void rcu_nocb_post_barrier(struct rcu_data *rdp, struct rcu_head *rhp,
+				  void (*func)(struct rcu_head *rhp));
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp);
+static void rcu_nocb_gp_cleanup(struct rcu_state *rsp);
+static void rcu_init_one_nocb(struct rcu_state *rsp);
+static void rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
+static void rcu_init_nocb(void);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
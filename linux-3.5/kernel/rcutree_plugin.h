@@ -2362,3 +2362,382 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocbs=.  Callbacks posted on such a "no-CBs" CPU are
+ * queued on a lockless per-CPU list and invoked by a kthread, named
+ * "rcuo" followed by the flavor and the CPU number, which waits for the
+ * needed grace periods on its own.  The kthreads are not bound to their
+ * CPU and start out affine to the CPUs that are not offloaded, so the
+ * no-CBs CPUs themselves see neither RCU softirq callback invocation nor
+ * the wakeups that go with it.
+ *
+ * The kthreads of the CPUs in a given leaf rcu_node structure wait for
+ * grace periods on that structure's ->nocb_gp_wq, so the end of a grace
+ * period wakes one waitqueue per group rather than every kthread in the
+ * system.
+ */
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the specified
+ * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
+ * string by rhp, and the tail of the string by rhtp.  The non-lazy/lazy
+ * counts are supplied by rhcount and rhcount_lazy.
+ *
+ * If warranted, also wake up the kthread servicing this CPUs queues.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    int rhcount, int rhcount_lazy)
+{
+	int len;
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
+
+	/* If there is no kthread yet, it will find the callbacks at spawn. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (!t)
+		return;
+	len = atomic_long_read(&rdp->nocb_q_count);
+	if (old_rhpp == &rdp->nocb_head) {
+		wake_up(&rdp->nocb_wq); /* ... only if queue was empty ... */
+		rdp->qlen_last_fqs_check = 0;
+	} else if (len > rdp->qlen_last_fqs_check + qhimark) {
+		wake_up_process(t); /* ... or if many callbacks queued. */
+		rdp->qlen_last_fqs_check = LONG_MAX / 2;
+	}
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the normal
+ * callback queue is inoperable.  If this is not a no-CBs CPU, this
+ * function returns failure back to __call_rcu(), which can complain
+ * appropriately.
+ *
+ * Otherwise, this function queues the callback where the corresponding
+ * "rcuo" kthread can find it.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return 0;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, lazy);
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return 1;
+}
+
+/*
+ * Queue an _rcu_barrier() callback behind the callbacks of the specified
+ * no-CBs CPU.  The queue is lockless, so this works from any CPU.
+ */
+static void rcu_nocb_post_barrier(struct rcu_data *rdp, struct rcu_head *rhp,
+				  void (*func)(struct rcu_head *rhp))
+{
+	rhp->func = func;
+	rhp->next = NULL;
+	smp_mb(); /* Ensure count increment seen before callback. */
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, 0);
+}
+
+/*
+ * Does an rcuo kthread still need a grace period that has not yet
+ * completed?  Any CPU noticing this will start one.
+ */
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return ULONG_CMP_LT(ACCESS_ONCE(rsp->completed),
+			    ACCESS_ONCE(rsp->nocb_gp_req));
+}
+
+/*
+ * Wake up the rcuo kthreads waiting for a grace period.  This runs from
+ * irq_work because the end of a grace period is declared with rcu_node
+ * locks held, under which awakening tasks is not safe.
+ */
+static void rcu_nocb_gp_wake(struct irq_work *work)
+{
+	struct rcu_state *rsp = container_of(work, struct rcu_state,
+					     nocb_gp_work);
+	struct rcu_node *rnp;
+
+	smp_mb(); /* Ensure ->completed update seen before waitqueue checks. */
+	rcu_for_each_leaf_node(rsp, rnp)
+		if (waitqueue_active(&rnp->nocb_gp_wq))
+			wake_up_all(&rnp->nocb_gp_wq);
+}
+
+/*
+ * A grace period has just completed: if there are no-CBs CPUs, arrange
+ * to wake up the rcuo kthreads that might be waiting for it.
+ */
+static void rcu_nocb_gp_cleanup(struct rcu_state *rsp)
+{
+	if (have_rcu_nocb_mask)
+		irq_work_queue(&rsp->nocb_gp_work);
+}
+
+/*
+ * Wait for a grace period that starts after the callbacks handed to the
+ * caller were queued.  If no grace period is in progress, the next one
+ * will do; otherwise, the one after the current one is needed.  Either
+ * way that is ->gpnum + 1, which is recorded so that rcu_start_gp() and
+ * cpu_needs_another_gp() see that a grace period is wanted.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	unsigned long c;
+	unsigned long flags;
+	struct rcu_state *rsp = rdp->rsp;
+	struct rcu_node *rnp = rcu_get_root(rsp);
+
+	raw_spin_lock_irqsave(&rnp->lock, flags);
+	c = rsp->gpnum + 1;
+	if (ULONG_CMP_LT(rsp->nocb_gp_req, c))
+		rsp->nocb_gp_req = c;
+	rcu_start_gp(rsp, flags);  /* releases rnp->lock. */
+
+	for (;;) {
+		wait_event_interruptible(
+			rdp->mynode->nocb_gp_wq,
+			ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c));
+		if (likely(ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c)))
+			break;
+		flush_signals(current);
+	}
+	smp_mb(); /* Ensure that CB invocation happens after GP end. */
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* Wait for callbacks to be posted. */
+		wait_event_interruptible(rdp->nocb_wq, rdp->nocb_head);
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			flush_signals(current);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			cond_resched();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_cbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize the no-CBs grace-period machinery of an rcu_state. */
+static void __init rcu_init_one_nocb(struct rcu_state *rsp)
+{
+	struct rcu_node *rnp;
+
+	rsp->nocb_gp_req = rsp->completed;
+	init_irq_work(&rsp->nocb_gp_work, rcu_nocb_gp_wake);
+	rcu_for_each_node_breadth_first(rsp, rnp)
+		init_waitqueue_head(&rnp->nocb_gp_wq);
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/*
+ * Full dynticks CPUs are no-CBs CPUs as well, otherwise invoking
+ * callbacks would keep bringing their tick back.
+ */
+static void __init rcu_init_nocb(void)
+{
+#ifdef CONFIG_NO_HZ_FULL
+	if (!tick_nohz_full_running)
+		return;
+	if (!have_rcu_nocb_mask) {
+		if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT))
+			return;
+		have_rcu_nocb_mask = true;
+	}
+	cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads_one(struct rcu_state *rsp,
+					       const struct cpumask *affinity)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (!cpu_possible(cpu))
+			continue;
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		/* rsp->name is "rcu_" followed by the flavor. */
+		t = kthread_create(rcu_nocb_kthread, rdp, "rcuo%c/%d",
+				   rsp->name[4], cpu);
+		BUG_ON(IS_ERR(t));
+		if (affinity)
+			set_cpus_allowed_ptr(t, affinity);
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+		wake_up_process(t);
+	}
+}
+
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	cpumask_var_t affinity;
+	bool have_affinity;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+
+	/* Start out on the CPUs that do not have their callbacks offloaded. */
+	have_affinity = alloc_cpumask_var(&affinity, GFP_KERNEL);
+	if (have_affinity) {
+		cpumask_andnot(affinity, cpu_possible_mask, rcu_nocb_mask);
+		if (cpumask_empty(affinity)) {
+			free_cpumask_var(affinity);
+			have_affinity = false;
+		}
+	}
+
+	printk(KERN_INFO "RCU: Offloading callbacks from %d CPUs.\n",
+	       cpumask_weight(rcu_nocb_mask));
+	rcu_spawn_nocb_kthreads_one(&rcu_sched_state,
+				    have_affinity ? affinity : NULL);
+	rcu_spawn_nocb_kthreads_one(&rcu_bh_state,
+				    have_affinity ? affinity : NULL);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads_one(&rcu_preempt_state,
+				    have_affinity ? affinity : NULL);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+	if (have_affinity)
+		free_cpumask_var(affinity);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return 0;
+}
+
+static void rcu_nocb_post_barrier(struct rcu_data *rdp, struct rcu_head *rhp,
+				  void (*func)(struct rcu_head *rhp))
+{
+}
+
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return false;
+}
+
+static void rcu_nocb_gp_cleanup(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_init_one_nocb(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
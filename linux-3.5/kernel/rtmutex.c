@@ -98,11 +98,22 @@ static inline void mark_rt_mutex_waiters(struct rt_mutex *lock)
  */
 int rt_mutex_getprio(struct task_struct *task)
 {
+	int prio;
+
 	if (likely(!task_has_pi_waiters(task)))
 		return task->normal_prio;
 
-	return min(task_top_pi_waiter(task)->pi_list_entry.prio,
+	prio = min(task_top_pi_waiter(task)->pi_list_entry.prio,
 		   task->normal_prio);
+
+	/*
+	 * Deadline inheritance is not implemented: an owner blocking a
+	 * SCHED_DEADLINE waiter is boosted to the highest rt priority.
+	 */
+	if (dl_prio(prio) && !dl_prio(task->normal_prio))
+		prio = MAX_DL_PRIO;
+
+	return prio;
 }
 
 /*
@@ -0,0 +1,345 @@
+/*
+ * Core scheduling
+ *
+ * SMT siblings share the caches, branch predictors and execution units of
+ * their physical core, and a task can learn a lot about whatever its
+ * sibling is running. Core scheduling lets tasks that do not trust each
+ * other share a machine without turning SMT off: every task carries a
+ * cookie, and the siblings of a core only ever run tasks with the same
+ * cookie at the same time - or idle.
+ *
+ * Each cpu publishes the cookie of the task it is about to run in
+ * rq->core_cookie. This happens in __schedule(), under the core_lock of
+ * the first sibling of the core, nested inside the cpu's own rq->lock.
+ * A cpu that picks a task whose cookie conflicts with what a sibling runs
+ * records the cookie it is waiting for, and runs one of its fair tasks that
+ * carries the sibling's cookie instead. Only if it has none is it forced
+ * idle.
+ *
+ * A cpu that reschedules while a sibling waits for another cookie hands
+ * the core over to it, and the tick makes sure that happens at least once
+ * every sched_latency. The core thus alternates between cookies at about
+ * the granularity at which CFS alternates between tasks.
+ *
+ * The stop task and the idle task run next to anything.
+ *
+ * Cookies come from prctl(PR_SCHED_CORE) for tasks and from cpu.core_tag
+ * for task groups; a task's own cookie takes precedence over the one of
+ * its group, and a tagged group covers the untagged groups below it.
+ * Tasks that have neither share cookie 0.
+ */
+#include <linux/prctl.h>
+#include <linux/ptrace.h>
+#include <linux/uaccess.h>
+
+#include "sched.h"
+
+struct static_key __sched_core_enabled = STATIC_KEY_INIT_FALSE;
+
+static atomic_long_t sched_core_cookie_seq;
+static DEFINE_MUTEX(sched_core_mutex);
+static bool sched_core_on;
+
+/*
+ * The first cookie switches core scheduling on for good: tearing it down
+ * again would need every cookie ever handed out to be reference counted,
+ * and once switched on the cost is a lock round trip per schedule().
+ */
+static unsigned long sched_core_alloc_cookie(void)
+{
+	mutex_lock(&sched_core_mutex);
+	if (!sched_core_on) {
+		sched_core_on = true;
+		static_key_slow_inc(&__sched_core_enabled);
+	}
+	mutex_unlock(&sched_core_mutex);
+
+	return atomic_long_inc_return(&sched_core_cookie_seq);
+}
+
+static inline struct rq *core_rq(struct rq *rq)
+{
+	return cpu_rq(cpumask_first(topology_thread_cpumask(cpu_of(rq))));
+}
+
+/*
+ * Check whether @rq may run a task with @cookie given what its siblings
+ * run. *@want is set to the cookie of a sibling that conflicts, or left
+ * at SCHED_CORE_IDLE if only a waiting sibling's turn is in the way.
+ *
+ * Called with the core_lock held.
+ */
+static bool sched_core_cookie_allowed(struct rq *rq, unsigned long cookie,
+				      int old_forceidle, unsigned long *want)
+{
+	const struct cpumask *smt_mask = topology_thread_cpumask(cpu_of(rq));
+	bool allowed = true;
+	int i;
+
+	*want = SCHED_CORE_IDLE;
+	if (cookie == SCHED_CORE_IDLE)
+		return true;
+
+	for_each_cpu(i, smt_mask) {
+		struct rq *srq = cpu_rq(i);
+
+		if (srq == rq)
+			continue;
+
+		/* a sibling runs a task we must not run next to */
+		if (srq->core_cookie != SCHED_CORE_IDLE &&
+		    srq->core_cookie != cookie) {
+			*want = srq->core_cookie;
+			allowed = false;
+		}
+
+		/*
+		 * A sibling has been kept out of the core for a different
+		 * cookie: its turn, unless we were the ones waiting to
+		 * begin with.
+		 */
+		if (!old_forceidle && srq->core_forceidle &&
+		    srq->core_wait_cookie != cookie)
+			allowed = false;
+	}
+	return allowed;
+}
+
+/*
+ * Decide what @rq runs given @next, the task it picked, and what its
+ * siblings run, and publish the outcome. Returns @next if it may run.
+ * Otherwise @next is put back and a fair task of @rq that matches the
+ * siblings' cookie is returned, or the idle task if there is none.
+ *
+ * Called from __schedule() with rq->lock held.
+ */
+struct task_struct *sched_core_pick(struct rq *rq, struct task_struct *next)
+{
+	struct rq *core = core_rq(rq);
+	unsigned long cookie, want, tmp, old_cookie = rq->core_cookie;
+	int old_forceidle = rq->core_forceidle;
+	struct task_struct *p = NULL;
+
+	if (next == rq->idle || next->sched_class == &stop_sched_class)
+		cookie = SCHED_CORE_IDLE;
+	else
+		cookie = task_core_cookie(next);
+
+	raw_spin_lock(&core->core_lock);
+	if (sched_core_cookie_allowed(rq, cookie, old_forceidle, &want)) {
+		rq->core_cookie = cookie;
+		rq->core_forceidle = 0;
+		rq->core_run_start = rq->clock_task;
+		goto unlock;
+	}
+
+	/* a sibling runs a task @next may not share the core with */
+	next->sched_class->put_prev_task(rq, next);
+
+	/*
+	 * Rather than idling, run one of our tasks that has the cookie the
+	 * siblings run. We still count as waiting for @next's cookie, so
+	 * that the tick eventually hands the core over to it.
+	 */
+	if (want != SCHED_CORE_IDLE &&
+	    sched_core_cookie_allowed(rq, want, old_forceidle, &tmp))
+		p = pick_next_task_fair_cookie(rq, want);
+
+	if (p) {
+		next = p;
+		rq->core_cookie = want;
+		rq->core_run_start = rq->clock_task;
+	} else {
+		next = idle_sched_class.pick_next_task(rq);
+		rq->core_cookie = SCHED_CORE_IDLE;
+		schedstat_inc(rq, core_forceidle_count);
+	}
+	rq->core_forceidle = 1;
+	rq->core_wait_cookie = cookie;
+unlock:
+	raw_spin_unlock(&core->core_lock);
+
+	/*
+	 * Siblings waiting for the core may be able to run now; they get
+	 * kicked once we have dropped rq->lock, see sched_core_kick().
+	 */
+	if (rq->core_cookie != old_cookie ||
+	    (old_forceidle && !rq->core_forceidle))
+		rq->core_kick = 1;
+
+	return next;
+}
+
+/*
+ * Make siblings that wait for the core re-evaluate it. Called from
+ * post_schedule() without any rq->lock held.
+ */
+void sched_core_kick(struct rq *rq)
+{
+	int i, cpu = cpu_of(rq);
+
+	rq->core_kick = 0;
+
+	for_each_cpu(i, topology_thread_cpumask(cpu)) {
+		struct rq *srq = cpu_rq(i);
+		unsigned long flags;
+
+		if (i == cpu || !srq->core_forceidle)
+			continue;
+
+		raw_spin_lock_irqsave(&srq->lock, flags);
+		if (srq->core_forceidle)
+			resched_task(srq->curr);
+		raw_spin_unlock_irqrestore(&srq->lock, flags);
+	}
+}
+
+/*
+ * Bound how long the current task can keep a sibling that waits for a
+ * different cookie off the core. Called from scheduler_tick() with
+ * rq->lock held.
+ */
+void sched_core_tick(struct rq *rq)
+{
+	int i, cpu = cpu_of(rq);
+
+	if (rq->core_cookie == SCHED_CORE_IDLE)
+		return;
+
+	if (rq->clock_task - rq->core_run_start < sysctl_sched_latency)
+		return;
+
+	for_each_cpu(i, topology_thread_cpumask(cpu)) {
+		struct rq *srq = cpu_rq(i);
+
+		if (i == cpu)
+			continue;
+
+		if (srq->core_forceidle &&
+		    srq->core_wait_cookie != rq->core_cookie) {
+			resched_task(rq->curr);
+			return;
+		}
+	}
+}
+
+static void sched_core_set_cookie(struct task_struct *p, unsigned long cookie)
+{
+	p->core_cookie = cookie;
+	sched_core_resched_task(p);
+}
+
+int sched_core_share_pid(unsigned long cmd, pid_t pid, unsigned long type,
+			 unsigned long uaddr)
+{
+	struct task_struct *task, *t;
+	unsigned long cookie;
+	int err = 0;
+
+	if (type > PR_SCHED_CORE_SCOPE_THREAD_GROUP)
+		return -EINVAL;
+
+	rcu_read_lock();
+	task = pid ? find_task_by_vpid(pid) : current;
+	if (!task) {
+		rcu_read_unlock();
+		return -ESRCH;
+	}
+	get_task_struct(task);
+	rcu_read_unlock();
+
+	/*
+	 * Sharing a cookie with a task amounts to being allowed to run next
+	 * to it, so require the same rights as for inspecting it.
+	 */
+	if (!ptrace_may_access(task, PTRACE_MODE_READ)) {
+		err = -EPERM;
+		goto out;
+	}
+
+	switch (cmd) {
+	case PR_SCHED_CORE_GET:
+		if (type != PR_SCHED_CORE_SCOPE_THREAD || !uaddr) {
+			err = -EINVAL;
+			goto out;
+		}
+		err = put_user((u64)task->core_cookie, (u64 __user *)uaddr);
+		goto out;
+
+	case PR_SCHED_CORE_CREATE:
+		cookie = sched_core_alloc_cookie();
+		break;
+
+	case PR_SCHED_CORE_SHARE_TO:
+		cookie = current->core_cookie;
+		break;
+
+	case PR_SCHED_CORE_SHARE_FROM:
+		if (type != PR_SCHED_CORE_SCOPE_THREAD) {
+			err = -EINVAL;
+			goto out;
+		}
+		sched_core_set_cookie(current, task->core_cookie);
+		goto out;
+
+	default:
+		err = -EINVAL;
+		goto out;
+	}
+
+	if (type == PR_SCHED_CORE_SCOPE_THREAD) {
+		sched_core_set_cookie(task, cookie);
+		goto out;
+	}
+
+	read_lock(&tasklist_lock);
+	t = task;
+	do {
+		sched_core_set_cookie(t, cookie);
+	} while_each_thread(task, t);
+	read_unlock(&tasklist_lock);
+out:
+	put_task_struct(task);
+
+	return err;
+}
+
+#ifdef CONFIG_CGROUP_SCHED
+u64 sched_core_tag_read(struct task_group *tg)
+{
+	return !!tg->core_cookie;
+}
+
+/* make the running tasks of @tg pick up a new cookie */
+static int sched_core_resched_group(struct task_group *tg, void *data)
+{
+	struct cgroup *cgrp = tg->css.cgroup;
+	struct cgroup_iter it;
+	struct task_struct *p;
+
+	cgroup_iter_start(cgrp, &it);
+	while ((p = cgroup_iter_next(cgrp, &it)))
+		sched_core_resched_task(p);
+	cgroup_iter_end(cgrp, &it);
+
+	return 0;
+}
+
+int sched_core_tag_write(struct task_group *tg, u64 val)
+{
+	if (tg == &root_task_group || val > 1)
+		return -EINVAL;
+
+	if (!val)
+		tg->core_cookie = 0;
+	else if (!tg->core_cookie)
+		cmpxchg(&tg->core_cookie, 0, sched_core_alloc_cookie());
+
+	/* the groups below inherit the tag, unless they have their own */
+	rcu_read_lock();
+	walk_tg_tree_from(tg, sched_core_resched_group, tg_nop, NULL);
+	rcu_read_unlock();
+
+	return 0;
+}
+#endif
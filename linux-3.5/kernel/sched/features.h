@@ -66,6 +66,12 @@ SCHED_FEAT(NONTASK_POWER, true)
  */
 SCHED_FEAT(TTWU_QUEUE, true)
 
+/*
+ * Bound the idle-cpu scan in select_idle_sibling() by how long this cpu
+ * is expected to stay idle, relative to the average cost of a scan.
+ */
+SCHED_FEAT(SIS_PROP, true)
+
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
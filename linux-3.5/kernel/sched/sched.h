@@ -3,8 +3,11 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/static_key.h>
+#include <linux/tick.h>
 
 #include "cpupri.h"
+#include "cpudeadline.h"
 
 extern __read_mostly int scheduler_running;
 
@@ -43,6 +46,11 @@ extern __read_mostly int scheduler_running;
  */
 #define RUNTIME_INF	((u64)~0ULL)
 
+static inline int fair_policy(int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+}
+
 static inline int rt_policy(int policy)
 {
 	if (policy == SCHED_FIFO || policy == SCHED_RR)
@@ -55,6 +63,41 @@ static inline int task_has_rt_policy(struct task_struct *p)
 	return rt_policy(p->policy);
 }
 
+static inline int dl_policy(int policy)
+{
+	return policy == SCHED_DEADLINE;
+}
+
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
+/*
+ * Deadline comparisons are done on the wrapped difference, so that
+ * they keep working when the u64 clock overflows.
+ */
+static inline bool dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+/*
+ * Tells if entity @a should preempt entity @b.
+ */
+static inline bool
+dl_entity_preempt(struct sched_dl_entity *a, struct sched_dl_entity *b)
+{
+	return dl_time_before(a->deadline, b->deadline);
+}
+
+/*
+ * Parameters below DL_SCALE bits of nanoseconds (about a microsecond)
+ * are not meaningful to the deadline class; the bandwidth checks are
+ * done at this resolution.
+ */
+#define DL_SCALE		(10)
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -71,8 +114,42 @@ struct rt_bandwidth {
 	struct hrtimer		rt_period_timer;
 };
 
+/*
+ * Bandwidth available to, and allocated by, SCHED_DEADLINE tasks in a
+ * root domain (or on the only runqueue, on UP).  @bw is the per-cpu
+ * limit as a fraction scaled by 2^20, -1 meaning unlimited, and
+ * @total_bw is the sum of the bandwidths of the admitted tasks.
+ */
+struct dl_bw {
+	raw_spinlock_t lock;
+	u64 bw, total_bw;
+};
+
+extern void init_dl_bw(struct dl_bw *dl_b);
+
 extern struct mutex sched_domains_mutex;
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * log2 histograms of the time tasks wait on a runqueue before they run,
+ * in microseconds: bucket 0 counts waits below 1us, bucket i waits in
+ * [2^(i-1), 2^i) us, and the last bucket all waits longer than that.
+ */
+#define SCHED_LAT_BUCKETS	24
+
+struct sched_lat_hist {
+	/* waits that started with a wakeup */
+	unsigned long wakeup[SCHED_LAT_BUCKETS];
+	/* all waits, including those of preempted tasks */
+	unsigned long runq[SCHED_LAT_BUCKETS];
+};
+
+static inline int sched_lat_bucket(u64 wait)
+{
+	return min(fls64(div_u64(wait, NSEC_PER_USEC)), SCHED_LAT_BUCKETS - 1);
+}
+#endif
+
 #ifdef CONFIG_CGROUP_SCHED
 
 #include <linux/cgroup.h>
@@ -82,21 +159,25 @@ struct rt_rq;
 
 static LIST_HEAD(task_groups);
 
+/* throttle durations below 1ms, 2ms, 4ms, ..., 256ms and above */
+#define CFS_THROTTLE_HIST_BUCKETS	10
+
 struct cfs_bandwidth {
 #ifdef CONFIG_CFS_BANDWIDTH
 	raw_spinlock_t lock;
 	ktime_t period;
-	u64 quota, runtime;
+	u64 quota, runtime, burst;
+	u64 runtime_snap;
 	s64 hierarchal_quota;
-	u64 runtime_expires;
 
 	int idle, timer_active;
 	struct hrtimer period_timer, slack_timer;
 	struct list_head throttled_cfs_rq;
 
 	/* statistics */
-	int nr_periods, nr_throttled;
-	u64 throttled_time;
+	int nr_periods, nr_throttled, nr_burst;
+	u64 throttled_time, burst_time;
+	unsigned int throttled_hist[CFS_THROTTLE_HIST_BUCKETS];
 #endif
 };
 
@@ -111,7 +192,10 @@ struct task_group {
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
 
-	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -133,6 +217,16 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_SCHED_CORE
+	/* core scheduling cookie of the group's tasks, 0 if untagged */
+	unsigned long core_cookie;
+#endif
+
+#ifdef CONFIG_SCHEDSTATS
+	/* per-cpu wait histograms of the group's tasks, unused for the root */
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -222,6 +316,18 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * CFS Load tracking
+	 * Under CFS, load is tracked on a per-entity basis and aggregated up.
+	 * This allows for the description of both thread and group usage (in
+	 * the FAIR_GROUP_SCHED case).
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter, removed_load;
+	u64 last_decay;
+#endif /* CONFIG_SMP */
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -238,6 +344,10 @@ struct cfs_rq {
 	struct task_group *tg;	/* group that "owns" this runqueue */
 
 #ifdef CONFIG_SMP
+	/* Required to track per-cpu representation of a task_group */
+	u32 tg_runnable_contrib;
+	unsigned long tg_load_contrib;
+
 	/*
 	 *   h_load = weight * f(tg)
 	 *
@@ -245,26 +355,13 @@ struct cfs_rq {
 	 * this group.
 	 */
 	unsigned long h_load;
-
-	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
-	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
-	u64 runtime_expires;
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -309,6 +406,41 @@ struct rt_rq {
 #endif
 };
 
+/* Deadline class' related fields in a runqueue */
+struct dl_rq {
+	/* runqueue is an rbtree, ordered by deadline */
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+
+#ifdef CONFIG_SMP
+	/*
+	 * Deadline values of the currently executing and the
+	 * earliest ready task on this rq. Caching these facilitates
+	 * the decision whether or not a ready but not running task
+	 * should migrate somewhere else.
+	 */
+	struct {
+		u64 curr;
+		u64 next;
+	} earliest_dl;
+
+	unsigned long dl_nr_migratory;
+	int overloaded;
+
+	/*
+	 * Tasks on this rq that can be pushed away. They are kept in
+	 * an rb-tree, ordered by tasks' deadlines, with caching
+	 * of the leftmost (earliest deadline) element.
+	 */
+	struct rb_root pushable_dl_tasks_root;
+	struct rb_node *pushable_dl_tasks_leftmost;
+#else
+	struct dl_bw dl_bw;
+#endif
+};
+
 #ifdef CONFIG_SMP
 
 /*
@@ -332,6 +464,15 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The bit corresponding to a CPU gets set here if such CPU has more
+	 * than one runnable -deadline task (as it is below for RT tasks).
+	 */
+	cpumask_var_t dlo_mask;
+	atomic_t dlo_count;
+	struct dl_bw dl_bw;
+	struct cpudl cpudl;
 };
 
 extern struct root_domain def_root_domain;
@@ -370,6 +511,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -414,6 +556,8 @@ struct rq {
 
 	struct list_head cfs_tasks;
 
+	struct sched_avg avg;
+
 	u64 rt_avg;
 	u64 age_stamp;
 	u64 idle_stamp;
@@ -458,11 +602,39 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+#ifdef CONFIG_SMP
+	unsigned int ttwu_wake_wide;
+
+	/* select_idle_sibling() stats */
+	unsigned int sis_idle_target;
+	unsigned int sis_idle_core;
+	unsigned int sis_idle_cpu;
+	unsigned int sis_failed;
+#endif
+#ifdef CONFIG_SCHED_CORE
+	/* times this cpu was forced idle by core scheduling */
+	unsigned int core_forceidle_count;
+#endif
+
+	/* runqueue wait histograms */
+	struct sched_lat_hist lat_hist;
 #endif
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
 #endif
+
+#ifdef CONFIG_SCHED_CORE
+	/* the core's state lives in the rq of its first sibling */
+	raw_spinlock_t core_lock;
+	/* cookie of the task this cpu runs, SCHED_CORE_IDLE if none */
+	unsigned long core_cookie;
+	/* the cookie this cpu was kept from running */
+	unsigned long core_wait_cookie;
+	int core_forceidle;
+	int core_kick;
+	u64 core_run_start;
+#endif
 };
 
 static inline int cpu_of(struct rq *rq)
@@ -524,7 +696,11 @@ static inline struct sched_domain *highest_flag_domain(int cpu, int flag)
 }
 
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
+DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+#ifdef CONFIG_SCHED_SMT
+DECLARE_PER_CPU(int, sd_llc_idle_cores);
+#endif
 
 extern int group_balance_cpu(struct sched_group *sg);
 
@@ -846,6 +1022,7 @@ enum cpuacct_stat_index {
    for (class = sched_class_highest; class; class = class->next)
 
 extern const struct sched_class stop_sched_class;
+extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
@@ -869,6 +1046,7 @@ extern void sched_init_granularity(void);
 extern void update_max_interval(void);
 extern void update_group_power(struct sched_domain *sd, int cpu);
 extern int update_runtime(struct notifier_block *nfb, unsigned long action, void *hcpu);
+extern void init_sched_dl_class(void);
 extern void init_sched_rt_class(void);
 extern void init_sched_fair_class(void);
 
@@ -878,6 +1056,10 @@ extern void resched_cpu(int cpu);
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
 
+extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+
+unsigned long to_ratio(u64 period, u64 runtime);
+
 extern void update_idle_cpu_load(struct rq *this_rq);
 
 #ifdef CONFIG_CGROUP_CPUACCT
@@ -919,6 +1101,15 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* A second task needs the tick back for preemption */
+	if (rq->nr_running == 2 && tick_nohz_full_cpu(rq->cpu)) {
+		/* Order rq->nr_running write against the IPI */
+		smp_wmb();
+		tick_nohz_full_kick_cpu(rq->cpu);
+	}
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -1140,13 +1331,76 @@ extern struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq);
 extern struct sched_entity *__pick_last_entity(struct cfs_rq *cfs_rq);
 extern void print_cfs_stats(struct seq_file *m, int cpu);
 extern void print_rt_stats(struct seq_file *m, int cpu);
+extern void print_dl_stats(struct seq_file *m, int cpu);
 
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
+extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
 extern void unthrottle_offline_cfs_rqs(struct rq *rq);
+extern void init_task_runnable_average(struct task_struct *p);
+
+#if defined(CONFIG_SMP) && defined(CONFIG_SCHED_SMT)
+extern void update_idle_core(struct rq *rq);
+#else
+static inline void update_idle_core(struct rq *rq) { }
+#endif
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
 
+#ifdef CONFIG_SCHED_CORE
+/* rq->core_cookie of a cpu that runs nothing that needs isolating */
+#define SCHED_CORE_IDLE		(~0UL)
+
+extern struct static_key __sched_core_enabled;
+
+static inline bool sched_core_enabled(void)
+{
+	return static_key_false(&__sched_core_enabled);
+}
+
+static inline unsigned long task_core_cookie(struct task_struct *p)
+{
+#ifdef CONFIG_CGROUP_SCHED
+	struct task_group *tg;
+#endif
+
+	if (p->core_cookie)
+		return p->core_cookie;
+#ifdef CONFIG_CGROUP_SCHED
+	/* the closest tagged group, as tags cover the groups below */
+	for (tg = task_group(p); tg; tg = tg->parent) {
+		if (tg->core_cookie)
+			return tg->core_cookie;
+	}
+#endif
+	return 0;
+}
+
+extern struct task_struct *sched_core_pick(struct rq *rq,
+					   struct task_struct *next);
+extern struct task_struct *pick_next_task_fair_cookie(struct rq *rq,
+						      unsigned long cookie);
+extern void sched_core_kick(struct rq *rq);
+extern void sched_core_tick(struct rq *rq);
+extern void sched_core_resched_task(struct task_struct *p);
+extern u64 sched_core_tag_read(struct task_group *tg);
+extern int sched_core_tag_write(struct task_group *tg, u64 val);
+#else
+static inline bool sched_core_enabled(void)
+{
+	return false;
+}
+
+static inline struct task_struct *sched_core_pick(struct rq *rq,
+						  struct task_struct *next)
+{
+	return next;
+}
+
+static inline void sched_core_kick(struct rq *rq) { }
+static inline void sched_core_tick(struct rq *rq) { }
+#endif
+
 #ifdef CONFIG_NO_HZ
 enum rq_nohz_flag_bits {
 	NOHZ_TICK_STOPPED,
@@ -10,11 +10,11 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 17
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
-	int cpu;
+	int cpu, i;
 	int mask_len = DIV_ROUND_UP(NR_CPUS, 32) * 9;
 	char *mask_str = kmalloc(mask_len, GFP_KERNEL);
 
@@ -38,7 +38,22 @@ static int show_schedstat(struct seq_file *seq, void *v)
 		    rq->ttwu_count, rq->ttwu_local,
 		    rq->rq_cpu_time,
 		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount);
+#ifdef CONFIG_SMP
+		seq_printf(seq, " %u %u %u %u %u",
+		    rq->ttwu_wake_wide,
+		    rq->sis_idle_target, rq->sis_idle_core,
+		    rq->sis_idle_cpu, rq->sis_failed);
+#endif
+
+		seq_printf(seq, "\n");
 
+		/* runqueue wait histograms */
+		seq_printf(seq, "wakeup_lat%d", cpu);
+		for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+			seq_printf(seq, " %lu", rq->lat_hist.wakeup[i]);
+		seq_printf(seq, "\nrunq_wait%d", cpu);
+		for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+			seq_printf(seq, " %lu", rq->lat_hist.runq[i]);
 		seq_printf(seq, "\n");
 
 #ifdef CONFIG_SMP
@@ -29,6 +29,42 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 	if (rq)
 		rq->rq_sched_info.run_delay += delta;
 }
+
+#ifdef CONFIG_CGROUP_SCHED
+extern void tg_sched_lat_account(struct task_struct *p, int bucket, int wakeup);
+#else
+static inline void
+tg_sched_lat_account(struct task_struct *p, int bucket, int wakeup) {}
+#endif
+
+/*
+ * A task that waited on a runqueue is about to run; account the whole wait,
+ * including the part spent on cpus it was migrated away from, in the wait
+ * histograms of this cpu and of the task's group.
+ *
+ * Expects runqueue lock to be held for atomicity of update
+ */
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t, unsigned long long delta)
+{
+	int bucket = sched_lat_bucket(t->sched_info.wait_migrated + delta);
+	int wakeup = t->sched_info.wait_wakeup;
+
+	t->sched_info.wait_migrated = 0;
+	t->sched_info.wait_wakeup = 0;
+
+	rq->lat_hist.runq[bucket]++;
+	if (wakeup)
+		rq->lat_hist.wakeup[bucket]++;
+
+	tg_sched_lat_account(t, bucket, wakeup);
+}
+
+static inline void
+sched_lat_dequeued(struct task_struct *t, unsigned long long delta)
+{
+	t->sched_info.wait_migrated += delta;
+}
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
@@ -42,6 +78,12 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 static inline void
 rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 {}
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t, unsigned long long delta)
+{}
+static inline void
+sched_lat_dequeued(struct task_struct *t, unsigned long long delta)
+{}
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
@@ -70,6 +112,7 @@ static inline void sched_info_dequeued(struct task_struct *t)
 	t->sched_info.run_delay += delta;
 
 	rq_sched_info_dequeued(task_rq(t), delta);
+	sched_lat_dequeued(t, delta);
 }
 
 /*
@@ -81,8 +124,10 @@ static void sched_info_arrive(struct task_struct *t)
 {
 	unsigned long long now = task_rq(t)->clock, delta = 0;
 
-	if (t->sched_info.last_queued)
+	if (t->sched_info.last_queued) {
 		delta = now - t->sched_info.last_queued;
+		sched_lat_arrive(task_rq(t), t, delta);
+	}
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
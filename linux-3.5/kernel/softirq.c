@@ -338,9 +338,15 @@ void irq_exit(void)
 		invoke_softirq();
 
 #ifdef CONFIG_NO_HZ
-	/* Make sure that timer wheel updates are propagated */
-	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
-		tick_nohz_irq_exit();
+	if (!in_interrupt()) {
+		int cpu = smp_processor_id();
+
+		/* Make sure that timer wheel updates are propagated */
+		if (idle_cpu(cpu) && !need_resched())
+			tick_nohz_irq_exit();
+		else if (tick_nohz_full_cpu(cpu))
+			tick_nohz_full_check();
+	}
 #endif
 	rcu_irq_exit();
 	sched_preempt_enable_no_resched();
@@ -2169,6 +2169,9 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			if (arg2 || arg3 || arg4 || arg5)
 				return -EINVAL;
 			return current->no_new_privs ? 1 : 0;
+		case PR_SCHED_CORE:
+			error = sched_core_share_pid(arg2, arg3, arg4, arg5);
+			break;
 		default:
 			error = -EINVAL;
 			break;
@@ -20,6 +20,8 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/posix-timers.h>
+#include <linux/perf_event.h>
 
 #include <asm/irq_regs.h>
 
@@ -40,6 +42,13 @@ struct tick_sched *tick_get_tick_sched(int cpu)
 	return &per_cpu(tick_cpu_sched, cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static void tick_nohz_full_account_tick(struct tick_sched *ts);
+static void tick_nohz_full_restart(struct tick_sched *ts, ktime_t now);
+#else
+static inline void tick_nohz_full_account_tick(struct tick_sched *ts) { }
+#endif
+
 /*
  * Must be called with interrupts disabled !
  */
@@ -123,6 +132,46 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * CPUs listed in nohz_full= stop their tick while they run a single task.
+ * Timekeeping stays with the boot CPU, which never stops its tick.
+ */
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+static bool tick_nohz_full_requested __initdata;
+
+/*
+ * Even with the tick stopped, a busy CPU takes one tick a second so that
+ * the scheduler statistics, the load balancer and the cputime of the
+ * running task keep moving.
+ */
+#define TICK_NOHZ_FULL_MAX_DEFERMENT	NSEC_PER_SEC
+
+static int __init setup_tick_nohz_full(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_requested = true;
+
+	return 1;
+}
+
+__setup("nohz_full=", setup_tick_nohz_full);
+#endif
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -271,50 +320,20 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
-static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
+/*
+ * Stop the tick, or push its next expiry further out when it is already
+ * stopped. This is shared between idle CPUs and full dynticks CPUs which
+ * run a single task; ts->inidle tells the two apart.
+ */
+static void tick_nohz_stop_sched_tick(struct tick_sched *ts, ktime_t now,
+				      int cpu)
 {
 	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
 	unsigned long rcu_delta_jiffies;
-	ktime_t last_update, expires, now;
+	ktime_t last_update, expires;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
 	u64 time_delta;
-	int cpu;
-
-	cpu = smp_processor_id();
-	ts = &per_cpu(tick_cpu_sched, cpu);
-
-	now = tick_nohz_start_idle(cpu, ts);
-
-	/*
-	 * If this cpu is offline and it is the one which updates
-	 * jiffies, then give up the assignment and let it be taken by
-	 * the cpu which runs the tick timer next. If we don't drop
-	 * this here the jiffies might be stale and do_timer() never
-	 * invoked.
-	 */
-	if (unlikely(!cpu_online(cpu))) {
-		if (cpu == tick_do_timer_cpu)
-			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
-	}
-
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
-		return;
-
-	if (need_resched())
-		return;
-
-	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
-		static int ratelimit;
-
-		if (ratelimit < 10) {
-			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
-			       (unsigned int) local_softirq_pending());
-			ratelimit++;
-		}
-		return;
-	}
 
-	ts->idle_calls++;
 	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&xtime_lock);
@@ -388,6 +407,13 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 					   tick_period.tv64 * delta_jiffies);
 		}
 
+#ifdef CONFIG_NO_HZ_FULL
+		/* A busy CPU still takes the residual tick */
+		if (!ts->inidle)
+			time_delta = min_t(u64, time_delta,
+					   TICK_NOHZ_FULL_MAX_DEFERMENT);
+#endif
+
 		if (time_delta < KTIME_MAX)
 			expires = ktime_add_ns(last_update, time_delta);
 		else
@@ -405,15 +431,22 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
+			if (ts->inidle) {
+				select_nohz_load_balancer(1);
+				calc_load_enter_idle();
+				ts->idle_jiffies = last_jiffies;
+			}
+#ifdef CONFIG_NO_HZ_FULL
+			else
+				ts->busy_jiffies = last_jiffies;
+#endif
 
 			ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
-			ts->idle_jiffies = last_jiffies;
 		}
 
-		ts->idle_sleeps++;
+		if (ts->inidle)
+			ts->idle_sleeps++;
 
 		/* Mark expires */
 		ts->idle_expires = expires;
@@ -450,6 +483,63 @@ out:
 	ts->sleep_length = ktime_sub(dev->next_event, now);
 }
 
+static void __tick_nohz_idle_enter(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	ktime_t now;
+
+	now = tick_nohz_start_idle(cpu, ts);
+
+	/*
+	 * If this cpu is offline and it is the one which updates
+	 * jiffies, then give up the assignment and let it be taken by
+	 * the cpu which runs the tick timer next. If we don't drop
+	 * this here the jiffies might be stale and do_timer() never
+	 * invoked.
+	 */
+	if (unlikely(!cpu_online(cpu))) {
+		if (cpu == tick_do_timer_cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	}
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (need_resched())
+		return;
+
+	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
+		static int ratelimit;
+
+		if (ratelimit < 10) {
+			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
+			       (unsigned int) local_softirq_pending());
+			ratelimit++;
+		}
+		return;
+	}
+
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * Full dynticks CPUs rely on the timekeeping CPU, so it keeps
+	 * its tick even when idle. A dropped duty is picked up here
+	 * before going to sleep.
+	 */
+	if (tick_nohz_full_running) {
+		if (tick_do_timer_cpu == cpu)
+			return;
+		if (tick_do_timer_cpu == TICK_DO_TIMER_NONE &&
+		    cpu_online(cpu) && !tick_nohz_full_cpu(cpu)) {
+			tick_do_timer_cpu = cpu;
+			return;
+		}
+	}
+#endif
+
+	ts->idle_calls++;
+	tick_nohz_stop_sched_tick(ts, now, cpu);
+}
+
 /**
  * tick_nohz_idle_enter - stop the idle tick from the idle task
  *
@@ -479,13 +569,22 @@ void tick_nohz_idle_enter(void)
 	local_irq_disable();
 
 	ts = &__get_cpu_var(tick_cpu_sched);
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * The tick may have been stopped for the task that just went to
+	 * sleep. Restart it so the idle path stops it with the idle time
+	 * and load accounting set up.
+	 */
+	if (ts->tick_stopped)
+		tick_nohz_full_restart(ts, ktime_get());
+#endif
 	/*
 	 * set ts->inidle unconditionally. even if the system did not
 	 * switch to nohz mode the cpu frequency governers rely on the
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 
 	local_irq_enable();
 }
@@ -505,7 +604,7 @@ void tick_nohz_irq_exit(void)
 	if (!ts->inidle)
 		return;
 
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 }
 
 /**
@@ -611,6 +710,216 @@ void tick_nohz_idle_exit(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Account the ticks a busy CPU skipped while its tick was stopped. The
+ * whole stretch is charged as user time unless @p is a kernel thread;
+ * the ticks that do fire sample the mode precisely.
+ */
+static void tick_nohz_account_busy_ticks(struct tick_sched *ts,
+					 struct task_struct *p)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->busy_jiffies;
+	cputime_t cputime;
+
+	ts->busy_jiffies = jiffies;
+	if (!ticks || ticks >= LONG_MAX || is_idle_task(p))
+		return;
+
+	cputime = jiffies_to_cputime(ticks);
+	if (p->flags & PF_KTHREAD)
+		account_system_time(p, hardirq_count(), cputime,
+				    cputime_to_scaled(cputime));
+	else
+		account_user_time(p, cputime, cputime_to_scaled(cputime));
+#endif
+}
+
+/*
+ * Called from the tick handler when the residual tick of a busy CPU
+ * fires. The tick itself is accounted by update_process_times().
+ */
+static void tick_nohz_full_account_tick(struct tick_sched *ts)
+{
+	ts->busy_jiffies++;
+	tick_nohz_account_busy_ticks(ts, current);
+}
+
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	if (rcu_needs_tick(cpu))
+		return false;
+
+	return true;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_account_busy_ticks(ts, current);
+	touch_softlockup_watchdog();
+
+	ts->tick_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/**
+ * tick_nohz_full_check - stop or restart the tick of a full dynticks CPU
+ *
+ * Called on interrupt exit on full dynticks CPUs that are not idle. Stops
+ * the tick when the CPU runs a single task and nothing else needs it, and
+ * restarts it when that is no longer true. Other CPUs make us get here by
+ * sending a reschedule IPI through tick_nohz_full_kick_cpu().
+ */
+void tick_nohz_full_check(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	int cpu = smp_processor_id();
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle)
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (can_stop_full_tick(cpu))
+		tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+	else if (ts->tick_stopped)
+		tick_nohz_full_restart(ts, ktime_get());
+}
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks CPU reevaluate its tick
+ * @cpu: the CPU to kick
+ *
+ * Safe to call with interrupts disabled and from any context that can
+ * send a reschedule IPI.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	smp_send_reschedule(cpu);
+}
+
+/**
+ * tick_nohz_full_kick_timer - kick a full dynticks CPU for a new timer
+ * @cpu: the CPU the timer was queued on
+ * @expires: the expiry of the new timer, in jiffies
+ *
+ * A busy full dynticks CPU with its tick stopped only looks at its timer
+ * wheel again when the event it programmed fires. Kick it when the new
+ * timer expires before that. Must be called with the timer base lock of
+ * @cpu held. Returns false if @cpu is not a busy full dynticks CPU, in
+ * which case the caller has to care about idle CPUs itself.
+ */
+bool tick_nohz_full_kick_timer(int cpu, unsigned long expires)
+{
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle)
+		return false;
+
+	if (ts->tick_stopped && time_before(expires, ts->next_jiffies))
+		smp_send_reschedule(cpu);
+	return true;
+}
+
+/**
+ * tick_nohz_full_kick_all - make all full dynticks CPUs reevaluate their tick
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		smp_send_reschedule(cpu);
+	preempt_enable();
+}
+
+/**
+ * tick_nohz_task_switch - reevaluate the tick after a context switch
+ * @prev: the task that was switched out
+ *
+ * Charges @prev with the ticks it ran through with the tick stopped and
+ * restarts the tick if the new task needs it, e.g. for its posix cpu
+ * timers. Called from finish_task_switch() with the runqueue unlocked.
+ */
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+
+	cpu = smp_processor_id();
+	ts = &per_cpu(tick_cpu_sched, cpu);
+	if (tick_nohz_full_cpu(cpu) && ts->tick_stopped && !ts->inidle) {
+		tick_nohz_account_busy_ticks(ts, prev);
+		if (!can_stop_full_tick(cpu))
+			tick_nohz_full_restart(ts, ktime_get());
+	}
+
+	local_irq_restore(flags);
+}
+
+static int __cpuinit tick_nohz_cpu_down_callback(struct notifier_block *nfb,
+						 unsigned long action,
+						 void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DOWN_PREPARE:
+		/*
+		 * The timekeeping CPU keeps jiffies and wall time going on
+		 * behalf of the full dynticks CPUs, it can't go away.
+		 */
+		if (tick_nohz_full_running && tick_do_timer_cpu == cpu)
+			return NOTIFY_BAD;
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+/**
+ * tick_nohz_init - enable full dynticks on the CPUs given by nohz_full=
+ */
+void __init tick_nohz_init(void)
+{
+	char buf[64];
+
+	if (!tick_nohz_full_requested || !tick_nohz_enabled)
+		return;
+
+	if (cpumask_empty(tick_nohz_full_mask))
+		return;
+
+	tick_nohz_full_running = true;
+	cpu_notifier(tick_nohz_cpu_down_callback, 0);
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", buf);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -636,7 +945,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -653,7 +963,10 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 */
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
-		ts->idle_jiffies++;
+		if (ts->inidle)
+			ts->idle_jiffies++;
+		else
+			tick_nohz_full_account_tick(ts);
 	}
 
 	update_process_times(user_mode(regs));
@@ -788,7 +1101,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -811,7 +1125,10 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		 */
 		if (ts->tick_stopped) {
 			touch_softlockup_watchdog();
-			ts->idle_jiffies++;
+			if (ts->inidle)
+				ts->idle_jiffies++;
+			else
+				tick_nohz_full_account_tick(ts);
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
@@ -55,33 +55,68 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The per-CPU timer wheel.
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each. Level 0 has a
+ * granularity of one jiffy, and every further level is LVL_CLK_DIV times
+ * coarser than the one below it:
+ *
+ * HZ 1000
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~12d)
+ *
+ * A timer is queued once, in the level whose range covers its timeout,
+ * with its expiry rounded up to the granularity of that level, and it is
+ * never moved again: there is no cascading. The price is that timers far
+ * in the future fire up to one granularity late (about 12%), which is
+ * fine for the timeouts that get that far - they are almost all canceled
+ * before they expire. Timeouts beyond the last level are clamped to its
+ * range and fire early.
+ *
+ * A bitmap of the non-empty buckets makes finding the next expiring
+ * bucket a handful of find_next_bit() calls, and lets the softirq skip
+ * the jiffies a NO_HZ CPU slept through.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The first jiffies offset that no longer fits into level n - 1 */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	int cpu;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -330,46 +365,105 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket index of a timer expiring at @expires in level @lvl. The expiry
+ * is rounded up to the level granularity, so a timer never fires early;
+ * the rounded expiry is returned in @bucket_expiry.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long) delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/*
+		 * Force the expiry into the last level: such timers fire
+		 * early, at the end of the range the wheel can cover.
 		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
+	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
 	}
+	return calc_index(expires, lvl, bucket_expiry);
+}
+
+static void enqueue_timer(struct tvec_base *base, struct timer_list *timer,
+			  unsigned int idx, unsigned long bucket_expiry)
+{
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	timer->idx = idx;
+
+	if (time_before(bucket_expiry, base->next_timer) &&
+	    !tbase_get_deferrable(timer->base))
+		base->next_timer = bucket_expiry;
+}
+
+/*
+ * A CPU whose tick is stopped, because it is idle or runs a single task
+ * in full dynticks mode, looks at its wheel again only when the event it
+ * programmed fires. Kick it when a timer goes into its base that expires
+ * before the first one it knows about. Holding the base lock keeps a CPU
+ * on its way to stopping the tick from evaluating the wheel under us.
+ * Must be called before the timer is enqueued.
+ */
+static void trigger_dyntick_cpu(struct tvec_base *base,
+				struct timer_list *timer,
+				unsigned long bucket_expiry)
+{
+#ifdef CONFIG_NO_HZ
+	if (tbase_get_deferrable(timer->base))
+		return;
+
+	if (time_after(base->next_timer, base->timer_jiffies) &&
+	    !time_before(bucket_expiry, base->next_timer))
+		return;
+
+	if (tick_nohz_full_kick_timer(base->cpu, bucket_expiry))
+		return;
+
+	if (base != __this_cpu_read(tvec_bases))
+		wake_up_idle_cpu(base->cpu);
+#endif
+}
+
+static inline void forward_timer_base(struct tvec_base *base);
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	forward_timer_base(base);
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
+	trigger_dyntick_cpu(base, timer, bucket_expiry);
+	enqueue_timer(base, timer, idx, bucket_expiry);
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -667,13 +761,35 @@ static inline void detach_timer(struct timer_list *timer,
 	entry->prev = LIST_POISON2;
 }
 
+/*
+ * Take a pending timer off its bucket. When that empties the bucket,
+ * clear its pending bit and invalidate the cached next expiry so that
+ * get_next_timer_interrupt() looks it up again.
+ */
+static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
+			     int clear_pending)
+{
+	unsigned int idx = timer->idx;
+
+	if (!timer_pending(timer))
+		return 0;
+
+	detach_timer(timer, clear_pending);
+	if (list_empty(base->vectors + idx)) {
+		__clear_bit(idx, base->pending_map);
+		if (!tbase_get_deferrable(timer->base))
+			base->next_timer = base->timer_jiffies;
+	}
+	return 1;
+}
+
 /*
  * We are using hashed locking: holding per_cpu(tvec_bases).lock
  * means that all timers which are tied to this base via timer->base are
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found in the wheel buckets.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -699,6 +815,35 @@ static struct tvec_base *lock_timer_base(struct timer_list *timer,
 	}
 }
 
+/*
+ * Move a timer that is not queued from @base to @new_base. Called with
+ * @base locked, returns with the base the timer ended up on locked.
+ */
+static struct tvec_base *switch_timer_base(struct timer_list *timer,
+					   struct tvec_base *base,
+					   struct tvec_base *new_base)
+{
+	if (base == new_base)
+		return base;
+
+	/*
+	 * We are trying to schedule the timer on the local CPU.
+	 * However we can't change timer's base while it is running,
+	 * otherwise del_timer_sync() can't detect that the timer's
+	 * handler yet has not finished. This also guarantees that
+	 * the timer is serialized wrt itself.
+	 */
+	if (likely(base->running_timer != timer)) {
+		/* See the comment in lock_timer_base() */
+		timer_set_base(timer, NULL);
+		spin_unlock(&base->lock);
+		base = new_base;
+		spin_lock(&base->lock);
+		timer_set_base(timer, base);
+	}
+	return base;
+}
+
 static inline int
 __mod_timer(struct timer_list *timer, unsigned long expires,
 						bool pending_only, int pinned)
@@ -713,10 +858,28 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	base = lock_timer_base(timer, &flags);
 
 	if (timer_pending(timer)) {
-		detach_timer(timer, 0);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
+		/*
+		 * A pending timer is re-armed on the base it is queued on,
+		 * unless the caller asked for it to be pinned here. Sockets
+		 * re-arm their timers from whichever CPU handled the last
+		 * packet; following them around costs a second base lock
+		 * and bounces the timer between wheels for nothing.
+		 *
+		 * When the new expiry lands in the bucket the timer already
+		 * sits in, only the expiry needs updating.
+		 */
+		if (!pinned || base == __this_cpu_read(tvec_bases)) {
+			unsigned long bucket_expiry;
+
+			forward_timer_base(base);
+			if (calc_wheel_index(expires, base->timer_jiffies,
+					     &bucket_expiry) == timer->idx) {
+				timer->expires = expires;
+				ret = 1;
+				goto out_unlock;
+			}
+		}
+		detach_if_pending(timer, base, 0);
 		ret = 1;
 	} else {
 		if (pending_only)
@@ -725,36 +888,20 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	debug_activate(timer, expires);
 
-	cpu = smp_processor_id();
+	new_base = base;
+	if (!ret || pinned) {
+		cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
-		cpu = get_nohz_timer_target();
+		if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
+			cpu = get_nohz_timer_target();
 #endif
-	new_base = per_cpu(tvec_bases, cpu);
-
-	if (base != new_base) {
-		/*
-		 * We are trying to schedule the timer on the local CPU.
-		 * However we can't change timer's base while it is running,
-		 * otherwise del_timer_sync() can't detect that the timer's
-		 * handler yet has not finished. This also guarantees that
-		 * the timer is serialized wrt itself.
-		 */
-		if (likely(base->running_timer != timer)) {
-			/* See the comment in lock_timer_base() */
-			timer_set_base(timer, NULL);
-			spin_unlock(&base->lock);
-			base = new_base;
-			spin_lock(&base->lock);
-			timer_set_base(timer, base);
-		}
+		new_base = per_cpu(tvec_bases, cpu);
 	}
 
+	base = switch_timer_base(timer, base, new_base);
+
 	timer->expires = expires;
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
 out_unlock:
@@ -882,6 +1029,79 @@ int mod_timer_pinned(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pinned);
 
+/**
+ * mod_timers - modify the timeout of a batch of timers
+ * @timers: the timers to be modified
+ * @nr: number of timers in @timers
+ * @expires: new timeout in jiffies, common to all of them
+ *
+ * mod_timers() has the effect of calling mod_timer() on each of @timers
+ * with the same @expires, but it keeps interrupts disabled across the
+ * whole batch and takes a timer base lock, and looks up the wheel bucket,
+ * only once for every run of timers that are queued on the same base.
+ * Pending timers stay on their base, inactive ones are queued on the
+ * current CPU. No slack is applied, so that all of them share a bucket.
+ *
+ * The function returns the number of timers that were pending.
+ */
+int mod_timers(struct timer_list **timers, unsigned int nr,
+	       unsigned long expires)
+{
+	struct tvec_base *base = NULL, *new_base;
+	unsigned long flags, tflags, bucket_expiry = 0;
+	unsigned int i, idx = 0;
+	int ret = 0;
+
+	local_irq_save(flags);
+	new_base = __this_cpu_read(tvec_bases);
+
+	for (i = 0; i < nr; i++) {
+		struct timer_list *timer = timers[i];
+
+		timer_stats_timer_set_start_info(timer);
+		BUG_ON(!timer->function);
+
+		/*
+		 * With base->lock held, timer->base can only point to base
+		 * if the timer is really queued there.
+		 */
+		if (!base || tbase_get_base(timer->base) != base) {
+			if (base)
+				spin_unlock(&base->lock);
+			base = lock_timer_base(timer, &tflags);
+			forward_timer_base(base);
+			idx = calc_wheel_index(expires, base->timer_jiffies,
+					       &bucket_expiry);
+		}
+
+		if (timer_pending(timer)) {
+			ret++;
+			if (timer->idx == idx) {
+				timer->expires = expires;
+				continue;
+			}
+			detach_if_pending(timer, base, 0);
+		} else if (base != new_base) {
+			base = switch_timer_base(timer, base, new_base);
+			forward_timer_base(base);
+			idx = calc_wheel_index(expires, base->timer_jiffies,
+					       &bucket_expiry);
+		}
+
+		debug_activate(timer, expires);
+		timer->expires = expires;
+		trigger_dyntick_cpu(base, timer, bucket_expiry);
+		enqueue_timer(base, timer, idx, bucket_expiry);
+	}
+
+	if (base)
+		spin_unlock(&base->lock);
+	local_irq_restore(flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(mod_timers);
+
 /**
  * add_timer - start a timer
  * @timer: the timer to be added
@@ -920,19 +1140,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
-	/*
-	 * Check whether the other CPU is idle and needs to be
-	 * triggered to reevaluate the timer wheel when nohz is
-	 * active. We are protected against the other CPU fiddling
-	 * with the timer by holding the timer base lock. This also
-	 * makes sure that a CPU on the way to idle can not evaluate
-	 * the timer wheel.
-	 */
-	wake_up_idle_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -959,13 +1167,7 @@ int del_timer(struct timer_list *timer)
 	timer_stats_timer_clear_start_info(timer);
 	if (timer_pending(timer)) {
 		base = lock_timer_base(timer, &flags);
-		if (timer_pending(timer)) {
-			detach_timer(timer, 1);
-			if (timer->expires == base->next_timer &&
-			    !tbase_get_deferrable(timer->base))
-				base->next_timer = base->timer_jiffies;
-			ret = 1;
-		}
+		ret = detach_if_pending(timer, base, 1);
 		spin_unlock_irqrestore(&base->lock, flags);
 	}
 
@@ -994,14 +1196,7 @@ int try_to_del_timer_sync(struct timer_list *timer)
 		goto out;
 
 	timer_stats_timer_clear_start_info(timer);
-	ret = 0;
-	if (timer_pending(timer)) {
-		detach_timer(timer, 1);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
-		ret = 1;
-	}
+	ret = detach_if_pending(timer, base, 1);
 out:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -1075,26 +1270,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1138,133 +1313,180 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	while (!list_empty(head)) {
+		struct timer_list *timer;
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
 
-/**
- * __run_timers - run all expired timers (if any) on this CPU.
- * @base: the timer vector to be processed.
- *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_timer(timer, 1);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
+/*
+ * Move the buckets that expire at base->timer_jiffies to @heads: the
+ * level 0 bucket, plus the bucket of every level whose granularity the
+ * clock is aligned to.
  */
-static inline void __run_timers(struct tvec_base *base)
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
 {
-	struct timer_list *timer;
+	unsigned long clk = base->timer_jiffies;
+	unsigned int i, idx;
+	int levels = 0;
 
-	spin_lock_irq(&base->lock);
-	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
+
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
+
+#ifdef CONFIG_NO_HZ
+/*
+ * Distance, in buckets of the level at @offset, from bucket @clk to the
+ * next pending bucket, or -1 if the level is empty.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
 
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
 
-			timer_stats_account_timer(timer);
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
+
+static bool bucket_has_timers(struct list_head *head, bool skip_deferrable)
+{
+	struct timer_list *timer;
 
-			base->running_timer = timer;
-			detach_timer(timer, 1);
+	if (!skip_deferrable)
+		return true;
 
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
+	list_for_each_entry(timer, head, entry) {
+		if (!tbase_get_deferrable(timer->base))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Find the jiffy at which the next bucket expires. With @skip_deferrable,
+ * buckets holding only deferrable timers are ignored. Must be called
+ * with the base lock held.
+ */
+static unsigned long __next_timer_expiry(struct tvec_base *base,
+					 bool skip_deferrable)
+{
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
+
+	next = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	clk = base->timer_jiffies;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		unsigned int pos = clk & LVL_MASK;
+		int dist = 0;
+
+		for (;;) {
+			int n = next_pending_bucket(base, offset,
+						    (pos + dist) & LVL_MASK);
+
+			if (n < 0 || dist + n >= LVL_SIZE)
+				break;
+			dist += n;
+			if (bucket_has_timers(base->vectors + offset +
+					      ((pos + dist) & LVL_MASK),
+					      skip_deferrable)) {
+				unsigned long tmp = clk + dist;
+
+				tmp <<= LVL_SHIFT(lvl);
+				if (time_before(tmp, next))
+					next = tmp;
+				break;
+			}
+			dist++;
 		}
+		/*
+		 * The next level is looked at once the clock reaches its
+		 * granularity, so round the clock up rather than down.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
-	base->running_timer = NULL;
-	spin_unlock_irq(&base->lock);
+	return next;
 }
 
-#ifdef CONFIG_NO_HZ
 /*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
+ * A CPU that was idle in NO_HZ mode can come back to a clock that lags
+ * jiffies by many ticks. There is no point in walking every one of them
+ * when the pending bitmap tells us where the next bucket is.
  */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
+static inline void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long next;
 
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+	if ((long)(jiffies - base->timer_jiffies) < 2)
+		return;
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+	next = __next_timer_expiry(base, false);
+	if (time_after(next, base->timer_jiffies))
+		base->timer_jiffies = time_before(next, jiffies) ? next : jiffies;
+}
+#else
+static inline void forward_timer_base(struct tvec_base *base) { }
+#endif
+
+/**
+ * __run_timers - run all expired timers (if any) on this CPU.
+ * @base: the timer vector to be processed.
+ *
+ * This function executes all expired timer buckets.
+ */
+static inline void __run_timers(struct tvec_base *base)
+{
+	struct list_head heads[LVL_DEPTH];
+	int levels;
+
+	spin_lock_irq(&base->lock);
+	while (time_after_eq(jiffies, base->timer_jiffies)) {
+		forward_timer_base(base);
+
+		levels = collect_expired_timers(base, heads);
+		++base->timer_jiffies;
+
+		while (levels--)
+			expire_timers(base, heads + levels);
 	}
-	return expires;
+	base->running_timer = NULL;
+	spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_NO_HZ
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1326,7 +1548,7 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 		return now + NEXT_TIMER_MAX_DELTA;
 	spin_lock(&base->lock);
 	if (time_before_eq(base->next_timer, base->timer_jiffies))
-		base->next_timer = __next_timer_interrupt(base);
+		base->next_timer = __next_timer_expiry(base, true);
 	expires = base->next_timer;
 	spin_unlock(&base->lock);
 
@@ -1693,17 +1915,13 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
+	base->cpu = cpu;
 	return 0;
 }
 
@@ -1716,9 +1934,6 @@ static void migrate_timer_list(struct tvec_base *new_base, struct list_head *hea
 		timer = list_first_entry(head, struct timer_list, entry);
 		detach_timer(timer, 0);
 		timer_set_base(timer, new_base);
-		if (time_before(timer->expires, new_base->next_timer) &&
-		    !tbase_get_deferrable(timer->base))
-			new_base->next_timer = timer->expires;
 		internal_add_timer(new_base, timer);
 	}
 }
@@ -1741,14 +1956,9 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for_each_set_bit(i, old_base->pending_map, WHEEL_SIZE)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SIZE);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -16,9 +16,11 @@
  *
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
- * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * automatically managed.  There is one worker pool for each CPU.
+ * Works which are better served by workers which are not bound to any
+ * specific CPU go to dynamically created unbound pools, which are
+ * shared among workqueues with identical attributes and, on NUMA
+ * machines, chosen per node.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +43,9 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/jhash.h>
+#include <linux/moduleparam.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -76,6 +81,8 @@ enum {
 	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
 	BUSY_WORKER_HASH_MASK	= BUSY_WORKER_HASH_SIZE - 1,
 
+	UNBOUND_GCWQ_HASH_ORDER	= 6,		/* hashed by gcwq->attrs */
+
 	MAX_IDLE_WORKERS_RATIO	= 4,		/* 1/4 of busy can be idle */
 	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* keep idle ones for 5 mins */
 
@@ -112,6 +119,16 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * FW: wq->flush_mutex and workqueue_lock protected for writes.  Either
+ *     for reads.
+ *
+ * FR: wq->flush_mutex protected for writes.  Sched-RCU protected for
+ *     reads.
+ *
+ * PL: wq_pool_mutex protected.
+ *
+ * MD: wq_mayday_lock protected.
  */
 
 struct global_cwq;
@@ -142,7 +159,9 @@ struct worker {
 /*
  * Global per-cpu workqueue.  There's one and only one for each cpu
  * and all works are queued and processed here regardless of their
- * target workqueues.
+ * target workqueues.  Unbound gcwqs are created on demand, one for
+ * each distinct set of workqueue_attrs in use, and have their cpu set
+ * to WORK_CPU_UNBOUND.
  */
 struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
@@ -167,6 +186,14 @@ struct global_cwq {
 	unsigned int		trustee_state;	/* L: trustee state */
 	wait_queue_head_t	trustee_wait;	/* trustee wait */
 	struct worker		*first_idle;	/* L: first idle worker */
+
+	/* the following are used only by unbound gcwqs */
+	int			id;		/* I: unbound gcwq ID */
+	int			node;		/* I: the associated node ID */
+	int			refcnt;		/* PL: refcnt for unbound gcwqs */
+	struct workqueue_attrs	*attrs;		/* I: worker attributes */
+	struct hlist_node	hash_node;	/* PL: unbound_gcwq_hash node */
+	struct rcu_head		rcu;		/* for sched-RCU protected free */
 } ____cacheline_aligned_in_smp;
 
 /*
@@ -181,9 +208,21 @@ struct cpu_workqueue_struct {
 	int			flush_color;	/* L: flushing color */
 	int			nr_in_flight[WORK_NR_COLORS];
 						/* L: nr of in_flight works */
+	int			refcnt;		/* L: reference count */
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	struct list_head	cwqs_node;	/* FW: node on wq->cwqs */
+	struct list_head	mayday_node;	/* MD: node on wq->maydays */
+
+	/*
+	 * Release of unbound cwq is punted to system_wq.  See
+	 * put_cwq_ref() for details.  cwq_cache has to be aligned
+	 * to WORK_STRUCT_FLAG_BITS anyway, so the extra fields don't
+	 * cost much.
+	 */
+	struct work_struct	unbound_release_work;
+	struct rcu_head		rcu;		/* for sched-RCU protected free */
 };
 
 /*
@@ -195,38 +234,17 @@ struct wq_flusher {
 	struct completion	done;		/* flush completion */
 };
 
-/*
- * All cpumasks are assumed to be always set on UP and thus can't be
- * used to determine whether there's something to be done.
- */
-#ifdef CONFIG_SMP
-typedef cpumask_var_t mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	\
-	cpumask_test_and_set_cpu((cpu), (mask))
-#define mayday_clear_cpu(cpu, mask)		cpumask_clear_cpu((cpu), (mask))
-#define for_each_mayday_cpu(cpu, mask)		for_each_cpu((cpu), (mask))
-#define alloc_mayday_mask(maskp, gfp)		zalloc_cpumask_var((maskp), (gfp))
-#define free_mayday_mask(mask)			free_cpumask_var((mask))
-#else
-typedef unsigned long mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	test_and_set_bit(0, &(mask))
-#define mayday_clear_cpu(cpu, mask)		clear_bit(0, &(mask))
-#define for_each_mayday_cpu(cpu, mask)		if ((cpu) = 0, (mask))
-#define alloc_mayday_mask(maskp, gfp)		true
-#define free_mayday_mask(mask)			do { } while (0)
-#endif
+struct wq_device;
 
 /*
  * The externally visible workqueue abstraction is an array of
- * per-CPU workqueues:
+ * per-CPU workqueues for bound workqueues and a per-node table of
+ * cwqs for unbound ones:
  */
 struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
-	union {
-		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
-		unsigned long				v;
-	} cpu_wq;				/* I: cwq's */
+	struct cpu_workqueue_struct __percpu *cpu_cwqs; /* I: per-cpu cwqs */
+	struct list_head	cwqs;		/* FW: all cwqs of this wq */
 	struct list_head	list;		/* W: list of all workqueues */
 
 	struct mutex		flush_mutex;	/* protects wq flushing */
@@ -237,17 +255,48 @@ struct workqueue_struct {
 	struct list_head	flusher_queue;	/* F: flush waiters */
 	struct list_head	flusher_overflow; /* F: flush overflow list */
 
-	mayday_mask_t		mayday_mask;	/* cpus requesting rescue */
+	struct list_head	maydays;	/* MD: cwqs requesting rescue */
 	struct worker		*rescuer;	/* I: rescue worker */
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+
+	struct workqueue_attrs	*unbound_attrs;	/* PL: only for unbound wqs */
+	struct cpu_workqueue_struct *dfl_cwq;	/* PL: only for unbound wqs */
+	struct cpu_workqueue_struct **numa_cwq_tbl; /* FR: unbound cwqs
+						       indexed by node */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: for sysfs interface */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
+	struct rcu_head		rcu;		/* for sched-RCU protected free */
 	char			name[];		/* I: workqueue name */
 };
 
+static struct kmem_cache *cwq_cache;
+
+/* the per-node cpumasks of possible CPUs, used to build unbound gcwqs */
+static cpumask_var_t *wq_numa_possible_cpumask;
+
+static bool wq_disable_numa;
+module_param_named(disable_numa, wq_disable_numa, bool, 0444);
+
+static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+
+static DEFINE_MUTEX(wq_pool_mutex);	/* protects unbound gcwqs */
+static DEFINE_SPINLOCK(wq_mayday_lock);	/* protects wq->maydays list */
+
+/* PL: hash of all unbound gcwqs keyed by gcwq->attrs */
+static struct hlist_head unbound_gcwq_hash[1 << UNBOUND_GCWQ_HASH_ORDER];
+
+/* PL: unbound gcwq ID allocator, lookups are RCU protected */
+static DEFINE_IDR(unbound_gcwq_idr);
+
+/* I: attributes used when instantiating standard unbound gcwqs */
+static struct workqueue_attrs *unbound_std_wq_attrs;
+
 struct workqueue_struct *system_wq __read_mostly;
 struct workqueue_struct *system_long_wq __read_mostly;
 struct workqueue_struct *system_nrt_wq __read_mostly;
@@ -268,54 +317,17 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
-static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
-				  unsigned int sw)
-{
-	if (cpu < nr_cpu_ids) {
-		if (sw & 1) {
-			cpu = cpumask_next(cpu, mask);
-			if (cpu < nr_cpu_ids)
-				return cpu;
-		}
-		if (sw & 2)
-			return WORK_CPU_UNBOUND;
-	}
-	return WORK_CPU_NONE;
-}
-
-static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
-				struct workqueue_struct *wq)
-{
-	return __next_gcwq_cpu(cpu, mask, !(wq->flags & WQ_UNBOUND) ? 1 : 2);
-}
-
-/*
- * CPU iterators
- *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+/**
+ * for_each_cwq - iterate through all cpu_workqueues of the specified workqueue
+ * @cwq: iteration cursor
+ * @wq: the target workqueue
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
- * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ * This must be called either with wq->flush_mutex or workqueue_lock
+ * held.  Per-cpu workqueues are linked once on creation, unbound ones
+ * come and go as apply_workqueue_attrs() replaces them.
  */
-#define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
-
-#define for_each_online_gcwq_cpu(cpu)					\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 3))
-
-#define for_each_cwq_cpu(cpu, wq)					\
-	for ((cpu) = __next_wq_cpu(-1, cpu_possible_mask, (wq));	\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_wq_cpu((cpu), cpu_possible_mask, (wq)))
+#define for_each_cwq(cwq, wq)						\
+	list_for_each_entry((cwq), &(wq)->cwqs, cwqs_node)
 
 #ifdef CONFIG_DEBUG_OBJECTS_WORK
 
@@ -447,21 +459,25 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * nr_running counter for unbound gcwqs.  Unbound gcwqs are always
+ * online, have GCWQ_DISASSOCIATED set, and all their workers have
+ * WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
+/*
+ * Off queue, work->data carries the cpu of the bound gcwq the work was
+ * last on or, for unbound gcwqs, the gcwq ID offset by this base.
+ */
+#define WORK_OFFQ_UNBOUND_BASE	(WORK_CPU_LAST + 1)
+#define WORK_OFFQ_UNBOUND_MAX	\
+	((int)((~0UL >> WORK_STRUCT_FLAG_BITS) - WORK_OFFQ_UNBOUND_BASE))
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
-		return &per_cpu(global_cwq, cpu);
-	else
-		return &unbound_global_cwq;
+	return &per_cpu(global_cwq, cpu);
 }
 
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
@@ -472,15 +488,37 @@ static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 		return &unbound_gcwq_nr_running;
 }
 
+/**
+ * unbound_cwq_by_node - return the unbound cwq for the given node
+ * @wq: the target workqueue
+ * @node: the node ID
+ *
+ * This must be called with sched-RCU read locked or wq->flush_mutex
+ * held.  The returned cwq stays valid until the read side ends.
+ */
+static struct cpu_workqueue_struct *unbound_cwq_by_node(
+				struct workqueue_struct *wq, int node)
+{
+	return rcu_dereference_sched(wq->numa_cwq_tbl[node]);
+}
+
+/*
+ * Return the cwq of @wq serving @cpu.  For unbound workqueues, this is
+ * the cwq of the node @cpu belongs to and WORK_CPU_UNBOUND selects the
+ * local node.  Unbound lookups should be done under sched-RCU.
+ */
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
-			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
-	return NULL;
+			return per_cpu_ptr(wq->cpu_cwqs, cpu);
+		return NULL;
+	}
+
+	if (cpu == WORK_CPU_UNBOUND)
+		cpu = raw_smp_processor_id();
+	return unbound_cwq_by_node(wq, cpu_to_node(cpu));
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -502,16 +540,19 @@ static int work_next_color(int color)
 /*
  * A work's data points to the cwq with WORK_STRUCT_CWQ set while the
  * work is on queue.  Once execution starts, WORK_STRUCT_CWQ is
- * cleared and the work data contains the cpu number it was last on.
+ * cleared and the work data identifies the gcwq it was last on - the
+ * cpu number for per-cpu gcwqs, the offset ID for unbound ones.
  *
- * set_work_{cwq|cpu}() and clear_work_data() can be used to set the
- * cwq, cpu or clear work->data.  These functions should only be
+ * set_work_{cwq|gcwq}() and clear_work_data() can be used to set the
+ * cwq, gcwq or clear work->data.  These functions should only be
  * called while the work is owned - ie. while the PENDING bit is set.
  *
  * get_work_[g]cwq() can be used to obtain the gcwq or cwq
  * corresponding to a work.  gcwq is available once the work has been
  * queued anywhere after initialization.  cwq is available only from
- * queueing until execution starts.
+ * queueing until execution starts.  As unbound gcwqs may be destroyed,
+ * the gcwq returned by get_work_gcwq() is only guaranteed to stay
+ * around while sched-RCU is read locked.
  */
 static inline void set_work_data(struct work_struct *work, unsigned long data,
 				 unsigned long flags)
@@ -528,9 +569,14 @@ static void set_work_cwq(struct work_struct *work,
 		      WORK_STRUCT_PENDING | WORK_STRUCT_CWQ | extra_flags);
 }
 
-static void set_work_cpu(struct work_struct *work, unsigned int cpu)
+static void set_work_gcwq(struct work_struct *work, struct global_cwq *gcwq)
 {
-	set_work_data(work, cpu << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
+	unsigned long id = gcwq->cpu;
+
+	if (gcwq->cpu == WORK_CPU_UNBOUND)
+		id = WORK_OFFQ_UNBOUND_BASE + gcwq->id;
+
+	set_work_data(work, id << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
 }
 
 static void clear_work_data(struct work_struct *work)
@@ -561,7 +607,17 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	if (cpu >= WORK_OFFQ_UNBOUND_BASE) {
+		struct global_cwq *gcwq;
+
+		rcu_read_lock();
+		gcwq = idr_find(&unbound_gcwq_idr,
+				cpu - WORK_OFFQ_UNBOUND_BASE);
+		rcu_read_unlock();
+		return gcwq;
+	}
+
+	BUG_ON(cpu >= nr_cpu_ids);
 	return get_gcwq(cpu);
 }
 
@@ -903,6 +959,57 @@ static inline struct list_head *gcwq_determine_ins_pos(struct global_cwq *gcwq,
 	return &twork->entry;
 }
 
+/**
+ * get_cwq_ref - get an extra reference on the specified cwq
+ * @cwq: cwq to get
+ *
+ * Obtain an extra reference on @cwq.  The caller should guarantee that
+ * @cwq has positive refcnt and be holding the matching gcwq->lock.
+ */
+static void get_cwq_ref(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&cwq->gcwq->lock);
+	WARN_ON_ONCE(cwq->refcnt <= 0);
+	cwq->refcnt++;
+}
+
+/**
+ * put_cwq_ref - put a cwq reference
+ * @cwq: cwq to put
+ *
+ * Drop a reference of @cwq.  If its refcnt reaches zero, schedule its
+ * destruction.  Only unbound cwqs are ever released.  The release
+ * needs to grab mutexes and is bounced to system_wq, which is per-cpu
+ * and thus never recurses on an unbound gcwq->lock.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void put_cwq_ref(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&cwq->gcwq->lock);
+	if (likely(--cwq->refcnt))
+		return;
+	if (WARN_ON_ONCE(!(cwq->wq->flags & WQ_UNBOUND)))
+		return;
+	schedule_work(&cwq->unbound_release_work);
+}
+
+/**
+ * put_cwq_unlocked - put_cwq_ref() with surrounding gcwq lock/unlock
+ * @cwq: cwq to put (can be %NULL)
+ *
+ * put_cwq_ref() with locking.  This function also allows %NULL @cwq.
+ */
+static void put_cwq_unlocked(struct cpu_workqueue_struct *cwq)
+{
+	if (cwq) {
+		spin_lock_irq(&cwq->gcwq->lock);
+		put_cwq_ref(cwq);
+		spin_unlock_irq(&cwq->gcwq->lock);
+	}
+}
+
 /**
  * insert_work - insert a work into gcwq
  * @cwq: cwq @work belongs to
@@ -924,6 +1031,7 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
+	get_cwq_ref(cwq);
 
 	/*
 	 * Ensure that we get the right work->data if we see the
@@ -946,40 +1054,31 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 /*
  * Test whether @work is being queued from another work executing on the
- * same workqueue.  This is rather expensive and should only be used from
- * cold paths.
+ * same workqueue.
  */
 static bool is_chained_work(struct workqueue_struct *wq)
 {
-	unsigned long flags;
-	unsigned int cpu;
+	struct worker *worker;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker *worker;
-		struct hlist_node *pos;
-		int i;
+	/* the rescuer only ever executes works of its own workqueue */
+	if (wq->rescuer && wq->rescuer->task == current)
+		return true;
 
-		spin_lock_irqsave(&gcwq->lock, flags);
-		for_each_busy_worker(worker, i, pos, gcwq) {
-			if (worker->task != current)
-				continue;
-			spin_unlock_irqrestore(&gcwq->lock, flags);
-			/*
-			 * I'm @worker, no locking necessary.  See if @work
-			 * is headed to the same workqueue.
-			 */
-			return worker->current_cwq->wq == wq;
-		}
-		spin_unlock_irqrestore(&gcwq->lock, flags);
-	}
-	return false;
+	if (!(current->flags & PF_WQ_WORKER))
+		return false;
+
+	/*
+	 * I'm a worker, no locking necessary.  See if @work is headed to
+	 * the same workqueue.
+	 */
+	worker = kthread_data(current);
+	return worker->current_cwq && worker->current_cwq->wq == wq;
 }
 
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -992,48 +1091,64 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	    WARN_ON_ONCE(!is_chained_work(wq)))
 		return;
 
-	/* determine gcwq to use */
-	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
+	/* unbound cwqs and gcwqs are sched-RCU protected */
+	rcu_read_lock_sched();
+retry:
+	if (cpu == WORK_CPU_UNBOUND)
+		cpu = raw_smp_processor_id();
 
-		if (unlikely(cpu == WORK_CPU_UNBOUND))
-			cpu = raw_smp_processor_id();
+	/* cwq which will be used unless @work is executing elsewhere */
+	cwq = get_cwq(cpu, wq);
+	gcwq = cwq->gcwq;
 
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
-		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	/*
+	 * If @wq is non-reentrant or unbound and @work was previously on
+	 * a different gcwq, it might still be running there, in which
+	 * case the work needs to be queued on that gcwq to guarantee
+	 * non-reentrance.  Unbound workqueues are spread over per-node
+	 * gcwqs and get this for free so that they stay non-reentrant.
+	 */
+	if ((wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND)) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		worker = find_worker_executing_work(last_gcwq, work);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		if (worker && worker->current_cwq->wq == wq) {
+			cwq = worker->current_cwq;
+			gcwq = last_gcwq;
+		} else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
+
+	/*
+	 * An unbound cwq replaced by apply_workqueue_attrs() drops its
+	 * last reference once drained and is released.  If we raced with
+	 * that, look up the new cwq and retry.  Per-cpu cwqs always hold
+	 * their base reference.
+	 */
+	if (unlikely(!cwq->refcnt)) {
+		spin_unlock_irqrestore(&gcwq->lock, flags);
+		if (!WARN_ON_ONCE(!(wq->flags & WQ_UNBOUND))) {
+			cpu_relax();
+			goto retry;
+		}
+		rcu_read_unlock_sched();
+		return;
 	}
 
-	/* gcwq determined, get cwq and queue */
-	cwq = get_cwq(gcwq->cpu, wq);
+	/* cwq determined, queue */
 	trace_workqueue_queue_work(cpu, cwq, work);
 
 	if (WARN_ON(!list_empty(&work->entry))) {
 		spin_unlock_irqrestore(&gcwq->lock, flags);
+		rcu_read_unlock_sched();
 		return;
 	}
 
@@ -1052,6 +1167,7 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	insert_work(cwq, work, worklist, work_flags);
 
 	spin_unlock_irqrestore(&gcwq->lock, flags);
+	rcu_read_unlock_sched();
 }
 
 /**
@@ -1102,9 +1218,8 @@ EXPORT_SYMBOL_GPL(queue_work_on);
 static void delayed_work_timer_fn(unsigned long __data)
 {
 	struct delayed_work *dwork = (struct delayed_work *)__data;
-	struct cpu_workqueue_struct *cwq = get_work_cwq(&dwork->work);
 
-	__queue_work(smp_processor_id(), cwq->wq, &dwork->work);
+	__queue_work(smp_processor_id(), dwork->wq, &dwork->work);
 }
 
 /**
@@ -1150,21 +1265,27 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		timer_stats_timer_set_start_info(&dwork->timer);
 
 		/*
-		 * This stores cwq for the moment, for the timer_fn.
+		 * The timer_fn finds the workqueue through @dwork->wq.
 		 * Note that the work's gcwq is preserved to allow
-		 * reentrance detection for delayed works.
+		 * reentrance detection for delayed works.  For bound
+		 * workqueues, this stores the cwq on the last cpu for the
+		 * moment.  Unbound cwqs may be replaced while the timer is
+		 * pending, leave the last gcwq in the work data for those.
 		 */
+		dwork->wq = wq;
 		if (!(wq->flags & WQ_UNBOUND)) {
-			struct global_cwq *gcwq = get_work_gcwq(work);
+			struct global_cwq *gcwq;
 
+			rcu_read_lock_sched();
+			gcwq = get_work_gcwq(work);
 			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
+			rcu_read_unlock_sched();
 
-		set_work_cwq(work, get_cwq(lcpu, wq), 0);
+			set_work_cwq(work, get_cwq(lcpu, wq), 0);
+		}
 
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
@@ -1278,6 +1399,13 @@ __acquires(&gcwq->lock)
 	struct global_cwq *gcwq = worker->gcwq;
 	struct task_struct *task = worker->task;
 
+	/* unbound gcwqs have no cpu to bind to, only follow their cpumask */
+	if (gcwq->cpu == WORK_CPU_UNBOUND) {
+		set_cpus_allowed_ptr(task, gcwq->attrs->cpumask);
+		spin_lock_irq(&gcwq->lock);
+		return false;
+	}
+
 	while (true) {
 		/*
 		 * The following call may fail, succeed or succeed
@@ -1383,11 +1511,18 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 						      cpu_to_node(gcwq->cpu),
 						      "kworker/%u:%d", gcwq->cpu, id);
 	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d", id);
+		worker->task = kthread_create_on_node(worker_thread, worker,
+						      gcwq->node,
+						      "kworker/u%d:%d",
+						      gcwq->id, id);
 	if (IS_ERR(worker->task))
 		goto fail;
 
+	if (on_unbound_cpu) {
+		set_user_nice(worker->task, gcwq->attrs->nice);
+		set_cpus_allowed_ptr(worker->task, gcwq->attrs->cpumask);
+	}
+
 	/*
 	 * A rogue worker will become a regular one if CPU comes
 	 * online later on.  Make sure every worker has
@@ -1494,18 +1629,23 @@ static bool send_mayday(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
 	struct workqueue_struct *wq = cwq->wq;
-	unsigned int cpu;
 
 	if (!(wq->flags & WQ_RESCUER))
 		return false;
 
 	/* mayday mayday mayday */
-	cpu = cwq->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
-		cpu = 0;
-	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
+	spin_lock(&wq_mayday_lock);
+	if (list_empty(&cwq->mayday_node)) {
+		/*
+		 * If @cwq is for an unbound wq, its base ref may be put at
+		 * any time due to an attribute change.  Pin @cwq until the
+		 * rescuer is done with it.
+		 */
+		get_cwq_ref(cwq);
+		list_add_tail(&cwq->mayday_node, &wq->maydays);
 		wake_up_process(wq->rescuer->task);
+	}
+	spin_unlock(&wq_mayday_lock);
 	return true;
 }
 
@@ -1674,10 +1814,10 @@ static bool manage_workers(struct worker *worker)
 	gcwq->flags &= ~GCWQ_MANAGING_WORKERS;
 
 	/*
-	 * The trustee might be waiting to take over the manager
-	 * position, tell it we're done.
+	 * The trustee or put_unbound_gcwq() might be waiting to take
+	 * over the manager position, tell it we're done.
 	 */
-	if (unlikely(gcwq->trustee))
+	if (unlikely(gcwq->trustee || gcwq->cpu == WORK_CPU_UNBOUND))
 		wake_up_all(&gcwq->trustee_wait);
 
 	return ret;
@@ -1743,7 +1883,8 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
  * @delayed: for a delayed work
  *
  * A work either has completed or is removed from pending queue,
- * decrement nr_in_flight of its cwq and handle workqueue flushing.
+ * decrement nr_in_flight of its cwq, handle workqueue flushing and
+ * drop the reference the work held on @cwq.
  *
  * CONTEXT:
  * spin_lock_irq(gcwq->lock).
@@ -1751,9 +1892,9 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 				 bool delayed)
 {
-	/* ignore uncolored works */
+	/* uncolored works don't participate in flushing or nr_active */
 	if (color == WORK_NO_COLOR)
-		return;
+		goto out_put;
 
 	cwq->nr_in_flight[color]--;
 
@@ -1768,11 +1909,11 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 
 	/* is flush in progress and are we at the flushing tip? */
 	if (likely(cwq->flush_color != color))
-		return;
+		goto out_put;
 
 	/* are there still in-flight works? */
 	if (cwq->nr_in_flight[color])
-		return;
+		goto out_put;
 
 	/* this cwq is done, clear flush_color */
 	cwq->flush_color = -1;
@@ -1783,6 +1924,8 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 	 */
 	if (atomic_dec_and_test(&cwq->wq->nr_cwqs_to_flush))
 		complete(&cwq->wq->first_flusher->done);
+out_put:
+	put_cwq_ref(cwq);
 }
 
 /**
@@ -1841,8 +1984,8 @@ __acquires(&gcwq->lock)
 	worker->current_cwq = cwq;
 	work_color = get_work_color(work);
 
-	/* record the current cpu number in the work data and dequeue */
-	set_work_cpu(work, gcwq->cpu);
+	/* record the current gcwq in the work data and dequeue */
+	set_work_gcwq(work, gcwq);
 	list_del_init(&work->entry);
 
 	/*
@@ -2036,28 +2179,33 @@ static int rescuer_thread(void *__wq)
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
 	struct list_head *scheduled = &rescuer->scheduled;
-	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
+	bool should_stop;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	if (kthread_should_stop())
-		return 0;
-
 	/*
-	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * By the time the rescuer is requested to stop, the workqueue
+	 * shouldn't have any work pending, but @wq->maydays may still have
+	 * cwqs requesting help.  Those hold references which need to be
+	 * dropped, so process them before exiting.
 	 */
-	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
+	should_stop = kthread_should_stop();
+
+	/* see whether any cwq is asking for help */
+	spin_lock_irq(&wq_mayday_lock);
+
+	while (!list_empty(&wq->maydays)) {
+		struct cpu_workqueue_struct *cwq = list_first_entry(&wq->maydays,
+					struct cpu_workqueue_struct, mayday_node);
 		struct global_cwq *gcwq = cwq->gcwq;
 		struct work_struct *work, *n;
 
 		__set_current_state(TASK_RUNNING);
-		mayday_clear_cpu(cpu, wq->mayday_mask);
+		list_del_init(&cwq->mayday_node);
+
+		spin_unlock_irq(&wq_mayday_lock);
 
 		/* migrate to the target cpu if possible */
 		rescuer->gcwq = gcwq;
@@ -2074,6 +2222,12 @@ repeat:
 
 		process_scheduled_works(rescuer);
 
+		/*
+		 * Put the reference grabbed by send_mayday().  @gcwq won't
+		 * go away while we're still holding its lock.
+		 */
+		put_cwq_ref(cwq);
+
 		/*
 		 * Leave this gcwq.  If keep_working() is %true, notify a
 		 * regular worker; otherwise, we end up with 0 concurrency
@@ -2083,6 +2237,14 @@ repeat:
 			wake_up_worker(gcwq);
 
 		spin_unlock_irq(&gcwq->lock);
+		spin_lock_irq(&wq_mayday_lock);
+	}
+
+	spin_unlock_irq(&wq_mayday_lock);
+
+	if (should_stop) {
+		__set_current_state(TASK_RUNNING);
+		return 0;
 	}
 
 	schedule();
@@ -2196,15 +2358,14 @@ static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 				      int flush_color, int work_color)
 {
 	bool wait = false;
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 
 	if (flush_color >= 0) {
 		BUG_ON(atomic_read(&wq->nr_cwqs_to_flush));
 		atomic_set(&wq->nr_cwqs_to_flush, 1);
 	}
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq) {
 		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -2403,7 +2564,7 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
 void drain_workqueue(struct workqueue_struct *wq)
 {
 	unsigned int flush_cnt = 0;
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 
 	/*
 	 * __queue_work() needs to test whether there are drainers, is much
@@ -2417,8 +2578,9 @@ void drain_workqueue(struct workqueue_struct *wq)
 reflush:
 	flush_workqueue(wq);
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	mutex_lock(&wq->flush_mutex);
+
+	for_each_cwq(cwq, wq) {
 		bool drained;
 
 		spin_lock_irq(&cwq->gcwq->lock);
@@ -2432,9 +2594,13 @@ reflush:
 		    (flush_cnt % 100 == 0 && flush_cnt <= 1000))
 			pr_warning("workqueue %s: flush on destruction isn't complete after %u tries\n",
 				   wq->name, flush_cnt);
+
+		mutex_unlock(&wq->flush_mutex);
 		goto reflush;
 	}
 
+	mutex_unlock(&wq->flush_mutex);
+
 	spin_lock(&workqueue_lock);
 	if (!--wq->nr_drainers)
 		wq->flags &= ~WQ_DRAINING;
@@ -2450,9 +2616,14 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	struct cpu_workqueue_struct *cwq;
 
 	might_sleep();
+
+	rcu_read_lock_sched();
+
 	gcwq = get_work_gcwq(work);
-	if (!gcwq)
+	if (!gcwq) {
+		rcu_read_unlock_sched();
 		return false;
+	}
 
 	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
@@ -2475,6 +2646,7 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 
 	insert_wq_barrier(cwq, barr, work, worker);
 	spin_unlock_irq(&gcwq->lock);
+	rcu_read_unlock_sched();
 
 	/*
 	 * If @max_active is 1 or rescuer is in use, flushing another work
@@ -2491,6 +2663,7 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	return true;
 already_gone:
 	spin_unlock_irq(&gcwq->lock);
+	rcu_read_unlock_sched();
 	return false;
 }
 
@@ -2531,7 +2704,19 @@ EXPORT_SYMBOL_GPL(flush_work);
 static bool wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 {
 	struct wq_barrier barr;
-	struct worker *worker;
+	struct worker *worker = NULL;
+
+	/*
+	 * A NULL @gcwq stands for the unbound gcwq @work was last on.
+	 * Unbound workqueues are non-reentrant across their gcwqs, so
+	 * that is the only unbound gcwq @work can be executing on.
+	 */
+	rcu_read_lock_sched();
+	if (!gcwq) {
+		gcwq = get_work_gcwq(work);
+		if (!gcwq || gcwq->cpu != WORK_CPU_UNBOUND)
+			goto out_unlock;
+	}
 
 	spin_lock_irq(&gcwq->lock);
 
@@ -2540,6 +2725,8 @@ static bool wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 		insert_wq_barrier(worker->current_cwq, &barr, work, worker);
 
 	spin_unlock_irq(&gcwq->lock);
+out_unlock:
+	rcu_read_unlock_sched();
 
 	if (unlikely(worker)) {
 		wait_for_completion(&barr.done);
@@ -2559,8 +2746,9 @@ static bool wait_on_work(struct work_struct *work)
 	lock_map_acquire(&work->lockdep_map);
 	lock_map_release(&work->lockdep_map);
 
-	for_each_gcwq_cpu(cpu)
+	for_each_possible_cpu(cpu)
 		ret |= wait_on_cpu_work(get_gcwq(cpu), work);
+	ret |= wait_on_cpu_work(NULL, work);
 	return ret;
 }
 
@@ -2615,9 +2803,10 @@ static int try_to_grab_pending(struct work_struct *work)
 	 * The queueing is in progress, or it is already queued. Try to
 	 * steal it from ->worklist without clearing WORK_STRUCT_PENDING.
 	 */
+	rcu_read_lock_sched();
 	gcwq = get_work_gcwq(work);
 	if (!gcwq)
-		return ret;
+		goto out_unlock;
 
 	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
@@ -2637,7 +2826,8 @@ static int try_to_grab_pending(struct work_struct *work)
 		}
 	}
 	spin_unlock_irq(&gcwq->lock);
-
+out_unlock:
+	rcu_read_unlock_sched();
 	return ret;
 }
 
@@ -2696,8 +2886,7 @@ EXPORT_SYMBOL_GPL(cancel_work_sync);
 bool flush_delayed_work(struct delayed_work *dwork)
 {
 	if (del_timer_sync(&dwork->timer))
-		__queue_work(raw_smp_processor_id(),
-			     get_work_cwq(&dwork->work)->wq, &dwork->work);
+		__queue_work(raw_smp_processor_id(), dwork->wq, &dwork->work);
 	return flush_work(&dwork->work);
 }
 EXPORT_SYMBOL(flush_delayed_work);
@@ -2717,8 +2906,7 @@ EXPORT_SYMBOL(flush_delayed_work);
 bool flush_delayed_work_sync(struct delayed_work *dwork)
 {
 	if (del_timer_sync(&dwork->timer))
-		__queue_work(raw_smp_processor_id(),
-			     get_work_cwq(&dwork->work)->wq, &dwork->work);
+		__queue_work(raw_smp_processor_id(), dwork->wq, &dwork->work);
 	return flush_work_sync(&dwork->work);
 }
 EXPORT_SYMBOL(flush_delayed_work_sync);
@@ -2897,171 +3085,1061 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
-static int alloc_cwqs(struct workqueue_struct *wq)
+/**
+ * free_workqueue_attrs - free a workqueue_attrs
+ * @attrs: workqueue_attrs to free
+ *
+ * Undo alloc_workqueue_attrs().
+ */
+void free_workqueue_attrs(struct workqueue_attrs *attrs)
 {
-	/*
-	 * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.
-	 * Make sure that the alignment isn't lower than that of
-	 * unsigned long long.
-	 */
-	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
+	if (attrs) {
+		free_cpumask_var(attrs->cpumask);
+		kfree(attrs);
+	}
+}
+EXPORT_SYMBOL_GPL(free_workqueue_attrs);
 
-	if (!(wq->flags & WQ_UNBOUND))
-		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
-	else {
-		void *ptr;
+/**
+ * alloc_workqueue_attrs - allocate a workqueue_attrs
+ * @gfp_mask: allocation mask to use
+ *
+ * Allocate a new workqueue_attrs, initialize with default settings and
+ * return it.  Returns NULL on failure.
+ */
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
+{
+	struct workqueue_attrs *attrs;
 
-		/*
-		 * Allocate enough room to align cwq and put an extra
-		 * pointer at the end pointing back to the originally
-		 * allocated pointer which will be used for free.
-		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
-		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
-		}
-	}
+	attrs = kzalloc(sizeof(*attrs), gfp_mask);
+	if (!attrs)
+		goto fail;
+	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask))
+		goto fail;
 
-	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
-	return wq->cpu_wq.v ? 0 : -ENOMEM;
+	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	return attrs;
+fail:
+	free_workqueue_attrs(attrs);
+	return NULL;
 }
+EXPORT_SYMBOL_GPL(alloc_workqueue_attrs);
 
-static void free_cwqs(struct workqueue_struct *wq)
+static void copy_workqueue_attrs(struct workqueue_attrs *to,
+				 const struct workqueue_attrs *from)
 {
-	if (!(wq->flags & WQ_UNBOUND))
-		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
-	}
+	to->nice = from->nice;
+	cpumask_copy(to->cpumask, from->cpumask);
 }
 
-static int wq_clamp_max_active(int max_active, unsigned int flags,
-			       const char *name)
+/* hash value of the content of @attrs */
+static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 {
-	int lim = flags & WQ_UNBOUND ? WQ_UNBOUND_MAX_ACTIVE : WQ_MAX_ACTIVE;
+	u32 hash = 0;
 
-	if (max_active < 1 || max_active > lim)
-		printk(KERN_WARNING "workqueue: max_active %d requested for %s "
-		       "is out of range, clamping between %d and %d\n",
-		       max_active, name, 1, lim);
+	hash = jhash_1word(attrs->nice, hash);
+	hash = jhash(cpumask_bits(attrs->cpumask),
+		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
+	return hash;
+}
 
-	return clamp_val(max_active, 1, lim);
+/* content equality test */
+static bool wqattrs_equal(const struct workqueue_attrs *a,
+			  const struct workqueue_attrs *b)
+{
+	if (a->nice != b->nice)
+		return false;
+	if (!cpumask_equal(a->cpumask, b->cpumask))
+		return false;
+	return true;
 }
 
-struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
-					       unsigned int flags,
-					       int max_active,
-					       struct lock_class_key *key,
-					       const char *lock_name, ...)
+/**
+ * init_gcwq - initialize a newly zalloc'd gcwq
+ * @gcwq: gcwq to initialize
+ * @cpu: the cpu @gcwq serves, WORK_CPU_UNBOUND for unbound gcwqs
+ *
+ * Initialize a newly zalloc'd @gcwq.  It starts out disassociated;
+ * per-cpu gcwqs get associated as their cpus come online.
+ */
+static void init_gcwq(struct global_cwq *gcwq, unsigned int cpu)
 {
-	va_list args, args1;
-	struct workqueue_struct *wq;
-	unsigned int cpu;
-	size_t namelen;
+	int i;
 
-	/* determine namelen, allocate wq and format name */
-	va_start(args, lock_name);
-	va_copy(args1, args);
-	namelen = vsnprintf(NULL, 0, fmt, args) + 1;
+	spin_lock_init(&gcwq->lock);
+	INIT_LIST_HEAD(&gcwq->worklist);
+	gcwq->cpu = cpu;
+	gcwq->flags |= GCWQ_DISASSOCIATED;
 
-	wq = kzalloc(sizeof(*wq) + namelen, GFP_KERNEL);
-	if (!wq)
-		goto err;
+	INIT_LIST_HEAD(&gcwq->idle_list);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
 
-	vsnprintf(wq->name, namelen, fmt, args1);
-	va_end(args);
-	va_end(args1);
+	init_timer_deferrable(&gcwq->idle_timer);
+	gcwq->idle_timer.function = idle_worker_timeout;
+	gcwq->idle_timer.data = (unsigned long)gcwq;
 
-	/*
-	 * Workqueues which may be used during memory reclaim should
-	 * have a rescuer to guarantee forward progress.
-	 */
-	if (flags & WQ_MEM_RECLAIM)
-		flags |= WQ_RESCUER;
+	setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
+		    (unsigned long)gcwq);
 
-	/*
-	 * Unbound workqueues aren't concurrency managed and should be
-	 * dispatched to workers immediately.
-	 */
-	if (flags & WQ_UNBOUND)
-		flags |= WQ_HIGHPRI;
+	ida_init(&gcwq->worker_ida);
 
-	max_active = max_active ?: WQ_DFL_ACTIVE;
-	max_active = wq_clamp_max_active(max_active, flags, wq->name);
+	gcwq->trustee_state = TRUSTEE_DONE;
+	init_waitqueue_head(&gcwq->trustee_wait);
 
-	/* init wq */
-	wq->flags = flags;
-	wq->saved_max_active = max_active;
-	mutex_init(&wq->flush_mutex);
+	gcwq->id = -1;
+	gcwq->node = NUMA_NO_NODE;
+	gcwq->refcnt = 1;
+	INIT_HLIST_NODE(&gcwq->hash_node);
+}
+
+static void rcu_free_gcwq(struct rcu_head *rcu)
+{
+	struct global_cwq *gcwq = container_of(rcu, struct global_cwq, rcu);
+
+	ida_destroy(&gcwq->worker_ida);
+	free_workqueue_attrs(gcwq->attrs);
+	kfree(gcwq);
+}
+
+/**
+ * put_unbound_gcwq - put an unbound gcwq
+ * @gcwq: unbound gcwq to put
+ *
+ * Put @gcwq.  If its refcnt reaches zero, it gets destroyed in a
+ * sched-RCU safe manner.  get_unbound_gcwq() calls this function on its
+ * failure path, so it must be able to release gcwqs which went through
+ * init_gcwq() but weren't fully set up.
+ *
+ * Should be called with wq_pool_mutex held.
+ */
+static void put_unbound_gcwq(struct global_cwq *gcwq)
+{
+	struct worker *worker;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (--gcwq->refcnt)
+		return;
+
+	/* sanity checks */
+	if (WARN_ON(gcwq->cpu != WORK_CPU_UNBOUND) ||
+	    WARN_ON(!list_empty(&gcwq->worklist)))
+		return;
+
+	/* release id and unhash */
+	if (gcwq->id >= 0)
+		idr_remove(&unbound_gcwq_idr, gcwq->id);
+	if (!hlist_unhashed(&gcwq->hash_node))
+		hlist_del(&gcwq->hash_node);
+
+	/*
+	 * Become the manager and destroy all workers.  With the worklist
+	 * empty, every worker is idle whenever gcwq->lock is held and
+	 * nobody else is managing.  manage_workers() wakes up
+	 * trustee_wait when it's done on an unbound gcwq.
+	 */
+	spin_lock_irq(&gcwq->lock);
+	while (gcwq->flags & GCWQ_MANAGING_WORKERS) {
+		spin_unlock_irq(&gcwq->lock);
+		wait_event(gcwq->trustee_wait,
+			   !(gcwq->flags & GCWQ_MANAGING_WORKERS));
+		spin_lock_irq(&gcwq->lock);
+	}
+	gcwq->flags |= GCWQ_MANAGING_WORKERS;
+
+	while ((worker = first_worker(gcwq)))
+		destroy_worker(worker);
+	WARN_ON(gcwq->nr_workers || gcwq->nr_idle);
+
+	spin_unlock_irq(&gcwq->lock);
+
+	/* shut down the timers */
+	del_timer_sync(&gcwq->idle_timer);
+	del_timer_sync(&gcwq->mayday_timer);
+
+	/* sched-RCU protected to allow dereferences from get_work_gcwq() */
+	call_rcu_sched(&gcwq->rcu, rcu_free_gcwq);
+}
+
+/**
+ * get_unbound_gcwq - get an unbound gcwq with the specified attributes
+ * @attrs: the attributes of the gcwq to get
+ *
+ * Obtain an unbound gcwq matching @attrs and return it.  If such a gcwq
+ * already exists, just bump its refcnt; otherwise, create a new one.
+ * A new gcwq is associated with the NUMA node @attrs->cpumask is
+ * confined to, if any, and its workers are allocated there.
+ *
+ * Should be called with wq_pool_mutex held.
+ *
+ * RETURNS:
+ * On success, a gcwq with the same attributes as @attrs.  On failure,
+ * %NULL.
+ */
+static struct global_cwq *get_unbound_gcwq(const struct workqueue_attrs *attrs)
+{
+	u32 hash = wqattrs_hash(attrs);
+	struct hlist_head *head;
+	struct global_cwq *gcwq;
+	struct hlist_node *pos;
+	struct worker *worker;
+	int node, target_node = NUMA_NO_NODE;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	/* do we already have a matching gcwq? */
+	head = &unbound_gcwq_hash[hash & ((1 << UNBOUND_GCWQ_HASH_ORDER) - 1)];
+	hlist_for_each_entry(gcwq, pos, head, hash_node) {
+		if (wqattrs_equal(gcwq->attrs, attrs)) {
+			gcwq->refcnt++;
+			return gcwq;
+		}
+	}
+
+	/* if cpumask is contained inside a NUMA node, we belong to that node */
+	if (wq_numa_enabled) {
+		for_each_node(node) {
+			if (cpumask_subset(attrs->cpumask,
+					   wq_numa_possible_cpumask[node])) {
+				target_node = node;
+				break;
+			}
+		}
+	}
+
+	/* nope, create a new one */
+	gcwq = kzalloc_node(sizeof(*gcwq), GFP_KERNEL, target_node);
+	if (!gcwq)
+		return NULL;
+
+	init_gcwq(gcwq, WORK_CPU_UNBOUND);
+	/* put_cwq_ref() may queue on a per-cpu gcwq under this lock */
+	lockdep_set_subclass(&gcwq->lock, 1);
+	gcwq->node = target_node;
+
+	gcwq->attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!gcwq->attrs)
+		goto fail;
+	copy_workqueue_attrs(gcwq->attrs, attrs);
+
+	/* the ID is recorded in work->data while off queue, see set_work_gcwq() */
+	if (!idr_pre_get(&unbound_gcwq_idr, GFP_KERNEL) ||
+	    idr_get_new(&unbound_gcwq_idr, gcwq, &gcwq->id) ||
+	    gcwq->id > WORK_OFFQ_UNBOUND_MAX)
+		goto fail;
+
+	/* create and start the initial worker */
+	worker = create_worker(gcwq, true);
+	if (!worker)
+		goto fail;
+
+	spin_lock_irq(&gcwq->lock);
+	start_worker(worker);
+	spin_unlock_irq(&gcwq->lock);
+
+	/* install */
+	hlist_add_head(&gcwq->hash_node, head);
+	return gcwq;
+fail:
+	put_unbound_gcwq(gcwq);
+	return NULL;
+}
+
+/*
+ * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.  Make
+ * sure that the alignment isn't lower than that of unsigned long long.
+ */
+#define CWQ_ALIGN	max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,	\
+			      __alignof__(unsigned long long))
+
+static void free_wq(struct workqueue_struct *wq)
+{
+	if (!(wq->flags & WQ_UNBOUND))
+		free_percpu(wq->cpu_cwqs);
+	free_workqueue_attrs(wq->unbound_attrs);
+	kfree(wq->numa_cwq_tbl);
+	kfree(wq->rescuer);
+	kfree(wq);
+}
+
+static void rcu_free_wq(struct rcu_head *rcu)
+{
+	free_wq(container_of(rcu, struct workqueue_struct, rcu));
+}
+
+static void rcu_free_cwq(struct rcu_head *rcu)
+{
+	kmem_cache_free(cwq_cache,
+			container_of(rcu, struct cpu_workqueue_struct, rcu));
+}
+
+/*
+ * Scheduled on system_wq by put_cwq_ref() when an unbound cwq hits zero
+ * refcnt.  Unlink the cwq, release its gcwq and free it.  If this was
+ * the last cwq of a workqueue being destroyed, free the workqueue too.
+ */
+static void cwq_unbound_release_workfn(struct work_struct *work)
+{
+	struct cpu_workqueue_struct *cwq = container_of(work,
+			struct cpu_workqueue_struct, unbound_release_work);
+	struct workqueue_struct *wq = cwq->wq;
+	struct global_cwq *gcwq = cwq->gcwq;
+	bool is_last;
+
+	if (WARN_ON_ONCE(!(wq->flags & WQ_UNBOUND)))
+		return;
+
+	mutex_lock(&wq->flush_mutex);
+	spin_lock(&workqueue_lock);
+	list_del(&cwq->cwqs_node);
+	spin_unlock(&workqueue_lock);
+	is_last = list_empty(&wq->cwqs);
+	mutex_unlock(&wq->flush_mutex);
+
+	mutex_lock(&wq_pool_mutex);
+	put_unbound_gcwq(gcwq);
+	mutex_unlock(&wq_pool_mutex);
+
+	call_rcu_sched(&cwq->rcu, rcu_free_cwq);
+
+	/*
+	 * A live unbound workqueue always has its default cwq linked.  If
+	 * we were the last one, @wq is being destroyed and nobody is
+	 * going to access it anymore.
+	 */
+	if (is_last)
+		call_rcu_sched(&wq->rcu, rcu_free_wq);
+}
+
+/**
+ * cwq_adjust_max_active - update a cwq's max_active to the current setting
+ * @cwq: target cwq
+ *
+ * If @cwq isn't freezing, set @cwq->max_active to the associated
+ * workqueue's saved_max_active and activate delayed work items
+ * accordingly.  If @cwq is freezing, clear @cwq->max_active to zero.
+ *
+ * CONTEXT:
+ * spin_lock(workqueue_lock).
+ */
+static void cwq_adjust_max_active(struct cpu_workqueue_struct *cwq)
+{
+	struct workqueue_struct *wq = cwq->wq;
+	struct global_cwq *gcwq = cwq->gcwq;
+	bool freezable = wq->flags & WQ_FREEZABLE;
+
+	lockdep_assert_held(&workqueue_lock);
+
+	spin_lock_irq(&gcwq->lock);
+
+	if (!freezable || !workqueue_freezing) {
+		cwq->max_active = wq->saved_max_active;
+
+		while (!list_empty(&cwq->delayed_works) &&
+		       cwq->nr_active < cwq->max_active)
+			cwq_activate_first_delayed(cwq);
+
+		/* kick workers in case we activated something */
+		if (!list_empty(&gcwq->worklist))
+			wake_up_worker(gcwq);
+	} else {
+		cwq->max_active = 0;
+	}
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/* initialize newly allocated @cwq which is associated with @wq and @gcwq */
+static void init_cwq(struct cpu_workqueue_struct *cwq,
+		     struct workqueue_struct *wq, struct global_cwq *gcwq)
+{
+	BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
+
+	memset(cwq, 0, sizeof(*cwq));
+
+	cwq->gcwq = gcwq;
+	cwq->wq = wq;
+	cwq->flush_color = -1;
+	cwq->refcnt = 1;
+	INIT_LIST_HEAD(&cwq->delayed_works);
+	INIT_LIST_HEAD(&cwq->cwqs_node);
+	INIT_LIST_HEAD(&cwq->mayday_node);
+	INIT_WORK(&cwq->unbound_release_work, cwq_unbound_release_workfn);
+}
+
+/* sync @cwq with the current state of its associated wq and link it */
+static void link_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct workqueue_struct *wq = cwq->wq;
+
+	lockdep_assert_held(&wq->flush_mutex);
+
+	/* may be called multiple times, ignore if already linked */
+	if (!list_empty(&cwq->cwqs_node))
+		return;
+
+	/*
+	 * Set the matching work_color.  This is synchronized with
+	 * flush_mutex to avoid confusing flush_workqueue().
+	 */
+	cwq->work_color = wq->work_color;
+
+	spin_lock(&workqueue_lock);
+	cwq_adjust_max_active(cwq);
+	list_add_tail(&cwq->cwqs_node, &wq->cwqs);
+	spin_unlock(&workqueue_lock);
+}
+
+/* obtain a gcwq matching @attrs and create a cwq associating @wq with it */
+static struct cpu_workqueue_struct *
+alloc_unbound_cwq(struct workqueue_struct *wq,
+		  const struct workqueue_attrs *attrs)
+{
+	struct global_cwq *gcwq;
+	struct cpu_workqueue_struct *cwq;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	gcwq = get_unbound_gcwq(attrs);
+	if (!gcwq)
+		return NULL;
+
+	cwq = kmem_cache_alloc_node(cwq_cache, GFP_KERNEL, gcwq->node);
+	if (!cwq) {
+		put_unbound_gcwq(gcwq);
+		return NULL;
+	}
+
+	init_cwq(cwq, wq, gcwq);
+	return cwq;
+}
+
+/* undo alloc_unbound_cwq(), used only in the error path */
+static void free_unbound_cwq(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (cwq) {
+		put_unbound_gcwq(cwq->gcwq);
+		kmem_cache_free(cwq_cache, cwq);
+	}
+}
+
+/**
+ * wq_calc_node_cpumask - calculate a wq_attrs' cpumask for the specified node
+ * @attrs: the wq_attrs of interest
+ * @node: the target NUMA node
+ * @cpumask: outarg, the resulting cpumask
+ *
+ * Calculate the cpumask a workqueue with @attrs should use on @node.  If
+ * NUMA affinity is disabled or @node has no possible CPUs in
+ * @attrs->cpumask, @attrs->cpumask is used as is.
+ *
+ * RETURNS:
+ * %true if the resulting @cpumask is different from @attrs->cpumask,
+ * %false if equal, in which case @node can use the default cwq.
+ */
+static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
+				 struct cpumask *cpumask)
+{
+	if (!wq_numa_enabled)
+		goto use_dfl;
+
+	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
+	if (cpumask_empty(cpumask))
+		goto use_dfl;
+
+	return !cpumask_equal(cpumask, attrs->cpumask);
+
+use_dfl:
+	cpumask_copy(cpumask, attrs->cpumask);
+	return false;
+}
+
+static int apply_workqueue_attrs_locked(struct workqueue_struct *wq,
+					const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *new_attrs, *tmp_attrs;
+	struct cpu_workqueue_struct **cwq_tbl, *dfl_cwq = NULL;
+	int node, ret;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	/* only unbound workqueues can change attributes */
+	if (WARN_ON(!(wq->flags & WQ_UNBOUND)))
+		return -EINVAL;
+
+	/* creating multiple cwqs breaks ordering guarantee */
+	if (WARN_ON((wq->flags & WQ_ORDERED) && !list_empty(&wq->cwqs)))
+		return -EINVAL;
+
+	cwq_tbl = kzalloc(nr_node_ids * sizeof(cwq_tbl[0]), GFP_KERNEL);
+	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	tmp_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!cwq_tbl || !new_attrs || !tmp_attrs)
+		goto out_free;
+
+	/* make a copy of @attrs and sanitize it */
+	copy_workqueue_attrs(new_attrs, attrs);
+	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, cpu_possible_mask);
+	ret = -EINVAL;
+	if (cpumask_empty(new_attrs->cpumask))
+		goto out_free;
+
+	/*
+	 * The default cwq covers the whole of @attrs->cpumask and serves
+	 * the nodes which don't need their own.  Each table slot holds
+	 * its own reference.
+	 */
+	ret = -ENOMEM;
+	dfl_cwq = alloc_unbound_cwq(wq, new_attrs);
+	if (!dfl_cwq)
+		goto out_free;
+
+	copy_workqueue_attrs(tmp_attrs, new_attrs);
+	for_each_node(node) {
+		if (!(wq->flags & WQ_ORDERED) &&
+		    wq_calc_node_cpumask(new_attrs, node, tmp_attrs->cpumask)) {
+			cwq_tbl[node] = alloc_unbound_cwq(wq, tmp_attrs);
+			if (!cwq_tbl[node])
+				goto out_free_cwqs;
+		} else {
+			dfl_cwq->refcnt++;
+			cwq_tbl[node] = dfl_cwq;
+		}
+	}
+
+	/* all cwqs have been created successfully, let's install'em */
+	mutex_lock(&wq->flush_mutex);
+
+	copy_workqueue_attrs(wq->unbound_attrs, new_attrs);
+
+	link_cwq(dfl_cwq);
+	swap(wq->dfl_cwq, dfl_cwq);
+
+	for_each_node(node) {
+		struct cpu_workqueue_struct *old_cwq = wq->numa_cwq_tbl[node];
+
+		link_cwq(cwq_tbl[node]);
+		rcu_assign_pointer(wq->numa_cwq_tbl[node], cwq_tbl[node]);
+		cwq_tbl[node] = old_cwq;
+	}
+
+	mutex_unlock(&wq->flush_mutex);
+
+	/*
+	 * Drop the references the old table held.  Retired cwqs go away
+	 * once their in-flight work items are finished.
+	 */
+	for_each_node(node)
+		put_cwq_unlocked(cwq_tbl[node]);
+	put_cwq_unlocked(dfl_cwq);
+	ret = 0;
+	goto out_free;
+
+out_free_cwqs:
+	for_each_node(node)
+		if (cwq_tbl[node] && cwq_tbl[node] != dfl_cwq)
+			free_unbound_cwq(cwq_tbl[node]);
+	free_unbound_cwq(dfl_cwq);
+out_free:
+	free_workqueue_attrs(tmp_attrs);
+	free_workqueue_attrs(new_attrs);
+	kfree(cwq_tbl);
+	return ret;
+}
+
+/**
+ * apply_workqueue_attrs - apply new workqueue_attrs to an unbound workqueue
+ * @wq: the target workqueue
+ * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
+ *
+ * Apply @attrs to an unbound workqueue @wq.  On NUMA machines, unless
+ * disabled with workqueue.disable_numa, a separate cwq is mapped to each
+ * node with possible CPUs in @attrs->cpumask so that work items are
+ * executed on the node they were queued from.  Work items already in
+ * flight finish on the cwqs they were queued on, which are released
+ * afterwards.
+ *
+ * Performs GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * 0 on success and -errno on failure.
+ */
+int apply_workqueue_attrs(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs)
+{
+	int ret;
+
+	mutex_lock(&wq_pool_mutex);
+	ret = apply_workqueue_attrs_locked(wq, attrs);
+	mutex_unlock(&wq_pool_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(apply_workqueue_attrs);
+
+static int alloc_and_link_cwqs(struct workqueue_struct *wq)
+{
+	unsigned int cpu;
+
+	if (wq->flags & WQ_UNBOUND)
+		return apply_workqueue_attrs(wq, unbound_std_wq_attrs);
+
+	wq->cpu_cwqs = __alloc_percpu(sizeof(struct cpu_workqueue_struct),
+				      CWQ_ALIGN);
+	if (!wq->cpu_cwqs)
+		return -ENOMEM;
+
+	mutex_lock(&wq->flush_mutex);
+	for_each_possible_cpu(cpu) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_cwqs, cpu);
+
+		init_cwq(cwq, wq, get_gcwq(cpu));
+		link_cwq(cwq);
+	}
+	mutex_unlock(&wq->flush_mutex);
+
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues with WQ_SYSFS flag set are visible to userland via
+ * /sys/bus/workqueue/devices/WQ_NAME.  All visible workqueues have the
+ * following attributes.
+ *
+ *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
+ *  max_active	RW int	: maximum number of in-flight work items
+ *
+ * Unbound workqueues have the following extra attributes.
+ *
+ *  pool_ids	RO int	: the associated gcwq IDs for each node
+ *  nice	RW int	: nice value of the workers
+ *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+/* PL: set once the workqueue bus is registered */
+static bool wq_sysfs_ready;
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	return wq_dev->wq;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", !(wq->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", wq->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (sscanf(buf, "%d", &val) != 1 || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+static ssize_t wq_pool_ids_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	const char *delim = "";
+	int node, written = 0;
+
+	rcu_read_lock_sched();
+	for_each_node(node) {
+		written += scnprintf(buf + written, PAGE_SIZE - written,
+				     "%s%d:%d", delim, node,
+				     unbound_cwq_by_node(wq, node)->gcwq->id);
+		delim = " ";
+	}
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	rcu_read_unlock_sched();
+
+	return written;
+}
+
+static ssize_t wq_nice_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq->unbound_attrs->nice);
+	mutex_unlock(&wq_pool_mutex);
+
+	return written;
+}
+
+/* prepare workqueue_attrs for sysfs store operations */
+static struct workqueue_attrs *wq_sysfs_prep_attrs(struct workqueue_struct *wq)
+{
+	struct workqueue_attrs *attrs;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!attrs)
+		return NULL;
+
+	copy_workqueue_attrs(attrs, wq->unbound_attrs);
+	return attrs;
+}
+
+static ssize_t wq_nice_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -ENOMEM;
+
+	mutex_lock(&wq_pool_mutex);
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	if (sscanf(buf, "%d", &attrs->nice) == 1 &&
+	    attrs->nice >= -20 && attrs->nice <= 19)
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	else
+		ret = -EINVAL;
+
+out_unlock:
+	mutex_unlock(&wq_pool_mutex);
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = cpumask_scnprintf(buf, PAGE_SIZE, wq->unbound_attrs->cpumask);
+	mutex_unlock(&wq_pool_mutex);
+
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	return written;
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -ENOMEM;
+
+	mutex_lock(&wq_pool_mutex);
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(attrs->cpumask),
+			   nr_cpumask_bits);
+	if (!ret)
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+
+out_unlock:
+	mutex_unlock(&wq_pool_mutex);
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_unbound_attrs[] = {
+	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
+	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name				= "workqueue",
+	.dev_attrs			= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	kfree(wq_dev);
+}
+
+/**
+ * workqueue_sysfs_register - make a workqueue visible in sysfs
+ * @wq: the workqueue to register
+ *
+ * Expose @wq in sysfs under /sys/bus/workqueue/devices.  Workqueues
+ * allocated with WQ_SYSFS are registered automatically; ones created
+ * before the workqueue bus is up are picked up by wq_sysfs_init().
+ *
+ * Should be called with wq_pool_mutex held.
+ *
+ * RETURNS:
+ * 0 on success, -errno on failure.
+ */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	int ret;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (!wq_sysfs_ready)
+		return 0;
+
+	wq->wq_dev = wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		return -ENOMEM;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.release = wq_device_release;
+	dev_set_name(&wq_dev->dev, "%s", wq->name);
+
+	/*
+	 * unbound_attrs are created separately.  Suppress uevent until
+	 * everything is ready.
+	 */
+	dev_set_uevent_suppress(&wq_dev->dev, true);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		wq->wq_dev = NULL;
+		return ret;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		struct device_attribute *attr;
+
+		for (attr = wq_sysfs_unbound_attrs; attr->attr.name; attr++) {
+			ret = device_create_file(&wq_dev->dev, attr);
+			if (ret) {
+				device_unregister(&wq_dev->dev);
+				wq->wq_dev = NULL;
+				return ret;
+			}
+		}
+	}
+
+	dev_set_uevent_suppress(&wq_dev->dev, false);
+	kobject_uevent(&wq_dev->dev.kobj, KOBJ_ADD);
+	return 0;
+}
+
+/**
+ * workqueue_sysfs_unregister - undo workqueue_sysfs_register()
+ * @wq: the workqueue to unregister
+ *
+ * If @wq is registered to sysfs by workqueue_sysfs_register(), unregister.
+ * Must not be called with wq_pool_mutex held as the attribute store
+ * methods grab it.
+ */
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev = wq->wq_dev;
+
+	if (!wq->wq_dev)
+		return;
+
+	wq->wq_dev = NULL;
+	device_unregister(&wq_dev->dev);
+}
+
+static int __init wq_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+	int ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	mutex_lock(&wq_pool_mutex);
+	wq_sysfs_ready = true;
+	list_for_each_entry(wq, &workqueues, list)
+		if (wq->flags & WQ_SYSFS)
+			WARN_ON(workqueue_sysfs_register(wq));
+	mutex_unlock(&wq_pool_mutex);
+
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+#else	/* CONFIG_SYSFS */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)	{ return 0; }
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)	{ }
+#endif	/* CONFIG_SYSFS */
+
+static int wq_clamp_max_active(int max_active, unsigned int flags,
+			       const char *name)
+{
+	int lim = flags & WQ_UNBOUND ? WQ_UNBOUND_MAX_ACTIVE : WQ_MAX_ACTIVE;
+
+	if (max_active < 1 || max_active > lim)
+		printk(KERN_WARNING "workqueue: max_active %d requested for %s "
+		       "is out of range, clamping between %d and %d\n",
+		       max_active, name, 1, lim);
+
+	return clamp_val(max_active, 1, lim);
+}
+
+struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
+					       unsigned int flags,
+					       int max_active,
+					       struct lock_class_key *key,
+					       const char *lock_name, ...)
+{
+	va_list args, args1;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
+	size_t namelen;
+
+	/*
+	 * Unbound workqueues with max_active of 1 are used to order work
+	 * items.  Keep them on a single cwq; see apply_workqueue_attrs().
+	 */
+	if ((flags & WQ_UNBOUND) && max_active == 1)
+		flags |= WQ_ORDERED;
+
+	/* determine namelen, allocate wq and format name */
+	va_start(args, lock_name);
+	va_copy(args1, args);
+	namelen = vsnprintf(NULL, 0, fmt, args) + 1;
+
+	wq = kzalloc(sizeof(*wq) + namelen, GFP_KERNEL);
+	if (!wq)
+		return NULL;
+
+	vsnprintf(wq->name, namelen, fmt, args1);
+	va_end(args);
+	va_end(args1);
+
+	/*
+	 * Workqueues which may be used during memory reclaim should
+	 * have a rescuer to guarantee forward progress.
+	 */
+	if (flags & WQ_MEM_RECLAIM)
+		flags |= WQ_RESCUER;
+
+	/*
+	 * Unbound workqueues aren't concurrency managed and should be
+	 * dispatched to workers immediately.
+	 */
+	if (flags & WQ_UNBOUND)
+		flags |= WQ_HIGHPRI;
+
+	max_active = max_active ?: WQ_DFL_ACTIVE;
+	max_active = wq_clamp_max_active(max_active, flags, wq->name);
+
+	/* init wq */
+	wq->flags = flags;
+	wq->saved_max_active = max_active;
+	mutex_init(&wq->flush_mutex);
 	atomic_set(&wq->nr_cwqs_to_flush, 0);
+	INIT_LIST_HEAD(&wq->cwqs);
 	INIT_LIST_HEAD(&wq->flusher_queue);
 	INIT_LIST_HEAD(&wq->flusher_overflow);
+	INIT_LIST_HEAD(&wq->maydays);
 
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	INIT_LIST_HEAD(&wq->list);
 
-	if (alloc_cwqs(wq) < 0)
-		goto err;
-
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
-		cwq->gcwq = gcwq;
-		cwq->wq = wq;
-		cwq->flush_color = -1;
-		cwq->max_active = max_active;
-		INIT_LIST_HEAD(&cwq->delayed_works);
+	if (flags & WQ_UNBOUND) {
+		wq->unbound_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+		wq->numa_cwq_tbl = kzalloc(nr_node_ids *
+					   sizeof(wq->numa_cwq_tbl[0]),
+					   GFP_KERNEL);
+		if (!wq->unbound_attrs || !wq->numa_cwq_tbl)
+			goto err_free_wq;
 	}
 
+	if (alloc_and_link_cwqs(wq) < 0)
+		goto err_free_wq;
+
 	if (flags & WQ_RESCUER) {
 		struct worker *rescuer;
 
-		if (!alloc_mayday_mask(&wq->mayday_mask, GFP_KERNEL))
-			goto err;
-
-		wq->rescuer = rescuer = alloc_worker();
+		rescuer = alloc_worker();
 		if (!rescuer)
-			goto err;
+			goto err_destroy;
 
 		rescuer->task = kthread_create(rescuer_thread, wq, "%s",
 					       wq->name);
-		if (IS_ERR(rescuer->task))
-			goto err;
+		if (IS_ERR(rescuer->task)) {
+			kfree(rescuer);
+			goto err_destroy;
+		}
 
+		wq->rescuer = rescuer;
 		rescuer->task->flags |= PF_THREAD_BOUND;
 		wake_up_process(rescuer->task);
 	}
 
 	/*
-	 * workqueue_lock protects global freeze state and workqueues
-	 * list.  Grab it, set max_active accordingly and add the new
-	 * workqueue to workqueues list.
+	 * wq_pool_mutex and workqueue_lock protect the workqueues list.
+	 * Grab them, sync max_active with the global freeze state and
+	 * add the new workqueue to the list.
 	 */
-	spin_lock(&workqueue_lock);
-
-	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
-		for_each_cwq_cpu(cpu, wq)
-			get_cwq(cpu, wq)->max_active = 0;
+	mutex_lock(&wq_pool_mutex);
 
+	spin_lock(&workqueue_lock);
+	for_each_cwq(cwq, wq)
+		cwq_adjust_max_active(cwq);
 	list_add(&wq->list, &workqueues);
-
 	spin_unlock(&workqueue_lock);
 
-	return wq;
-err:
-	if (wq) {
-		free_cwqs(wq);
-		free_mayday_mask(wq->mayday_mask);
-		kfree(wq->rescuer);
-		kfree(wq);
+	if ((wq->flags & WQ_SYSFS) && workqueue_sysfs_register(wq)) {
+		mutex_unlock(&wq_pool_mutex);
+		goto err_destroy;
 	}
+
+	mutex_unlock(&wq_pool_mutex);
+
+	return wq;
+
+err_free_wq:
+	free_wq(wq);
+	return NULL;
+err_destroy:
+	destroy_workqueue(wq);
 	return NULL;
 }
 EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
@@ -3074,22 +4152,18 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+	int node;
+
+	/* remove from sysfs first so that it can't be poked while going down */
+	workqueue_sysfs_unregister(wq);
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
 
-	/*
-	 * wq list is used to freeze wq, remove from list after
-	 * flushing is complete in case freeze races us.
-	 */
-	spin_lock(&workqueue_lock);
-	list_del(&wq->list);
-	spin_unlock(&workqueue_lock);
-
-	/* sanity check */
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	/* sanity checks */
+	mutex_lock(&wq->flush_mutex);
+	for_each_cwq(cwq, wq) {
 		int i;
 
 		for (i = 0; i < WORK_NR_COLORS; i++)
@@ -3097,15 +4171,40 @@ void destroy_workqueue(struct workqueue_struct *wq)
 		BUG_ON(cwq->nr_active);
 		BUG_ON(!list_empty(&cwq->delayed_works));
 	}
+	mutex_unlock(&wq->flush_mutex);
+
+	/*
+	 * wq list is used to freeze wq, remove from list after
+	 * flushing is complete in case freeze races us.
+	 */
+	mutex_lock(&wq_pool_mutex);
+	spin_lock(&workqueue_lock);
+	list_del_init(&wq->list);
+	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq_pool_mutex);
 
-	if (wq->flags & WQ_RESCUER) {
+	if (wq->rescuer)
 		kthread_stop(wq->rescuer->task);
-		free_mayday_mask(wq->mayday_mask);
-		kfree(wq->rescuer);
-	}
 
-	free_cwqs(wq);
-	kfree(wq);
+	if (!(wq->flags & WQ_UNBOUND)) {
+		/* per-cpu cwqs are never released on their own */
+		call_rcu_sched(&wq->rcu, rcu_free_wq);
+	} else {
+		/*
+		 * We're the sole accessor of @wq at this point.  Directly
+		 * access numa_cwq_tbl[] and dfl_cwq to put the base refs.
+		 * @wq will be freed when the last cwq is released.
+		 */
+		for_each_node(node) {
+			cwq = wq->numa_cwq_tbl[node];
+			RCU_INIT_POINTER(wq->numa_cwq_tbl[node], NULL);
+			put_cwq_unlocked(cwq);
+		}
+
+		cwq = wq->dfl_cwq;
+		wq->dfl_cwq = NULL;
+		put_cwq_unlocked(cwq);
+	}
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
@@ -3121,7 +4220,7 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
  */
 void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
 
 	max_active = wq_clamp_max_active(max_active, wq->flags, wq->name);
 
@@ -3129,17 +4228,8 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 
 	wq->saved_max_active = max_active;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		spin_lock_irq(&gcwq->lock);
-
-		if (!(wq->flags & WQ_FREEZABLE) ||
-		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
-
-		spin_unlock_irq(&gcwq->lock);
-	}
+	for_each_cwq(cwq, wq)
+		cwq_adjust_max_active(cwq);
 
 	spin_unlock(&workqueue_lock);
 }
@@ -3150,8 +4240,9 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  * @cpu: CPU in question
  * @wq: target workqueue
  *
- * Test whether @wq's cpu workqueue for @cpu is congested.  There is
- * no synchronization around this function and the test result is
+ * Test whether @wq's cpu workqueue for @cpu is congested.  For unbound
+ * workqueues, the cwq serving @cpu's node is tested.  There is no
+ * synchronization around this function and the test result is
  * unreliable and only useful as advisory hints or for debugging.
  *
  * RETURNS:
@@ -3159,9 +4250,17 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+	bool ret;
+
+	rcu_read_lock_sched();
+
+	cwq = get_cwq(cpu, wq);
+	ret = !list_empty(&cwq->delayed_works);
 
-	return !list_empty(&cwq->delayed_works);
+	rcu_read_unlock_sched();
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(workqueue_congested);
 
@@ -3171,12 +4270,19 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  *
  * RETURNS:
  * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * WORK_CPU_UNBOUND if @work was last queued on an unbound workqueue.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
-	struct global_cwq *gcwq = get_work_gcwq(work);
+	struct global_cwq *gcwq;
+	unsigned int cpu;
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	rcu_read_lock_sched();
+	gcwq = get_work_gcwq(work);
+	cpu = gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	rcu_read_unlock_sched();
+
+	return cpu;
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3195,21 +4301,23 @@ EXPORT_SYMBOL_GPL(work_cpu);
  */
 unsigned int work_busy(struct work_struct *work)
 {
-	struct global_cwq *gcwq = get_work_gcwq(work);
+	struct global_cwq *gcwq;
 	unsigned long flags;
 	unsigned int ret = 0;
 
-	if (!gcwq)
-		return false;
-
-	spin_lock_irqsave(&gcwq->lock, flags);
+	rcu_read_lock_sched();
 
-	if (work_pending(work))
-		ret |= WORK_BUSY_PENDING;
-	if (find_worker_executing_work(gcwq, work))
-		ret |= WORK_BUSY_RUNNING;
+	gcwq = get_work_gcwq(work);
+	if (gcwq) {
+		spin_lock_irqsave(&gcwq->lock, flags);
+		if (work_pending(work))
+			ret |= WORK_BUSY_PENDING;
+		if (find_worker_executing_work(gcwq, work))
+			ret |= WORK_BUSY_RUNNING;
+		spin_unlock_irqrestore(&gcwq->lock, flags);
+	}
 
-	spin_unlock_irqrestore(&gcwq->lock, flags);
+	rcu_read_unlock_sched();
 
 	return ret;
 }
@@ -3651,6 +4759,8 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
  */
 void freeze_workqueues_begin(void)
 {
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 	unsigned int cpu;
 
 	spin_lock(&workqueue_lock);
@@ -3658,23 +4768,23 @@ void freeze_workqueues_begin(void)
 	BUG_ON(workqueue_freezing);
 	workqueue_freezing = true;
 
-	for_each_gcwq_cpu(cpu) {
+	/* the trustee of a going down cpu checks FREEZING */
+	for_each_possible_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
-
 		BUG_ON(gcwq->flags & GCWQ_FREEZING);
 		gcwq->flags |= GCWQ_FREEZING;
+		spin_unlock_irq(&gcwq->lock);
+	}
 
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-
-			if (cwq && wq->flags & WQ_FREEZABLE)
-				cwq->max_active = 0;
-		}
+	/* suppress further executions by setting max_active to zero */
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 
-		spin_unlock_irq(&gcwq->lock);
+		for_each_cwq(cwq, wq)
+			cwq_adjust_max_active(cwq);
 	}
 
 	spin_unlock(&workqueue_lock);
@@ -3695,25 +4805,22 @@ void freeze_workqueues_begin(void)
  */
 bool freeze_workqueues_busy(void)
 {
-	unsigned int cpu;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 	bool busy = false;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(!workqueue_freezing);
 
-	for_each_gcwq_cpu(cpu) {
-		struct workqueue_struct *wq;
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 		/*
 		 * nr_active is monotonically decreasing.  It's safe
 		 * to peek without lock.
 		 */
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
-
+		for_each_cwq(cwq, wq) {
 			BUG_ON(cwq->nr_active < 0);
 			if (cwq->nr_active) {
 				busy = true;
@@ -3737,6 +4844,8 @@ out_unlock:
  */
 void thaw_workqueues(void)
 {
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 	unsigned int cpu;
 
 	spin_lock(&workqueue_lock);
@@ -3744,80 +4853,92 @@ void thaw_workqueues(void)
 	if (!workqueue_freezing)
 		goto out_unlock;
 
-	for_each_gcwq_cpu(cpu) {
+	workqueue_freezing = false;
+
+	for_each_possible_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct workqueue_struct *wq;
 
 		spin_lock_irq(&gcwq->lock);
-
 		BUG_ON(!(gcwq->flags & GCWQ_FREEZING));
 		gcwq->flags &= ~GCWQ_FREEZING;
-
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
-
-			/* restore max_active and repopulate worklist */
-			cwq->max_active = wq->saved_max_active;
-
-			while (!list_empty(&cwq->delayed_works) &&
-			       cwq->nr_active < cwq->max_active)
-				cwq_activate_first_delayed(cwq);
-		}
-
-		wake_up_worker(gcwq);
-
 		spin_unlock_irq(&gcwq->lock);
 	}
 
-	workqueue_freezing = false;
+	/* restore max_active and repopulate worklist */
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
+
+		for_each_cwq(cwq, wq)
+			cwq_adjust_max_active(cwq);
+	}
 out_unlock:
 	spin_unlock(&workqueue_lock);
 }
 #endif /* CONFIG_FREEZER */
 
-static int __init init_workqueues(void)
+static void __init wq_numa_init(void)
 {
-	unsigned int cpu;
-	int i;
+	cpumask_var_t *tbl;
+	int node, cpu;
 
-	cpu_notifier(workqueue_cpu_callback, CPU_PRI_WORKQUEUE);
+	if (num_possible_nodes() <= 1)
+		return;
 
-	/* initialize gcwqs */
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	if (wq_disable_numa) {
+		pr_info("workqueue: NUMA affinity support disabled\n");
+		return;
+	}
 
-		spin_lock_init(&gcwq->lock);
-		INIT_LIST_HEAD(&gcwq->worklist);
-		gcwq->cpu = cpu;
-		gcwq->flags |= GCWQ_DISASSOCIATED;
+	/*
+	 * We want masks of possible CPUs of each node which isn't readily
+	 * available.  Build one from cpu_to_node() which should have been
+	 * fully initialized by now.
+	 */
+	tbl = kzalloc(nr_node_ids * sizeof(tbl[0]), GFP_KERNEL);
+	BUG_ON(!tbl);
+
+	for_each_node(node)
+		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
+				node_online(node) ? node : NUMA_NO_NODE));
+
+	for_each_possible_cpu(cpu) {
+		node = cpu_to_node(cpu);
+		if (WARN_ON(node == NUMA_NO_NODE)) {
+			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n",
+				cpu);
+			/* happens iff arch is bonkers, let's just proceed */
+			return;
+		}
+		cpumask_set_cpu(cpu, tbl[node]);
+	}
+
+	wq_numa_possible_cpumask = tbl;
+	wq_numa_enabled = true;
+}
 
-		INIT_LIST_HEAD(&gcwq->idle_list);
-		for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
-			INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+static int __init init_workqueues(void)
+{
+	unsigned int cpu;
 
-		init_timer_deferrable(&gcwq->idle_timer);
-		gcwq->idle_timer.function = idle_worker_timeout;
-		gcwq->idle_timer.data = (unsigned long)gcwq;
+	cwq_cache = kmem_cache_create("cpu_workqueue_struct",
+				      sizeof(struct cpu_workqueue_struct),
+				      CWQ_ALIGN, SLAB_PANIC, NULL);
 
-		setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
-			    (unsigned long)gcwq);
+	cpu_notifier(workqueue_cpu_callback, CPU_PRI_WORKQUEUE);
 
-		ida_init(&gcwq->worker_ida);
+	wq_numa_init();
 
-		gcwq->trustee_state = TRUSTEE_DONE;
-		init_waitqueue_head(&gcwq->trustee_wait);
-	}
+	/* initialize per-cpu gcwqs, unbound ones are created on demand */
+	for_each_possible_cpu(cpu)
+		init_gcwq(get_gcwq(cpu), cpu);
 
 	/* create the initial worker */
-	for_each_online_gcwq_cpu(cpu) {
+	for_each_online_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker *worker;
 
-		if (cpu != WORK_CPU_UNBOUND)
-			gcwq->flags &= ~GCWQ_DISASSOCIATED;
+		gcwq->flags &= ~GCWQ_DISASSOCIATED;
 		worker = create_worker(gcwq, true);
 		BUG_ON(!worker);
 		spin_lock_irq(&gcwq->lock);
@@ -3825,10 +4946,15 @@ static int __init init_workqueues(void)
 		spin_unlock_irq(&gcwq->lock);
 	}
 
+	/* create default unbound wq attrs */
+	unbound_std_wq_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	BUG_ON(!unbound_std_wq_attrs);
+
 	system_wq = alloc_workqueue("events", 0, 0);
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_nrt_wq = alloc_workqueue("events_nrt", WQ_NON_REENTRANT, 0);
-	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
+	system_unbound_wq = alloc_workqueue("events_unbound",
+					    WQ_UNBOUND | WQ_SYSFS,
 					    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
@@ -10,6 +10,8 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/cgroup.h>
 #include <trace/events/writeback.h>
 
 static atomic_long_t bdi_seq = ATOMIC_LONG_INIT(0);
@@ -74,10 +76,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long nr_dirty, nr_io, nr_more_io;
+	unsigned long nr_dirty, nr_io, nr_more_io, nr_busy;
 	struct inode *inode;
 
-	nr_dirty = nr_io = nr_more_io = 0;
+	nr_dirty = nr_io = nr_more_io = nr_busy = 0;
 	spin_lock(&wb->list_lock);
 	list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
 		nr_dirty++;
@@ -85,6 +87,8 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		nr_io++;
 	list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
 		nr_more_io++;
+	list_for_each_entry(inode, &wb->b_busy, i_wb_list)
+		nr_busy++;
 	spin_unlock(&wb->list_lock);
 
 	global_dirty_limits(&background_thresh, &dirty_thresh);
@@ -103,6 +107,8 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
+		   "b_busy:             %10lu\n"
+		   "wb_workers:         %10u\n"
 		   "bdi_list:           %10u\n"
 		   "state:              %10lx\n",
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
@@ -116,6 +122,8 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
+		   nr_busy,
+		   bdi->wb_workers,
 		   !list_empty(&bdi->bdi_list), bdi->state);
 #undef K
 
@@ -225,12 +233,31 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t writeback_workers_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned int nr;
+	ssize_t ret = -EINVAL;
+
+	nr = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0'))) {
+		ret = bdi_set_wb_workers(bdi, nr);
+		if (!ret)
+			ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(writeback_workers, bdi->wb_workers)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(writeback_workers),
 	__ATTR_NULL,
 };
 
@@ -265,9 +292,33 @@ static int __init default_bdi_init(void)
 }
 subsys_initcall(default_bdi_init);
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+static int cgwb_has_dirty_io(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb;
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&bdi->cgwb_lock, flags);
+	list_for_each_entry(wb, &bdi->cgwb_list, bdi_node) {
+		if (wb_has_dirty_io(wb)) {
+			ret = 1;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&bdi->cgwb_lock, flags);
+	return ret;
+}
+#else
+static inline int cgwb_has_dirty_io(struct backing_dev_info *bdi)
+{
+	return 0;
+}
+#endif
+
 int bdi_has_dirty_io(struct backing_dev_info *bdi)
 {
-	return wb_has_dirty_io(&bdi->wb);
+	return wb_has_dirty_io(&bdi->wb) || cgwb_has_dirty_io(bdi);
 }
 
 /*
@@ -422,7 +473,7 @@ static int bdi_forker_thread(void *ptr)
 			     "bdi %p/%s is not registered!\n", bdi, bdi->name);
 
 			have_dirty_io = !list_empty(&bdi->work_list) ||
-					wb_has_dirty_io(&bdi->wb);
+					bdi_has_dirty_io(bdi);
 
 			/*
 			 * If the bdi has work to do, but the thread does not
@@ -660,6 +711,7 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 	INIT_LIST_HEAD(&wb->b_dirty);
 	INIT_LIST_HEAD(&wb->b_io);
 	INIT_LIST_HEAD(&wb->b_more_io);
+	INIT_LIST_HEAD(&wb->b_busy);
 	spin_lock_init(&wb->list_lock);
 	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
 }
@@ -669,6 +721,258 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
  */
 #define INIT_BW		(100 << (20 - PAGE_SHIFT))
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * Each blkcg other than the root one that dirties inodes on a bdi gets a
+ * bdi_writeback of its own, linked on bdi->cgwb_list.  The flusher thread
+ * of the bdi writes its inodes with the IO charged to the blkcg.
+ *
+ * A cgroup bdi_writeback is pinned by the inodes attached to it, for the
+ * rest of their life, and by bdi->cgwb_list.  When its blkcg goes away it
+ * is marked dead and no more inodes are attached to it; the flusher keeps
+ * writing the ones it has and frees it once the last of them is gone.
+ *
+ * Its page counters are per-cpu, and per-cpu memory can't be allocated
+ * in the atomic context inodes get attached in.  So the bdi keeps one
+ * bdi_writeback allocated ahead, which the flusher replaces once it has
+ * been handed out.
+ */
+static struct bdi_writeback *cgwb_alloc(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb;
+	int i;
+
+	wb = kmalloc(sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return NULL;
+
+	bdi_wb_init(wb, bdi);
+	for (i = 0; i < NR_WB_STAT_ITEMS; i++) {
+		if (percpu_counter_init(&wb->stat[i], 0))
+			goto err;
+	}
+	return wb;
+
+err:
+	while (i--)
+		percpu_counter_destroy(&wb->stat[i]);
+	kfree(wb);
+	return NULL;
+}
+
+static void cgwb_free(struct bdi_writeback *wb)
+{
+	int i;
+
+	for (i = 0; i < NR_WB_STAT_ITEMS; i++)
+		percpu_counter_destroy(&wb->stat[i]);
+	kfree(wb);
+}
+
+/* Allocate the next bdi_writeback for a blkcg, unless there is one. */
+static void cgwb_refill_spare(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb;
+
+	if (ACCESS_ONCE(bdi->cgwb_spare))
+		return;
+
+	wb = cgwb_alloc(bdi);
+	if (!wb)
+		return;
+
+	spin_lock_irq(&bdi->cgwb_lock);
+	if (!bdi->cgwb_spare) {
+		bdi->cgwb_spare = wb;
+		wb = NULL;
+	}
+	spin_unlock_irq(&bdi->cgwb_lock);
+
+	if (wb)
+		cgwb_free(wb);
+}
+
+/*
+ * Hand the spare bdi_writeback of @bdi to @blkcg_css.  Returns NULL if
+ * the flusher hasn't replaced the last one yet.  Called with cgwb_lock
+ * held.
+ */
+static struct bdi_writeback *cgwb_create(struct backing_dev_info *bdi,
+				struct cgroup_subsys_state *blkcg_css)
+{
+	struct bdi_writeback *wb = bdi->cgwb_spare;
+
+	if (!wb)
+		return NULL;
+	bdi->cgwb_spare = NULL;
+
+	wb->last_old_flush = jiffies;
+	wb->blkcg_css = blkcg_css;
+	atomic_set(&wb->refcnt, 1);
+	wb->bw_time_stamp = jiffies;
+	wb->write_bandwidth = INIT_BW;
+	wb->avg_write_bandwidth = INIT_BW;
+	list_add_tail(&wb->bdi_node, &bdi->cgwb_list);
+	return wb;
+}
+
+/**
+ * inode_attach_wb - attribute an inode to the blkcg of the current task
+ * @inode: inode getting dirty
+ * @bdi: the bdi @inode writes to
+ *
+ * Attach @inode to the bdi_writeback of the current task's blkcg on @bdi
+ * unless it is attached already, and return the bdi_writeback it is
+ * attached to.  Called before @inode gets dirty pages accounted or is put
+ * on a writeback list, so that it sticks to the first cgroup dirtying it.
+ * Callable from atomic context; if no bdi_writeback is available for the
+ * blkcg the inode is attached to the bdi's own one.
+ */
+struct bdi_writeback *inode_attach_wb(struct inode *inode,
+				      struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb = &bdi->wb, *iter;
+	struct cgroup_subsys_state *blkcg_css;
+	unsigned long flags;
+
+	if (inode->i_wb)
+		return inode->i_wb;
+
+	if (!bdi_cap_writeback_dirty(bdi) || !bdi_cap_account_dirty(bdi))
+		goto attach;
+
+	rcu_read_lock();
+	blkcg_css = task_subsys_state(current, blkio_subsys_id);
+	if (blkcg_css->cgroup->parent) {
+		spin_lock_irqsave(&bdi->cgwb_lock, flags);
+		list_for_each_entry(iter, &bdi->cgwb_list, bdi_node) {
+			if (iter->blkcg_css == blkcg_css) {
+				wb = iter;
+				break;
+			}
+		}
+		if (wb == &bdi->wb)
+			wb = cgwb_create(bdi, blkcg_css) ? : &bdi->wb;
+		if (wb != &bdi->wb)
+			atomic_inc(&wb->refcnt);
+		spin_unlock_irqrestore(&bdi->cgwb_lock, flags);
+	}
+	rcu_read_unlock();
+attach:
+	if (cmpxchg(&inode->i_wb, NULL, wb) && wb_is_cgwb(wb))
+		atomic_dec(&wb->refcnt);
+	return inode->i_wb;
+}
+
+/**
+ * inode_switch_wb - change the bdi_writeback of an inode
+ * @inode: inode to switch
+ * @wb: a bdi's own bdi_writeback, or NULL to detach @inode
+ *
+ * Point @inode at @wb, dropping the reference to the cgroup bdi_writeback
+ * it was attached to.  The caller moves @inode to the lists of @wb.
+ */
+void inode_switch_wb(struct inode *inode, struct bdi_writeback *wb)
+{
+	struct bdi_writeback *old = xchg(&inode->i_wb, wb);
+
+	if (old && wb_is_cgwb(old))
+		atomic_dec(&old->refcnt);
+}
+
+/*
+ * @blkcg_css is going away: mark its bdi_writebacks dead.
+ */
+void cgwb_blkcg_offline(struct cgroup_subsys_state *blkcg_css)
+{
+	struct backing_dev_info *bdi;
+	struct bdi_writeback *wb;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
+		spin_lock_irq(&bdi->cgwb_lock);
+		list_for_each_entry(wb, &bdi->cgwb_list, bdi_node)
+			if (wb->blkcg_css == blkcg_css)
+				wb->blkcg_css = NULL;
+		spin_unlock_irq(&bdi->cgwb_lock);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Free the dead cgroup bdi_writebacks of @bdi that no inode is attached
+ * to any more, and make sure the next blkcg can get one.  Called by the
+ * flusher thread of @bdi, which is the only one to walk bdi->cgwb_list
+ * without holding cgwb_lock.
+ */
+void bdi_reap_cgwbs(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb, *next;
+
+	cgwb_refill_spare(bdi);
+
+	spin_lock_irq(&bdi->cgwb_lock);
+	list_for_each_entry_safe(wb, next, &bdi->cgwb_list, bdi_node) {
+		if (wb->blkcg_css || atomic_read(&wb->refcnt) > 1)
+			continue;
+		WARN_ON(wb_has_dirty_io(wb));
+		list_del(&wb->bdi_node);
+		cgwb_free(wb);
+	}
+	spin_unlock_irq(&bdi->cgwb_lock);
+}
+
+/*
+ * Move the dirty inodes of the cgroup bdi_writebacks of @bdi to @dst,
+ * like bdi_destroy() does for the bdi's own lists.  A bdi_writeback still
+ * pinned by clean inodes is left to them.
+ */
+static void cgwb_bdi_destroy(struct backing_dev_info *bdi,
+			     struct bdi_writeback *dst)
+{
+	struct bdi_writeback *wb, *next, *spare;
+	struct inode *inode;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&bdi->cgwb_lock);
+	list_splice_init(&bdi->cgwb_list, &list);
+	spare = bdi->cgwb_spare;
+	bdi->cgwb_spare = NULL;
+	spin_unlock_irq(&bdi->cgwb_lock);
+
+	if (spare)
+		cgwb_free(spare);
+
+	list_for_each_entry_safe(wb, next, &list, bdi_node) {
+		bdi_lock_two(wb, dst);
+		list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
+			inode_switch_wb(inode, dst);
+		list_for_each_entry(inode, &wb->b_io, i_wb_list)
+			inode_switch_wb(inode, dst);
+		list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
+			inode_switch_wb(inode, dst);
+		list_splice_init(&wb->b_dirty, &dst->b_dirty);
+		list_splice_init(&wb->b_io, &dst->b_io);
+		list_splice_init(&wb->b_more_io, &dst->b_more_io);
+		spin_unlock(&wb->list_lock);
+		spin_unlock(&dst->list_lock);
+
+		list_del(&wb->bdi_node);
+		if (atomic_dec_and_test(&wb->refcnt))
+			cgwb_free(wb);
+	}
+}
+#else
+static inline void cgwb_refill_spare(struct backing_dev_info *bdi)
+{
+}
+
+static inline void cgwb_bdi_destroy(struct backing_dev_info *bdi,
+				    struct bdi_writeback *dst)
+{
+}
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
 int bdi_init(struct backing_dev_info *bdi)
 {
 	int i, err;
@@ -678,9 +982,15 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
+	bdi->wb_workers = 1;
 	spin_lock_init(&bdi->wb_lock);
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->work_list);
+#ifdef CONFIG_CGROUP_WRITEBACK
+	INIT_LIST_HEAD(&bdi->cgwb_list);
+	bdi->cgwb_spare = NULL;
+	spin_lock_init(&bdi->cgwb_lock);
+#endif
 
 	bdi_wb_init(&bdi->wb, bdi);
 
@@ -701,6 +1011,8 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->avg_write_bandwidth = INIT_BW;
 
 	err = prop_local_init_percpu(&bdi->completions);
+	if (!err)
+		cgwb_refill_spare(bdi);
 
 	if (err) {
 err:
@@ -733,6 +1045,9 @@ void bdi_destroy(struct backing_dev_info *bdi)
 
 	bdi_unregister(bdi);
 
+	/* The flusher is gone, the cgroups' inodes can follow */
+	cgwb_bdi_destroy(bdi, &default_backing_dev_info.wb);
+
 	/*
 	 * If bdi_unregister() had already been called earlier, the
 	 * wakeup_timer could still be armed because bdi_prune_sb()
@@ -748,6 +1063,22 @@ void bdi_destroy(struct backing_dev_info *bdi)
 }
 EXPORT_SYMBOL(bdi_destroy);
 
+/*
+ * Set the number of inodes the flusher of @bdi writes back in parallel.
+ * The flusher thread picks the new value up the next time it runs.
+ */
+int bdi_set_wb_workers(struct backing_dev_info *bdi, unsigned int nr)
+{
+	if (nr < 1 || nr > BDI_MAX_WB_WORKERS)
+		return -EINVAL;
+	if (!bdi_cap_writeback_dirty(bdi))
+		return -EINVAL;
+
+	bdi->wb_workers = nr;
+	return 0;
+}
+EXPORT_SYMBOL(bdi_set_wb_workers);
+
 /*
  * For use from filesystems to quickly init and register a bdi associated
  * with dirty writeback
@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
 #include "internal.h"
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -556,6 +559,55 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 	return ISOLATE_SUCCESS;
 }
 
+/*
+ * A zone's fragmentation score is the unusable free space index, on the
+ * same 0-1000 scale as /sys/kernel/debug/extfrag/unusable_index, for a
+ * pageblock-sized allocation. A zone without free memory scores zero as
+ * compaction cannot help it.
+ */
+static int fragmentation_score_zone(struct zone *zone)
+{
+	if (!zone_page_state(zone, NR_FREE_PAGES))
+		return 0;
+
+	return unusable_index(zone, pageblock_order);
+}
+
+/*
+ * The node score weights each zone by its share of the node so that a small
+ * zone such as ZONE_DMA cannot trigger proactive compaction on its own.
+ */
+static int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned long score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		score += fragmentation_score_zone(zone) * zone->present_pages;
+	}
+
+	return score / max(pgdat->node_present_pages, 1UL);
+}
+
+/*
+ * Proactive compaction starts when the score rises above the high mark and
+ * stops once it falls below the low mark. Both are derived from
+ * vm.compaction_proactiveness; the hysteresis keeps kcompactd from waking
+ * for every small change in the free lists.
+ */
+static int fragmentation_score_wmark(bool low)
+{
+	int wmark_low;
+
+	wmark_low = max(100 - sysctl_compaction_proactiveness, 5) * 10;
+	return low ? wmark_low : min(wmark_low + 100, 1000);
+}
+
 static int compact_finished(struct zone *zone,
 			    struct compact_control *cc)
 {
@@ -569,6 +621,14 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* Proactive compaction stops once the zone is defragmented enough */
+	if (cc->proactive) {
+		if (fragmentation_score_zone(zone) <=
+					fragmentation_score_wmark(true))
+			return COMPACT_PARTIAL;
+		return COMPACT_CONTINUE;
+	}
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -735,6 +795,7 @@ static unsigned long compact_zone_order(struct zone *zone,
 }
 
 int sysctl_extfrag_threshold = 500;
+int sysctl_compaction_proactiveness = 20;
 
 /**
  * try_to_compact_pages - Direct compact to satisfy a high-order allocation
@@ -773,6 +834,8 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		int status;
 
 		status = compact_zone_order(zone, order, gfp_mask, sync);
+		if (status != COMPACT_SKIPPED)
+			inc_zone_state(zone, NR_COMPACT_STALL);
 		rc = max(status, rc);
 
 		/* If a normal allocation would succeed, stop compacting */
@@ -822,16 +885,6 @@ static int __compact_pgdat(pg_data_t *pgdat, struct compact_control *cc)
 	return 0;
 }
 
-int compact_pgdat(pg_data_t *pgdat, int order)
-{
-	struct compact_control cc = {
-		.order = order,
-		.sync = false,
-	};
-
-	return __compact_pgdat(pgdat, &cc);
-}
-
 static int compact_node(int nid)
 {
 	struct compact_control cc = {
@@ -877,6 +930,22 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+int sysctl_compaction_proactiveness_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/* Let sleeping kcompactd threads pick up the new proactive interval */
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+
+	return 0;
+}
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -906,4 +975,331 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/* How often kcompactd rechecks the fragmentation score when proactive */
+#define KCOMPACTD_PROACTIVE_MSECS	500
+
+/*
+ * Number of proactive intervals skipped after a proactive run that failed
+ * to lower the node score.
+ */
+#define KCOMPACTD_PROACTIVE_DEFER	(1 << COMPACT_MAX_DEFER_SHIFT)
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+/* Returns true if compaction is worth attempting on any eligible zone */
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static bool kcompactd_zone_ok(struct zone *zone, int order)
+{
+	return zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0);
+}
+
+static void kcompactd_compact_zone(struct zone *zone,
+				   struct compact_control *cc)
+{
+	cc->nr_freepages = 0;
+	cc->nr_migratepages = 0;
+	cc->zone = zone;
+	INIT_LIST_HEAD(&cc->freepages);
+	INIT_LIST_HEAD(&cc->migratepages);
+
+	compact_zone(zone, cc);
+
+	VM_BUG_ON(!list_empty(&cc->freepages));
+	VM_BUG_ON(!list_empty(&cc->migratepages));
+}
+
+/*
+ * Compact the zones kswapd asked for. Async migration is tried first as it
+ * only moves pages that can be moved cheaply; sync migration is only used
+ * for zones that are still unable to satisfy the order afterwards. Only a
+ * failed sync run defers compaction, as in the direct compaction path.
+ */
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+	struct compact_control cc = {
+		.order = order,
+		.migratetype = MIGRATE_MOVABLE,
+	};
+	int zoneid;
+
+	trace_mm_compaction_kcompactd_wake(pgdat->node_id, order,
+					   classzone_idx);
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone, order))
+			continue;
+
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		cc.sync = false;
+		kcompactd_compact_zone(zone, &cc);
+
+		if (!kcompactd_zone_ok(zone, order) && !kthread_should_stop()) {
+			cc.sync = true;
+			kcompactd_compact_zone(zone, &cc);
+		}
+
+		if (kcompactd_zone_ok(zone, order)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			if (order >= zone->compact_order_failed)
+				zone->compact_order_failed = order + 1;
+			inc_zone_state(zone, NR_KCOMPACTD_SUCCESS);
+		} else if (cc.sync) {
+			defer_compaction(zone, order);
+		}
+
+		if (kthread_should_stop())
+			return;
+	}
+
+	/*
+	 * Regardless of success, we are done until woken up next. But remember
+	 * the requested order/classzone_idx in case it was higher/tighter than
+	 * our current ones
+	 */
+	if (pgdat->kcompactd_max_order <= order)
+		pgdat->kcompactd_max_order = 0;
+	if (pgdat->kcompactd_classzone_idx >= classzone_idx)
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+}
+
+static bool kcompactd_proactive_needed(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness)
+		return false;
+
+	return fragmentation_score_node(pgdat) > fragmentation_score_wmark(false);
+}
+
+/*
+ * Compact every zone of the node with async migration until its score drops
+ * below the low mark. Sync migration is never used here as nobody is waiting
+ * on the result.
+ */
+static void kcompactd_proactive(pg_data_t *pgdat)
+{
+	struct compact_control cc = {
+		.order = -1,
+		.sync = false,
+		.proactive = true,
+		.migratetype = MIGRATE_MOVABLE,
+	};
+	int zoneid;
+
+	count_vm_event(KCOMPACTD_PROACTIVE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (fragmentation_score_zone(zone) <=
+					fragmentation_score_wmark(true))
+			continue;
+
+		/* Migration needs free pages to copy into */
+		if (!zone_watermark_ok(zone, 0, low_wmark_pages(zone) +
+				       (2UL << pageblock_order), 0, 0))
+			continue;
+
+		kcompactd_compact_zone(zone, &cc);
+
+		if (kthread_should_stop())
+			return;
+	}
+}
+
+/*
+ * The background compaction daemon, started as a kernel thread from the
+ * init process. kswapd wakes it when a high-order watermark cannot be met
+ * and it also wakes periodically to defragment the node proactively.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned int proactive_defer = 0;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+		int prev_score;
+
+		if (sysctl_compaction_proactiveness)
+			timeout = msecs_to_jiffies(KCOMPACTD_PROACTIVE_MSECS);
+
+		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+			kcompactd_work_requested(pgdat) ||
+			(timeout == MAX_SCHEDULE_TIMEOUT &&
+			 sysctl_compaction_proactiveness), timeout);
+
+		if (kthread_should_stop())
+			break;
+
+		if (pgdat->kcompactd_max_order) {
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/* Nothing was requested: consider proactive compaction */
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
+
+		if (!kcompactd_proactive_needed(pgdat))
+			continue;
+
+		/* Flush pending updates to the LRU lists */
+		lru_add_drain();
+
+		prev_score = fragmentation_score_node(pgdat);
+		kcompactd_proactive(pgdat);
+
+		/* Back off if the node could not be defragmented further */
+		if (fragmentation_score_node(pgdat) >= prev_score)
+			proactive_defer = KCOMPACTD_PROACTIVE_DEFER;
+	}
+
+	return 0;
+}
+
+/*
+ * A high-order watermark could not be met on this node, so wake its
+ * kcompactd to service it.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	trace_mm_compaction_wakeup_kcompactd(pgdat->node_id, order,
+					     classzone_idx);
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined. Caller must
+ * hold lock_memory_hotplug().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/*
+ * As with kswapd, it's optimal to keep kcompactd on the same CPUs as its
+ * node's memory but not required for correctness. Restore the binding when
+ * the first CPU of a node comes back online.
+ */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (pgdat->kcompactd &&
+			    cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				/* One of our CPUs online: restore mask */
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #endif /* CONFIG_COMPACTION */
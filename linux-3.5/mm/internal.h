@@ -96,6 +96,26 @@ extern void putback_lru_page(struct page *page);
  */
 extern void __free_pages_bootmem(struct page *page, unsigned int order);
 extern void prep_compound_page(struct page *page, unsigned long order);
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+extern void reserve_bootmem_region(phys_addr_t start, phys_addr_t end);
+
+/* Free memory of @nid from this pfn on is released by deferred init */
+static inline unsigned long deferred_pfn_limit(int nid)
+{
+	if (nid == MAX_NUMNODES)
+		return ULONG_MAX;
+	return NODE_DATA(nid)->first_deferred_pfn;
+}
+#else
+static inline void reserve_bootmem_region(phys_addr_t start, phys_addr_t end)
+{
+}
+
+static inline unsigned long deferred_pfn_limit(int nid)
+{
+	return ULONG_MAX;
+}
+#endif
 #ifdef CONFIG_MEMORY_FAILURE
 extern bool is_free_buddy_page(struct page *page);
 #endif
@@ -120,6 +140,7 @@ struct compact_control {
 	unsigned long free_pfn;		/* isolate_freepages search base */
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
 	bool sync;			/* Synchronous migration */
+	bool proactive;			/* kcompactd reducing fragmentation */
 
 	int order;			/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
@@ -347,3 +368,19 @@ extern u32 hwpoison_filter_enable;
 extern unsigned long vm_mmap_pgoff(struct file *, unsigned long,
         unsigned long, unsigned long,
         unsigned long, unsigned long);
+
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+void try_to_unmap_flush(void);
+void try_to_unmap_flush_dirty(void);
+void flush_tlb_batched_pending(struct mm_struct *mm);
+#else
+static inline void try_to_unmap_flush(void)
+{
+}
+static inline void try_to_unmap_flush_dirty(void)
+{
+}
+static inline void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+}
+#endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
@@ -49,6 +49,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/shmem_fs.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/tcp_memcontrol.h>
@@ -5097,17 +5098,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 
-#ifdef CONFIG_SWAP
-	/* shmem/tmpfs may report page out on swap: account for that too. */
 	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+#ifdef CONFIG_SWAP
+		/* shmem/tmpfs may report page out on swap: account for that too. */
+		if (shmem_mapping(mapping)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		} else
 #endif
+			page = NULL;	/* shadow of an evicted page */
+	}
 	return page;
 }
 
@@ -29,6 +29,7 @@
 #include <linux/suspend.h>
 #include <linux/mm_inline.h>
 #include <linux/firmware-map.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 
@@ -523,6 +524,7 @@ int __ref online_pages(unsigned long pfn, unsigned long nr_pages)
 
 	if (onlined_pages) {
 		kswapd_run(zone_to_nid(zone));
+		kcompactd_run(zone_to_nid(zone));
 		node_set_state(zone_to_nid(zone), N_HIGH_MEMORY);
 	}
 
@@ -968,6 +970,7 @@ repeat:
 	if (!node_present_pages(node)) {
 		node_clear_state(node, N_HIGH_MEMORY);
 		kswapd_stop(node);
+		kcompactd_stop(node);
 	}
 
 	vm_total_pages = nr_free_pagecache_pages();
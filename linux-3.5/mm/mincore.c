@@ -14,6 +14,7 @@
 #include <linux/syscalls.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/hugetlb.h>
 
 #include <asm/uaccess.h>
@@ -70,14 +71,17 @@ static unsigned char mincore_page(struct address_space *mapping, pgoff_t pgoff)
 	 * any other file mapping (ie. marked !present and faulted in with
 	 * tmpfs's .fault). So swapped out tmpfs mappings are tested here.
 	 */
-	page = find_get_page(mapping, pgoff);
-#ifdef CONFIG_SWAP
-	/* shmem/tmpfs may return swap: account for swapcache page too. */
+	page = find_get_entry(mapping, pgoff);
 	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		page = find_get_page(&swapper_space, swap.val);
-	}
+#ifdef CONFIG_SWAP
+		/* shmem/tmpfs may return swap: account for swapcache page too. */
+		if (shmem_mapping(mapping)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			page = find_get_page(&swapper_space, swap.val);
+		} else
 #endif
+			page = NULL;	/* shadow of an evicted page */
+	}
 	if (page) {
 		present = PageUptodate(page);
 		page_cache_release(page);
@@ -106,12 +106,15 @@ static void __init __free_pages_memory(unsigned long start, unsigned long end)
 }
 
 static unsigned long __init __free_memory_core(phys_addr_t start,
-				 phys_addr_t end)
+				 phys_addr_t end, int nid)
 {
 	unsigned long start_pfn = PFN_UP(start);
 	unsigned long end_pfn = min_t(unsigned long,
 				      PFN_DOWN(end), max_low_pfn);
 
+	/* struct pages beyond this are not initialised yet */
+	end_pfn = min(end_pfn, deferred_pfn_limit(nid));
+
 	if (start_pfn > end_pfn)
 		return 0;
 
@@ -124,15 +127,21 @@ unsigned long __init free_low_memory_core_early(int nodeid)
 {
 	unsigned long count = 0;
 	phys_addr_t start, end, size;
+	struct memblock_region *reg;
+	int nid;
 	u64 i;
 
-	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, NULL)
-		count += __free_memory_core(start, end);
+	/* reserved pages must have valid struct pages even if deferred */
+	for_each_memblock(reserved, reg)
+		reserve_bootmem_region(reg->base, reg->base + reg->size);
+
+	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, &nid)
+		count += __free_memory_core(start, end, nid);
 
 	/* free range that is used for reserved array if we allocate it */
 	size = get_allocated_memblock_reserved_regions_info(&start);
 	if (size)
-		count += __free_memory_core(start, start + size);
+		count += __free_memory_core(start, start + size, MAX_NUMNODES);
 
 	return count;
 }
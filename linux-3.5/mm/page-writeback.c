@@ -1040,6 +1040,109 @@ static void bdi_update_bandwidth(struct backing_dev_info *bdi,
 	spin_unlock(&bdi->wb.list_lock);
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * Estimate the write bandwidth a cgroup gets on the bdi, i.e. how fast the
+ * flusher manages to write the cgroup's inodes with the blkio limits of
+ * the cgroup applied.  Periods without any of its pages being written
+ * don't count, so that the estimate survives the flusher being busy with
+ * other cgroups.
+ */
+static void cgwb_update_bandwidth(struct bdi_writeback *wb)
+{
+	const unsigned long period = roundup_pow_of_two(3 * HZ);
+	unsigned long now = jiffies;
+	unsigned long elapsed;
+	unsigned long written;
+	unsigned long avg;
+	u64 bw;
+
+	if (time_is_after_eq_jiffies(wb->bw_time_stamp + BANDWIDTH_INTERVAL))
+		return;
+
+	spin_lock(&wb->list_lock);
+	elapsed = now - wb->bw_time_stamp;
+	if (elapsed < BANDWIDTH_INTERVAL)
+		goto unlock;
+
+	written = percpu_counter_read(&wb->stat[WB_WRITTEN]);
+	if (elapsed > period ||
+	    (written == wb->written_stamp && !wb_stat(wb, WB_WRITEBACK)))
+		goto snapshot;
+
+	/* same as bdi_update_write_bandwidth() */
+	bw = written - wb->written_stamp;
+	bw *= HZ;
+	bw += (u64)wb->write_bandwidth * (period - elapsed);
+	bw >>= ilog2(period);
+
+	avg = wb->avg_write_bandwidth;
+	if (avg > wb->write_bandwidth && wb->write_bandwidth >= bw)
+		avg -= (avg - wb->write_bandwidth) >> 3;
+	if (avg < wb->write_bandwidth && wb->write_bandwidth <= bw)
+		avg += (wb->write_bandwidth - avg) >> 3;
+
+	wb->write_bandwidth = bw;
+	wb->avg_write_bandwidth = max(avg, 1UL);
+snapshot:
+	wb->written_stamp = written;
+	wb->bw_time_stamp = now;
+unlock:
+	spin_unlock(&wb->list_lock);
+}
+
+/*
+ * Dirty throttling of a cgroup on top of the bdi's: the cgroup's share of
+ * bdi_thresh is in proportion to its write bandwidth, and its dirtiers are
+ * allowed
+ *
+ *	task_ratelimit = wb_bw * 2 * (wb_thresh - wb_dirty) / wb_thresh
+ *
+ * that is twice the bandwidth with no dirty pages, the bandwidth itself at
+ * half the share, and at least 1/8 of it above the share.  A cgroup the
+ * blkio controller limits thus can't dirty memory faster than it is
+ * allowed to write it back.
+ */
+static unsigned long cgwb_task_ratelimit(struct backing_dev_info *bdi,
+					 struct bdi_writeback *wb,
+					 unsigned long bdi_thresh)
+{
+	unsigned long wb_bw;
+	unsigned long wb_thresh;
+	unsigned long wb_dirty;
+	unsigned long pos_ratio;
+
+	cgwb_update_bandwidth(wb);
+
+	wb_bw = wb->avg_write_bandwidth;
+	wb_thresh = div_u64((u64)bdi_thresh * wb_bw,
+			    max(bdi->avg_write_bandwidth, 1UL));
+	wb_thresh = clamp(wb_thresh, 1UL, max(bdi_thresh, 1UL));
+	/* a small share needs exact counts, as in balance_dirty_pages() */
+	if (wb_thresh < 2 * bdi_stat_error(bdi))
+		wb_dirty = wb_stat_sum(wb, WB_RECLAIMABLE) +
+			   wb_stat_sum(wb, WB_WRITEBACK);
+	else
+		wb_dirty = wb_stat(wb, WB_RECLAIMABLE) +
+			   wb_stat(wb, WB_WRITEBACK);
+
+	pos_ratio = 0;
+	if (wb_dirty < wb_thresh)
+		pos_ratio = div_u64((u64)(wb_thresh - wb_dirty) <<
+				    (RATELIMIT_CALC_SHIFT + 1), wb_thresh);
+	pos_ratio = max(pos_ratio, (1UL << RATELIMIT_CALC_SHIFT) / 8);
+
+	return max(((u64)wb_bw * pos_ratio) >> RATELIMIT_CALC_SHIFT, 1ULL);
+}
+#else
+static inline unsigned long cgwb_task_ratelimit(struct backing_dev_info *bdi,
+						struct bdi_writeback *wb,
+						unsigned long bdi_thresh)
+{
+	return ULONG_MAX;
+}
+#endif
+
 /*
  * After a task dirtied this many pages, balance_dirty_pages_ratelimited_nr()
  * will look to see if it needs to start dirty throttling.
@@ -1179,6 +1282,7 @@ static void balance_dirty_pages(struct address_space *mapping,
 	unsigned long dirty_ratelimit;
 	unsigned long pos_ratio;
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	struct bdi_writeback *wb = mapping_cgwb(mapping);
 	unsigned long start_time = jiffies;
 
 	for (;;) {
@@ -1264,6 +1368,10 @@ static void balance_dirty_pages(struct address_space *mapping,
 					       bdi_thresh, bdi_dirty);
 		task_ratelimit = ((u64)dirty_ratelimit * pos_ratio) >>
 							RATELIMIT_CALC_SHIFT;
+		if (wb)
+			task_ratelimit = min(task_ratelimit,
+					     cgwb_task_ratelimit(bdi, wb,
+								 bdi_thresh));
 		max_pause = bdi_max_pause(bdi, bdi_dirty);
 		min_pause = bdi_min_pause(bdi, max_pause,
 					  task_ratelimit, dirty_ratelimit,
@@ -1937,9 +2045,13 @@ int __set_page_dirty_no_writeback(struct page *page)
 void account_page_dirtied(struct page *page, struct address_space *mapping)
 {
 	if (mapping_cap_account_dirty(mapping)) {
+		if (mapping->host)
+			inode_attach_wb(mapping->host,
+					mapping->backing_dev_info);
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_DIRTIED);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
+		inc_wb_stat(mapping_cgwb(mapping), WB_RECLAIMABLE);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_DIRTIED);
 		task_io_account_write(PAGE_CACHE_SIZE);
 		current->nr_dirtied++;
@@ -2159,6 +2271,7 @@ int clear_page_dirty_for_io(struct page *page)
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
+			dec_wb_stat(mapping_cgwb(mapping), WB_RECLAIMABLE);
 			return 1;
 		}
 		return 0;
@@ -2183,8 +2296,12 @@ int test_clear_page_writeback(struct page *page)
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
 			if (bdi_cap_account_writeback(bdi)) {
+				struct bdi_writeback *wb = mapping_cgwb(mapping);
+
 				__dec_bdi_stat(bdi, BDI_WRITEBACK);
 				__bdi_writeout_inc(bdi);
+				dec_wb_stat(wb, WB_WRITEBACK);
+				inc_wb_stat(wb, WB_WRITTEN);
 			}
 		}
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
@@ -2213,8 +2330,11 @@ int test_set_page_writeback(struct page *page)
 			radix_tree_tag_set(&mapping->page_tree,
 						page_index(page),
 						PAGECACHE_TAG_WRITEBACK);
-			if (bdi_cap_account_writeback(bdi))
+			if (bdi_cap_account_writeback(bdi)) {
 				__inc_bdi_stat(bdi, BDI_WRITEBACK);
+				inc_wb_stat(mapping_cgwb(mapping),
+					    WB_WRITEBACK);
+			}
 		}
 		if (!PageDirty(page))
 			radix_tree_tag_clear(&mapping->page_tree,
@@ -57,6 +57,7 @@
 #include <linux/ftrace_event.h>
 #include <linux/memcontrol.h>
 #include <linux/prefetch.h>
+#include <linux/kthread.h>
 #include <linux/migrate.h>
 #include <linux/page-debug-flags.h>
 
@@ -619,10 +620,46 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
+static inline unsigned int order_to_pindex(int migratetype, unsigned int order)
+{
+	return order * MIGRATE_PCPTYPES + migratetype;
+}
+
+static inline unsigned int pindex_to_order(unsigned int pindex)
+{
+	return pindex / MIGRATE_PCPTYPES;
+}
+
+/*
+ * zone->lock serialises every transfer between the buddy lists and the
+ * per-cpu lists. Account how long it is held so that contention on it
+ * can be followed through /proc/vmstat and the mm_page_zone_lock_hold
+ * tracepoint. Both must be called with interrupts disabled.
+ */
+static inline u64 zone_lock(struct zone *zone)
+{
+	spin_lock(&zone->lock);
+	return local_clock();
+}
+
+static inline void zone_unlock(struct zone *zone, u64 start,
+				unsigned int order, int nr_pages)
+{
+	u64 held = local_clock() - start;
+
+	spin_unlock(&zone->lock);
+	__count_vm_event(ZONE_LOCK_ACQUIRE);
+	__count_vm_events(ZONE_LOCK_HOLD_NS, held);
+	trace_mm_page_zone_lock_hold(zone, order, nr_pages, held);
+}
+
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone. Each list holds blocks of
+ * a single order, see order_to_pindex().
+ * count is the number of base pages to free; pcp->count is updated by
+ * the number of pages actually freed, which may be slightly larger when
+ * the last block freed is a high-order one.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -633,17 +670,23 @@ static inline int free_pages_check(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	int pindex = 0;
 	int batch_free = 0;
-	int to_free = count;
+	int to_free = min(count, pcp->count);
+	int freed = 0;
+	u64 start;
 
-	spin_lock(&zone->lock);
+	if (unlikely(to_free <= 0))
+		return;
+
+	start = zone_lock(zone);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
-	while (to_free) {
+	while (to_free > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -654,40 +697,48 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = to_free;
 
+		order = pindex_to_order(pindex);
 		do {
 			page = list_entry(list->prev, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
 			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
-		} while (--to_free && --batch_free && !list_empty(list));
+			__free_one_page(page, zone, order, page_private(page));
+			trace_mm_page_pcpu_drain(page, order, page_private(page));
+			to_free -= 1 << order;
+			freed += 1 << order;
+		} while (to_free > 0 && --batch_free && !list_empty(list));
 	}
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
-	spin_unlock(&zone->lock);
+	pcp->count -= freed;
+	__mod_zone_page_state(zone, NR_FREE_PAGES, freed);
+	zone_unlock(zone, start, 0, freed);
 }
 
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
-	spin_lock(&zone->lock);
+	u64 start;
+
+	start = zone_lock(zone);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
 	__free_one_page(page, zone, order, migratetype);
 	__mod_zone_page_state(zone, NR_FREE_PAGES, 1 << order);
-	spin_unlock(&zone->lock);
+	zone_unlock(zone, start, order, 1 << order);
 }
 
+static void free_pcp_page(struct page *page, unsigned int order, int cold);
+
 static bool free_pages_prepare(struct page *page, unsigned int order)
 {
 	int i;
@@ -717,8 +768,14 @@ static bool free_pages_prepare(struct page *page, unsigned int order)
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
-	int wasMlocked = __TestClearPageMlocked(page);
+	int wasMlocked;
+
+	if (order <= PAGE_ALLOC_COSTLY_ORDER) {
+		free_pcp_page(page, order, 0);
+		return;
+	}
 
+	wasMlocked = __TestClearPageMlocked(page);
 	if (!free_pages_prepare(page, order))
 		return;
 
@@ -1106,8 +1163,9 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			int migratetype, int cold)
 {
 	int mt = migratetype, i;
+	u64 start;
 
-	spin_lock(&zone->lock);
+	start = zone_lock(zone);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
 		if (unlikely(page == NULL))
@@ -1135,10 +1193,20 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
-	spin_unlock(&zone->lock);
+	zone_unlock(zone, start, order, i << order);
 	return i;
 }
 
+/*
+ * Number of blocks of the given order to move between the buddy lists
+ * and the per-cpu lists at once. Scaling the batch down by order keeps
+ * the number of base pages moved under one lock hold roughly constant.
+ */
+static inline int nr_pcp_batch(struct per_cpu_pages *pcp, unsigned int order)
+{
+	return max(pcp->batch >> order, 1);
+}
+
 #ifdef CONFIG_NUMA
 /*
  * Called from the vmstat counter updater to drain pagesets of this
@@ -1159,7 +1227,6 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	else
 		to_drain = pcp->count;
 	free_pcppages_bulk(zone, to_drain, pcp);
-	pcp->count -= to_drain;
 	local_irq_restore(flags);
 }
 #endif
@@ -1184,10 +1251,8 @@ static void drain_pages(unsigned int cpu)
 		pset = per_cpu_ptr(zone->pageset, cpu);
 
 		pcp = &pset->pcp;
-		if (pcp->count) {
+		if (pcp->count)
 			free_pcppages_bulk(zone, pcp->count, pcp);
-			pcp->count = 0;
-		}
 		local_irq_restore(flags);
 	}
 }
@@ -1281,10 +1346,10 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Free a page of order up to PAGE_ALLOC_COSTLY_ORDER to the per-cpu lists
  * cold == 1 ? free a cold page : free a hot page
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void free_pcp_page(struct page *page, unsigned int order, int cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
@@ -1292,7 +1357,15 @@ void free_hot_cold_page(struct page *page, int cold)
 	int migratetype;
 	int wasMlocked = __TestClearPageMlocked(page);
 
-	if (!free_pages_prepare(page, 0))
+	if (!free_pages_prepare(page, order))
+		return;
+
+	/*
+	 * The block may be handed out again without __GFP_COMP, so it must
+	 * not sit on the per-cpu lists as a compound page.
+	 */
+	if (unlikely(PageCompound(page)) &&
+	    unlikely(destroy_compound_page(page, order)))
 		return;
 
 	migratetype = get_pageblock_migratetype(page);
@@ -1300,7 +1373,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -1311,7 +1384,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
-			free_one_page(zone, page, 0, migratetype);
+			free_one_page(zone, page, order, migratetype);
 			goto out;
 		}
 		migratetype = MIGRATE_MOVABLE;
@@ -1319,19 +1392,28 @@ void free_hot_cold_page(struct page *page, int cold)
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
 	if (cold)
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
+		list_add_tail(&page->lru,
+			      &pcp->lists[order_to_pindex(migratetype, order)]);
 	else
-		list_add(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
-	if (pcp->count >= pcp->high) {
+		list_add(&page->lru,
+			 &pcp->lists[order_to_pindex(migratetype, order)]);
+	pcp->count += 1 << order;
+	if (pcp->count >= pcp->high)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
-		pcp->count -= pcp->batch;
-	}
 
 out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	free_pcp_page(page, 0, cold);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -1436,18 +1518,32 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	int cold = !!(gfp_flags & __GFP_COLD);
 
+	if (unlikely(gfp_flags & __GFP_NOFAIL)) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
-	if (likely(order == 0)) {
+	if (likely(order <= PAGE_ALLOC_COSTLY_ORDER)) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
 		local_irq_save(flags);
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
-		list = &pcp->lists[migratetype];
+		list = &pcp->lists[order_to_pindex(migratetype, order)];
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype, cold);
+			pcp->count += rmqueue_bulk(zone, order,
+					nr_pcp_batch(pcp, order), list,
+					migratetype, cold) << order;
 			if (unlikely(list_empty(list)))
 				goto failed;
 		}
@@ -1458,24 +1554,14 @@ again:
 			page = list_entry(list->next, struct page, lru);
 
 		list_del(&page->lru);
-		pcp->count--;
+		pcp->count -= 1 << order;
 	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
-		}
-		spin_lock_irqsave(&zone->lock, flags);
+		u64 start;
+
+		local_irq_save(flags);
+		start = zone_lock(zone);
 		page = __rmqueue(zone, order, migratetype);
-		spin_unlock(&zone->lock);
+		zone_unlock(zone, start, order, page ? 1 << order : 0);
 		if (!page)
 			goto failed;
 		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1 << order));
@@ -1775,6 +1861,12 @@ static void zlc_clear_zones_full(struct zonelist *zonelist)
 }
 #endif	/* CONFIG_NUMA */
 
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/* Set while any node still has struct pages left to initialise */
+static bool deferred_pages __read_mostly;
+static bool _deferred_grow_zone(struct zone *zone, unsigned int order);
+#endif
+
 /*
  * get_page_from_freelist goes through the zonelist trying to allocate
  * a page.
@@ -1846,6 +1938,16 @@ zonelist_scan:
 				    classzone_idx, alloc_flags))
 				goto try_this_zone;
 
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+			/*
+			 * Grow the zone into its uninitialised part before
+			 * looking anywhere else.
+			 */
+			if (unlikely(deferred_pages) &&
+			    _deferred_grow_zone(zone, order))
+				goto try_this_zone;
+#endif
+
 			if (NUMA_BUILD && !did_zlc_setup && nr_online_nodes > 1) {
 				/*
 				 * we do zlc_setup if there are multiple nodes
@@ -2095,6 +2197,7 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 			if (order >= preferred_zone->compact_order_failed)
 				preferred_zone->compact_order_failed = order + 1;
 			count_vm_event(COMPACTSUCCESS);
+			inc_zone_page_state(page, NR_COMPACT_SUCCESS);
 			return page;
 		}
 
@@ -2314,6 +2417,13 @@ restart:
 	if (!(gfp_mask & __GFP_NO_KSWAPD))
 		wake_all_kswapd(order, zonelist, high_zoneidx,
 						zone_idx(preferred_zone));
+	else
+		/*
+		 * kswapd is not woken for these callers (THP), so ask
+		 * kcompactd to prepare for the next high-order attempt.
+		 */
+		wakeup_kcompactd(preferred_zone->zone_pgdat, order,
+						zone_idx(preferred_zone));
 
 	/*
 	 * OK, we're below the kswapd watermark and have kicked background
@@ -3674,18 +3784,127 @@ static void setup_zone_migrate_reserve(struct zone *zone)
  * up by free_all_bootmem() once the early boot process is
  * done. Non-atomic initialization, single-pass.
  */
+static void __meminit __init_single_page(struct page *page, unsigned long pfn,
+				unsigned long zone, int nid)
+{
+	set_page_links(page, zone, nid, pfn);
+	mminit_verify_page_links(page, zone, nid, pfn);
+	init_page_count(page);
+	reset_page_mapcount(page);
+	INIT_LIST_HEAD(&page->lru);
+#ifdef WANT_PAGE_VIRTUAL
+	/* The shift won't overflow because ZONE_NORMAL is below 4G. */
+	if (!is_highmem_idx(zone))
+		set_page_address(page, __va(pfn << PAGE_SHIFT));
+#endif
+}
+
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/*
+ * Returns false once the static part of the node's highest zone has been
+ * initialised; the rest is left to deferred_init_memmap().  Deferral
+ * starts on a section boundary so that no MAX_ORDER block straddles it.
+ * Lower zones are always initialised to serve address-constrained
+ * allocations.
+ */
+static inline bool __meminit update_defer_init(pg_data_t *pgdat,
+				unsigned long pfn, unsigned long zone_end,
+				unsigned long *nr_initialised)
+{
+	if (zone_end < pgdat->node_start_pfn + pgdat->node_spanned_pages)
+		return true;
+
+	(*nr_initialised)++;
+	if (*nr_initialised > pgdat->static_init_size &&
+	    (pfn & (PAGES_PER_SECTION - 1)) == 0) {
+		pgdat->first_deferred_pfn = pfn;
+		deferred_pages = true;
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool __meminit early_page_uninitialised(unsigned long pfn)
+{
+	int nid = early_pfn_to_nid(pfn);
+
+	return pfn >= NODE_DATA(nid)->first_deferred_pfn;
+}
+
+static void __meminit __init_deferred_page(unsigned long pfn,
+				unsigned long zone, int nid)
+{
+	struct page *page = pfn_to_page(pfn);
+
+	__init_single_page(page, pfn, zone, nid);
+	if (!(pfn & (pageblock_nr_pages - 1)))
+		set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+}
+
+static int __meminit zone_idx_of_pfn(pg_data_t *pgdat, unsigned long pfn)
+{
+	int zid;
+
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		struct zone *zone = &pgdat->node_zones[zid];
+
+		if (pfn >= zone->zone_start_pfn &&
+		    pfn < zone->zone_start_pfn + zone->spanned_pages)
+			return zid;
+	}
+	return -1;
+}
+
+/*
+ * Initialise the struct pages of memblock reserved memory that falls into
+ * the deferred part of a node.  These pages are never freed by
+ * deferred_init_memmap(), which recognises them by their non-zero flags.
+ */
+void __meminit reserve_bootmem_region(phys_addr_t start, phys_addr_t end)
+{
+	unsigned long start_pfn = PFN_DOWN(start);
+	unsigned long end_pfn = PFN_UP(end);
+
+	for (; start_pfn < end_pfn; start_pfn++) {
+		int nid, zid;
+
+		if (!early_pfn_valid(start_pfn))
+			continue;
+		if (!early_page_uninitialised(start_pfn))
+			continue;
+
+		nid = early_pfn_to_nid(start_pfn);
+		zid = zone_idx_of_pfn(NODE_DATA(nid), start_pfn);
+		if (zid < 0)
+			continue;
+		__init_deferred_page(start_pfn, zid, nid);
+		SetPageReserved(pfn_to_page(start_pfn));
+	}
+}
+#else
+static inline bool update_defer_init(pg_data_t *pgdat,
+				unsigned long pfn, unsigned long zone_end,
+				unsigned long *nr_initialised)
+{
+	return true;
+}
+#endif /* CONFIG_DEFERRED_STRUCT_PAGE_INIT */
+
 void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		unsigned long start_pfn, enum memmap_context context)
 {
+	pg_data_t *pgdat = NODE_DATA(nid);
 	struct page *page;
 	unsigned long end_pfn = start_pfn + size;
+	unsigned long nr_initialised = 0;
 	unsigned long pfn;
 	struct zone *z;
 
 	if (highest_memmap_pfn < end_pfn - 1)
 		highest_memmap_pfn = end_pfn - 1;
 
-	z = &NODE_DATA(nid)->node_zones[zone];
+	z = &pgdat->node_zones[zone];
 	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
 		/*
 		 * There can be holes in boot-time mem_map[]s
@@ -3697,12 +3916,12 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 				continue;
 			if (!early_pfn_in_nid(pfn, nid))
 				continue;
+			if (!update_defer_init(pgdat, pfn, end_pfn,
+					       &nr_initialised))
+				break;
 		}
 		page = pfn_to_page(pfn);
-		set_page_links(page, zone, nid, pfn);
-		mminit_verify_page_links(page, zone, nid, pfn);
-		init_page_count(page);
-		reset_page_mapcount(page);
+		__init_single_page(page, pfn, zone, nid);
 		SetPageReserved(page);
 		/*
 		 * Mark the block movable so that blocks are reserved for
@@ -3722,16 +3941,170 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		    && (pfn < z->zone_start_pfn + z->spanned_pages)
 		    && !(pfn & (pageblock_nr_pages - 1)))
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+}
 
-		INIT_LIST_HEAD(&page->lru);
-#ifdef WANT_PAGE_VIRTUAL
-		/* The shift won't overflow because ZONE_NORMAL is below 4G. */
-		if (!is_highmem_idx(zone))
-			set_page_address(page, __va(pfn << PAGE_SHIFT));
-#endif
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+static atomic_t pgdat_init_n_undone __initdata;
+static __initdata DECLARE_COMPLETION(pgdat_init_all_done_comp);
+static atomic_long_t deferred_pages_freed __initdata;
+
+static void __init deferred_free_range(unsigned long pfn,
+				       unsigned long end_pfn)
+{
+	while (pfn < end_pfn) {
+		unsigned int order = min(MAX_ORDER - 1UL, __ffs(pfn));
+
+		while (pfn + (1UL << order) > end_pfn)
+			order--;
+		__free_pages_bootmem(pfn_to_page(pfn), order);
+		pfn += 1UL << order;
 	}
 }
 
+/*
+ * Initialise the struct pages of the next section of the deferred range
+ * of @pgdat and free its memory to the buddy allocator.  Memory that is
+ * reserved, and holes inside the memmap, are initialised as reserved.
+ * Must be called with pgdat_resize_lock held.  Returns the number of
+ * pages freed.
+ */
+static unsigned long __init deferred_init_chunk(pg_data_t *pgdat)
+{
+	unsigned long spfn = pgdat->first_deferred_pfn;
+	unsigned long zone_end, epfn, start, end, pfn;
+	unsigned long nr_freed = 0;
+	int nid = pgdat->node_id;
+	int zid, i;
+
+	zid = zone_idx_of_pfn(pgdat, spfn);
+	if (WARN_ON_ONCE(zid < 0)) {
+		pgdat->first_deferred_pfn = ULONG_MAX;
+		return 0;
+	}
+	zone_end = pgdat->node_zones[zid].zone_start_pfn +
+		   pgdat->node_zones[zid].spanned_pages;
+	epfn = min(ALIGN(spfn + 1, PAGES_PER_SECTION), zone_end);
+
+	/* Memory: initialise and free everything not already reserved */
+	for_each_mem_pfn_range(i, nid, &start, &end, NULL) {
+		unsigned long run = 0;
+
+		start = max(start, spfn);
+		end = min(end, epfn);
+		for (pfn = start; pfn < end; pfn++) {
+			if (!pfn_valid(pfn) || pfn_to_page(pfn)->flags) {
+				deferred_free_range(pfn - run, pfn);
+				nr_freed += run;
+				run = 0;
+				continue;
+			}
+			__init_deferred_page(pfn, zid, nid);
+			run++;
+		}
+		if (run) {
+			deferred_free_range(end - run, end);
+			nr_freed += run;
+		}
+	}
+
+	/* Holes: whatever is left has to look reserved */
+	for (pfn = spfn; pfn < epfn; pfn++) {
+		if (!early_pfn_valid(pfn) || !early_pfn_in_nid(pfn, nid))
+			continue;
+		if (pfn_to_page(pfn)->flags)
+			continue;
+		__init_deferred_page(pfn, zid, nid);
+		SetPageReserved(pfn_to_page(pfn));
+	}
+
+	pgdat->first_deferred_pfn = epfn < zone_end ? epfn : ULONG_MAX;
+	atomic_long_add(nr_freed, &deferred_pages_freed);
+	return nr_freed;
+}
+
+/* Initialise the remaining struct pages of a node */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned long start = jiffies;
+	unsigned long nr_pages = 0;
+	unsigned long flags;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	for (;;) {
+		pgdat_resize_lock(pgdat, &flags);
+		if (pgdat->first_deferred_pfn == ULONG_MAX) {
+			pgdat_resize_unlock(pgdat, &flags);
+			break;
+		}
+		nr_pages += deferred_init_chunk(pgdat);
+		pgdat_resize_unlock(pgdat, &flags);
+		cond_resched();
+	}
+
+	if (nr_pages)
+		pr_info("node %d initialised, %lu pages in %ums\n",
+			pgdat->node_id, nr_pages,
+			jiffies_to_msecs(jiffies - start));
+
+	if (atomic_dec_and_test(&pgdat_init_n_undone))
+		complete(&pgdat_init_all_done_comp);
+	return 0;
+}
+
+/*
+ * An allocation failed the watermark check of @zone while part of it is
+ * still uninitialised: initialise enough of it on demand to satisfy an
+ * allocation of @order rather than falling back to other zones.
+ */
+static noinline bool __init deferred_grow_zone(struct zone *zone,
+					       unsigned int order)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+	unsigned long zone_end = zone->zone_start_pfn + zone->spanned_pages;
+	unsigned long nr_pages = 0;
+	unsigned long flags;
+
+	pgdat_resize_lock(pgdat, &flags);
+	while (nr_pages < (1UL << order) &&
+	       pgdat->first_deferred_pfn >= zone->zone_start_pfn &&
+	       pgdat->first_deferred_pfn < zone_end)
+		nr_pages += deferred_init_chunk(pgdat);
+	pgdat_resize_unlock(pgdat, &flags);
+
+	return nr_pages > 0;
+}
+
+static bool __ref _deferred_grow_zone(struct zone *zone, unsigned int order)
+{
+	return deferred_grow_zone(zone, order);
+}
+#endif /* CONFIG_DEFERRED_STRUCT_PAGE_INIT */
+
+/*
+ * Called once SMP is up: finish initialising the memmap of all nodes in
+ * parallel and wait for it before the bulk of the initcalls run.
+ */
+void __init page_alloc_init_late(void)
+{
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	int nid;
+
+	atomic_set(&pgdat_init_n_undone, num_node_state(N_HIGH_MEMORY));
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kthread_run(deferred_init_memmap, NODE_DATA(nid),
+			    "pgdatinit%d", nid);
+	wait_for_completion(&pgdat_init_all_done_comp);
+
+	deferred_pages = false;
+	totalram_pages += atomic_long_read(&deferred_pages_freed);
+#endif
+}
+
 static void __meminit zone_init_free_lists(struct zone *zone)
 {
 	int order, t;
@@ -3799,7 +4172,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3807,8 +4180,8 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 /*
@@ -4353,6 +4726,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -4472,6 +4848,12 @@ void __paginginit free_area_init_node(int nid, unsigned long *zones_size,
 	pgdat->node_id = nid;
 	pgdat->node_start_pfn = node_start_pfn;
 	calculate_node_totalpages(pgdat, zones_size, zholes_size);
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	/* Initialise at least 2G of the node's highest zone at boot */
+	pgdat->static_init_size = min_t(unsigned long, 2UL << (30 - PAGE_SHIFT),
+					pgdat->node_spanned_pages);
+	pgdat->first_deferred_pfn = ULONG_MAX;
+#endif
 
 	alloc_node_mem_map(pgdat);
 #ifdef CONFIG_FLAT_NODE_MEM_MAP
@@ -293,8 +293,14 @@ void __init page_cgroup_init(void)
 			 * -------------pfn-------------->
 			 * N0 | N1 | N2 | N0 | N1 | N2|....
 			 */
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+			/* the section's struct pages may not be set up yet */
+			if (early_pfn_to_nid(pfn) != nid)
+				continue;
+#else
 			if (pfn_to_nid(pfn) != nid)
 				continue;
+#endif
 			if (init_section_page_cgroup(pfn, nid))
 				goto oom;
 		}
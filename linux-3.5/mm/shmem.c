@@ -187,6 +187,16 @@ static struct backing_dev_info shmem_backing_dev_info  __read_mostly = {
 static LIST_HEAD(shmem_swaplist);
 static DEFINE_MUTEX(shmem_swaplist_mutex);
 
+/*
+ * Exceptional entries in a shmem mapping are swap entries; anywhere else
+ * they are the shadow entries of evicted page cache pages.
+ */
+bool shmem_mapping(struct address_space *mapping)
+{
+	return mapping->backing_dev_info == &shmem_backing_dev_info;
+}
+EXPORT_SYMBOL_GPL(shmem_mapping);
+
 static int shmem_reserve_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
@@ -1084,7 +1094,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 		return -EFBIG;
 repeat:
 	swap.val = 0;
-	page = find_lock_page(mapping, index);
+	page = find_lock_entry(mapping, index);
 	if (radix_tree_exceptional_entry(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
@@ -2852,6 +2862,12 @@ out4:
 
 #include <linux/ramfs.h>
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return false;
+}
+EXPORT_SYMBOL_GPL(shmem_mapping);
+
 static struct file_system_type shmem_fs_type = {
 	.name		= "tmpfs",
 	.mount		= ramfs_mount,
@@ -79,6 +79,7 @@ void cancel_dirty_page(struct page *page, unsigned int account_size)
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
+			dec_wb_stat(mapping_cgwb(mapping), WB_RECLAIMABLE);
 			if (account_size)
 				task_io_account_cancelled_write(account_size);
 		}
@@ -183,6 +184,46 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Remove the shadow entries of evicted pages between @start and @end
+ * (inclusive).  Pages are left alone; the caller has removed them already.
+ */
+static void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	pgoff_t indices[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	while (index <= end && mapping->nrshadows) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			void *entry;
+
+			if (indices[i] > end)
+				break;
+			/* deleting an entry may move a slot, look it up again */
+			entry = radix_tree_lookup(&mapping->page_tree,
+						  indices[i]);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+			workingset_forget(entry);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		if (!nr || i < nr)
+			break;
+		index = indices[nr - 1] + 1;
+		if (!index)
+			break;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages_range - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -214,7 +255,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -292,6 +333,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		index++;
 	}
+	clear_shadow_entries(mapping, start, end);
 	cleancache_invalidate_inode(mapping);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
@@ -400,7 +442,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -602,6 +602,37 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * Return an index indicating how much of the available free memory is
+ * unusable for an allocation of the requested size.
+ */
+static int unusable_free_index(unsigned int order,
+				struct contig_page_info *info)
+{
+	/* No free memory is interpreted as all free memory is unusable */
+	if (info->free_pages == 0)
+		return 1000;
+
+	/*
+	 * Index should be a value between 0 and 1. Return a value to 3
+	 * decimal places.
+	 *
+	 * 0 => no fragmentation
+	 * 1 => high fragmentation
+	 */
+	return div_u64((info->free_pages - (info->free_blocks_suitable << order)) * 1000ULL, info->free_pages);
+
+}
+
+/* Same as unusable_free_index but allocs contig_page_info on stack */
+int unusable_index(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	return unusable_free_index(order, &info);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -712,6 +743,9 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_shadows",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -720,6 +754,11 @@ const char * const vmstat_text[] = {
 	"numa_interleave",
 	"numa_local",
 	"numa_other",
+#endif
+#ifdef CONFIG_COMPACTION
+	"nr_compact_stall",
+	"nr_compact_success",
+	"nr_kcompactd_success",
 #endif
 	"nr_anon_transparent_hugepages",
 	"nr_dirty_threshold",
@@ -737,6 +776,9 @@ const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 
+	"zone_lock_acquire",
+	"zone_lock_hold_ns",
+
 	"pgfault",
 	"pgmajfault",
 
@@ -767,6 +809,8 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
+	"compact_daemon_proactive",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -1224,28 +1268,6 @@ module_init(setup_vmstat)
 #include <linux/debugfs.h>
 
 
-/*
- * Return an index indicating how much of the available free memory is
- * unusable for an allocation of the requested size.
- */
-static int unusable_free_index(unsigned int order,
-				struct contig_page_info *info)
-{
-	/* No free memory is interpreted as all free memory is unusable */
-	if (info->free_pages == 0)
-		return 1000;
-
-	/*
-	 * Index should be a value between 0 and 1. Return a value to 3
-	 * decimal places.
-	 *
-	 * 0 => no fragmentation
-	 * 1 => high fragmentation
-	 */
-	return div_u64((info->free_pages - (info->free_blocks_suitable << order)) * 1000ULL, info->free_pages);
-
-}
-
 static void unusable_show_print(struct seq_file *m,
 					pg_data_t *pgdat, struct zone *zone)
 {
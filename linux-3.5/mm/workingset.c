@@ -0,0 +1,142 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection for the file LRU lists
+ *
+ * The file LRU is split into an inactive list, where newly faulted pages
+ * start out, and an active list for pages that were referenced again
+ * while on the inactive list.  A page that is evicted from the inactive
+ * list before its second access never gets promoted, so a large enough
+ * stream of used-once pages can flush a working set that is merely
+ * larger than the inactive list, and the kernel would not notice.
+ *
+ * To detect this, every zone keeps a counter, inactive_age, that is
+ * incremented whenever a page leaves the inactive list: on eviction and
+ * on activation.  When a file page is evicted, the current value is
+ * stored in its page cache slot as a shadow entry.  When the page is
+ * faulted back in, the difference between the counter and the shadow
+ * value - the refault distance - is the number of slots the inactive
+ * list would have needed to hold on to the page for this access.
+ *
+ * Giving the inactive list more room can only come out of the active
+ * list, so if the refault distance is no larger than the active list,
+ * the page is activated straight away and has to compete with the
+ * current active pages.  If it is not in fact part of the working set,
+ * it will be demoted again by the normal aging of the active list.
+ *
+ * Shadow entries are removed when the page refaults or the file is
+ * truncated or evicted.  Their total number is capped at the number of
+ * pages in the system: the refault distance of anything older than that
+ * could not be satisfied by any list size anyway.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/mm_inline.h>
+#include <linux/radix-tree.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *evictionp)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*evictionp = entry;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page, or NULL if none should be stored.  Called with
+ * the mapping's tree_lock held and interrupts disabled.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	if (global_page_state(WORKINGSET_SHADOWS) >= totalram_pages)
+		return NULL;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	__inc_zone_state(zone, WORKINGSET_SHADOWS);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_forget - note the removal of a shadow entry
+ * @shadow: shadow entry taken out of a page cache tree
+ *
+ * Called with the mapping's tree_lock held and interrupts disabled.
+ */
+void workingset_forget(void *shadow)
+{
+	unsigned long eviction;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+	__dec_zone_state(zone, WORKINGSET_SHADOWS);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates the refault distance of the page and compares it with the
+ * size of the active file list of the zone it was evicted from.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	unsigned long eviction;
+	unsigned long refault;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+
+	refault = atomic_long_read(&zone->inactive_age);
+	refault_distance = (refault - eviction) & EVICTION_MASK;
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
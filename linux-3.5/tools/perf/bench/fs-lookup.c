@@ -0,0 +1,269 @@
+/*
+ *
+ * fs-lookup.c
+ *
+ * lookup: Benchmark for parallel metadata lookups
+ *
+ * Fills a directory with files and has a number of processes look up
+ * extended attributes of random files in it, optionally while other
+ * processes keep creating and unlinking files in the same directory.
+ * An xattr lookup isn't answered from the dcache, so on btrfs every
+ * operation is a search of the fs tree, and the readers end up on the
+ * same tree blocks the writers modify.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+
+static const char *directory = ".";
+static int nr_files = 10000;
+static int nr_readers;
+static int nr_writers;
+static int runtime = 5;
+static bool use_stat;
+
+static const struct option options[] = {
+	OPT_STRING('d', "directory", &directory, "dir",
+		   "Specify directory to create the files in"),
+	OPT_INTEGER('n', "files", &nr_files,
+		    "Specify number of files"),
+	OPT_INTEGER('r', "readers", &nr_readers,
+		    "Specify number of reader processes (default: nr_cpus)"),
+	OPT_INTEGER('w', "writers", &nr_writers,
+		    "Specify number of processes creating and unlinking files"),
+	OPT_INTEGER('t', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_BOOLEAN('s', "stat", &use_stat,
+		    "Use stat() instead of getxattr() for lookups"),
+	OPT_END()
+};
+
+static const char * const bench_fs_lookup_usage[] = {
+	"perf bench fs lookup <options>",
+	NULL
+};
+
+struct worker_stat {
+	unsigned long long	ops;
+	char			pad[56];
+};
+
+static volatile int *stop;
+static struct worker_stat *stats;
+static char dir[PATH_MAX];
+
+static void reader(struct worker_stat *ws, unsigned int seed)
+{
+	unsigned long long ops = 0;
+	char name[PATH_MAX];
+	struct stat st;
+	char value[16];
+
+	while (!*stop) {
+		snprintf(name, sizeof(name), "%s/f%d", dir,
+			 rand_r(&seed) % nr_files);
+		if (use_stat) {
+			if (stat(name, &st))
+				exit(1);
+		} else if (getxattr(name, "user.perf-bench", value,
+				    sizeof(value)) < 0 && errno != ENODATA &&
+			   errno != ENOTSUP) {
+			exit(1);
+		}
+		ops++;
+		if (!(ops & 0xff))
+			ws->ops = ops;
+	}
+	ws->ops = ops;
+	exit(0);
+}
+
+static void writer(struct worker_stat *ws, int id)
+{
+	unsigned long long ops = 0;
+	char name[PATH_MAX];
+	int fd;
+
+	while (!*stop) {
+		snprintf(name, sizeof(name), "%s/w%d.%llu", dir, id,
+			 ops & 0xff);
+		fd = open(name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			exit(1);
+		close(fd);
+		if (unlink(name))
+			exit(1);
+		ops++;
+		if (!(ops & 0xf))
+			ws->ops = ops;
+	}
+	ws->ops = ops;
+	exit(0);
+}
+
+static int populate(void)
+{
+	char name[PATH_MAX];
+	int i, fd;
+
+	snprintf(dir, sizeof(dir), "%s/perf-bench-lookup.%d",
+		 directory, getpid());
+	if (mkdir(dir, 0755)) {
+		fprintf(stderr, "mkdir(%s): %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(name, sizeof(name), "%s/f%d", dir, i);
+		fd = open(name, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "open(%s): %s\n", name,
+				strerror(errno));
+			return -1;
+		}
+		close(fd);
+	}
+	sync();
+	return 0;
+}
+
+static void cleanup(void)
+{
+	char name[PATH_MAX];
+	int i;
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(name, sizeof(name), "%s/f%d", dir, i);
+		unlink(name);
+	}
+	rmdir(dir);
+}
+
+int bench_fs_lookup(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval start, now, diff;
+	unsigned long long reads = 0, writes = 0;
+	int i, nr, wait_stat, failed = 0;
+	double secs;
+	size_t size;
+	void *mem;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_lookup_usage, 0);
+
+	if (nr_files <= 0 || nr_writers < 0 || runtime <= 0) {
+		fprintf(stderr, "Invalid number of files, writers or runtime\n");
+		return 1;
+	}
+
+	if (nr_readers <= 0)
+		nr_readers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_readers <= 0)
+		nr_readers = 1;
+	nr = nr_readers + nr_writers;
+
+	size = sizeof(struct worker_stat) * (nr + 1);
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	stop = mem;
+	stats = (struct worker_stat *)mem + 1;
+
+	if (populate()) {
+		cleanup();
+		munmap(mem, size);
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr; i++) {
+		pid = fork();
+		assert(pid >= 0);
+		if (pid)
+			continue;
+		if (i < nr_readers)
+			reader(&stats[i], getpid());
+		else
+			writer(&stats[i], i - nr_readers);
+	}
+
+	sleep(runtime);
+	*stop = 1;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start, &diff);
+	secs = (double)diff.tv_sec + (double)diff.tv_usec / 1000000;
+
+	for (i = 0; i < nr; i++) {
+		pid = wait(&wait_stat);
+		assert(pid > 0);
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			failed = 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (i < nr_readers)
+			reads += stats[i].ops;
+		else
+			writes += stats[i].ops;
+	}
+
+	cleanup();
+	munmap(mem, size);
+
+	if (failed) {
+		fprintf(stderr, "Worker failed\n");
+		return 1;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d files, %d readers (%s), %d writers, %d sec\n\n",
+		       nr_files, nr_readers, use_stat ? "stat" : "getxattr",
+		       nr_writers, runtime);
+		printf(" %14s: %.0f ops/sec\n", "Lookups", reads / secs);
+		printf(" %14s: %.0f ops/sec per reader\n", "",
+		       reads / secs / nr_readers);
+		if (nr_writers)
+			printf(" %14s: %.0f ops/sec\n", "Create+unlink",
+			       writes / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f %.0f\n", reads / secs, writes / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ *
+ * sched-core.c
+ *
+ * core: Benchmark for core scheduling
+ *
+ * Runs groups of cpu bound processes, first with all of them sharing the
+ * default core cookie and then with a cookie per group, and compares the
+ * amount of work done. The difference is what keeping the groups off each
+ * other's SMT siblings costs.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifndef PR_SCHED_CORE
+#define PR_SCHED_CORE			41
+#define PR_SCHED_CORE_CREATE		1
+#define PR_SCHED_CORE_SCOPE_THREAD	0
+#endif
+
+static int nr_groups = 2;
+static int nr_workers;
+static int runtime = 5;
+
+static const struct option options[] = {
+	OPT_INTEGER('g', "group", &nr_groups,
+		    "Specify number of groups"),
+	OPT_INTEGER('w', "worker", &nr_workers,
+		    "Specify number of workers per group (default: nr_cpus / groups)"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime of each pass in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_sched_core_usage[] = {
+	"perf bench sched core <options>",
+	NULL
+};
+
+struct worker_stat {
+	unsigned long long	loops;
+	char			pad[56];
+};
+
+static volatile int *stop;
+static struct worker_stat *stats;
+
+static void worker(struct worker_stat *stat)
+{
+	unsigned long long loops = 0;
+
+	while (!*stop) {
+		loops++;
+		if (!(loops & 0xfff))
+			stat->loops = loops;
+	}
+	stat->loops = loops;
+	exit(0);
+}
+
+/*
+ * Run one pass and return the number of loops done per second. With
+ * @cookies each group gets a core cookie of its own, which its workers
+ * inherit across fork().
+ */
+static double run_pass(int cookies)
+{
+	int nr = nr_groups * nr_workers;
+	struct timeval start, now, diff;
+	unsigned long long total = 0;
+	int g, i, wait_stat, failed = 0;
+	pid_t pid;
+
+	*stop = 0;
+	memset(stats, 0, nr * sizeof(*stats));
+
+	gettimeofday(&start, NULL);
+
+	for (g = 0; g < nr_groups; g++) {
+		pid = fork();
+		assert(pid >= 0);
+		if (pid)
+			continue;
+
+		if (cookies &&
+		    prctl(PR_SCHED_CORE, PR_SCHED_CORE_CREATE, 0,
+			  PR_SCHED_CORE_SCOPE_THREAD, 0)) {
+			fprintf(stderr, "prctl(PR_SCHED_CORE): %s\n",
+				strerror(errno));
+			exit(1);
+		}
+
+		for (i = 0; i < nr_workers; i++) {
+			pid = fork();
+			assert(pid >= 0);
+			if (!pid)
+				worker(&stats[g * nr_workers + i]);
+		}
+		while (wait(&wait_stat) > 0)
+			;
+		exit(0);
+	}
+
+	sleep(runtime);
+	*stop = 1;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start, &diff);
+
+	for (g = 0; g < nr_groups; g++) {
+		pid = wait(&wait_stat);
+		assert(pid > 0);
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat))
+			failed = 1;
+	}
+	if (failed)
+		return -1;
+
+	for (i = 0; i < nr; i++)
+		total += stats[i].loops;
+
+	return (double)total /
+	       ((double)diff.tv_sec + (double)diff.tv_usec / 1000000);
+}
+
+int bench_sched_core(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	double plain, tagged;
+	size_t size;
+	void *mem;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_core_usage, 0);
+
+	if (nr_groups <= 0 || runtime <= 0) {
+		fprintf(stderr, "Invalid number of groups or runtime\n");
+		return 1;
+	}
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN) / nr_groups;
+	if (nr_workers <= 0)
+		nr_workers = 1;
+
+	size = sizeof(struct worker_stat) * (nr_groups * nr_workers + 1);
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	stop = mem;
+	stats = (struct worker_stat *)mem + 1;
+
+	plain = run_pass(0);
+	tagged = run_pass(1);
+
+	munmap(mem, size);
+
+	if (plain < 0) {
+		fprintf(stderr, "Worker failed\n");
+		return 1;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d groups of %d cpu bound processes, %d sec per pass\n\n",
+		       nr_groups, nr_workers, runtime);
+		printf(" %14s: %.0f loops/sec\n", "No cookies", plain);
+		if (tagged < 0) {
+			printf(" %14s: not supported\n", "Group cookies");
+			break;
+		}
+		printf(" %14s: %.0f loops/sec\n", "Group cookies", tagged);
+		printf(" %14s: %.1f%%\n", "Throughput",
+		       100.0 * tagged / plain);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0f %.0f\n", plain, tagged < 0 ? 0 : tagged);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
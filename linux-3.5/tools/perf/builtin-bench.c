@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  fs    ... filesystem metadata performance
  *
  */
 
@@ -42,6 +43,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "core",
+	  "Throughput of cpu bound groups with and without core scheduling",
+	  bench_sched_core      },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -61,6 +65,16 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite fs_suites[] = {
+	{ "lookup",
+	  "Parallel metadata lookups, optionally racing with creates",
+	  bench_fs_lookup },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL            }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +88,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fs",
+	  "filesystem metadata performance",
+	  fs_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },